@@ -39,23 +39,33 @@ static void set_raw_mode() {
 
 // --- safe_printf implementation ---
 void safe_printf(const char* format, ...) {
-    std::lock_guard<std::mutex> lock(g_stdout_mutex);
-
-    // 1. Clear the current user input line from the screen
-    printf("\r");                                                     // Move cursor to the beginning of the line
-    for (size_t i = 0; i < g_current_input_line.length() + 2; ++i) {  // +2 for "> " prompt
-        printf(" ");
-    }
-    printf("\r");  // Move cursor back to the beginning
-
-    // 2. Print the actual log message
+    char buf[1024];
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) return;
+    if ((size_t)len < sizeof(buf)) {
+        console_write(std::string(buf, len));
+        return;
+    }
+    std::string text(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&text[0], len + 1, format, args);
     va_end(args);
+    text.resize(len);
+    console_write(text);
+}
 
+void console_write(const std::string& text) {
+    std::lock_guard<std::mutex> lock(g_stdout_mutex);
+    // 1. Clear the current user input line from the screen (+2 for the "> " prompt)
+    std::string out = "\r" + std::string(g_current_input_line.length() + 2, ' ') + "\r";
+    // 2. The text itself
+    out += text;
     // 3. Redraw the user input prompt and the line they were typing
-    printf("> %s", g_current_input_line.c_str());
+    out += "> " + g_current_input_line;
+    fwrite(out.data(), 1, out.size(), stdout);
     fflush(stdout);
 }
 
@@ -68,4 +68,10 @@ class CommandInterpreter {
  */
 void safe_printf(const char* format, ...);
 
+/**
+ * @brief Prints text the same way as safe_printf, with one write and one flush.
+ * The logger's writer thread prints its batches of lines through this.
+ */
+void console_write(const std::string& text);
+
 #endif  // COMMAND_INTERPRETER_HPP
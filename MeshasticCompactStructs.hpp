@@ -57,6 +57,7 @@ struct MC_Header {
     uint32_t reply_id;
     uint16_t freq;
     bool emoji;
+    uint64_t rx_time_ms;  // local receive time, unix epoch ms
 };
 
 struct MC_OutQueueEntry {
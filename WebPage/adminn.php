@@ -28,20 +28,22 @@ if ($_SERVER['REQUEST_METHOD'] === 'POST') {
         // Adatbázis kapcsolat létrehozása
         $db = new PDO('sqlite:' . $db_path);
         $db->setAttribute(PDO::ATTR_ERRMODE, PDO::ERRMODE_EXCEPTION);
+        // Az időbélyegek egész számok (epoch ezredmásodperc)
+        $now_ms = (int)(microtime(true) * 1000);
 
         // Régi node-ok törlése
         if (isset($_POST['delete_old_nodes'])) {
             // Az SQLite datetime függvényét használjuk a 14 napnál régebbi rekordok kiválasztására
-            $stmt = $db->prepare("DELETE FROM nodes WHERE last_updated < datetime('now', '-14 days')");
-            $stmt->execute();
+            $stmt = $db->prepare("DELETE FROM nodes WHERE last_updated < :before");
+            $stmt->execute([':before' => $now_ms - 14 * 86400000]);
             $deleted_count = $stmt->rowCount(); // Megszámoljuk a törölt sorokat
             $feedback_message = "Sikeres törlés. Eltávolított node-ok száma: {$deleted_count}.";
         }
 
         // Régi chat üzenetek törlése
         if (isset($_POST['delete_old_chats'])) {
-            $stmt = $db->prepare("DELETE FROM chat WHERE timestamp < datetime('now', '-14 days')");
-            $stmt->execute();
+            $stmt = $db->prepare("DELETE FROM chat WHERE timestamp < :before");
+            $stmt->execute([':before' => $now_ms - 14 * 86400000]);
             $deleted_count = $stmt->rowCount();
             $feedback_message = "Sikeres törlés. Eltávolított chat üzenetek száma: {$deleted_count}.";
         }
@@ -49,8 +51,8 @@ if ($_SERVER['REQUEST_METHOD'] === 'POST') {
         // --- ÚJ RÉSZ: 7 NAPNÁL RÉGEBBI SNR BEJEGYZÉSEK TÖRLÉSE ---
         if (isset($_POST['delete_old_snr'])) {
             // Feltételezzük, hogy az 'snr' táblában van egy 'timestamp' nevű oszlop.
-            $stmt = $db->prepare("DELETE FROM snr WHERE last_updated < datetime('now', '-7 days')");
-            $stmt->execute();
+            $stmt = $db->prepare("DELETE FROM snr WHERE last_updated < :before");
+            $stmt->execute([':before' => $now_ms - 7 * 86400000]);
             $deleted_count = $stmt->rowCount();
             $feedback_message = "Sikeres törlés. Eltávolított 7 napnál régebbi SNR bejegyzések száma: {$deleted_count}.";
         }
@@ -17,6 +17,12 @@ $ROLE_MAP_LONG = [
     8 => 'Client Hidden', 9 => 'Lost and Found', 10 => 'TAK Tracker', 11 => 'Router Late', 12 => 'Client base'
 ];
 
+// NodeDb stores timestamps as integer epoch milliseconds
+function msToUtc($ms)
+{
+	return $ms ? gmdate('Y-m-d H:i:s', intdiv((int)$ms, 1000)) : null;
+}
+
 function chanelName($chn)
 {
 	if ($chn=="8") return "LongFast";
@@ -66,7 +72,7 @@ try {
             $formattedMainStats = [];
             foreach ($mainStatsData as $row) {
                 $formattedMainStats[] = [
-                    'time_utc' => $row['time'],
+                    'time_utc' => msToUtc($row['time']),
                     'all_packets' => (int)($row[$allCntKey] ?? 0),
                     'decoded' => (int)($row[$decodedKey] ?? 0),
                     'handled' => (int)($row[$handledKey] ?? 0)
@@ -78,17 +84,9 @@ try {
             $nodesById = [];
             $stmt_nodes = $db->query('SELECT node_id, short_name, long_name, latitude, longitude, last_updated, battery_level, temperature, freq, role, battery_voltage, uptime, msgcntph, tracecntph, telemetrycntph, nodeinfocntph, poscntph, sumcntph, chutil, lastchn FROM nodes');
             $rows = $stmt_nodes->fetchAll(PDO::FETCH_ASSOC);
+            $now_ms = (int)(microtime(true) * 1000);
             foreach ($rows as $row) {
-                $is_stale = false;
-                if (!empty($row['last_updated'])) {
-                    $utc = new DateTimeZone('UTC');
-                    $last_seen = new DateTime($row['last_updated'], $utc);
-                    $now = new DateTime('now', $utc);
-                    $diff_seconds = $now->getTimestamp() - $last_seen->getTimestamp();
-                    if ($diff_seconds > 86400) {
-                        $is_stale = true;
-                    }
-                }
+                $is_stale = !empty($row['last_updated']) && ($now_ms - (int)$row['last_updated']) > 86400000;
                 $hex = sprintf('%x', $row['node_id']);
                 $short_hex = substr($hex, -8);
                 
@@ -99,7 +97,7 @@ try {
                     'long_name' => $row['long_name'] ?? 'N/A',
                     'latitude' => $row['latitude'] / 10000000.0,
                     'longitude' => $row['longitude'] / 10000000.0,
-                    'last_updated' => $row['last_updated'],
+                    'last_updated' => msToUtc($row['last_updated']),
                     'battery_level' => (int)($row['battery_level'] ?? 0),
                     'battery_voltage' => (float)($row['battery_voltage'] ?? 0.0),
                     'temperature' => (float)($row['temperature'] ?? 0.0),
@@ -121,7 +119,8 @@ try {
             }
 
             // --- 3. Fetch SNR data (from map2.php) ---
-            $snr_stmt = $db->query("SELECT node1, node2, snr FROM snr WHERE last_updated >= date('now', '-7 days') AND node1 != node2 AND snr != 0 AND node1 != -1 AND node2 != -1");
+            $snr_stmt = $db->prepare("SELECT node1, node2, snr FROM snr WHERE last_updated >= :since AND node1 != node2 AND snr != 0 AND node1 != -1 AND node2 != -1");
+            $snr_stmt->execute([':since' => $now_ms - 7 * 86400000]);
             $snrData = $snr_stmt->fetchAll(PDO::FETCH_ASSOC);
 
             // --- 4. Process data (logic from calculateAndShowStats) ---
@@ -380,13 +379,16 @@ try {
             }
 
             // Find the node by short name (case-insensitive) OR short hex ID (case-insensitive, with or without '!')
+            // The hex id is resolved here, so both sides of the OR can use an index (node_id / idx_nodes_short_name).
+            $hexQuery = ltrim($query, '!');
+            $queryNodeId = ctype_xdigit($hexQuery) && strlen($hexQuery) <= 8 ? hexdec($hexQuery) : 0;
+            if ($queryNodeId > 0x7FFFFFFF) $queryNodeId -= 0x100000000; // node_id is stored as signed 32 bit
             $stmt = $db->prepare("
                 SELECT * FROM nodes 
-                WHERE UPPER(short_name) = UPPER(:query) 
-                   OR UPPER('!' || SUBSTR(printf('%x', node_id), -8)) = UPPER(:query) 
-                   OR UPPER(SUBSTR(printf('%x', node_id), -8)) = UPPER(:query)
+                WHERE node_id = :node_id 
+                   OR short_name = :query COLLATE NOCASE
             ");
-            $stmt->execute([':query' => $query]);
+            $stmt->execute([':query' => $query, ':node_id' => $queryNodeId]);
             $node = $stmt->fetch(PDO::FETCH_ASSOC);
 
             if (!$node) {
@@ -405,7 +407,7 @@ try {
                         'latitude' => $node['latitude'] / 10000000.0,
                         'longitude' => $node['longitude'] / 10000000.0
                     ],
-                    'last_updated' => $node['last_updated'],
+                    'last_updated' => msToUtc($node['last_updated']),
                     'frequency' => (int)$node['freq'],
                     'role' => $ROLE_MAP_LONG[$node['role']] ?? 'Unknown',
 					'lastchn' => chanelName($node['lastchn']) ?? chanelName(0),
@@ -432,6 +434,7 @@ try {
             else if ($action === 'snrinfo') {
                 $node_id = $node['node_id'];
                 $snrData = ['incoming' => [], 'outgoing' => []];
+                $since_ms = (int)(microtime(true) * 1000) - 7 * 86400000;
 
                 // Get incoming SNR
                 $stmt_in = $db->prepare("
@@ -439,10 +442,10 @@ try {
                     FROM snr AS T1 
                     LEFT JOIN nodes AS T2 ON T1.node1 = T2.node_id 
                     WHERE T1.node2 = :node_id 
-                      AND T1.last_updated >= date('now', '-7 days') 
+                      AND T1.last_updated >= :since 
                       AND T1.snr != 0 AND T1.node1 != -1
                 ");
-                $stmt_in->execute([':node_id' => $node_id]);
+                $stmt_in->execute([':node_id' => $node_id, ':since' => $since_ms]);
                 while ($row = $stmt_in->fetch(PDO::FETCH_ASSOC)) {
                     $hex = '!' . substr(sprintf('%x', $row['node1']), -8);
                     $name = ($row['short_name'] !== 'N/A' && !empty($row['short_name'])) ? $row['short_name'] : $hex;
@@ -459,10 +462,10 @@ try {
                     FROM snr AS T1 
                     LEFT JOIN nodes AS T2 ON T1.node2 = T2.node_id 
                     WHERE T1.node1 = :node_id 
-                      AND T1.last_updated >= date('now', '-7 days') 
+                      AND T1.last_updated >= :since 
                       AND T1.snr != 0 AND T1.node2 != -1
                 ");
-                $stmt_out->execute([':node_id' => $node_id]);
+                $stmt_out->execute([':node_id' => $node_id, ':since' => $since_ms]);
                 while ($row = $stmt_out->fetch(PDO::FETCH_ASSOC)) {
                     $hex = '!' . substr(sprintf('%x', $row['node2']), -8);
                     $name = ($row['short_name'] !== 'N/A' && !empty($row['short_name'])) ? $row['short_name'] : $hex;
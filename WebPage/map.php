@@ -6,6 +6,8 @@ header("Pragma: no-cache");
 header("Expires: 0");
 
 $db_path = '/home/totoo/projects/meshlogger/build/nodes.db';
+// meshlogger event stream (HTTP_API_PORT, /events) as the browser reaches it, empty disables live updates
+$live_feed_url = '';
 
 $nodes = [];
 $snr_data = [];
@@ -22,6 +24,11 @@ if ($sort_by === 'msgcntph') {
     $order_by_sql = 'ORDER BY sumcntph DESC';
 }
 
+// NodeDb stores timestamps as integer epoch milliseconds
+function msToUtc($ms) {
+    return $ms ? gmdate('Y-m-d H:i:s', intdiv((int)$ms, 1000)) : null;
+}
+
 function getChanNameById($chan_id) {
     $chan_map = [
         8 =>  'LongFast',
@@ -41,20 +48,12 @@ try {
     $node_map = [];
     $stmt = $db->query('SELECT node_id, short_name, long_name, latitude, longitude, last_updated, battery_level, temperature, freq, role, battery_voltage, uptime, msgcntph, tracecntph, telemetrycntph, nodeinfocntph, poscntph, sumcntph, chutil, lastchn FROM nodes ' . $order_by_sql);
     $rows = $stmt->fetchAll(PDO::FETCH_ASSOC);
+    $now_ms = (int)(microtime(true) * 1000);
     foreach ($rows as $row) {
         $hex = sprintf('%x', $row['node_id']);
         $short_hex = substr($hex, -8);
 
-        $is_stale = false;
-        if (!empty($row['last_updated'])) {
-            $utc = new DateTimeZone('UTC');
-            $last_seen = new DateTime($row['last_updated'], $utc);
-            $now = new DateTime('now', $utc);
-            $diff_seconds = $now->getTimestamp() - $last_seen->getTimestamp();
-            if ($diff_seconds > 86400) {
-                $is_stale = true;
-            }
-        }
+        $is_stale = !empty($row['last_updated']) && ($now_ms - (int)$row['last_updated']) > 86400000;
 
 
         $node_data = [
@@ -64,7 +63,7 @@ try {
             'long_name' => htmlspecialchars($row['long_name'] ?? 'N/A', ENT_QUOTES, 'UTF-8'),
             'latitude' => $row['latitude'] / 10000000.0,
             'longitude' => $row['longitude'] / 10000000.0,
-            'last_updated' => $row['last_updated'],
+            'last_updated' => msToUtc($row['last_updated']),
             'battery_level' => $row['battery_level'] ?? 0,
             'battery_voltage' => $row['battery_voltage'] ?? 0.0,
             'temperature' => $row['temperature'] ?? 0.0,
@@ -86,11 +85,13 @@ try {
     }
     $node_count = count($nodes);
 
-    $snr_stmt = $db->query("SELECT node1, node2, snr FROM snr WHERE last_updated >= date('now', '-7 days') AND node1 != node2 AND snr != 0 AND node1 != -1 AND node2 != -1");
+    $snr_stmt = $db->prepare("SELECT node1, node2, snr FROM snr WHERE last_updated >= :since AND node1 != node2 AND snr != 0 AND node1 != -1 AND node2 != -1");
+    $snr_stmt->execute([':since' => $now_ms - 7 * 86400000]);
     $snr_data = $snr_stmt->fetchAll(PDO::FETCH_ASSOC);
 
 
-    $chat_stmt = $db->query("SELECT node_id, message, timestamp, freq, chan_id FROM chat WHERE timestamp >= date('now', '-5 days') ORDER BY timestamp DESC");
+    $chat_stmt = $db->prepare("SELECT node_id, message, timestamp, freq, chan_id FROM chat WHERE timestamp >= :since ORDER BY timestamp DESC");
+    $chat_stmt->execute([':since' => $now_ms - 5 * 86400000]);
     $chat_rows = $chat_stmt->fetchAll(PDO::FETCH_ASSOC);
     foreach ($chat_rows as $chat_row) {
         $sender_id = $chat_row['node_id'];
@@ -109,7 +110,7 @@ try {
             'node_id' => $sender_id,
             'sender' => $sender_display,
             'message' => htmlspecialchars($chat_row['message'], ENT_QUOTES, 'UTF-8'),
-            'timestamp' => htmlspecialchars($chat_row['timestamp'], ENT_QUOTES, 'UTF-8'),
+            'timestamp' => msToUtc($chat_row['timestamp']),
 			'freq' => $freq,
             'chan_id' => $chan_id,
             'has_coords' => $has_coords
@@ -118,6 +119,10 @@ try {
 
     $stats_stmt = $db->query("SELECT allcnt_868, allcnt_433, decoded_868, decoded_433, handled_868, handled_433, time FROM mainstats ORDER BY time DESC LIMIT 5");
     $main_stats = $stats_stmt->fetchAll(PDO::FETCH_ASSOC);
+    foreach ($main_stats as &$stat) {
+        $stat['time'] = msToUtc($stat['time']);
+    }
+    unset($stat);
 
 } catch (PDOException $e) {
     die("Database Error: " . $e->getMessage());
@@ -1195,6 +1200,68 @@ try {
             }
         });
         
+        // Live updates pushed by meshlogger. New nodes show up on the next page load.
+        const liveFeedUrl = <?php echo json_encode($live_feed_url); ?>;
+        if (liveFeedUrl && window.EventSource) {
+            const liveNodesById = Object.fromEntries(nodes.map(n => [n.node_id, n]));
+            const feed = new EventSource(liveFeedUrl);
+            const applyNodeUpdate = (e) => {
+                const update = JSON.parse(e.data);
+                const node = liveNodesById[update.node_id];
+                if (!node) return null;
+                Object.assign(node, update);
+                node.is_stale = false;
+                return node;
+            };
+            feed.addEventListener('nodeinfo', applyNodeUpdate);
+            feed.addEventListener('telemetry', applyNodeUpdate);
+            feed.addEventListener('position', (e) => {
+                const node = applyNodeUpdate(e);
+                if (!node) return;
+                [markerLayer[node.node_id], individualMarkerLayer[node.node_id]].forEach(marker => {
+                    if (!marker) return;
+                    marker.setLatLng([node.latitude, node.longitude]);
+                    marker.setIcon(blueIcon);
+                });
+            });
+            feed.addEventListener('link', (e) => {
+                const update = JSON.parse(e.data);
+                const link = snrData.find(l => l.node1 == update.node1 && l.node2 == update.node2);
+                if (link) {
+                    link.snr = update.snr;
+                } else {
+                    snrData.push(update);
+                }
+            });
+            feed.addEventListener('chat', (e) => {
+                const msg = JSON.parse(e.data);
+                const senderNode = liveNodesById[msg.node_id];
+                if (senderNode && msg.last_updated) {
+                    senderNode.last_updated = msg.last_updated;
+                    senderNode.is_stale = false;
+                }
+                const item = document.createElement('div');
+                item.className = 'chat-message';
+                const stamp = document.createElement('span');
+                stamp.className = 'chat-timestamp';
+                stamp.textContent = `[${msg.timestamp}] [${msg.freq}-${getChanNameById(String(msg.chan_id))}] `;
+                const sender = document.createElement(msg.has_coords ? 'a' : 'span');
+                sender.className = msg.has_coords ? 'chat-sender-link' : 'chat-sender';
+                sender.textContent = `${msg.sender}: `;
+                if (msg.has_coords) {
+                    sender.href = '#';
+                    sender.addEventListener('click', (event) => handleChatLinkClick(event, msg.node_id));
+                }
+                const text = document.createElement('span');
+                text.className = 'chat-text';
+                text.textContent = msg.message;
+                item.append(stamp, sender, text);
+                document.getElementById('chat-content').prepend(item);
+            });
+            // the server dropped events for us (slow connection), our copy is out of date
+            feed.addEventListener('dropped', () => location.reload());
+        }
+
         const statsModal = document.getElementById('stats-modal');
         const statsButton433 = document.getElementById('stats-button-433');
         const statsButton868 = document.getElementById('stats-button-868');
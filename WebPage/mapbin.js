@@ -0,0 +1,101 @@
+// Decoder of the /map.bin export of the meshlogger HTTP API.
+//
+// Layout, little endian, every array starts 4 byte aligned (zero padded):
+//   "MMB1", u32 nodeCount, u32 linkCount, u32 stringCount, u32 generated (epoch s)
+//   nodes, one array each: u32 id, i32 latitude, i32 longitude (1e-7 deg), u32 last_updated (epoch s, 0: never),
+//     u32 uptime, u32 short_name, u32 long_name (string indexes), i16 temperature (0.01 C),
+//     u16 battery_voltage (mV), u16 chutil (0.01 %), u16 msgcntph, tracecntph, telemetrycntph, nodeinfocntph,
+//     poscntph, sumcntph (saturated at 65535), u16 freq, u8 battery_level, u8 role, u8 lastchn, u8 is_stale
+//   links: u32 node1, u32 node2, f32 snr, u32 last_updated
+//   strings: UTF-8, each one NUL terminated
+//
+// decodeMapBin(arrayBuffer) maps the arrays as typed arrays without copying, nodes are in /nodes order.
+// Per item objects are only built on demand: mapBinNode(map, i) and mapBinLink(map, i) return what
+// /nodes and /snr give in their "data" arrays (links also carry last_updated).
+
+function decodeMapBin(buffer) {
+    const head = new DataView(buffer, 0, 20);
+    if (String.fromCharCode(head.getUint8(0), head.getUint8(1), head.getUint8(2), head.getUint8(3)) !== 'MMB1') {
+        throw new Error('not a map.bin document');
+    }
+    const nodeCount = head.getUint32(4, true);
+    const linkCount = head.getUint32(8, true);
+    const stringCount = head.getUint32(12, true);
+
+    let offset = 20;
+    const take = (Type, count) => {
+        const array = new Type(buffer, offset, count);
+        offset += Math.ceil(count * Type.BYTES_PER_ELEMENT / 4) * 4;
+        return array;
+    };
+    const nodes = {
+        id: take(Uint32Array, nodeCount),
+        latitude: take(Int32Array, nodeCount),
+        longitude: take(Int32Array, nodeCount),
+        lastUpdated: take(Uint32Array, nodeCount),
+        uptime: take(Uint32Array, nodeCount),
+        shortName: take(Uint32Array, nodeCount),
+        longName: take(Uint32Array, nodeCount),
+        temperature: take(Int16Array, nodeCount),
+        batteryVoltage: take(Uint16Array, nodeCount),
+        chutil: take(Uint16Array, nodeCount),
+        msgcnt: take(Uint16Array, nodeCount),
+        tracecnt: take(Uint16Array, nodeCount),
+        telemetrycnt: take(Uint16Array, nodeCount),
+        nodeinfocnt: take(Uint16Array, nodeCount),
+        poscnt: take(Uint16Array, nodeCount),
+        sumcnt: take(Uint16Array, nodeCount),
+        freq: take(Uint16Array, nodeCount),
+        batteryLevel: take(Uint8Array, nodeCount),
+        role: take(Uint8Array, nodeCount),
+        lastchn: take(Uint8Array, nodeCount),
+        stale: take(Uint8Array, nodeCount),
+    };
+    const links = {
+        node1: take(Uint32Array, linkCount),
+        node2: take(Uint32Array, linkCount),
+        snr: take(Float32Array, linkCount),
+        lastUpdated: take(Uint32Array, linkCount),
+    };
+    const strings = new TextDecoder().decode(new Uint8Array(buffer, offset)).split('\0', stringCount);
+    return { generated: head.getUint32(16, true), nodeCount, linkCount, nodes, links, strings };
+}
+
+// same text as the JSON documents: UTC "YYYY-MM-DD HH:MM:SS", null when never
+function mapBinUtc(seconds) {
+    return seconds ? new Date(seconds * 1000).toISOString().slice(0, 19).replace('T', ' ') : null;
+}
+
+function mapBinNode(map, i) {
+    const n = map.nodes;
+    return {
+        node_id: n.id[i] | 0,
+        node_id_hex: '!' + n.id[i].toString(16),
+        short_name: map.strings[n.shortName[i]],
+        long_name: map.strings[n.longName[i]],
+        latitude: n.latitude[i] / 1e7,
+        longitude: n.longitude[i] / 1e7,
+        last_updated: mapBinUtc(n.lastUpdated[i]),
+        battery_level: n.batteryLevel[i],
+        battery_voltage: n.batteryVoltage[i] / 1000,
+        temperature: n.temperature[i] / 100,
+        freq: n.freq[i],
+        role: n.role[i],
+        uptime: n.uptime[i],
+        msgcntph: n.msgcnt[i],
+        tracecntph: n.tracecnt[i],
+        telemetrycntph: n.telemetrycnt[i],
+        nodeinfocntph: n.nodeinfocnt[i],
+        poscntph: n.poscnt[i],
+        sumcntph: n.sumcnt[i],
+        chutil: n.chutil[i] / 100,
+        lastchn: n.lastchn[i],
+        is_stale: n.stale[i] !== 0,
+    };
+}
+
+function mapBinLink(map, i) {
+    const l = map.links;
+    // snr went through f32, round it like the JSON writer's shortest form does
+    return { node1: l.node1[i] | 0, node2: l.node2[i] | 0, snr: parseFloat(l.snr[i].toPrecision(7)), last_updated: mapBinUtc(l.lastUpdated[i]) };
+}
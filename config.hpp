@@ -1,2 +1,20 @@
 #define TELEGRAM_TOKEN "YOUR_TELEGRAM_BOT_TOKEN"
-#define TELEGRAM_CHAT_ID "YOUR_TELEGRAM_CHAT_ID"
\ No newline at end of file
+#define TELEGRAM_CHAT_ID "YOUR_TELEGRAM_CHAT_ID"
+#define DISCORD_LOG_868 "YOUR_DISCORD_WEBHOOK_URL"       // chat of the 868 MHz mesh
+#define DISCORD_LOG_433 "YOUR_DISCORD_WEBHOOK_URL"       // chat of the 433 MHz mesh
+#define DISCORD_MESHCORE "YOUR_DISCORD_WEBHOOK_URL"      // MeshCore channel 3
+#define DISCORD_MESHCORE_PUB "YOUR_DISCORD_WEBHOOK_URL"  // MeshCore public channel 1
+#define MCMAPURL "YOUR_MESHCORE_MAP_URL"                 // polled for the MeshCore channel messages
+
+#define MQTT_MAIN_ADDRESS "tcp://mqtt.meshtastic.org:1883"  // the public broker of the "main" client
+#define MQTT_NODE_ID 0xabbababa  // sender of our node infos, announcements and the mqtt868 route sink's messages
+
+#define HTTP_API_PORT 8088           // embedded JSON API, 0 disables it
+#define HTTP_API_BIND "127.0.0.1"  // put it behind the web server's reverse proxy
+#define CHAT_RING_SIZE 2000          // newest chat messages served from memory, older /chat pages come from SQLite
+#define NOTIFY_QUEUE_DIR "notifyqueue"  // on-disk queues of the Telegram / Discord posts, "" keeps them in memory
+#define ROUTES_FILE "routes.conf"   // routing rules of chat and other events to the notifiers, see eventrouter.hpp
+#define EVENT_LOG_FILE ""           // routable event log, "" disables the file sink
+#define LOG_FILE ""                 // log lines with time and level, "" logs to the console only
+#define LOG_FILE_MAX_BYTES 10485760 // the log file is rotated at this size, 0 never
+#define LOG_FILE_KEEP 5             // rotated log files kept, LOG_FILE.1 is the newest
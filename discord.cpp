@@ -1,6 +1,13 @@
 #include "discord.hpp"
 #include <iostream>
 
+#define DISCORD_MAX_MESSAGE 2000  // characters of a webhook message
+#define DISCORD_RATE (30.0 / 60)  // posts per second, the per channel webhook limit
+#define DISCORD_BURST 5           // posts per 2 s bucket of a webhook
+
+DiscordBot::DiscordBot(HttpDispatcher& http, std::string webhook, const std::string& name)
+    : Notifier(http, name, DISCORD_MAX_MESSAGE, DISCORD_RATE, DISCORD_BURST), webhook_url(webhook) {}
+
 std::string DiscordBot::escape_json(const std::string& s) {
     std::string escaped;
     // Reserve space to avoid frequent reallocations.
@@ -49,54 +56,9 @@ std::string DiscordBot::escape_json(const std::string& s) {
     return escaped;
 }
 
-void DiscordBot::sendQueuedMessage() {
-    std::lock_guard<std::mutex> lock(mtx);
-    if (messageQueue.empty()) {
-        return;
-    }
-
-    std::string message = escape_json(messageQueue.front());
-    messageQueue.pop();
-
-    std::string json_payload = R"({"content": ")" + message + R"("})";
-
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Error initializing curl!" << std::endl;
-        return;
-    }
-    CURLcode res;
-    curl_easy_setopt(curl, CURLOPT_URL, webhook_url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_payload.c_str());
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        // If the request failed, print the error
-        std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
-    } else {
-        // Get the HTTP response code from Discord
-        long response_code;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-        // Discord returns 204 No Content on success
-        if (response_code == 204) {
-            std::cout << "Webhook sent successfully!" << std::endl;
-        } else {
-            std::cout << "Discord returned HTTP code: " << response_code << std::endl;
-        }
-    }
-    curl_slist_free_all(headers);  // Free the header list
-    curl_easy_cleanup(curl);       // Free the easy handle
-}
-
-void DiscordBot::loop() {
-    sendQueuedMessage();
+bool DiscordBot::buildCall(const std::string& text, HttpCall& call) {
+    call.url = webhook_url;
+    call.body = R"({"content": ")" + escape_json(text) + R"("})";
+    call.headers.push_back("Content-Type: application/json");
+    return true;
 }
-
-void DiscordBot::queueMessage(const std::string& message) {
-    std::lock_guard<std::mutex> lock(mtx);
-    if (messageQueue.size() >= 100) return;
-    messageQueue.push(message);
-}
\ No newline at end of file
@@ -1,23 +1,18 @@
 #pragma once
 
 #include <string>
-#include <mutex>
-#include <queue>
-#include <curl/curl.h>
+#include "notifier.hpp"
 
-class DiscordBot {
+class DiscordBot : public Notifier {
    public:
-    DiscordBot(std::string webhook) : webhook_url(webhook) {}
+    DiscordBot(HttpDispatcher& http, std::string webhook, const std::string& name = "discord");
     ~DiscordBot() {}
-    void queueMessage(const std::string& message);
-    void loop();
+
+   protected:
+    bool configured() const override { return !webhook_url.empty(); }
+    bool buildCall(const std::string& text, HttpCall& call) override;
 
    private:
     std::string escape_json(const std::string& s);
-    void sendQueuedMessage();
-    std::string apiToken;
-    std::string chatId;
-    std::mutex mtx;
-    std::queue<std::string> messageQueue;
     std::string webhook_url = "";
 };
@@ -0,0 +1,225 @@
+#include "diskqueue.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define DISKQUEUE_HEADER 8  // u32 length, u32 crc32 of the payload, little endian
+
+static void putU32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((char)((v >> (8 * i)) & 0xFF));
+}
+
+static uint32_t getU32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+DiskQueue::~DiskQueue() {
+    sync();
+    if (writeFd >= 0) close(writeFd);
+}
+
+std::string DiskQueue::segmentPath(uint64_t segment) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llu.seg", (unsigned long long)segment);
+    return dir + name;
+}
+
+bool DiskQueue::open(const std::string& path) {
+    dir = path;
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("Failed to create queue directory %s: %s\n", dir.c_str(), strerror(errno));
+        return false;
+    }
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        LOG_ERROR("Failed to open queue directory %s: %s\n", dir.c_str(), strerror(errno));
+        return false;
+    }
+    while (struct dirent* entry = readdir(d)) {
+        unsigned long long segment;
+        char tail[8];
+        if (sscanf(entry->d_name, "%16llu.%7s", &segment, tail) == 2 && strcmp(tail, "seg") == 0) segments.push_back(segment);
+    }
+    closedir(d);
+    std::sort(segments.begin(), segments.end());
+
+    FILE* f = fopen((dir + "/offset").c_str(), "r");
+    if (f) {
+        unsigned long long segment = 0, offset = 0;
+        if (fscanf(f, "%llu %llu", &segment, &offset) == 2) {
+            head.segment = segment;
+            head.offset = offset;
+        }
+        fclose(f);
+    }
+    // segments already consumed, left behind by a crash between saving the offset and deleting them
+    while (!segments.empty() && segments.front() < head.segment) {
+        unlink(segmentPath(segments.front()).c_str());
+        segments.pop_front();
+    }
+    if (segments.empty() || segments.front() != head.segment) {
+        head.segment = segments.empty() ? 1 : segments.front();
+        head.offset = 0;
+    }
+
+    // count the waiting records, a damaged record ends the queue
+    Position pos = head;
+    std::string record;
+    while (readRecord(pos, &record)) {
+        records++;
+        bytes += DISKQUEUE_HEADER + record.size();
+    }
+    if (!segments.empty()) {
+        std::string damaged = segmentPath(pos.segment);
+        struct stat st;
+        if (stat(damaged.c_str(), &st) == 0 && (uint64_t)st.st_size > pos.offset) {
+            LOG_WARN("Queue %s: dropping a damaged tail of %" PRIu64 " bytes\n", dir.c_str(), (uint64_t)(st.st_size - pos.offset));
+            if (truncate(damaged.c_str(), pos.offset) != 0) {
+                LOG_ERROR("Failed to truncate %s: %s\n", damaged.c_str(), strerror(errno));
+                return false;
+            }
+        }
+        while (segments.back() > pos.segment) {
+            unlink(segmentPath(segments.back()).c_str());
+            segments.pop_back();
+        }
+    }
+    return openSegment(segments.empty() ? head.segment : segments.back());
+}
+
+bool DiskQueue::openSegment(uint64_t segment) {
+    if (writeFd >= 0) close(writeFd);
+    std::string path = segmentPath(segment);
+    writeFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (writeFd < 0) {
+        LOG_ERROR("Failed to open queue segment %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    writeSize = fstat(writeFd, &st) == 0 ? st.st_size : 0;
+    if (segments.empty() || segments.back() != segment) segments.push_back(segment);
+    return true;
+}
+
+bool DiskQueue::push(const std::string& record) {
+    if (writeFd < 0 || record.size() > DISKQUEUE_MAX_RECORD) return false;
+    if (bytes + DISKQUEUE_HEADER + record.size() > DISKQUEUE_MAX_BYTES) return false;
+    putU32(buffered, (uint32_t)record.size());
+    putU32(buffered, (uint32_t)crc32(0, (const Bytef*)record.data(), record.size()));
+    buffered += record;
+    bufferedRecords++;
+    bytes += DISKQUEUE_HEADER + record.size();
+    records++;
+    return true;
+}
+
+void DiskQueue::sync() {
+    if (!buffered.empty() && writeFd >= 0) {
+        if (writeSize >= DISKQUEUE_SEGMENT_BYTES) {
+            fdatasync(writeFd);
+            openSegment(segments.back() + 1);
+        }
+        if (writeFd >= 0 && writeAll(writeFd, buffered.data(), buffered.size()) && fdatasync(writeFd) == 0) {
+            writeSize += buffered.size();
+        } else {
+            // the records are lost, cut off what made it so later ones don't follow a torn record
+            LOG_ERROR("Failed to write queue %s: %s\n", dir.c_str(), strerror(errno));
+            if (writeFd >= 0 && ftruncate(writeFd, writeSize) != 0) LOG_ERROR("Failed to truncate queue %s\n", dir.c_str());
+            records -= bufferedRecords;
+            bytes -= buffered.size();
+        }
+        buffered.clear();
+        bufferedRecords = 0;
+    }
+    if (headDirty) saveHead();
+}
+
+bool DiskQueue::readRecord(Position& pos, std::string* out) {
+    while (true) {
+        std::string path = segmentPath(pos.segment);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        unsigned char header[DISKQUEUE_HEADER];
+        ssize_t n = pread(fd, header, sizeof(header), pos.offset);
+        if (n == 0) {
+            close(fd);
+            // end of this segment, go on with the next one when there is one
+            auto it = std::upper_bound(segments.begin(), segments.end(), pos.segment);
+            if (it == segments.end()) return false;
+            pos.segment = *it;
+            pos.offset = 0;
+            continue;
+        }
+        bool valid = n == (ssize_t)sizeof(header);
+        uint32_t length = valid ? getU32(header) : 0;
+        valid = valid && length <= DISKQUEUE_MAX_RECORD;
+        std::string payload(valid ? length : 0, '\0');
+        if (valid) valid = pread(fd, &payload[0], length, pos.offset + DISKQUEUE_HEADER) == (ssize_t)length;
+        close(fd);
+        if (!valid || crc32(0, (const Bytef*)payload.data(), length) != getU32(header + 4)) return false;
+        pos.offset += DISKQUEUE_HEADER + length;
+        if (out) out->swap(payload);
+        return true;
+    }
+}
+
+void DiskQueue::peek(const std::function<bool(const std::string&)>& fn) {
+    Position pos = head;
+    std::string record;
+    while (readRecord(pos, &record)) {
+        if (!fn(record)) return;
+    }
+}
+
+void DiskQueue::pop(size_t count) {
+    std::string record;
+    for (size_t i = 0; i < count && readRecord(head, &record); i++) {
+        records--;
+        bytes -= DISKQUEUE_HEADER + record.size();
+        headDirty = true;
+    }
+    // the offset goes to disk before the segments it moved past are deleted
+    if (!segments.empty() && segments.front() < head.segment) {
+        saveHead();
+        while (segments.front() < head.segment) {
+            unlink(segmentPath(segments.front()).c_str());
+            segments.pop_front();
+        }
+    }
+}
+
+void DiskQueue::saveHead() {
+    std::string tmp = dir + "/offset.tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        LOG_ERROR("Failed to write %s: %s\n", tmp.c_str(), strerror(errno));
+        return;
+    }
+    fprintf(f, "%llu %llu\n", (unsigned long long)head.segment, (unsigned long long)head.offset);
+    fflush(f);
+    fdatasync(fileno(f));
+    fclose(f);
+    if (rename(tmp.c_str(), (dir + "/offset").c_str()) == 0) headDirty = false;
+}
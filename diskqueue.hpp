@@ -0,0 +1,72 @@
+#ifndef DISKQUEUE_HPP
+#define DISKQUEUE_HPP
+
+#include <string>
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+#define DISKQUEUE_SEGMENT_BYTES (1024 * 1024)   // a new segment file is started past this size
+#define DISKQUEUE_MAX_BYTES (64 * 1024 * 1024)  // backlog kept on disk, newer records are refused beyond
+#define DISKQUEUE_MAX_RECORD (1024 * 1024)      // longer records are refused, longer lengths read back mean corruption
+
+/**
+ * @brief Append-only FIFO of strings in a directory, surviving crashes and restarts.
+ *
+ * Records go to numbered segment files as length, CRC32, payload. The consumer position is kept in
+ * an "offset" file next to them, and segments are deleted once it has moved past them.
+ * push() only buffers; sync() writes and fsyncs everything pushed since the last call in one go
+ * (group commit), so a crash loses at most the records pushed since. On open() the records after
+ * the consumer position are checked and a torn tail is cut off. Delivery is at least once:
+ * records consumed shortly before a crash may be read again.
+ *
+ * Not thread safe, the owner serializes the calls.
+ */
+class DiskQueue {
+   public:
+    ~DiskQueue();
+
+    // Opens or creates the queue in dir (created when missing) and recovers its state.
+    bool open(const std::string& dir);
+
+    // Buffers a record until the next sync(), false when the queue is full.
+    bool push(const std::string& record);
+
+    // Writes the buffered records and the consumer position to disk.
+    void sync();
+
+    // Reads the records from the consumer position on, without consuming them, until fn returns false.
+    // Only sees records written by sync().
+    void peek(const std::function<bool(const std::string&)>& fn);
+
+    // Consumes count records from the front.
+    void pop(size_t count);
+
+    size_t size() const { return records; }  // records waiting, including buffered ones
+
+   private:
+    struct Position {
+        uint64_t segment = 0;
+        uint64_t offset = 0;
+    };
+
+    std::string segmentPath(uint64_t segment) const;
+    // Reads the record at pos and moves pos past it, stepping into the next segment at the end of one.
+    // false at the end of the queue or at a damaged record.
+    bool readRecord(Position& pos, std::string* out);
+    bool openSegment(uint64_t segment);
+    void saveHead();
+
+    std::string dir;
+    std::deque<uint64_t> segments;  // segment numbers on disk, oldest first, the last one is appended to
+    int writeFd = -1;
+    uint64_t writeSize = 0;         // bytes written to the last segment
+    std::string buffered;           // records pushed since the last sync()
+    size_t bufferedRecords = 0;
+    Position head;                  // consumer position
+    bool headDirty = false;
+    size_t records = 0;
+    uint64_t bytes = 0;             // size of the records waiting, on disk and buffered
+};
+
+#endif  // DISKQUEUE_HPP
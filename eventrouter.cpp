@@ -0,0 +1,242 @@
+#include "eventrouter.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+static const char* TYPE_NAMES[] = {"chat", "position", "nodeinfo", "telemetry", "waypoint", "traceroute", "neighborinfo"};
+
+EventFormat::EventFormat(const std::string& pattern) {
+    static const std::pair<const char*, Field> fields[] = {{"{freq}", FREQ}, {"{chan}", CHAN}, {"{chanhash}", CHANHASH}, {"{name}", NAME}, {"{node}", NODE}, {"{type}", TYPE}, {"{text}", TEXT}, {"{emoji}", EMOJI}};
+    std::string literal;
+    size_t i = 0;
+    while (i < pattern.size()) {
+        bool matched = false;
+        if (pattern[i] == '{') {
+            for (const auto& field : fields) {
+                size_t length = strlen(field.first);
+                if (pattern.compare(i, length, field.first) != 0) continue;
+                if (!literal.empty()) parts.push_back({LITERAL, literal});
+                literal.clear();
+                parts.push_back({field.second, ""});
+                i += length;
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) literal.push_back(pattern[i++]);
+    }
+    if (!literal.empty()) parts.push_back({LITERAL, literal});
+}
+
+std::string EventFormat::format(const MeshEvent& event) const {
+    std::string out;
+    char hex[16];
+    for (const auto& part : parts) {
+        switch (part.first) {
+            case LITERAL: out += part.second; break;
+            case FREQ: out += std::to_string(event.freq); break;
+            case CHAN: out += event.channel; break;
+            case CHANHASH: out += std::to_string(event.chanHash); break;
+            case NAME: out += event.nodeName; break;
+            case NODE:
+                snprintf(hex, sizeof(hex), "!%08x", event.node);
+                out += hex;
+                break;
+            case TYPE: out += TYPE_NAMES[(size_t)event.type]; break;
+            case TEXT: out += event.text; break;
+            case EMOJI:
+                if (event.emoji) out += "(EMOJI) ";
+                break;
+        }
+    }
+    return out;
+}
+
+FileSink::FileSink(const std::string& path, const std::string& pattern) : format(pattern) {
+    file = fopen(path.c_str(), "a");
+    if (!file) LOG_ERROR("Failed to open event log %s\n", path.c_str());
+}
+
+FileSink::~FileSink() {
+    if (file) fclose(file);
+}
+
+void FileSink::deliver(const MeshEvent& event) {
+    if (!file) return;
+    time_t t = event.timeMs / 1000;
+    char timeStr[32];
+    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+    std::string line = format.format(event);
+    std::lock_guard<std::mutex> lock(mtx);
+    fprintf(file, "%s %s\n", timeStr, line.c_str());
+    fflush(file);
+}
+
+// Parses a comma separated list of numbers (decimal, or hex after '!' / "0x").
+template <typename T>
+static bool parseNumbers(const std::string& list, std::vector<T>& out) {
+    if (list.empty() || list.back() == ',') return false;  // getline would not see an empty last item
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) return false;
+        bool hex = item[0] == '!' || item.compare(0, 2, "0x") == 0;
+        const char* start = item.c_str() + (item[0] == '!' ? 1 : 0);
+        char* end = nullptr;
+        unsigned long long v = strtoull(start, &end, hex ? 16 : 10);
+        if (*end != '\0' || end == start || v > (unsigned long long)(T)~(T)0) return false;
+        out.push_back((T)v);
+    }
+    return !out.empty();
+}
+
+bool RouteRule::parse(const std::string& text, RouteRule& out, std::string& error) {
+    std::stringstream ss(text);
+    std::string token;
+    out = RouteRule();
+    if (!(ss >> out.sink)) {
+        error = "missing sink name";
+        return false;
+    }
+    while (ss >> token) {
+        size_t eq = token.find('=');
+        std::string key = token.substr(0, eq), value = eq == std::string::npos ? "" : token.substr(eq + 1);
+        bool ok = false;
+        if (key == "type") {
+            std::stringstream types(value);
+            std::string name;
+            while (std::getline(types, name, ',')) {
+                size_t i = 0;
+                while (i < (size_t)EventType::Count && name != TYPE_NAMES[i]) i++;
+                if (i == (size_t)EventType::Count) break;
+                out.types.push_back((EventType)i);
+                ok = true;
+            }
+            ok = ok && !types && value.back() != ',';  // every name was known, none empty
+        } else if (key == "freq") {
+            ok = parseNumbers(value, out.freqs);
+        } else if (key == "chan") {
+            ok = parseNumbers(value, out.chanHashes);
+        } else if (key == "port") {
+            ok = parseNumbers(value, out.ports);
+        } else if (key == "node") {
+            ok = parseNumbers(value, out.nodes);
+        }
+        if (!ok) {
+            error = "bad condition '" + token + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EventRouter::addSink(const std::string& name, std::unique_ptr<EventSink> sink) {
+    if (sinks.size() >= ROUTER_MAX) {
+        LOG_WARN("Too many event sinks, %s ignored\n", name.c_str());
+        return false;
+    }
+    sinkNames.push_back(name);
+    sinks.push_back(std::move(sink));
+    return true;
+}
+
+bool EventRouter::addRoute(const RouteRule& rule) {
+    size_t sink = 0;
+    while (sink < sinkNames.size() && sinkNames[sink] != rule.sink) sink++;
+    if (sink == sinkNames.size()) {
+        LOG_WARN("Route to unknown sink %s ignored\n", rule.sink.c_str());
+        return false;
+    }
+    if (rules.size() >= ROUTER_MAX) {
+        LOG_WARN("Too many routes, route to %s ignored\n", rule.sink.c_str());
+        return false;
+    }
+    rules.push_back(rule);
+    ruleSink.push_back(sink);
+    return true;
+}
+
+bool EventRouter::addRoute(const std::string& text) {
+    RouteRule rule;
+    std::string error;
+    if (!RouteRule::parse(text, rule, error)) {
+        LOG_WARN("Route '%s' ignored: %s\n", text.c_str(), error.c_str());
+        return false;
+    }
+    return addRoute(rule);
+}
+
+size_t EventRouter::loadRoutes(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    size_t added = 0;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.resize(hash);
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        if (addRoute(line)) added++;
+    }
+    return added;
+}
+
+void EventRouter::compile() {
+    for (auto& mask : typeMask) mask = 0;
+    for (auto& mask : chanMask) mask = 0;
+    freqMasks.clear();
+    portMasks.clear();
+    nodeMasks.clear();
+    anyFreq = anyPort = anyNode = 0;
+
+    for (size_t i = 0; i < rules.size(); i++) {
+        const RouteRule& rule = rules[i];
+        Mask bit = (Mask)1 << i;
+        for (size_t t = 0; t < (size_t)EventType::Count; t++) {
+            if (rule.types.empty() || std::find(rule.types.begin(), rule.types.end(), (EventType)t) != rule.types.end()) typeMask[t] |= bit;
+        }
+        for (size_t c = 0; c < 256; c++) {
+            if (rule.chanHashes.empty() || std::find(rule.chanHashes.begin(), rule.chanHashes.end(), (uint8_t)c) != rule.chanHashes.end()) chanMask[c] |= bit;
+        }
+        if (rule.freqs.empty()) anyFreq |= bit;
+        for (uint16_t freq : rule.freqs) freqMasks[freq] |= bit;
+        if (rule.ports.empty()) anyPort |= bit;
+        for (uint16_t port : rule.ports) portMasks[port] |= bit;
+        if (rule.nodes.empty()) anyNode |= bit;
+        for (uint32_t node : rule.nodes) nodeMasks[node] |= bit;
+    }
+    // values named by some rules also match the rules without that condition
+    for (auto& pair : freqMasks) pair.second |= anyFreq;
+    for (auto& pair : portMasks) pair.second |= anyPort;
+    for (auto& pair : nodeMasks) pair.second |= anyNode;
+}
+
+void EventRouter::publish(const MeshEvent& event) const {
+    if (event.type >= EventType::Count) return;
+    auto lookup = [](const std::unordered_map<uint16_t, Mask>& masks, uint16_t key, Mask any) {
+        auto it = masks.find(key);
+        return it != masks.end() ? it->second : any;
+    };
+    auto node = nodeMasks.find(event.node);
+    Mask matched = typeMask[(size_t)event.type] & chanMask[event.chanHash] & lookup(freqMasks, event.freq, anyFreq) &
+                   lookup(portMasks, event.port, anyPort) & (node != nodeMasks.end() ? node->second : anyNode);
+    if (!matched) return;
+
+    Mask targets = 0;
+    while (matched) {
+        int rule = __builtin_ctzll(matched);
+        matched &= matched - 1;
+        targets |= (Mask)1 << ruleSink[rule];
+    }
+    while (targets) {
+        int sink = __builtin_ctzll(targets);
+        targets &= targets - 1;
+        try {
+            sinks[sink]->deliver(event);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Event sink %s failed: %s\n", sinkNames[sink].c_str(), e.what());
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef EVENTROUTER_HPP
+#define EVENTROUTER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include "notifier.hpp"
+
+#define ROUTER_MAX 64  // routes and sinks each, they are bit masks in the dispatch table
+
+enum class EventType : uint8_t { Chat, Position, NodeInfo, Telemetry, Waypoint, Traceroute, NeighborInfo, Count };
+
+// One packet worth routing, filled by the MQTT callbacks.
+struct MeshEvent {
+    EventType type = EventType::Chat;
+    uint16_t freq = 0;
+    uint8_t chanHash = 0;
+    uint16_t port = 0;     // meshtastic portnum
+    uint32_t node = 0;     // sender
+    std::string nodeName;
+    std::string channel;   // channel name
+    std::string text;      // chat text, a one line summary for the other types
+    bool emoji = false;
+    uint64_t timeMs = 0;
+};
+
+/**
+ * @brief Turns an event into a line from a template, compiled once.
+ *
+ * Placeholders: {freq} {chan} {chanhash} {name} {node} (hex id) {type} {text}
+ * {emoji} ("(EMOJI) " for emoji reactions, empty otherwise). Other text is copied.
+ */
+class EventFormat {
+   public:
+    explicit EventFormat(const std::string& pattern);
+    std::string format(const MeshEvent& event) const;
+
+   private:
+    enum Field { LITERAL, FREQ, CHAN, CHANHASH, NAME, NODE, TYPE, TEXT, EMOJI };
+    std::vector<std::pair<Field, std::string>> parts;
+};
+
+// A destination of routed events. deliver() runs on the thread of the MQTT callback, it must not block.
+class EventSink {
+   public:
+    virtual ~EventSink() = default;
+    virtual void deliver(const MeshEvent& event) = 0;
+};
+
+// Queues the formatted event on a Notifier (Discord, Telegram).
+class NotifierSink : public EventSink {
+   public:
+    NotifierSink(Notifier& notifier, const std::string& pattern) : notifier(notifier), format(pattern) {}
+    void deliver(const MeshEvent& event) override { notifier.queueMessage(format.format(event)); }
+
+   private:
+    Notifier& notifier;
+    EventFormat format;
+};
+
+// Appends the formatted event as a line to a file.
+class FileSink : public EventSink {
+   public:
+    FileSink(const std::string& path, const std::string& pattern);
+    ~FileSink();
+    void deliver(const MeshEvent& event) override;
+
+   private:
+    FILE* file = nullptr;
+    EventFormat format;
+    std::mutex mtx;
+};
+
+/**
+ * @brief Routing rule: a sink and the values each event field must have, an empty list matches anything.
+ *
+ * Text form, fields in any order, lists are comma separated:
+ *   discord868 type=chat freq=868 chan=8,31 port=1 node=!aabbccdd,!11223344
+ * Types: chat, position, nodeinfo, telemetry, waypoint, traceroute, neighborinfo.
+ */
+struct RouteRule {
+    std::string sink;
+    std::vector<EventType> types;
+    std::vector<uint16_t> freqs;
+    std::vector<uint8_t> chanHashes;
+    std::vector<uint16_t> ports;
+    std::vector<uint32_t> nodes;
+
+    static bool parse(const std::string& text, RouteRule& out, std::string& error);
+};
+
+/**
+ * @brief Fans events out to sinks by routing rules.
+ *
+ * Sinks and routes are registered at startup, then compile() turns the rules into one lookup
+ * table per event field, each giving the bit mask of the rules that accept a value. Routing an event
+ * is a lookup per field and an AND of the masks, whatever the number of rules; each sink gets an
+ * event once even when several rules match it. After compile() the router is read only and
+ * publish() may be called from any thread.
+ */
+class EventRouter {
+   public:
+    bool addSink(const std::string& name, std::unique_ptr<EventSink> sink);
+    bool addRoute(const RouteRule& rule);
+    bool addRoute(const std::string& text);      // logs and skips a malformed rule
+    size_t loadRoutes(const std::string& path);  // one rule per line, '#' starts a comment; returns the rules added
+    size_t routeCount() const { return rules.size(); }
+
+    void compile();
+    void publish(const MeshEvent& event) const;
+
+   private:
+    using Mask = uint64_t;
+
+    std::vector<std::string> sinkNames;
+    std::vector<std::unique_ptr<EventSink>> sinks;
+    std::vector<RouteRule> rules;
+    std::vector<size_t> ruleSink;  // sink index of each rule
+
+    // the dispatch table, from compile()
+    Mask typeMask[(size_t)EventType::Count] = {};
+    Mask chanMask[256] = {};
+    std::unordered_map<uint16_t, Mask> freqMasks, portMasks;
+    std::unordered_map<uint32_t, Mask> nodeMasks;
+    Mask anyFreq = 0, anyPort = 0, anyNode = 0;  // rules without a freq / port / node condition
+};
+
+#endif  // EVENTROUTER_HPP
@@ -0,0 +1,165 @@
+#ifndef GLOBALSTATS_HPP
+#define GLOBALSTATS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include "noderecords.hpp"
+
+// Snapshot of the globalstats aggregates of one frequency, as api.php computes them.
+struct GlobalStats {
+    struct Top {
+        std::string node = "N/A";
+        double count = 0;
+    };
+
+    uint16_t freq = 0;
+    size_t totalNodes = 0;
+    size_t onlineNodes = 0;
+    size_t staleNodes = 0;
+    size_t nodesWithGps = 0;
+
+    // hourly counters, online nodes only
+    uint64_t sumCnt = 0;
+    uint64_t msgCnt = 0;
+    uint64_t traceCnt = 0;
+    uint64_t telemetryCnt = 0;
+    uint64_t nodeInfoCnt = 0;
+    uint64_t posCnt = 0;
+    Top topMsg, topTrace, topTelemetry, topNodeInfo, topPos, topChutil;
+
+    // averages of online nodes reporting a nonzero value
+    double sumBattery = 0;
+    size_t batteryNodes = 0;
+    double sumUptime = 0;
+    size_t uptimeNodes = 0;
+    double sumChutil = 0;
+    size_t chutilNodes = 0;
+
+    // links between nodes of this frequency
+    size_t linkCount = 0;
+    double sumSnr = 0;
+    double minSnr = 999;
+    double maxSnr = -999;
+    std::string bestLink = "N/A";
+    std::string worstLink = "N/A";
+    size_t snrGood = 0;  // > 0 dB
+    size_t snrOkay = 0;  // 0 .. -5 dB
+    size_t snrWeak = 0;  // -5 .. -10 dB
+    size_t snrBad = 0;   // < -10 dB
+
+    std::vector<std::pair<uint8_t, size_t>> roles;  // role -> node count, by role id
+};
+
+/**
+ * @brief Running globalstats aggregates of one frequency.
+ *
+ * NodeStore calls the remove* method with the old state and the add* method with the new state
+ * around every change, so nothing is ever recomputed. Top contributors and link extremes are kept
+ * in ordered sets, the largest entry is always at rbegin().
+ */
+struct FreqStats {
+    using LinkKey = std::pair<uint32_t, uint32_t>;
+
+    size_t totalNodes = 0;
+    size_t onlineNodes = 0;
+    size_t nodesWithGps = 0;
+    std::map<uint8_t, size_t> roles;
+
+    uint64_t sumCnt = 0, msgCnt = 0, traceCnt = 0, telemetryCnt = 0, nodeInfoCnt = 0, posCnt = 0;
+    int64_t sumBattery = 0;
+    size_t batteryNodes = 0;
+    uint64_t sumUptime = 0;
+    size_t uptimeNodes = 0;
+    double sumChutil = 0;
+    size_t chutilNodes = 0;
+    std::set<std::pair<uint32_t, uint32_t>> topMsg, topTrace, topTelemetry, topNodeInfo, topPos;  // (count, node id)
+    std::set<std::pair<float, uint32_t>> topChutil;
+
+    size_t linkCount = 0;
+    double sumSnr = 0;
+    size_t snrGood = 0, snrOkay = 0, snrWeak = 0, snrBad = 0;
+    std::set<std::pair<float, LinkKey>> linksBySnr;
+
+    // --- every node of the frequency ---
+    void addNode(const NodeRecord& node) {
+        totalNodes++;
+        if (node.hasPosition()) nodesWithGps++;
+        roles[node.role]++;
+    }
+    void removeNode(const NodeRecord& node) {
+        totalNodes--;
+        if (node.hasPosition()) nodesWithGps--;
+        if (--roles[node.role] == 0) roles.erase(node.role);
+    }
+
+    // --- online (not stale) nodes only ---
+    void addOnline(const NodeRecord& node) { applyOnline(node, 1); }
+    void removeOnline(const NodeRecord& node) { applyOnline(node, -1); }
+
+    // --- links with both ends on this frequency ---
+    void addLink(const LinkRecord& link) {
+        linkCount++;
+        sumSnr += link.snr;
+        bucket(link.snr)++;
+        linksBySnr.insert({link.snr, {link.node1, link.node2}});
+    }
+    void removeLink(const LinkRecord& link) {
+        linkCount--;
+        sumSnr -= link.snr;
+        bucket(link.snr)--;
+        linksBySnr.erase({link.snr, {link.node1, link.node2}});
+        if (linkCount == 0) sumSnr = 0;  // no rounding residue on an empty set
+    }
+
+   private:
+    size_t& bucket(float snr) {
+        if (snr > 0) return snrGood;
+        if (snr >= -5) return snrOkay;
+        if (snr >= -10) return snrWeak;
+        return snrBad;
+    }
+
+    template <typename T>
+    static void applyTop(std::set<std::pair<T, uint32_t>>& top, T value, uint32_t nodeId, int sign) {
+        if (value <= 0) return;  // api.php only names a top node above zero
+        if (sign > 0) {
+            top.insert({value, nodeId});
+        } else {
+            top.erase({value, nodeId});
+        }
+    }
+
+    void applyOnline(const NodeRecord& node, int sign) {
+        onlineNodes += sign;
+        sumCnt += sign * (int64_t)node.sumcntph;
+        msgCnt += sign * (int64_t)node.msgcntph;
+        traceCnt += sign * (int64_t)node.tracecntph;
+        telemetryCnt += sign * (int64_t)node.telemetrycntph;
+        nodeInfoCnt += sign * (int64_t)node.nodeinfocntph;
+        posCnt += sign * (int64_t)node.poscntph;
+        if (node.batteryLevel > 0) {
+            sumBattery += sign * node.batteryLevel;
+            batteryNodes += sign;
+        }
+        if (node.uptime > 0) {
+            sumUptime += sign * (int64_t)node.uptime;
+            uptimeNodes += sign;
+        }
+        if (node.chutil > 0) {
+            sumChutil += sign * node.chutil;
+            chutilNodes += sign;
+            if (chutilNodes == 0) sumChutil = 0;
+        }
+        applyTop(topMsg, node.msgcntph, node.nodeId, sign);
+        applyTop(topTrace, node.tracecntph, node.nodeId, sign);
+        applyTop(topTelemetry, node.telemetrycntph, node.nodeId, sign);
+        applyTop(topNodeInfo, node.nodeinfocntph, node.nodeId, sign);
+        applyTop(topPos, node.poscntph, node.nodeId, sign);
+        applyTop(topChutil, node.chutil, node.nodeId, sign);
+    }
+};
+
+#endif  // GLOBALSTATS_HPP
@@ -0,0 +1,197 @@
+#include "httpdispatcher.hpp"
+#include "logger.hpp"
+#include <algorithm>
+
+#define HTTPDISPATCHER_MAX_HOST_CONNECTIONS 4  // parallel connections per host
+#define HTTPDISPATCHER_IDLE_HANDLES 8          // finished easy handles kept for reuse
+
+HttpDispatcher::~HttpDispatcher() {
+    stop();
+}
+
+void HttpDispatcher::start() {
+    if (running) return;
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    multi = curl_multi_init();
+    if (!multi) {
+        LOG_ERROR("Failed to initialize the libcurl multi handle\n");
+        return;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)HTTPDISPATCHER_MAX_HOST_CONNECTIONS);
+    running = true;
+    worker = std::thread(&HttpDispatcher::run, this);
+}
+
+void HttpDispatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopped = true;
+    }
+    if (running) {
+        running = false;
+        curl_multi_wakeup(multi);
+        worker.join();
+    }
+    for (auto& pair : transfers) {
+        curl_multi_remove_handle(multi, pair.first);
+        pair.second->result.code = CURLE_ABORTED_BY_CALLBACK;
+        complete(*pair.second);
+        curl_easy_cleanup(pair.first);
+    }
+    transfers.clear();
+    std::deque<std::unique_ptr<Transfer>> left;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        left.swap(incoming);
+    }
+    for (auto& transfer : left) {
+        transfer->result.code = CURLE_ABORTED_BY_CALLBACK;
+        complete(*transfer);
+    }
+    for (CURL* easy : idleHandles) curl_easy_cleanup(easy);
+    idleHandles.clear();
+    if (multi) {
+        curl_multi_cleanup(multi);
+        multi = nullptr;
+    }
+    active = 0;
+}
+
+void HttpDispatcher::submit(HttpCall call, HttpCallback done) {
+    std::unique_ptr<Transfer> transfer(new Transfer());
+    transfer->call = std::move(call);
+    transfer->done = std::move(done);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!stopped) {
+            incoming.push_back(std::move(transfer));
+            active++;
+            if (running) curl_multi_wakeup(multi);  // under the lock, stop() frees multi only after setting stopped
+            return;
+        }
+    }
+    transfer->result.code = CURLE_ABORTED_BY_CALLBACK;
+    complete(*transfer);
+}
+
+std::future<HttpResult> HttpDispatcher::submit(HttpCall call) {
+    auto promise = std::make_shared<std::promise<HttpResult>>();
+    std::future<HttpResult> future = promise->get_future();
+    submit(std::move(call), [promise](const HttpResult& result) { promise->set_value(result); });
+    return future;
+}
+
+void HttpDispatcher::run() {
+    while (running) {
+        std::deque<std::unique_ptr<Transfer>> batch;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            batch.swap(incoming);
+        }
+        for (auto& transfer : batch) begin(std::move(transfer));
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg == CURLMSG_DONE) finish(msg->easy_handle, msg->data.result);
+        }
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+}
+
+void HttpDispatcher::begin(std::unique_ptr<Transfer> transfer) {
+    CURL* easy = nullptr;
+    if (!idleHandles.empty()) {
+        easy = idleHandles.back();
+        idleHandles.pop_back();
+        curl_easy_reset(easy);  // keeps the connection and TLS session caches
+    } else {
+        easy = curl_easy_init();
+    }
+    if (!easy) {
+        LOG_ERROR("Failed to initialize libcurl\n");
+        transfer->result.code = CURLE_FAILED_INIT;
+        complete(*transfer);
+        active--;
+        return;
+    }
+    const HttpCall& call = transfer->call;
+    curl_easy_setopt(easy, CURLOPT_URL, call.url.c_str());
+    curl_easy_setopt(easy, CURLOPT_USERAGENT, "meshlogger/1.0");
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, call.timeoutMs);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+    if (!call.verifyPeer) {
+        curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 0L);
+        curl_easy_setopt(easy, CURLOPT_SSL_VERIFYHOST, 0L);
+    }
+    if (call.followRedirects) curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+    if (!call.body.empty()) {
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, (long)call.body.size());
+        curl_easy_setopt(easy, CURLOPT_POSTFIELDS, call.body.c_str());
+    }
+    for (const auto& header : call.headers) transfer->headerList = curl_slist_append(transfer->headerList, header.c_str());
+    if (transfer->headerList) curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->headerList);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, &HttpDispatcher::onBody);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer->result);
+    curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, &HttpDispatcher::onHeader);
+    curl_easy_setopt(easy, CURLOPT_HEADERDATA, &transfer->result);
+
+    transfer->easy = easy;
+    curl_multi_add_handle(multi, easy);
+    transfers[easy] = std::move(transfer);
+}
+
+void HttpDispatcher::finish(CURL* easy, CURLcode code) {
+    auto it = transfers.find(easy);
+    if (it == transfers.end()) return;
+    std::unique_ptr<Transfer> transfer = std::move(it->second);
+    transfers.erase(it);
+    curl_multi_remove_handle(multi, easy);
+
+    transfer->result.code = code;
+    if (code == CURLE_OK) curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &transfer->result.status);
+    if (idleHandles.size() < HTTPDISPATCHER_IDLE_HANDLES) {
+        idleHandles.push_back(easy);
+    } else {
+        curl_easy_cleanup(easy);
+    }
+    complete(*transfer);
+    active--;
+}
+
+void HttpDispatcher::complete(Transfer& transfer) {
+    if (transfer.headerList) {
+        curl_slist_free_all(transfer.headerList);
+        transfer.headerList = nullptr;
+    }
+    if (!transfer.done) return;
+    try {
+        transfer.done(transfer.result);
+    } catch (const std::exception& e) {
+        LOG_ERROR("HTTP callback failed: %s\n", e.what());
+    }
+}
+
+size_t HttpDispatcher::onBody(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    static_cast<HttpResult*>(userdata)->body.append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+size_t HttpDispatcher::onHeader(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    HttpResult* result = static_cast<HttpResult*>(userdata);
+    std::string line(ptr, size * nmemb);
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        result->headers.clear();  // status line of the next response (redirect, 100 continue)
+        return size * nmemb;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) return size * nmemb;
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    size_t start = line.find_first_not_of(" \t", colon + 1);
+    size_t end = line.find_last_not_of(" \t\r\n");
+    result->headers[name] = start == std::string::npos || end < start ? "" : line.substr(start, end - start + 1);
+    return size * nmemb;
+}
@@ -0,0 +1,99 @@
+#ifndef HTTPDISPATCHER_HPP
+#define HTTPDISPATCHER_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <curl/curl.h>
+
+struct HttpCall {
+    std::string url;
+    std::string body;                  // sent as POST when not empty, GET otherwise
+    std::vector<std::string> headers;  // "Name: value"
+    long timeoutMs = 10000;
+    bool verifyPeer = true;
+    bool followRedirects = false;
+};
+
+struct HttpResult {
+    CURLcode code = CURLE_OK;  // transport error, the status is 0 when set
+    long status = 0;
+    std::string body;
+    std::unordered_map<std::string, std::string> headers;  // names in lower case, of the last response
+
+    bool ok() const { return code == CURLE_OK && status >= 200 && status < 300; }
+    std::string header(const std::string& name) const {
+        auto it = headers.find(name);
+        return it != headers.end() ? it->second : "";
+    }
+};
+
+/**
+ * @brief Called once per call with its result. Runs on the dispatcher thread, it must be quick;
+ * submitting follow-up calls from it is fine.
+ */
+using HttpCallback = std::function<void(const HttpResult&)>;
+
+/**
+ * @brief Shared client for every outbound HTTP call (notifier webhooks, the MeshCore poller).
+ *
+ * One thread drives all transfers with a curl multi handle. Its connection cache keeps idle
+ * connections (and their TLS sessions) open per host, so steady traffic to the same webhook
+ * skips the handshakes. Submitting never blocks on the network.
+ */
+class HttpDispatcher {
+   public:
+    HttpDispatcher() = default;
+    ~HttpDispatcher();
+
+    // Starts the dispatcher thread, calls submitted before are sent then.
+    void start();
+
+    // Stops the thread, calls not finished yet complete with CURLE_ABORTED_BY_CALLBACK.
+    void stop();
+
+    /**
+     * @brief Queues a call. Thread safe.
+     * @param done Gets the result on the dispatcher thread, may be empty.
+     */
+    void submit(HttpCall call, HttpCallback done);
+    std::future<HttpResult> submit(HttpCall call);
+
+    // Calls queued or in flight.
+    size_t pending() const { return active; }
+
+   private:
+    struct Transfer {
+        HttpCall call;
+        HttpCallback done;
+        HttpResult result;
+        CURL* easy = nullptr;
+        curl_slist* headerList = nullptr;
+    };
+
+    void run();
+    void begin(std::unique_ptr<Transfer> transfer);
+    void finish(CURL* easy, CURLcode code);
+    static void complete(Transfer& transfer);
+    static size_t onBody(char* ptr, size_t size, size_t nmemb, void* userdata);
+    static size_t onHeader(char* ptr, size_t size, size_t nmemb, void* userdata);
+
+    CURLM* multi = nullptr;
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::atomic<size_t> active{0};
+    std::mutex mtx;                                    // guards incoming and stopped
+    std::deque<std::unique_ptr<Transfer>> incoming;    // submitted, not handed to curl yet
+    bool stopped = false;
+    std::unordered_map<CURL*, std::unique_ptr<Transfer>> transfers;  // in flight, dispatcher thread only
+    std::vector<CURL*> idleHandles;                    // finished easy handles, reused for their caches
+};
+
+#endif  // HTTPDISPATCHER_HPP
@@ -0,0 +1,461 @@
+#include "httpserver.hpp"
+#include "logger.hpp"
+#include "timeutil.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#define HTTP_MAX_CONNECTIONS 512
+#define HTTP_MAX_HEADER_SIZE 16384
+#define HTTP_MAX_BODY_SIZE 1024  // only GET and HEAD are served, a larger body is answered with 413
+#define HTTP_IDLE_TIMEOUT_MS 30000
+#define HTTP_STREAM_QUEUE 256      // events buffered per stream, the oldest is dropped beyond this
+#define HTTP_STREAM_CHUNK 65536    // bytes moved from a stream queue to its socket buffer at a time
+#define HTTP_STREAM_PING_MS 15000  // comment line sent on quiet streams, keeps proxies from closing them
+#define HTTP_PENDING_EVENTS 4096   // events waiting for the server thread
+
+HttpServer::HttpServer() {}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+void HttpServer::subscribe(const std::string& path, HttpHandler handler) {
+    if (!path.empty() && path.back() == '/' && path.size() > 1) {
+        prefixRoutes.emplace_back(path, handler);
+        // longest prefix first
+        std::sort(prefixRoutes.begin(), prefixRoutes.end(), [](const auto& a, const auto& b) { return a.first.size() > b.first.size(); });
+    } else {
+        routes[path] = handler;
+    }
+}
+
+bool HttpServer::start(uint16_t port, const std::string& bindAddress) {
+    if (running) return true;
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        LOG_ERROR("HTTP: socket() failed: %s\n", strerror(errno));
+        return false;
+    }
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, bindAddress.c_str(), &addr.sin_addr) != 1) {
+        LOG_ERROR("HTTP: invalid bind address %s\n", bindAddress.c_str());
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 64) < 0) {
+        LOG_ERROR("HTTP: can't listen on %s:%u: %s\n", bindAddress.c_str(), port, strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL, 0) | O_NONBLOCK);
+    if (pipe(wakePipe) < 0) {
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    fcntl(wakePipe[0], F_SETFL, fcntl(wakePipe[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, fcntl(wakePipe[1], F_GETFL, 0) | O_NONBLOCK);
+    running = true;
+    serverThread = std::thread(&HttpServer::run, this);
+    LOG_INFO("HTTP API listening on %s:%u\n", bindAddress.c_str(), port);
+    return true;
+}
+
+void HttpServer::stop() {
+    if (!running) return;
+    running = false;
+    wake();
+    if (serverThread.joinable()) {
+        serverThread.join();
+    }
+    while (!connections.empty()) closeConnection(connections.begin()->first);
+    close(listenFd);
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    listenFd = -1;
+    wakePipe[0] = wakePipe[1] = -1;
+}
+
+void HttpServer::wake() {
+    if (write(wakePipe[1], "x", 1) < 0) {
+        // pipe full means a wakeup is pending already, the poll timeout covers the rest
+    }
+}
+
+void HttpServer::broadcast(const std::string& topic, const std::string& data) {
+    if (streams == 0 || !running) return;
+    auto frame = std::make_shared<const std::string>("event: " + topic + "\ndata: " + data + "\n\n");
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(eventMtx);
+        wasEmpty = pendingEvents.empty();
+        pendingEvents.push_back({topic, frame});
+        if (pendingEvents.size() > HTTP_PENDING_EVENTS) {
+            pendingEvents.pop_front();
+            pendingDropped++;
+        }
+    }
+    if (wasEmpty) wake();
+}
+
+void HttpServer::deliverEvents() {
+    std::deque<Event> batch;
+    size_t lost;
+    {
+        std::lock_guard<std::mutex> lock(eventMtx);
+        batch.swap(pendingEvents);
+        lost = pendingDropped;
+        pendingDropped = 0;
+    }
+    if (batch.empty() && lost == 0) return;
+    for (auto& pair : connections) {
+        Connection& conn = pair.second;
+        if (!conn.streaming) continue;
+        conn.dropped += lost;
+        for (const auto& event : batch) {
+            if (!conn.topics.empty() && !conn.topics.count(event.topic)) continue;
+            conn.events.push_back(event.frame);
+            if (conn.events.size() > HTTP_STREAM_QUEUE) {
+                conn.events.pop_front();
+                conn.dropped++;
+            }
+        }
+    }
+}
+
+void HttpServer::fillStream(Connection& conn) {
+    if (conn.outOffset < conn.out.size()) return;  // previous chunk still in flight
+    conn.out.clear();
+    conn.outOffset = 0;
+    if (conn.dropped > 0) {
+        conn.out += "event: dropped\ndata: {\"count\":" + std::to_string(conn.dropped) + "}\n\n";
+        conn.dropped = 0;
+    }
+    while (!conn.events.empty() && conn.out.size() < HTTP_STREAM_CHUNK) {
+        conn.out += *conn.events.front();
+        conn.events.pop_front();
+    }
+    if (conn.out.empty() && nowMs() - conn.lastActive > HTTP_STREAM_PING_MS) {
+        conn.out = ": ping\n\n";
+    }
+}
+
+void HttpServer::run() {
+    std::vector<pollfd> fds;
+    while (running) {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        fds.push_back({wakePipe[0], POLLIN, 0});
+        for (const auto& pair : connections) {
+            short events = POLLIN;
+            if (pair.second.outOffset < pair.second.out.size() || !pair.second.events.empty()) events |= POLLOUT;
+            fds.push_back({pair.first, events, 0});
+        }
+
+        int n = poll(fds.data(), fds.size(), 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("HTTP: poll() failed: %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            char buf[64];
+            if (read(wakePipe[0], buf, sizeof(buf)) < 0) {
+                // nothing to do, it's only a wakeup
+            }
+        }
+        if (fds[0].revents & POLLIN) acceptConnections();
+        deliverEvents();
+
+        uint64_t now = nowMs();
+        for (size_t i = 2; i < fds.size(); i++) {
+            auto it = connections.find(fds[i].fd);
+            if (it == connections.end()) continue;
+            Connection& conn = it->second;
+            bool keep = true;
+            if (fds[i].revents & (POLLERR | POLLNVAL)) keep = false;
+            if (keep && (fds[i].revents & (POLLIN | POLLHUP))) keep = readConnection(conn);
+            if (keep && conn.streaming) fillStream(conn);
+            if (keep && conn.outOffset < conn.out.size()) keep = writeConnection(conn);
+            if (keep && conn.closeAfterWrite && conn.outOffset >= conn.out.size()) keep = false;
+            if (keep && !conn.streaming && now - conn.lastActive > HTTP_IDLE_TIMEOUT_MS) keep = false;
+            if (!keep) closeConnection(fds[i].fd);
+        }
+    }
+}
+
+void HttpServer::acceptConnections() {
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) return;
+        if (connections.size() >= HTTP_MAX_CONNECTIONS) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        Connection& conn = connections[fd];
+        conn.fd = fd;
+        conn.lastActive = nowMs();
+    }
+}
+
+bool HttpServer::readConnection(Connection& conn) {
+    char buf[4096];
+    while (true) {
+        ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            conn.in.append(buf, n);
+            conn.lastActive = nowMs();
+            continue;
+        }
+        if (n == 0) return false;  // peer closed
+        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        if (errno == EINTR) continue;
+        return false;
+    }
+    if (conn.streaming || conn.closeAfterWrite) {
+        conn.in.clear();  // nothing more is expected from a stream client, or from one being closed
+        return true;
+    }
+    return processRequests(conn);
+}
+
+bool HttpServer::writeConnection(Connection& conn) {
+    while (conn.outOffset < conn.out.size()) {
+        ssize_t n = send(conn.fd, conn.out.data() + conn.outOffset, conn.out.size() - conn.outOffset, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.outOffset += n;
+            conn.lastActive = nowMs();
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n < 0 && errno == EINTR) continue;
+        return false;
+    }
+    conn.out.clear();
+    conn.outOffset = 0;
+    return true;
+}
+
+bool HttpServer::processRequests(Connection& conn) {
+    while (!conn.closeAfterWrite) {
+        size_t end = conn.in.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return conn.in.size() <= HTTP_MAX_HEADER_SIZE;
+        }
+        HttpRequest request;
+        bool ok = parseRequest(conn.in.substr(0, end), request);
+        size_t consumed = end + 4;
+        // we don't take bodies, but skip small ones so the next pipelined request parses
+        bool tooLarge = false;
+        if (ok) {
+            std::string contentLength = request.header("content-length");
+            if (!contentLength.empty()) {
+                size_t len = strtoul(contentLength.c_str(), nullptr, 10);
+                if (len > HTTP_MAX_BODY_SIZE) {
+                    tooLarge = true;
+                } else {
+                    if (conn.in.size() < consumed + len) return true;  // wait for the rest
+                    consumed += len;
+                }
+            }
+        }
+        if (tooLarge)
+            conn.in.clear();  // the connection is closed after the 413, the body is never read
+        else
+            conn.in.erase(0, consumed);
+
+        HttpResponse response;
+        if (!ok) {
+            response.status = 400;
+            response.body = "{\"status\":\"error\",\"message\":\"Bad request\"}";
+            conn.closeAfterWrite = true;
+        } else if (tooLarge) {
+            response.status = 413;
+            response.body = "{\"status\":\"error\",\"message\":\"Request body too large\"}";
+            conn.closeAfterWrite = true;
+        } else if (request.method == "OPTIONS") {
+            response.status = 204;
+            response.contentType.clear();
+        } else if (request.method != "GET" && request.method != "HEAD") {
+            response.status = 405;
+            response.body = "{\"status\":\"error\",\"message\":\"Method not allowed\"}";
+        } else {
+            dispatch(request, response);
+        }
+
+        std::string connHeader = request.header("connection");
+        std::transform(connHeader.begin(), connHeader.end(), connHeader.begin(), ::tolower);
+        bool http10 = request.headers.count(":version") && request.headers.at(":version") == "HTTP/1.0";
+        if (connHeader == "close" || (http10 && connHeader != "keep-alive")) conn.closeAfterWrite = true;
+
+        std::string& out = conn.out;
+        if (response.stream && response.status == 200 && request.method == "GET" && !conn.closeAfterWrite) {
+            out += "HTTP/1.1 200 OK\r\n";
+            out += "Content-Type: text/event-stream\r\n";
+            out += "Cache-Control: no-cache\r\n";
+            out += "Access-Control-Allow-Origin: *\r\n";
+            out += "X-Accel-Buffering: no\r\n\r\n";  // nginx must not buffer the stream
+            out += response.body;
+            conn.streaming = true;
+            conn.topics = response.topics;
+            conn.in.clear();
+            streams++;
+            return true;
+        }
+        out += "HTTP/1.1 " + std::to_string(response.status) + " " + statusText(response.status) + "\r\n";
+        if (!response.contentType.empty()) out += "Content-Type: " + response.contentType + "\r\n";
+        const std::string& body = response.sharedBody ? *response.sharedBody : response.body;
+        if (response.status != 204 && response.status != 304) out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        out += "Access-Control-Allow-Origin: *\r\n";
+        for (const auto& header : response.headers) {
+            out += header.first + ": " + header.second + "\r\n";
+        }
+        out += conn.closeAfterWrite ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+        if (request.method != "HEAD") out += body;
+    }
+    return true;
+}
+
+void HttpServer::dispatch(const HttpRequest& request, HttpResponse& response) {
+    HttpHandler* handler = nullptr;
+    auto it = routes.find(request.path);
+    if (it != routes.end()) {
+        handler = &it->second;
+    } else {
+        for (auto& route : prefixRoutes) {
+            if (request.path.compare(0, route.first.size(), route.first) == 0) {
+                handler = &route.second;
+                break;
+            }
+        }
+    }
+    if (!handler) {
+        response.status = 404;
+        response.body = "{\"status\":\"error\",\"message\":\"Not found\"}";
+        return;
+    }
+    try {
+        (*handler)(request, response);
+    } catch (const std::exception& e) {
+        LOG_ERROR("HTTP: handler for %s failed: %s\n", request.path.c_str(), e.what());
+        response = HttpResponse();
+        response.status = 500;
+        response.body = "{\"status\":\"error\",\"message\":\"Internal error\"}";
+    }
+}
+
+void HttpServer::closeConnection(int fd) {
+    auto it = connections.find(fd);
+    if (it != connections.end() && it->second.streaming) streams--;
+    close(fd);
+    connections.erase(fd);
+}
+
+bool HttpServer::parseRequest(const std::string& head, HttpRequest& request) {
+    size_t lineEnd = head.find("\r\n");
+    std::string requestLine = head.substr(0, lineEnd);
+    size_t sp1 = requestLine.find(' ');
+    size_t sp2 = requestLine.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1) return false;
+    request.method = requestLine.substr(0, sp1);
+    std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    request.headers[":version"] = requestLine.substr(sp2 + 1);
+
+    size_t qpos = target.find('?');
+    request.path = target.substr(0, qpos);
+    if (qpos != std::string::npos) {
+        std::string qs = target.substr(qpos + 1);
+        size_t pos = 0;
+        while (pos <= qs.size()) {
+            size_t amp = qs.find('&', pos);
+            if (amp == std::string::npos) amp = qs.size();
+            std::string pair = qs.substr(pos, amp - pos);
+            if (!pair.empty()) {
+                size_t eq = pair.find('=');
+                if (eq == std::string::npos) {
+                    request.query[urlDecode(pair)] = "";
+                } else {
+                    request.query[urlDecode(pair.substr(0, eq))] = urlDecode(pair.substr(eq + 1));
+                }
+            }
+            pos = amp + 1;
+        }
+    }
+
+    size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+    while (pos < head.size()) {
+        size_t end = head.find("\r\n", pos);
+        if (end == std::string::npos) end = head.size();
+        std::string line = head.substr(pos, end - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+            request.headers[name] = valueStart == std::string::npos ? "" : line.substr(valueStart);
+        }
+        pos = end + 2;
+    }
+    return !request.path.empty() && request.path[0] == '/';
+}
+
+std::string HttpServer::urlDecode(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            out.push_back(' ');
+        } else if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char)s[i + 1]) && isxdigit((unsigned char)s[i + 2])) {
+            out.push_back((char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            out.push_back(s[i]);
+        }
+    }
+    return out;
+}
+
+const char* HttpServer::statusText(int status) {
+    switch (status) {
+        case 200:
+            return "OK";
+        case 204:
+            return "No Content";
+        case 304:
+            return "Not Modified";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 405:
+            return "Method Not Allowed";
+        case 413:
+            return "Payload Too Large";
+        case 429:
+            return "Too Many Requests";
+        case 500:
+            return "Internal Server Error";
+        case 503:
+            return "Service Unavailable";
+        default:
+            return "Unknown";
+    }
+}
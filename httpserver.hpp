@@ -0,0 +1,141 @@
+#ifndef HTTPSERVER_HPP
+#define HTTPSERVER_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <memory>
+#include <set>
+#include <cstdint>
+
+struct HttpRequest {
+    std::string method;
+    std::string path;  // without the query string, not decoded
+    std::unordered_map<std::string, std::string> query;    // decoded query parameters
+    std::unordered_map<std::string, std::string> headers;  // names in lower case
+
+    std::string param(const std::string& name, const std::string& def = "") const {
+        auto it = query.find(name);
+        return it != query.end() ? it->second : def;
+    }
+    std::string header(const std::string& name) const {
+        auto it = headers.find(name);
+        return it != headers.end() ? it->second : "";
+    }
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::string contentType = "application/json";
+    std::string body;
+    std::shared_ptr<const std::string> sharedBody;              // sent instead of body when set, for cached documents
+    std::vector<std::pair<std::string, std::string>> headers;  // extra headers
+    bool stream = false;              // keep the connection open as a text/event-stream, fed by HttpServer::broadcast()
+    std::set<std::string> topics;     // topics a stream receives, empty for all of them
+};
+
+/**
+ * @brief Defines the function signature for HTTP route handlers.
+ * Handlers run on the server thread, they must be quick and must not block.
+ */
+using HttpHandler = std::function<void(const HttpRequest&, HttpResponse&)>;
+
+/**
+ * @brief A small embedded HTTP/1.1 server for the JSON API.
+ *
+ * One thread serves every connection with poll(), with keep-alive and pipelining.
+ * Only GET and HEAD requests are served.
+ *
+ * Server-sent event streams get every broadcast() of their topics. Each stream has its own
+ * bounded queue; when a client reads slower than events arrive, the oldest ones are dropped and
+ * the client gets a "dropped" event telling it to reload its state.
+ */
+class HttpServer {
+   public:
+    HttpServer();
+    ~HttpServer();
+
+    /**
+     * @brief Subscribes a path to a handler.
+     * @param path Exact path (e.g. "/nodes"), or a prefix when it ends with '/' (e.g. "/node/").
+     * @param handler The function to execute for matching requests.
+     */
+    void subscribe(const std::string& path, HttpHandler handler);
+
+    /**
+     * @brief Binds the port and starts serving in a new thread.
+     * @return false if the socket could not be set up.
+     */
+    bool start(uint16_t port, const std::string& bindAddress = "0.0.0.0");
+
+    /**
+     * @brief Stops the server thread and closes every connection.
+     */
+    void stop();
+
+    /**
+     * @brief Sends an event to every open stream subscribed to the topic. Thread safe, does not block.
+     * @param topic SSE event name.
+     * @param data One line of data (JSON).
+     */
+    void broadcast(const std::string& topic, const std::string& data);
+
+    /**
+     * @brief Number of open event streams, publishers can skip building events when it is 0.
+     */
+    size_t streamCount() const { return streams; }
+
+    static std::string urlDecode(const std::string& s);
+
+   private:
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        size_t outOffset = 0;
+        bool closeAfterWrite = false;
+        uint64_t lastActive = 0;
+        // event stream state
+        bool streaming = false;
+        std::set<std::string> topics;
+        std::deque<std::shared_ptr<const std::string>> events;  // bounded, oldest dropped first
+        size_t dropped = 0;
+    };
+    struct Event {
+        std::string topic;
+        std::shared_ptr<const std::string> frame;
+    };
+
+    void run();
+    void acceptConnections();
+    bool readConnection(Connection& conn);   // false: close it
+    bool writeConnection(Connection& conn);  // false: close it
+    bool processRequests(Connection& conn);  // false: malformed request
+    void dispatch(const HttpRequest& request, HttpResponse& response);
+    void closeConnection(int fd);
+    void deliverEvents();
+    void fillStream(Connection& conn);
+    void wake();
+    static bool parseRequest(const std::string& head, HttpRequest& request);
+    static const char* statusText(int status);
+
+    std::unordered_map<std::string, HttpHandler> routes;
+    std::vector<std::pair<std::string, HttpHandler>> prefixRoutes;
+    std::unordered_map<int, Connection> connections;
+    int listenFd = -1;
+    int wakePipe[2] = {-1, -1};
+    std::thread serverThread;
+    std::atomic<bool> running{false};
+
+    std::mutex eventMtx;
+    std::deque<Event> pendingEvents;  // broadcast, not yet handed to the streams
+    size_t pendingDropped = 0;        // events lost before reaching the streams, the server thread was behind
+    std::atomic<size_t> streams{0};
+};
+
+#endif  // HTTPSERVER_HPP
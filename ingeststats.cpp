@@ -0,0 +1,77 @@
+#include "ingeststats.hpp"
+#include <algorithm>
+
+static const char* kindNames[] = {"meshmap_packets_received_total", "meshmap_packets_decoded_total", "meshmap_packets_handled_total"};
+static const char* kindHelp[] = {"MQTT packets received", "Packets decrypted and decoded, by portnum", "Decoded packets passed on to a callback, by portnum"};
+
+IngestStats& ingestStats() {
+    static IngestStats* instance = new IngestStats();
+    return *instance;
+}
+
+static std::string labelsOf(const std::string& client, const std::string& region) {
+    return "client=\"" + client + "\",region=\"" + region + "\"";
+}
+
+Counter IngestStats::received(const std::string& client, const std::string& region) {
+    return add(RECEIVED, client, region, labelsOf(client, region));
+}
+
+Counter IngestStats::decoded(const std::string& client, const std::string& region, uint32_t port) {
+    return add(DECODED, client, region, labelsOf(client, region) + ",port=\"" + std::to_string(port) + "\"");
+}
+
+Counter IngestStats::handled(const std::string& client, const std::string& region, uint32_t port) {
+    return add(HANDLED, client, region, labelsOf(client, region) + ",port=\"" + std::to_string(port) + "\"");
+}
+
+Counter IngestStats::add(Kind kind, const std::string& client, const std::string& region, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string key = std::string(kindNames[kind]) + "{" + labels + "}";
+    auto it = registered.find(key);
+    if (it != registered.end()) return it->second;
+    Counter counter = metrics().counter(kindNames[kind], labels, kindHelp[kind]);
+    registered[key] = counter;
+    if (!counter.valid()) return counter;
+
+    std::string rowKey = client + "/" + region;
+    auto row = rowIndex.find(rowKey);
+    if (row == rowIndex.end()) {
+        RegionStatsRecord record;
+        record.client = client;
+        record.region = region;
+        row = rowIndex.emplace(rowKey, rows.size()).first;
+        rows.push_back(record);
+    }
+    Entry entry;
+    entry.row = row->second;
+    entry.kind = kind;
+    entry.counter = counter;
+    entries.push_back(entry);
+    return counter;
+}
+
+std::vector<RegionStatsRecord> IngestStats::snapshot(uint64_t timeMs) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<Counter> counters;
+    counters.reserve(entries.size());
+    for (const Entry& entry : entries) counters.push_back(entry.counter);
+    std::vector<uint64_t> totals = metrics().values(counters);
+
+    std::vector<RegionStatsRecord> out = rows;
+    for (RegionStatsRecord& record : out) record.time = timeMs;
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry& entry = entries[i];
+        uint64_t delta = totals[i] - entry.last;
+        entry.last = totals[i];
+        RegionStatsRecord& record = out[entry.row];
+        if (entry.kind == RECEIVED)
+            record.received += delta;
+        else if (entry.kind == DECODED)
+            record.decoded += delta;
+        else
+            record.handled += delta;
+    }
+    std::sort(out.begin(), out.end(), [](const RegionStatsRecord& a, const RegionStatsRecord& b) { return a.client != b.client ? a.client < b.client : a.region < b.region; });
+    return out;
+}
@@ -0,0 +1,52 @@
+#ifndef INGESTSTATS_HPP
+#define INGESTSTATS_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include "metrics.hpp"
+#include "noderecords.hpp"
+
+/**
+ * @brief The MQTT ingest counters: packets received, decoded and handled by a callback, by client,
+ * modem region and portnum.
+ *
+ * They are metrics counters (meshmap_packets_*_total), counted on the calling thread's cells without
+ * a lock; the clients keep the handles. Nothing is ever reset: snapshot() returns what was counted
+ * since the previous snapshot as the difference of the totals, so no count is lost or counted twice
+ * while the callback threads keep counting.
+ */
+class IngestStats {
+   public:
+    // Registration is thread safe and returns the existing counter for the same labels.
+    Counter received(const std::string& client, const std::string& region);
+    Counter decoded(const std::string& client, const std::string& region, uint32_t port);
+    Counter handled(const std::string& client, const std::string& region, uint32_t port);
+
+    // Counts since the previous call by client and region (ports summed), sorted, time set to timeMs.
+    std::vector<RegionStatsRecord> snapshot(uint64_t timeMs);
+
+   private:
+    enum Kind { RECEIVED, DECODED, HANDLED };
+    struct Entry {
+        size_t row;  // into rows
+        Kind kind;
+        Counter counter;
+        uint64_t last = 0;  // total at the previous snapshot
+    };
+
+    Counter add(Kind kind, const std::string& client, const std::string& region, const std::string& labels);
+
+    std::mutex mtx;
+    std::vector<RegionStatsRecord> rows;                // client and region of the entries
+    std::unordered_map<std::string, size_t> rowIndex;   // by "<client>/<region>"
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, Counter> registered;  // by metric name and labels
+};
+
+// The ingest counters of the process, never destroyed like metrics().
+IngestStats& ingestStats();
+
+#endif  // INGESTSTATS_HPP
@@ -0,0 +1,206 @@
+#ifndef JSONREADER_HPP
+#define JSONREADER_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+/**
+ * @brief Minimal pull JSON reader over a buffer, the counterpart of JsonWriter.
+ *
+ * The caller walks the document with beginObject() / nextKey() and beginArray() / nextElement(),
+ * reads the values it wants and skipValue()s the rest, so no tree is built and skipped parts cost a
+ * single scan. Any syntax error, a missing or trailing comma included, makes every later call fail.
+ */
+class JsonReader {
+   public:
+    enum Type { NONE, OBJECT, ARRAY, STRING, NUMBER, BOOL, NUL };
+
+    JsonReader(const char* begin, const char* end) : p(begin), end(end) {}
+    explicit JsonReader(const std::string& text) : JsonReader(text.data(), text.data() + text.size()) {}
+
+    bool failed() const { return error; }
+
+    // Type of the next value.
+    Type peek() {
+        if (!skipSpace()) return NONE;
+        switch (*p) {
+            case '{': return OBJECT;
+            case '[': return ARRAY;
+            case '"': return STRING;
+            case 't':
+            case 'f': return BOOL;
+            case 'n': return NUL;
+            default: return (*p == '-' || (*p >= '0' && *p <= '9')) ? NUMBER : NONE;
+        }
+    }
+
+    bool beginObject() { return begin('{'); }
+    // Reads the next key of the current object, false at its end.
+    bool nextKey(std::string& key) {
+        if (!next('}')) return false;
+        if (!readString(key) || !expect(':')) return false;
+        return true;
+    }
+
+    bool beginArray() { return begin('['); }
+    // Moves to the next element of the current array, false at its end.
+    bool nextElement() { return next(']'); }
+
+    bool readString(std::string& out) {
+        if (!expect('"')) return false;
+        out.clear();
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out.push_back(*p++);
+                continue;
+            }
+            if (++p >= end) return fail();
+            char c = *p++;
+            switch (c) {
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!readHex4(cp)) return false;
+                    if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        p += 2;
+                        uint32_t low;
+                        if (!readHex4(low)) return false;
+                        cp = (low >= 0xDC00 && low < 0xE000) ? 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00) : 0xFFFD;
+                    }
+                    if (cp >= 0xD800 && cp < 0xE000) cp = 0xFFFD;  // unpaired surrogate
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default: out.push_back(c); break;  // \" \\ \/
+            }
+        }
+        if (p >= end) return fail();
+        p++;
+        return true;
+    }
+
+    bool readNumber(double& out) {
+        if (peek() != NUMBER) return fail();
+        const char* start = p;
+        while (p < end && isNumberChar(*p)) p++;
+        std::string text(start, p);
+        char* stop = nullptr;
+        out = strtod(text.c_str(), &stop);
+        return *stop == '\0' || fail();
+    }
+
+    // Skips the next value with everything inside it.
+    bool skipValue() {
+        switch (peek()) {
+            case STRING: return skipString();
+            case OBJECT:
+            case ARRAY: {
+                int depth = 0;
+                while (p < end) {
+                    char c = *p;
+                    if (c == '"') {
+                        if (!skipString()) return false;
+                        continue;
+                    }
+                    p++;
+                    if (c == '{' || c == '[') depth++;
+                    if ((c == '}' || c == ']') && --depth == 0) return true;
+                }
+                return fail();
+            }
+            case NUMBER:
+            case BOOL:
+            case NUL:
+                while (p < end && (isNumberChar(*p) || (*p >= 'a' && *p <= 'z'))) p++;
+                return true;
+            default: return fail();
+        }
+    }
+
+   private:
+    static bool isNumberChar(char c) { return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'; }
+
+    bool fail() {
+        error = true;
+        p = end;
+        return false;
+    }
+    bool skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+        return p < end && !error;
+    }
+    bool expect(char c) {
+        if (!skipSpace() || *p != c) return fail();
+        p++;
+        return true;
+    }
+    bool begin(char open) {
+        if (!expect(open)) return false;
+        first = true;
+        return true;
+    }
+    // Before a key or element: false (consumed) at the closing bracket. Every one but the first
+    // follows a comma, which is consumed.
+    bool next(char close) {
+        bool atFirst = first;
+        first = false;
+        if (!skipSpace()) return fail();
+        if (*p == close) {
+            p++;
+            return false;
+        }
+        if (atFirst) return true;
+        if (*p != ',') return fail();
+        p++;
+        return (skipSpace() && *p != close) || fail();
+    }
+    bool skipString() {
+        p++;  // opening quote
+        while (p < end && *p != '"') p += (*p == '\\') ? 2 : 1;
+        if (p >= end) return fail();
+        p++;
+        return true;
+    }
+    bool readHex4(uint32_t& out) {
+        if (end - p < 4) return fail();
+        out = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p++;
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= c - '0';
+            else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+            else return fail();
+        }
+        return true;
+    }
+    static void appendUtf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back((char)cp);
+        } else if (cp < 0x800) {
+            out.push_back((char)(0xC0 | (cp >> 6)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back((char)(0xE0 | (cp >> 12)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back((char)(0xF0 | (cp >> 18)));
+            out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    const char* p;
+    const char* end;
+    bool error = false;
+    bool first = false;  // the next key or element is the first of its object or array
+};
+
+#endif  // JSONREADER_HPP
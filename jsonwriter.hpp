@@ -0,0 +1,172 @@
+#ifndef JSONWRITER_HPP
+#define JSONWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <charconv>
+#include <cstring>
+
+/**
+ * @brief Minimal streaming JSON writer, appends straight into a std::string.
+ *
+ * Commas are inserted automatically. Floats and doubles are written in shortest round-trip form,
+ * non finite values become null.
+ */
+class JsonWriter {
+   public:
+    explicit JsonWriter(std::string& out) : out(out) {}
+
+    JsonWriter& beginObject() {
+        separator();
+        out.push_back('{');
+        first.push_back(true);
+        return *this;
+    }
+    JsonWriter& endObject() {
+        first.pop_back();
+        out.push_back('}');
+        return *this;
+    }
+    JsonWriter& beginArray() {
+        separator();
+        out.push_back('[');
+        first.push_back(true);
+        return *this;
+    }
+    JsonWriter& endArray() {
+        first.pop_back();
+        out.push_back(']');
+        return *this;
+    }
+
+    JsonWriter& key(const char* k) {
+        separator();
+        appendString(out, k);
+        out.push_back(':');
+        afterKey = true;
+        return *this;
+    }
+
+    JsonWriter& value(const std::string& v) {
+        separator();
+        appendString(out, v);
+        return *this;
+    }
+    JsonWriter& value(const char* v) {
+        separator();
+        if (v) {
+            appendString(out, v);
+        } else {
+            out.append("null");
+        }
+        return *this;
+    }
+    JsonWriter& value(bool v) {
+        separator();
+        out.append(v ? "true" : "false");
+        return *this;
+    }
+    JsonWriter& value(int v) { return integer(v); }
+    JsonWriter& value(unsigned int v) { return integer(v); }
+    JsonWriter& value(long v) { return integer(v); }
+    JsonWriter& value(unsigned long v) { return integer(v); }
+    JsonWriter& value(long long v) { return integer(v); }
+    JsonWriter& value(unsigned long long v) { return integer(v); }
+    JsonWriter& value(double v) {
+        separator();
+        if (!std::isfinite(v)) {
+            out.append("null");
+            return *this;
+        }
+        char buf[32];
+        auto res = std::to_chars(buf, buf + sizeof(buf), v);
+        out.append(buf, res.ptr);
+        return *this;
+    }
+    JsonWriter& value(float v) {
+        separator();
+        if (!std::isfinite(v)) {
+            out.append("null");
+            return *this;
+        }
+        char buf[32];
+        auto res = std::to_chars(buf, buf + sizeof(buf), v);  // shortest form that reads back as this float
+        out.append(buf, res.ptr);
+        return *this;
+    }
+    JsonWriter& null() {
+        separator();
+        out.append("null");
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter& field(const char* k, const T& v) {
+        key(k);
+        return value(v);
+    }
+
+    static void appendString(std::string& out, const std::string& s) { appendString(out, s.data(), s.size()); }
+    static void appendString(std::string& out, const char* s) { appendString(out, s, strlen(s)); }
+    static void appendString(std::string& out, const char* s, size_t len) {
+        static const char* hex_chars = "0123456789abcdef";
+        out.push_back('"');
+        for (size_t i = 0; i < len; i++) {
+            unsigned char c = s[i];
+            switch (c) {
+                case '"':
+                    out.append("\\\"");
+                    break;
+                case '\\':
+                    out.append("\\\\");
+                    break;
+                case '\n':
+                    out.append("\\n");
+                    break;
+                case '\r':
+                    out.append("\\r");
+                    break;
+                case '\t':
+                    out.append("\\t");
+                    break;
+                default:
+                    if (c <= 0x1F) {
+                        out.append("\\u00");
+                        out.push_back(hex_chars[(c >> 4) & 0x0F]);
+                        out.push_back(hex_chars[c & 0x0F]);
+                    } else {
+                        out.push_back(c);
+                    }
+            }
+        }
+        out.push_back('"');
+    }
+
+   private:
+    template <typename T>
+    JsonWriter& integer(T v) {
+        separator();
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), v);
+        out.append(buf, res.ptr);
+        return *this;
+    }
+
+    void separator() {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (first.empty()) return;
+        if (!first.back()) out.push_back(',');
+        first.back() = false;
+    }
+
+    std::string& out;
+    std::vector<bool> first;
+    bool afterKey = false;
+};
+
+#endif  // JSONWRITER_HPP
@@ -0,0 +1,87 @@
+#include "latency.hpp"
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+static const char* stageNames[] = {"envelope", "decrypt_default_l1", "decrypt_default_channel", "payload", "on_message", "on_position", "on_nodeinfo", "on_waypoint", "on_telemetry_device", "on_telemetry_environment", "on_traceroute", "on_neighborinfo", "db_write", "db_enqueue", "notifier_enqueue"};
+static_assert(sizeof(stageNames) / sizeof(stageNames[0]) == (size_t)LatencyStage::Count, "a name for every stage");
+
+const char* latencyStageName(LatencyStage stage) {
+    return stage < LatencyStage::Count ? stageNames[(size_t)stage] : "unknown";
+}
+
+#if MESHMAP_LATENCY
+
+static LogHistogram stageHistogram(LatencyStage stage) {
+    return metrics().logHistogram("meshmap_stage_seconds", "stage=\"" + std::string(latencyStageName(stage)) + "\"", "Time spent in a stage of the packet path, since start", 1e-9);
+}
+
+const LogHistogram latencyHistograms[(size_t)LatencyStage::Count] = {
+    stageHistogram(LatencyStage::Envelope),
+    stageHistogram(LatencyStage::DecryptDefaultL1),
+    stageHistogram(LatencyStage::DecryptDefaultChannel),
+    stageHistogram(LatencyStage::Payload),
+    stageHistogram(LatencyStage::OnMessage),
+    stageHistogram(LatencyStage::OnPosition),
+    stageHistogram(LatencyStage::OnNodeInfo),
+    stageHistogram(LatencyStage::OnWaypoint),
+    stageHistogram(LatencyStage::OnTelemetryDevice),
+    stageHistogram(LatencyStage::OnTelemetryEnvironment),
+    stageHistogram(LatencyStage::OnTraceroute),
+    stageHistogram(LatencyStage::OnNeighborInfo),
+    stageHistogram(LatencyStage::DbWrite),
+    stageHistogram(LatencyStage::DbEnqueue),
+    stageHistogram(LatencyStage::NotifierEnqueue),
+};
+
+static std::string formatNs(double ns) {
+    char buf[32];
+    if (ns < 1000)
+        snprintf(buf, sizeof(buf), "%.0f ns", ns);
+    else if (ns < 1e6)
+        snprintf(buf, sizeof(buf), "%.1f us", ns / 1e3);
+    else if (ns < 1e9)
+        snprintf(buf, sizeof(buf), "%.1f ms", ns / 1e6);
+    else
+        snprintf(buf, sizeof(buf), "%.2f s", ns / 1e9);
+    return buf;
+}
+
+std::string latencyReport(bool reset) {
+    static std::mutex mtx;
+    static std::vector<std::vector<uint64_t>> baseline((size_t)LatencyStage::Count);  // bucket counts at the last reset
+    std::lock_guard<std::mutex> lock(mtx);
+
+    char row[160];
+    snprintf(row, sizeof(row), "%-26s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "mean", "p50", "p90", "p99", "p99.9");
+    std::string out = row;
+    for (size_t s = 0; s < (size_t)LatencyStage::Count; s++) {
+        std::vector<uint64_t> counts = metrics().buckets(latencyHistograms[s]);
+        std::vector<uint64_t> current = counts;
+        if (baseline[s].size() == counts.size()) {
+            for (size_t i = 0; i < counts.size(); i++) counts[i] -= baseline[s][i];
+        }
+        if (reset) baseline[s] = current;
+        uint64_t count = 0;
+        for (uint32_t i = 0; i < LogHistogram::BUCKETS; i++) count += counts[i];
+        if (count == 0) {
+            snprintf(row, sizeof(row), "%-26s %10d %10s %10s %10s %10s %10s\n", stageNames[s], 0, "-", "-", "-", "-", "-");
+        } else {
+            snprintf(row, sizeof(row), "%-26s %10" PRIu64 " %10s %10s %10s %10s %10s\n", stageNames[s], count, formatNs((double)counts[LogHistogram::BUCKETS] / count).c_str(),
+                     formatNs(LogHistogram::quantile(counts, 0.5)).c_str(), formatNs(LogHistogram::quantile(counts, 0.9)).c_str(), formatNs(LogHistogram::quantile(counts, 0.99)).c_str(),
+                     formatNs(LogHistogram::quantile(counts, 0.999)).c_str());
+        }
+        out += row;
+    }
+    if (reset) out += "Counts reset, the next report starts from here\n";
+    return out;
+}
+
+#else
+
+std::string latencyReport(bool) {
+    return "Latency probes are compiled out (MESHMAP_LATENCY=0)\n";
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <string>
+#include <cstdint>
+
+// Per stage timing of the packet path. Build with MESHMAP_LATENCY=0 (cmake -DMESHMAP_LATENCY=OFF) and
+// every LATENCY_SCOPE compiles to nothing.
+#ifndef MESHMAP_LATENCY
+#define MESHMAP_LATENCY 1
+#endif
+
+// Stages nest: a callback's time includes its database writes and notifier enqueues.
+enum class LatencyStage : uint8_t {
+    Envelope,          // ServiceEnvelope decode
+    DecryptDefaultL1,  // one decryption attempt and the Data decode checking it, per key
+    DecryptDefaultChannel,
+    Payload,  // decode of the port's protobuf
+    OnMessage,
+    OnPosition,
+    OnNodeInfo,
+    OnWaypoint,
+    OnTelemetryDevice,
+    OnTelemetryEnvironment,
+    OnTraceroute,
+    OnNeighborInfo,
+    DbWrite,          // a database write on the packet path, waiting for the lock included
+    DbEnqueue,        // a node update merged into the pending map, written later by NodeDb::flushNodeUpdates()
+    NotifierEnqueue,  // a line queued to a notifier
+    Count
+};
+
+const char* latencyStageName(LatencyStage stage);
+
+// Count, mean and percentiles of every stage observed since start or the last reset, for the console.
+std::string latencyReport(bool reset = false);
+
+#if MESHMAP_LATENCY
+#include <chrono>
+#include "metrics.hpp"
+
+// meshmap_stage_seconds{stage="..."}, in nanoseconds.
+extern const LogHistogram latencyHistograms[(size_t)LatencyStage::Count];
+
+class LatencyScope {
+   public:
+    explicit LatencyScope(LatencyStage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~LatencyScope() { latencyHistograms[(size_t)stage].observe(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()); }
+    LatencyScope(const LatencyScope&) = delete;
+    LatencyScope& operator=(const LatencyScope&) = delete;
+
+   private:
+    LatencyStage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define LATENCY_CONCAT_(a, b) a##b
+#define LATENCY_CONCAT(a, b) LATENCY_CONCAT_(a, b)
+// Times the rest of the enclosing block as stage.
+#define LATENCY_SCOPE(stage) LatencyScope LATENCY_CONCAT(latencyScope, __LINE__)(stage)
+#else
+#define LATENCY_SCOPE(stage) ((void)0)
+#endif
+
+#endif  // LATENCY_HPP
@@ -0,0 +1,216 @@
+#include "logger.hpp"
+#include "CommandInterpreter.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdarg>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <sys/stat.h>
+
+#define LOG_WRITER_PERIOD_MS 20  // the writer's sleep when the rings are empty
+
+namespace logdetail {
+
+void appendFormatted(std::string& out, const char* format, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) return;
+    if ((size_t)len < sizeof(buf)) {
+        out.append(buf, len);
+        return;
+    }
+    size_t at = out.size();
+    out.resize(at + len + 1);
+    va_start(args, format);
+    vsnprintf(&out[at], len + 1, format, args);
+    va_end(args);
+    out.resize(at + len);
+}
+
+}  // namespace logdetail
+
+Logger& logger() {
+    static Logger* instance = new Logger();
+    return *instance;
+}
+
+namespace {
+
+thread_local bool ringReleased = false;  // trivially destructible, readable while the other thread_locals are torn down
+
+// Hands the thread's ring to the writer when the thread exits.
+struct RingOwner {
+    LogRing* ring = nullptr;
+    ~RingOwner() {
+        ringReleased = true;
+        if (ring) ring->orphaned.store(true, std::memory_order_release);
+    }
+};
+
+const char* levelName(uint8_t level) {
+    static const char* names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+    return level <= LOG_LEVEL_ERROR ? names[level] : "?";
+}
+
+// Lines are written as printed before: trailing "\r\n" or none at all become one "\n".
+void appendLine(std::string& out, const std::string& text) {
+    size_t end = text.size();
+    while (end > 0 && (text[end - 1] == '\n' || text[end - 1] == '\r')) end--;
+    out.append(text, 0, end);
+    out += '\n';
+}
+
+}  // namespace
+
+LogRing* Logger::threadRing() {
+    if (ringReleased) return nullptr;
+    thread_local RingOwner owner;
+    if (!owner.ring) {
+        owner.ring = new LogRing();
+        attach(owner.ring);
+    }
+    return owner.ring;
+}
+
+void Logger::attach(LogRing* ring) {
+    std::lock_guard<std::mutex> lock(ringsMtx);
+    rings.push_back(ring);
+}
+
+bool Logger::setFile(const std::string& path, uint64_t maxBytes, uint32_t keep) {
+    std::lock_guard<std::mutex> lock(fileMtx);
+    if (file) fclose(file);
+    file = fopen(path.c_str(), "a");
+    if (!file) {
+        std::cerr << "Logger: can't open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    fileBytes = stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    filePath = path;
+    fileMaxBytes = maxBytes;
+    fileKeep = keep;
+    return true;
+}
+
+void Logger::start() {
+    if (running.exchange(true)) return;
+    writer = std::thread(&Logger::run, this);
+}
+
+void Logger::stop() {
+    if (!running.exchange(false)) return;
+    if (writer.joinable()) writer.join();
+    std::vector<Pending> batch;
+    drain(batch);  // what was queued while the writer finished
+    writeBatch(batch);
+}
+
+uint64_t Logger::dropped() {
+    std::lock_guard<std::mutex> lock(ringsMtx);
+    uint64_t total = droppedRetired;
+    for (LogRing* ring : rings) total += ring->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+void Logger::run() {
+    std::vector<Pending> batch;
+    uint64_t droppedReported = 0;
+    while (running.load()) {
+        if (drain(batch) == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITER_PERIOD_MS));
+            continue;
+        }
+        uint64_t lost = dropped();
+        if (lost > droppedReported) {
+            Pending note{clockNs(), LOG_LEVEL_WARN, ""};
+            logdetail::appendFormatted(note.text, "Logger: %" PRIu64 " line(s) dropped, a thread logged faster than they could be written", lost - droppedReported);
+            batch.push_back(std::move(note));
+            droppedReported = lost;
+        }
+        writeBatch(batch);
+    }
+}
+
+size_t Logger::drain(std::vector<Pending>& batch) {
+    batch.clear();
+    std::lock_guard<std::mutex> lock(ringsMtx);
+    for (auto it = rings.begin(); it != rings.end();) {
+        LogRing* ring = *it;
+        bool orphaned = ring->orphaned.load(std::memory_order_acquire);  // before head: the thread's last records are seen
+        uint32_t head = ring->head.load(std::memory_order_acquire);
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail != head; tail++) {
+            const LogRecord& record = ring->records[tail % LOG_RING_RECORDS];
+            Pending line{record.timeNs, record.level, ""};
+            record.formatFn(record.format, record.data, line.text);
+            batch.push_back(std::move(line));
+        }
+        ring->tail.store(tail, std::memory_order_release);
+        if (orphaned) {
+            droppedRetired += ring->dropped.load(std::memory_order_relaxed);
+            delete ring;
+            it = rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::stable_sort(batch.begin(), batch.end(), [](const Pending& a, const Pending& b) { return a.timeNs < b.timeNs; });
+    return batch.size();
+}
+
+void Logger::writeNow(uint8_t level, uint64_t timeNs, const std::string& text) {
+    std::vector<Pending> batch;
+    batch.push_back({timeNs, level, text});
+    writeBatch(batch);
+}
+
+void Logger::writeBatch(std::vector<Pending>& batch) {
+    if (batch.empty()) return;
+    std::string console;
+    for (const Pending& line : batch) appendLine(console, line.text);
+    console_write(console);
+
+    std::lock_guard<std::mutex> lock(fileMtx);
+    if (!file) return;
+    // monotonic to wall clock, taken per batch so a clock step shows up in the next one
+    int64_t offsetNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - (int64_t)clockNs();
+    std::string text;
+    for (const Pending& line : batch) {
+        int64_t wallNs = (int64_t)line.timeNs + offsetNs;
+        time_t seconds = wallNs / 1000000000;
+        struct tm tmLocal;
+        localtime_r(&seconds, &tmLocal);
+        char stamp[48];
+        size_t len = strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tmLocal);
+        snprintf(stamp + len, sizeof(stamp) - len, ".%03d %-5s ", (int)(wallNs / 1000000 % 1000), levelName(line.level));
+        text = stamp;
+        appendLine(text, line.text);
+        writeFile(text);
+    }
+    if (file) fflush(file);
+}
+
+void Logger::writeFile(const std::string& line) {
+    if (fileMaxBytes && fileBytes > 0 && fileBytes + line.size() > fileMaxBytes) rotate();
+    if (!file) return;
+    fwrite(line.data(), 1, line.size(), file);
+    fileBytes += line.size();
+}
+
+void Logger::rotate() {
+    fclose(file);
+    if (fileKeep == 0) {
+        remove(filePath.c_str());
+    } else {
+        for (uint32_t i = fileKeep - 1; i >= 1; i--) rename((filePath + "." + std::to_string(i)).c_str(), (filePath + "." + std::to_string(i + 1)).c_str());
+        rename(filePath.c_str(), (filePath + ".1").c_str());
+    }
+    file = fopen(filePath.c_str(), "a");
+    fileBytes = 0;
+    if (!file) std::cerr << "Logger: can't reopen " << filePath << " after rotating it" << std::endl;
+}
@@ -0,0 +1,236 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <tuple>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+// Calls below this level are compiled out (cmake -DMESHMAP_LOG_LEVEL=DEBUG keeps them all).
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_RECORDS 1024  // per logging thread, a full ring drops the new lines
+#define LOG_RECORD_SIZE 256    // bytes of a record, arguments and copied strings included
+
+class Logger;
+
+namespace logdetail {
+
+using FormatFn = void (*)(const char* format, const uint8_t* data, std::string& out);
+
+// Plain values are copied as they are and passed back to snprintf when the line is written.
+template <typename T>
+struct Arg {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value, "log arguments are numbers, enums, pointers or C strings");
+    static constexpr size_t fixed = sizeof(T);
+    static void encode(uint8_t*& dst, const uint8_t*, T value) {
+        memcpy(dst, &value, sizeof(T));
+        dst += sizeof(T);
+    }
+    static T decode(const uint8_t*& src) {
+        T value;
+        memcpy(&value, src, sizeof(T));
+        src += sizeof(T);
+        return value;
+    }
+};
+
+// C strings are copied at the call, the caller's buffer may be gone when the line is written. Long ones
+// are cut to the room the record has left.
+template <>
+struct Arg<const char*> {
+    static constexpr size_t fixed = 3;  // length and terminator
+    static void encode(uint8_t*& dst, const uint8_t* end, const char* value) {
+        if (!value) value = "(null)";
+        size_t len = strnlen(value, end - dst - fixed);
+        uint16_t stored = (uint16_t)len;
+        memcpy(dst, &stored, 2);
+        memcpy(dst + 2, value, len);
+        dst[2 + len] = 0;
+        dst += fixed + len;
+    }
+    static const char* decode(const uint8_t*& src) {
+        uint16_t len;
+        memcpy(&len, src, 2);
+        const char* value = (const char*)src + 2;
+        src += 3 + len;
+        return value;
+    }
+};
+template <>
+struct Arg<char*> : Arg<const char*> {};
+
+template <typename T>
+using ArgOf = Arg<typename std::decay<T>::type>;
+
+// Bytes the arguments take at least, with every string empty.
+template <typename... Args>
+constexpr size_t fixedSize() {
+    return (size_t(0) + ... + ArgOf<Args>::fixed);
+}
+
+inline void encodeArgs(uint8_t*&, const uint8_t*) {}
+template <typename T, typename... Rest>
+void encodeArgs(uint8_t*& dst, const uint8_t* end, const T& first, const Rest&... rest) {
+    ArgOf<T>::encode(dst, end - fixedSize<Rest...>(), first);  // a string leaves the room the others need
+    encodeArgs(dst, end, rest...);
+}
+
+void appendFormatted(std::string& out, const char* format, ...);
+
+template <typename... Args>
+void formatRecord(const char* format, const uint8_t* data, std::string& out) {
+    const uint8_t* src = data;
+    (void)src;
+    std::tuple<decltype(ArgOf<Args>::decode(src))...> values{ArgOf<Args>::decode(src)...};  // braces: decoded left to right
+    std::apply([&](auto... v) { appendFormatted(out, format, v...); }, values);
+}
+
+// Never called, lets the compiler check the format against the arguments.
+inline void checkFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+inline void checkFormat(const char*, ...) {}
+
+}  // namespace logdetail
+
+struct LogRecord {
+    uint64_t timeNs;  // Logger::clockNs()
+    const char* format;
+    logdetail::FormatFn formatFn;
+    uint8_t level;
+    uint8_t data[LOG_RECORD_SIZE - 2 * sizeof(uint64_t) - sizeof(void*) - 8];
+};
+
+// One logging thread's records, written by that thread only and read by the writer thread.
+struct LogRing {
+    LogRecord records[LOG_RING_RECORDS];
+    alignas(64) std::atomic<uint32_t> head{0};  // next record to fill, owner thread
+    uint32_t cachedTail = 0;                    // owner thread's last look at tail
+    std::atomic<uint64_t> dropped{0};           // owner thread
+    alignas(64) std::atomic<uint32_t> tail{0};  // next record to write out, writer thread
+    std::atomic<bool> orphaned{false};          // the thread exited, freed once drained
+};
+
+/**
+ * @brief Asynchronous leveled logger.
+ *
+ * A LOG_* call copies the format (a string literal), the arguments and a timestamp into the
+ * calling thread's ring, lock free, and returns; the line is formatted and printed by the writer
+ * thread, which owns the console (see console_write()) and the optional log file with size based
+ * rotation. Lines from several threads are written in time order per batch.
+ *
+ * Until start() and after stop() the lines are written synchronously on the calling thread.
+ */
+class Logger {
+   public:
+    Logger() = default;
+    ~Logger() { stop(); }
+
+    // maxBytes 0 never rotates, keep is the number of old files (path.1 ... path.keep).
+    bool setFile(const std::string& path, uint64_t maxBytes, uint32_t keep);
+    void start();
+    void stop();  // writes out what is queued
+    uint64_t dropped();
+
+    template <typename... Args>
+    void log(uint8_t level, const char* format, const Args&... args) {
+        static_assert(logdetail::fixedSize<Args...>() <= sizeof(LogRecord::data), "too many log arguments for a record");
+        uint64_t now = clockNs();
+        LogRing* ring = running.load(std::memory_order_relaxed) ? threadRing() : nullptr;
+        if (!ring) {  // not started, stopped, or the thread is exiting
+            uint8_t data[sizeof(LogRecord::data)];
+            uint8_t* dst = data;
+            logdetail::encodeArgs(dst, data + sizeof(data), args...);
+            std::string line;
+            logdetail::formatRecord<Args...>(format, data, line);
+            writeNow(level, now, line);
+            return;
+        }
+        uint32_t head = ring->head.load(std::memory_order_relaxed);
+        if (head - ring->cachedTail >= LOG_RING_RECORDS) {
+            ring->cachedTail = ring->tail.load(std::memory_order_acquire);
+            if (head - ring->cachedTail >= LOG_RING_RECORDS) {
+                ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        LogRecord& record = ring->records[head % LOG_RING_RECORDS];
+        record.timeNs = now;
+        record.format = format;
+        record.formatFn = &logdetail::formatRecord<Args...>;
+        record.level = level;
+        uint8_t* dst = record.data;
+        logdetail::encodeArgs(dst, record.data + sizeof(record.data), args...);
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+   private:
+    struct Pending {
+        uint64_t timeNs;
+        uint8_t level;
+        std::string text;
+    };
+
+    // The coarse monotonic clock: a few ns instead of tens, and its ms resolution is what the file shows.
+    static uint64_t clockNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+    LogRing* threadRing();  // nullptr once the thread's ring is released
+
+    void attach(LogRing* ring);
+    void run();
+    size_t drain(std::vector<Pending>& batch);
+    void writeNow(uint8_t level, uint64_t timeNs, const std::string& text);
+    void writeBatch(std::vector<Pending>& batch);
+    void writeFile(const std::string& line);  // fileMtx must be held
+    void rotate();                             // fileMtx must be held
+
+    std::atomic<bool> running{false};
+    std::thread writer;
+
+    std::mutex ringsMtx;
+    std::vector<LogRing*> rings;
+    uint64_t droppedRetired = 0;  // of the freed rings
+
+    std::mutex fileMtx;
+    FILE* file = nullptr;
+    std::string filePath;
+    uint64_t fileBytes = 0;
+    uint64_t fileMaxBytes = 0;
+    uint32_t fileKeep = 0;
+};
+
+// The logger of the process, never destroyed: threads outliving main() may still log.
+Logger& logger();
+
+#define LOG_AT(level, ...)                              \
+    do {                                                \
+        if (false) logdetail::checkFormat(__VA_ARGS__); \
+        logger().log(level, __VA_ARGS__);               \
+    } while (0)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif  // LOGGER_HPP
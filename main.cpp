@@ -20,6 +20,16 @@
 #include "nodenamemap.hpp"
 #include "meshcoredown.hpp"
 #include "discord.hpp"
+#include "nodestore.hpp"
+#include "httpserver.hpp"
+#include "httpdispatcher.hpp"
+#include "webapi.hpp"
+#include "eventrouter.hpp"
+#include "mqttsink.hpp"
+#include "latency.hpp"
+#include "logger.hpp"
+#include "ingeststats.hpp"
+#include "metrics.hpp"
 
 #include "config.hpp"
 
@@ -29,8 +39,8 @@
 #include "CommandInterpreter.hpp"
 #endif
 
-MessageIdTracker messageIdTracker;
-MessageIdTracker messageIdTrackerTelemetry;
+MessageIdTracker messageIdTracker("chat");
+MessageIdTracker messageIdTrackerTelemetry("telemetry");
 NodeNameMap nodeNameMap;
 
 std::atomic<bool> running(true);
@@ -38,12 +48,23 @@ std::atomic<bool> running(true);
 MeshMqttClient localClient;
 MeshMqttClient mainClient;
 NodeDb nodeDb("nodes.db");
-TelegramPoster telegramPoster;
-DiscordBot discordBot868(DISCORD_LOG_868);
-DiscordBot discordBot433(DISCORD_LOG_433);
-MeshCoreDown meshcoreDown;
+NodeStore nodeStore;
+HttpServer httpServer;
+WebApi webApi(nodeStore, nodeDb);
+HttpDispatcher httpDispatcher;  // outbound HTTP of the notifiers, declared before them
+TelegramPoster telegramPoster(httpDispatcher);
+DiscordBot discordBot868(httpDispatcher, DISCORD_LOG_868, "discord868");
+DiscordBot discordBot433(httpDispatcher, DISCORD_LOG_433, "discord433");
+MeshCoreDown meshcoreDown(httpDispatcher);
+EventRouter eventRouter;
 time_t lastHourlyReset = 0;
 
+std::vector<Notifier*> allNotifiers() {
+    std::vector<Notifier*> notifiers = {&telegramPoster, &discordBot868, &discordBot433};
+    for (Notifier* notifier : meshcoreDown.getNotifiers()) notifiers.push_back(notifier);
+    return notifiers;
+}
+
 #ifdef USECONSOLE
 // --- Command Callback Functions ---
 void cmd_help(const std::string& parameters) {
@@ -53,6 +74,9 @@ void cmd_help(const std::string& parameters) {
     safe_printf("  send4 <node_id_hex> <message> - Sends a text message\n");
     safe_printf("  send8 <node_id_hex> <message> - Sends a text message\n");
     safe_printf("  nodeinfo                     - Send my nodeinfo\n");
+    safe_printf("  search <words>               - Search the chat history\n");
+    safe_printf("  notify                       - Notifier queues and rate limits\n");
+    safe_printf("  latency [reset]              - Packet path stage times since start or the last reset\n");
     safe_printf("  exit                         - Exits the application\n");
 }
 
@@ -122,11 +146,41 @@ void cmd_nodeinfo(const std::string& parameters) {
     std::string shortname = "INFO";
     std::string longname = "Hungarian Info Node";
     std::string rootTopic = "msh/EU_868/HU";
-    localClient.sendMeshtasticNodeinfo(0xabbababa, shortname, longname, rootTopic);
+    localClient.sendMeshtasticNodeinfo(MQTT_NODE_ID, shortname, longname, rootTopic);
     rootTopic = "msh/EU_433/HU";
-    localClient.sendMeshtasticNodeinfo(0xabbababa, shortname, longname, rootTopic);
+    localClient.sendMeshtasticNodeinfo(MQTT_NODE_ID, shortname, longname, rootTopic);
     rootTopic = "msh/EU_868";
-    mainClient.sendMeshtasticNodeinfo(0xabbababa, shortname, longname, rootTopic);
+    mainClient.sendMeshtasticNodeinfo(MQTT_NODE_ID, shortname, longname, rootTopic);
+}
+
+void cmd_search(const std::string& parameters) {
+    if (parameters.empty()) {
+        safe_printf("Usage: search <words>\n");
+        return;
+    }
+    ChatSearchQuery query;
+    query.text = parameters;
+    query.limit = 20;
+    std::vector<ChatSearchResult> results = nodeDb.searchChat(query);
+    for (const ChatSearchResult& r : results) {
+        time_t t = r.timestamp / 1000;
+        char timeStr[32];
+        strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+        safe_printf("[%s] %u %s: %s\n", timeStr, r.freq, nodeNameMap.getNodeName(r.nodeId).c_str(), r.message.c_str());
+    }
+    safe_printf("%zu result(s)\n", results.size());
+}
+
+void cmd_notify(const std::string& parameters) {
+    for (Notifier* notifier : allNotifiers()) {
+        NotifierStats s = notifier->stats();
+        safe_printf("%-13s queued %zu, sent %" PRIu64 ", retries %" PRIu64 ", rate limited %" PRIu64 ", failed %" PRIu64 ", dropped %" PRIu64 ", throttled %" PRIu64 " s\n", notifier->getName().c_str(), s.queued, s.sent, s.retries, s.rateLimited, s.failed, s.dropped, s.throttledMs / 1000);
+    }
+    safe_printf("HTTP calls pending: %zu\n", httpDispatcher.pending());
+}
+
+void cmd_latency(const std::string& parameters) {
+    safe_printf("%s", latencyReport(parameters == "reset").c_str());
 }
 
 void cmd_exit(const std::string& parameters) {
@@ -136,30 +190,107 @@ void cmd_exit(const std::string& parameters) {
 
 #endif
 
+std::string channelName(uint8_t chanHash) {
+    if (chanHash == 0 || chanHash == 8) return "LongFast";
+    if (chanHash == 31) return "MediFast";
+    if (chanHash == 92) return "Hungary ";
+    return "Unknown";
+}
+
+MeshEvent makeEvent(EventType type, uint16_t port, const MC_Header& header, const std::string& text) {
+    MeshEvent event;
+    event.type = type;
+    event.freq = header.freq;
+    event.chanHash = header.chan_hash;
+    event.port = port;
+    event.node = header.srcnode;
+    event.nodeName = nodeNameMap.getNodeName(header.srcnode);
+    event.channel = channelName(header.chan_hash);
+    event.text = text;
+    event.emoji = header.emoji;
+    event.timeMs = header.rx_time_ms;
+    return event;
+}
+
+// Gauges and totals kept by the components themselves, read when /metrics is scraped.
+void registerMetrics() {
+    Metrics& m = metrics();
+    // one stats() snapshot per notifier and scrape: the first family takes them, and scrape() runs the
+    // families in registration order under its lock, so the others read that same snapshot
+    std::vector<Notifier*> notifiers = allNotifiers();
+    auto snapshot = std::make_shared<std::vector<NotifierStats>>(notifiers.size());
+    auto notifierSeries = [&m, notifiers, snapshot](const char* name, const char* help, Metrics::Type type, bool refresh, double (*value)(const NotifierStats&)) {
+        m.callbackSeries(name, help, type, [notifiers, snapshot, refresh, value](std::vector<std::pair<std::string, double>>& out) {
+            for (size_t i = 0; i < notifiers.size(); i++) {
+                if (refresh) (*snapshot)[i] = notifiers[i]->stats();
+                out.push_back({"notifier=\"" + notifiers[i]->getName() + "\"", value((*snapshot)[i])});
+            }
+        });
+    };
+    notifierSeries("meshmap_notifier_queued_lines", "Lines waiting to be posted", Metrics::GAUGE, true, [](const NotifierStats& s) { return (double)s.queued; });
+    notifierSeries("meshmap_notifier_posts_total", "Posts delivered", Metrics::COUNTER, false, [](const NotifierStats& s) { return (double)s.sent; });
+    notifierSeries("meshmap_notifier_retries_total", "Posts sent again after a failure or rate limit", Metrics::COUNTER, false, [](const NotifierStats& s) { return (double)s.retries; });
+    notifierSeries("meshmap_notifier_rate_limited_total", "429 answers", Metrics::COUNTER, false, [](const NotifierStats& s) { return (double)s.rateLimited; });
+    notifierSeries("meshmap_notifier_failed_total", "Posts given up", Metrics::COUNTER, false, [](const NotifierStats& s) { return (double)s.failed; });
+    notifierSeries("meshmap_notifier_dropped_lines_total", "Lines lost to a full queue", Metrics::COUNTER, false, [](const NotifierStats& s) { return (double)s.dropped; });
+    notifierSeries("meshmap_notifier_throttled_seconds_total", "Time lines waited for the rate limit", Metrics::COUNTER, false, [](const NotifierStats& s) { return s.throttledMs / 1000.0; });
+    m.callback("meshmap_http_calls_pending", "", "Outbound HTTP calls queued or in flight", Metrics::GAUGE, []() { return (double)httpDispatcher.pending(); });
+    m.callback("meshmap_log_dropped_lines_total", "", "Log lines dropped on a full ring", Metrics::COUNTER, []() { return (double)logger().dropped(); });
+    m.callback("meshmap_db_pending_node_updates", "", "Nodes with updates waiting for the next flush", Metrics::GAUGE, []() { return (double)nodeDb.pendingNodeUpdates(); });
+    m.callback("meshmap_event_streams", "", "Open server-sent event streams", Metrics::GAUGE, []() { return (double)httpServer.streamCount(); });
+    m.callback("meshmap_nodes", "", "Nodes in the in-memory store", Metrics::GAUGE, []() { return (double)nodeStore.nodeCount(); });
+    // one walk of the store per scrape for all its parts
+    m.callbackSeries("meshmap_cache_bytes", "Approximate heap use of the in-memory caches", Metrics::GAUGE, [](std::vector<std::pair<std::string, double>>& out) {
+        StoreMemory memory = nodeStore.memoryUsage();
+        out.push_back({"cache=\"store_nodes\"", (double)memory.nodes});
+        out.push_back({"cache=\"store_links\"", (double)memory.links});
+        out.push_back({"cache=\"store_chat\"", (double)memory.chat});
+        out.push_back({"cache=\"store_telemetry\"", (double)memory.telemetry});
+        out.push_back({"cache=\"store_indexes\"", (double)memory.indexes});
+    });
+    m.callback("meshmap_cache_bytes", "cache=\"node_names\"", "Approximate heap use of the in-memory caches", Metrics::GAUGE, []() { return (double)nodeNameMap.memoryUsage(); });
+}
+
+// Sinks and the routes to them. routes.conf replaces the default routes when present.
+void setupEventRouter() {
+    eventRouter.addSink("telegram", std::unique_ptr<EventSink>(new NotifierSink(telegramPoster, "{freq}# {name}:  {text}")));
+    eventRouter.addSink("discord868", std::unique_ptr<EventSink>(new NotifierSink(discordBot868, "{chan}# {name}:  {emoji}{text}")));
+    eventRouter.addSink("discord433", std::unique_ptr<EventSink>(new NotifierSink(discordBot433, "{chan}# {name}:  {emoji}{text}")));
+    eventRouter.addSink("mqtt868", std::unique_ptr<EventSink>(new MqttSink(mainClient, MQTT_NODE_ID, "msh/EU_868", 2, "{name}: {text}")));
+    if (strlen(EVENT_LOG_FILE) > 0) eventRouter.addSink("file", std::unique_ptr<EventSink>(new FileSink(EVENT_LOG_FILE, "{freq} {chan} {type} {node} {name}: {emoji}{text}")));
+
+    if (access(ROUTES_FILE, R_OK) == 0) {
+        safe_printf("Loaded %zu route(s) from %s\n", eventRouter.loadRoutes(ROUTES_FILE), ROUTES_FILE);
+    } else {
+        eventRouter.addRoute("telegram type=chat");
+        eventRouter.addRoute("discord868 type=chat freq=868");
+        eventRouter.addRoute("discord433 type=chat freq=433");
+    }
+    eventRouter.compile();
+}
+
 void m_on_message(MC_Header& header, MC_TextMessage& message) {
     if (messageIdTracker.check(header.packet_id)) {
         return;
     }
     nodeNameMap.incrementMessageCount(header.srcnode);
-    safe_printf("Message from node 0x%08" PRIx32 ": %s\n", header.srcnode, message.text.c_str());
+    LOG_DEBUG("Message from node 0x%08" PRIx32 ": %s\n", header.srcnode, message.text.c_str());
     if (message.text.find("seq ", 0) == 0) {
         // return;
     }
     std::string emojiStr = header.emoji ? "(EMOJI) " : "";
-    nodeDb.saveChatMessage(header.srcnode, header.chan_hash, emojiStr + message.text, header.freq);
-
-    std::string chanstr = "Unknown";
-    if (header.chan_hash == 0) chanstr = "LongFast";
-    if (header.chan_hash == 8) chanstr = "LongFast";
-    if (header.chan_hash == 31) chanstr = "MediFast";
-    if (header.chan_hash == 92) chanstr = "Hungary ";
-
-    std::string telegramMessage = std::to_string(header.freq) + "# " + nodeNameMap.getNodeName(header.srcnode) + ":  " + message.text;
-    std::string discordMessage = chanstr + "# " + nodeNameMap.getNodeName(header.srcnode) + ":  " + emojiStr + message.text;
-    safe_printf("MSG: %s\n", telegramMessage.c_str());
-    telegramPoster.queueMessage(telegramMessage);
-    if (header.freq == 868) discordBot868.queueMessage(discordMessage);
-    if (header.freq == 433) discordBot433.queueMessage(discordMessage);
+    ChatRecord chat;
+    chat.id = nodeDb.saveChatMessage(header.srcnode, header.chan_hash, emojiStr + message.text, header.freq, header.rx_time_ms);
+    chat.nodeId = header.srcnode;
+    chat.chanId = header.chan_hash;
+    chat.freq = header.freq;
+    chat.message = emojiStr + message.text;
+    chat.timestamp = header.rx_time_ms;
+    nodeStore.addChatMessage(chat);
+
+    MeshEvent event = makeEvent(EventType::Chat, meshtastic_PortNum_TEXT_MESSAGE_APP, header, message.text);
+    LOG_INFO("MSG: %u# %s:  %s\n", header.freq, event.nodeName.c_str(), message.text.c_str());
+    eventRouter.publish(event);
 }
 
 void m_on_position_message(MC_Header& header, MC_Position& position, bool needReply) {
@@ -173,18 +304,24 @@ void m_on_position_message(MC_Header& header, MC_Position& position, bool needRe
     if (position.latitude_i == 0 && position.longitude_i == 0) {
         return;
     }
-    safe_printf("Position from node %s: Lat: %d, Lon: %d, Alt: %d, Speed: %d\n", nodeNameMap.getNodeName(header.srcnode).c_str(), position.latitude_i, position.longitude_i, position.altitude, position.ground_speed);
-    nodeDb.setNodePosition(header.srcnode, position.latitude_i, position.longitude_i, position.altitude);
+    LOG_DEBUG("Position from node %s: Lat: %d, Lon: %d, Alt: %d, Speed: %u\n", nodeNameMap.getNodeName(header.srcnode).c_str(), position.latitude_i, position.longitude_i, position.altitude, position.ground_speed);
+    nodeDb.setNodePosition(header.srcnode, position.latitude_i, position.longitude_i, position.altitude, header.rx_time_ms);
+    nodeStore.setNodePosition(header.srcnode, position.latitude_i, position.longitude_i, position.altitude, header.rx_time_ms);
+    char summary[64];
+    snprintf(summary, sizeof(summary), "%.5f, %.5f, %d m", position.latitude_i / 1e7, position.longitude_i / 1e7, position.altitude);
+    eventRouter.publish(makeEvent(EventType::Position, meshtastic_PortNum_POSITION_APP, header, summary));
 }
 
 void m_on_node_info(MC_Header& header, MC_NodeInfo& nodeinfo, bool needReply) {
     if (messageIdTrackerTelemetry.check(header.packet_id)) {
         return;
     }
-    safe_printf("Node Info from node 0x%08" PRIx32 ": ID: %s, Short Name: %s, Long Name: %s, Chanhash: %u\n", header.srcnode, nodeinfo.id, nodeinfo.short_name, nodeinfo.long_name, header.chan_hash);
-    nodeDb.setNodeInfo(header.srcnode, nodeinfo.short_name, nodeinfo.long_name, header.freq, nodeinfo.role, header.chan_hash);
+    LOG_DEBUG("Node Info from node 0x%08" PRIx32 ": ID: %s, Short Name: %s, Long Name: %s, Chanhash: %u\n", header.srcnode, nodeinfo.id, nodeinfo.short_name, nodeinfo.long_name, header.chan_hash);
+    nodeDb.setNodeInfo(header.srcnode, nodeinfo.short_name, nodeinfo.long_name, header.freq, nodeinfo.role, header.chan_hash, header.rx_time_ms);
+    nodeStore.setNodeInfo(header.srcnode, nodeinfo.short_name, nodeinfo.long_name, header.freq, nodeinfo.role, header.chan_hash, header.rx_time_ms);
     nodeNameMap.setNodeName(header.srcnode, nodeinfo.short_name);
     nodeNameMap.incrementNodeInfoCount(header.srcnode);
+    eventRouter.publish(makeEvent(EventType::NodeInfo, meshtastic_PortNum_NODEINFO_APP, header, std::string(nodeinfo.short_name) + " " + nodeinfo.long_name));
 }
 
 void m_on_waypoint_message(MC_Header& header, MC_Waypoint& waypoint) {
@@ -192,7 +329,10 @@ void m_on_waypoint_message(MC_Header& header, MC_Waypoint& waypoint) {
         return;
     }
     nodeNameMap.incrementMessageCount(header.srcnode);
-    safe_printf("Waypoint from node 0x%08" PRIx32 ": Lat: %d, Lon: %d, Name: %s\n", header.srcnode, waypoint.latitude_i, waypoint.longitude_i, waypoint.name);
+    LOG_INFO("Waypoint from node 0x%08" PRIx32 ": Lat: %d, Lon: %d, Name: %s\n", header.srcnode, waypoint.latitude_i, waypoint.longitude_i, waypoint.name);
+    char summary[128];
+    snprintf(summary, sizeof(summary), "%s %.5f, %.5f", waypoint.name, waypoint.latitude_i / 1e7, waypoint.longitude_i / 1e7);
+    eventRouter.publish(makeEvent(EventType::Waypoint, meshtastic_PortNum_WAYPOINT_APP, header, summary));
 }
 
 void m_on_telemetry_device(MC_Header& header, MC_Telemetry_Device& telemetry) {
@@ -200,27 +340,32 @@ void m_on_telemetry_device(MC_Header& header, MC_Telemetry_Device& telemetry) {
         return;
     }
     nodeNameMap.incrementTelemetryCount(header.srcnode);
-    nodeDb.setNodeTelemetryDevice(header.srcnode, telemetry.battery_level, telemetry.voltage, telemetry.has_uptime_seconds ? telemetry.uptime_seconds : 0, telemetry.has_channel_utilization ? telemetry.channel_utilization : 0, header.chan_hash);
-    safe_printf("Telemetry Device from node 0x%08" PRIx32 ": Battery: %d, Uptime: %d, Voltage: %d, Channel Utilization: %d\n", header.srcnode, telemetry.battery_level, telemetry.uptime_seconds, telemetry.voltage, telemetry.channel_utilization);
+    nodeDb.setNodeTelemetryDevice(header.srcnode, telemetry.battery_level, telemetry.voltage, telemetry.has_uptime_seconds ? telemetry.uptime_seconds : 0, telemetry.has_channel_utilization ? telemetry.channel_utilization : 0, header.chan_hash, header.rx_time_ms);
+    nodeStore.setNodeTelemetryDevice(header.srcnode, telemetry.battery_level, telemetry.voltage, telemetry.has_uptime_seconds ? telemetry.uptime_seconds : 0, telemetry.has_channel_utilization ? telemetry.channel_utilization : 0, header.chan_hash, header.rx_time_ms);
+    LOG_DEBUG("Telemetry Device from node 0x%08" PRIx32 ": Battery: %u, Uptime: %u, Voltage: %.2f, Channel Utilization: %.1f\n", header.srcnode, telemetry.battery_level, telemetry.uptime_seconds, telemetry.voltage, telemetry.channel_utilization);
+    char summary[64];
+    snprintf(summary, sizeof(summary), "battery %d%%, %.2f V, chutil %.1f%%", (int)telemetry.battery_level, (double)telemetry.voltage, (double)telemetry.channel_utilization);
+    eventRouter.publish(makeEvent(EventType::Telemetry, meshtastic_PortNum_TELEMETRY_APP, header, summary));
 }
 void m_on_telemetry_environment(MC_Header& header, MC_Telemetry_Environment& telemetry) {
     if (messageIdTrackerTelemetry.check(header.packet_id)) {
         return;
     }
     nodeNameMap.incrementTelemetryCount(header.srcnode);
-    safe_printf("Telemetry Environment from node 0x%08" PRIx32 ": Temperature: %d, Humidity: %d, Pressure: %d, Lux: %d\n", header.srcnode, telemetry.temperature, telemetry.humidity, telemetry.pressure, telemetry.lux);
-    nodeDb.setNodeTemperature(header.srcnode, telemetry.temperature, header.chan_hash);
+    LOG_DEBUG("Telemetry Environment from node 0x%08" PRIx32 ": Temperature: %.1f, Humidity: %.1f, Pressure: %.1f, Lux: %.1f\n", header.srcnode, telemetry.temperature, telemetry.humidity, telemetry.pressure, telemetry.lux);
+    nodeDb.setNodeTemperature(header.srcnode, telemetry.temperature, header.chan_hash, header.rx_time_ms);
+    nodeStore.setNodeTemperature(header.srcnode, telemetry.temperature, header.chan_hash, header.rx_time_ms);
 }
 
 void m_on_traceroute(MC_Header& header, MC_RouteDiscovery& route, bool for_me, bool is_reply, bool need_reply) {
     if (header.via_mqtt) {
-        safe_printf("Skip bc mqtt\n");
+        LOG_DEBUG("Skip bc mqtt\n");
         return;
     }
     nodeNameMap.incrementTraceCount(header.srcnode);
     // Print the route details if needed
     uint32_t n1 = (route.route_back_count > 0) ? header.dstnode : header.srcnode;
-    safe_printf("Traceroute from node 0x%08" PRIx32 " to node 0x%08" PRIx32 ": Route Count: %d Back count: %d\n", header.srcnode, header.dstnode, route.route_count, route.route_back_count);
+    LOG_INFO("Traceroute from node 0x%08" PRIx32 " to node 0x%08" PRIx32 ": Route Count: %d Back count: %d\n", header.srcnode, header.dstnode, route.route_count, route.route_back_count);
     bool hasbad = false;
     for (int i = 0; i < route.route_count; i++) {
         if (route.route[i] == 0xffffffff || route.route[i] == 0) {
@@ -229,13 +374,13 @@ void m_on_traceroute(MC_Header& header, MC_RouteDiscovery& route, bool for_me, b
     }
     if (!hasbad) {
         for (int i = 0; i < route.route_count; i++) {
-            safe_printf("Route [%d]: 0x%08" PRIx32 " -> 0x%08" PRIx32 "  : %d\n", i, n1, route.route[i], route.snr_towards[i] / 4);
-            nodeDb.saveNodeSNR(n1, route.route[i], route.snr_towards[i] / 4);
+            LOG_DEBUG("Route [%d]: 0x%08" PRIx32 " -> 0x%08" PRIx32 "  : %d\n", i, n1, route.route[i], route.snr_towards[i] / 4);
+            nodeStore.saveNodeSNR(n1, route.route[i], route.snr_towards[i] / 4, header.rx_time_ms);
             n1 = route.route[i];
         }
     }
     if (route.route_back_count > 0) {
-        // nodeDb.saveNodeSNR(n1, header.srcnode, route.snr_towards[route.route_count + 1]);
+        // nodeStore.saveNodeSNR(n1, header.srcnode, route.snr_towards[route.route_count + 1]);
     }
     hasbad = false;
     for (int i = 0; i < route.route_back_count; i++) {
@@ -246,19 +391,19 @@ void m_on_traceroute(MC_Header& header, MC_RouteDiscovery& route, bool for_me, b
     if (!hasbad) {
         n1 = (route.route_back_count > 0) ? header.srcnode : header.dstnode;
         for (int i = 0; i < route.route_back_count; i++) {
-            nodeDb.saveNodeSNR(n1, route.route_back[i], route.snr_back[i] / 4);
-            safe_printf("Back[%d]: 0x%08" PRIx32 " -> 0x%08" PRIx32 "  : %d\n", i, n1, route.route_back[i], route.snr_back[i] / 4);
+            nodeStore.saveNodeSNR(n1, route.route_back[i], route.snr_back[i] / 4, header.rx_time_ms);
+            LOG_DEBUG("Back[%d]: 0x%08" PRIx32 " -> 0x%08" PRIx32 "  : %d\n", i, n1, route.route_back[i], route.snr_back[i] / 4);
             n1 = route.route_back[i];
         }
     }
 }
 
 void m_on_neighbor_info(MC_Header& header, meshtastic_NeighborInfo& neighborinfo) {
-    safe_printf("Neighbor Info from node 0x%08" PRIx32 "\n", header.srcnode);
+    LOG_DEBUG("Neighbor Info from node 0x%08" PRIx32 "\n", header.srcnode);
     for (size_t i = 0; i < neighborinfo.neighbors_count; i++) {
         meshtastic_Neighbor& neighbor = neighborinfo.neighbors[i];
-        safe_printf("  Neighbor 0x%08" PRIx32 ":  SNR: %f\n", neighbor.node_id, neighbor.snr);
-        nodeDb.saveNodeSNR(neighbor.node_id, header.srcnode, neighbor.snr);
+        LOG_DEBUG("  Neighbor 0x%08" PRIx32 ":  SNR: %f\n", neighbor.node_id, neighbor.snr);
+        nodeStore.saveNodeSNR(neighbor.node_id, header.srcnode, neighbor.snr, header.rx_time_ms);
     }
 }
 
@@ -271,6 +416,8 @@ void handle_signal(int signal) {
 
 int main(int argc, char* argv[]) {
     signal(SIGINT, handle_signal);
+    if (strlen(LOG_FILE) > 0) logger().setFile(LOG_FILE, LOG_FILE_MAX_BYTES, LOG_FILE_KEEP);
+    logger().start();
 
 #ifdef USECONSOLE
     CommandInterpreter interpreter;
@@ -282,6 +429,9 @@ int main(int argc, char* argv[]) {
     interpreter.subscribe("send8", cmd_send8);
     interpreter.subscribe("sendlowhop", cmd_sendlowhop);
     interpreter.subscribe("nodeinfo", cmd_nodeinfo);
+    interpreter.subscribe("search", cmd_search);
+    interpreter.subscribe("notify", cmd_notify);
+    interpreter.subscribe("latency", cmd_latency);
     interpreter.subscribe("exit", cmd_exit);
 
     // Start listening for input in the background
@@ -289,11 +439,29 @@ int main(int argc, char* argv[]) {
 #endif
     telegramPoster.setApiToken(TELEGRAM_TOKEN);
     telegramPoster.setChatId(TELEGRAM_CHAT_ID);
+    if (strlen(NOTIFY_QUEUE_DIR) > 0) {
+        for (Notifier* notifier : allNotifiers()) notifier->persist(NOTIFY_QUEUE_DIR);
+    }
+    httpDispatcher.start();
     safe_printf("Loading node names from database...\n");
     nodeDb.loadNodeNames(nodeNameMap);
+    nodeStore.setChatCapacity(CHAT_RING_SIZE);
+    setupEventRouter();
+    nodeDb.loadNodeStore(nodeStore);
+    registerMetrics();
+    if (HTTP_API_PORT != 0) {
+        webApi.registerRoutes(httpServer);
+        httpServer.subscribe("/metrics", [](const HttpRequest&, HttpResponse& response) {
+            response.contentType = "text/plain; version=0.0.4; charset=utf-8";
+            response.body = metrics().scrape();
+        });
+        httpServer.start(HTTP_API_PORT, HTTP_API_BIND);
+    }
     safe_printf("Connecting to MQTT servers...\n");
 
-    mainClient.set_address("tcp://mqtt.meshtastic.org:1883");
+    mainClient.set_address(MQTT_MAIN_ADDRESS);
+    mainClient.setName("main");
+    localClient.setName("local");
     localClient.setOnMessage(m_on_message);
     localClient.setOnPositionMessage(m_on_position_message);
     localClient.setOnWaypointMessage(m_on_waypoint_message);
@@ -320,55 +488,69 @@ int main(int argc, char* argv[]) {
         try {
             telegramPoster.loop();
         } catch (const std::exception& e) {
-            std::cerr << e.what() << '\n';
+            LOG_ERROR("%s\n", e.what());
         }
         try {
             discordBot868.loop();
         } catch (const std::exception& e) {
-            std::cerr << e.what() << '\n';
+            LOG_ERROR("%s\n", e.what());
         }
         try {
             discordBot433.loop();
         } catch (const std::exception& e) {
-            std::cerr << e.what() << '\n';
+            LOG_ERROR("%s\n", e.what());
         }
         try {
             meshcoreDown.loop();
         } catch (const std::exception& e) {
-            std::cerr << e.what() << '\n';
+            LOG_ERROR("%s\n", e.what());
         }
+        nodeDb.loop();
 
         sleep(1);
         timer++;
+        if (timer % 60 == 0) {
+            nodeDb.saveLinks(nodeStore);
+        }
         if (timer % 3600 == 0) {
             cmd_nodeinfo("");
         }
         if ((timer % (3600 * 4)) == 0) {
             std::string rt = "msh/EU_868";
-            mainClient.sendMeshtasticMsg(0xabbababa, globalad, rt, 2);
+            mainClient.sendMeshtasticMsg(MQTT_NODE_ID, globalad, rt, 2);
         }
 
         time_t now = time(nullptr);
         if (now - lastHourlyReset >= 3600) {
             bool needsave = lastHourlyReset != 0;
             lastHourlyReset = now;
+            // counts since the last hour, the first snapshot sets the starting point
+            std::vector<RegionStatsRecord> regions = ingestStats().snapshot(nowMs());
             if (needsave) {
                 safe_printf("Hourly node message counts:\n");
                 nodeNameMap.saveMessageCounts([](uint32_t nodeId, uint32_t msgCnt, uint32_t traceCnt, uint32_t telemetryCnt, uint32_t nodeInfoCnt, uint32_t posCnt) {
                     // safe_printf("Node 0x%08" PRIx32 ": %d messages\n", nodeId, msgCnt);
                     nodeDb.saveNodeMsgCnt(nodeId, msgCnt, traceCnt, telemetryCnt, nodeInfoCnt, posCnt);
+                    nodeStore.setNodeMsgCnt(nodeId, msgCnt, traceCnt, telemetryCnt, nodeInfoCnt, posCnt);
                 });
-                uint32_t msgnum_all_868 = mainClient.msgnum_all_868 + localClient.msgnum_all_868;
-                uint32_t msgnum_decoded_868 = mainClient.msgnum_decoded_868 + localClient.msgnum_decoded_868;
-                uint32_t msgnum_handled_868 = mainClient.msgnum_handled_868 + localClient.msgnum_handled_868;
-                uint32_t msgnum_all_433 = mainClient.msgnum_all_433 + localClient.msgnum_all_433;
-                uint32_t msgnum_decoded_433 = mainClient.msgnum_decoded_433 + localClient.msgnum_decoded_433;
-                uint32_t msgnum_handled_433 = mainClient.msgnum_handled_433 + localClient.msgnum_handled_433;
-                nodeDb.saveGlobalStats(msgnum_all_868, msgnum_all_433, msgnum_decoded_868, msgnum_decoded_433, msgnum_handled_868, msgnum_handled_433);
+                MainStatsRecord stats;
+                stats.time = nowMs();
+                for (const RegionStatsRecord& region : regions) {
+                    if (region.region == "EU_868") {
+                        stats.allcnt_868 += region.received;
+                        stats.decoded_868 += region.decoded;
+                        stats.handled_868 += region.handled;
+                    } else if (region.region == "EU_433") {
+                        stats.allcnt_433 += region.received;
+                        stats.decoded_433 += region.decoded;
+                        stats.handled_433 += region.handled;
+                    }
+                }
+                nodeDb.saveGlobalStats(stats, regions);
+                nodeStore.addMainStats(stats);
             }
             nodeNameMap.resetMessageCount();
-            mainClient.resetStats();
-            localClient.resetStats();
+            nodeStore.expire(nowMs());
         }
     }
 
@@ -376,5 +558,9 @@ int main(int argc, char* argv[]) {
 #ifdef USECONSOLE
     interpreter.stop();
 #endif
+    httpServer.stop();
+    httpDispatcher.stop();  // in flight notifications are dropped
+    nodeDb.saveLinks(nodeStore);
+    logger().stop();
     return 0;
 }
\ No newline at end of file
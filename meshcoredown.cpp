@@ -1,10 +1,12 @@
 #include "meshcoredown.hpp"
-#include "parson.h"
-#include <iostream>
+#include "timeutil.hpp"
+#include "logger.hpp"
 
-MeshCoreDown::MeshCoreDown() {
+MeshCoreDown::MeshCoreDown(HttpDispatcher& http, const std::string& mapUrl, const std::string& webhook, const std::string& webhookPub)
+    : http(http), mapUrl(mapUrl), discordBot(http, webhook, "meshcore"), discordBotPub(http, webhookPub, "meshcore_pub") {
     cnt = 0;
-    last_check_time = static_cast<uint64_t>(time(nullptr));
+    cursorMs = static_cast<uint64_t>(time(nullptr)) * 1000;  // only messages from now on
+    cursorMoved = cursorMs;
 }
 
 void MeshCoreDown::loop() {
@@ -12,91 +14,122 @@ void MeshCoreDown::loop() {
     if (cnt % 10 == 0) {
         checkNew();
     }
+    discordBot.loop();
+    discordBotPub.loop();
 }
 
 void MeshCoreDown::checkNew() {
-    uint64_t current_time = static_cast<uint64_t>(time(nullptr));
-    std::string url = MCMAPURL "/api/v1/all/?after_ms=" + std::to_string(last_check_time * 1000);
-    last_check_time = current_time;
-    std::string response;
+    if (polling) return;  // the previous poll is still waiting for the server
+    HttpCall call;
+    call.url = mapUrl + "/api/v1/all/?after_ms=" + std::to_string(cursorMs);
+    call.followRedirects = true;
+    call.verifyPeer = false;
+    if (!etag.empty()) call.headers.push_back("If-None-Match: " + etag);
+    if (!lastModified.empty()) call.headers.push_back("If-Modified-Since: " + lastModified);
 
-    CURL* curl = curl_easy_init();
-    if (!curl) return;
+    polling = true;
+    http.submit(std::move(call), [this](const HttpResult& result) {
+        if (result.code != CURLE_OK) LOG_WARN("MeshCore request failed: %s\n", curl_easy_strerror(result.code));
+        handleResponse(result);
+        polling = false;
+    });
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "meshlogger/1.0");
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, +[](char* ptr, size_t size, size_t nmemb, void* userdata) -> size_t {
-            auto* out = static_cast<std::string*>(userdata);
-            out->append(ptr, size * nmemb);
-            return size * nmemb; });
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+void MeshCoreDown::handleResponse(const HttpResult& result) {
+    if (!result.ok()) return;  // 304 included: nothing new
+    JsonReader json(result.body);
+    size_t fresh = readMessages(json);
+    if (json.failed()) LOG_WARN("MeshCore response is not valid JSON\n");
 
-    CURLcode rc = curl_easy_perform(curl);
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    curl_easy_cleanup(curl);
-    if (rc != CURLE_OK) {
-        // This is the real error!
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(rc));
+    uint64_t now = nowMs();
+    if (fresh == 0 && now - cursorMoved < MESHCORE_CURSOR_MAX_AGE_MS) {
+        // same URL next time, let the server answer 304 while nothing changes
+        etag = result.header("etag");
+        lastModified = result.header("last-modified");
+        return;
     }
-    if (rc != CURLE_OK || http_code < 200 || http_code >= 300) return;
+    time_t serverTime = curl_getdate(result.header("date").c_str(), nullptr);
+    uint64_t serverMs = serverTime > 0 ? (uint64_t)serverTime * 1000 : now;
+    if (serverMs > MESHCORE_OVERLAP_MS && serverMs - MESHCORE_OVERLAP_MS > cursorMs) cursorMs = serverMs - MESHCORE_OVERLAP_MS;
+    cursorMoved = now;
+    etag.clear();
+    lastModified.clear();
+}
 
-    try {
-        JSON_Value* root_value = json_parse_string((const char*)response.c_str());
-        if (json_value_get_type(root_value) != JSONObject) {
-            json_value_free(root_value);
-            return;
-        }
-        JSON_Object* root_object = json_value_get_object(root_value);
-        if (!root_object) {
-            json_value_free(root_value);
-            return;
-        }
-        // get channel_messages object
-        JSON_Object* channel_messages = json_object_get_object(root_object, "channel_messages");
-        if (!channel_messages) {
-            json_value_free(root_value);
-            return;
+size_t MeshCoreDown::readMessages(JsonReader& json) {
+    size_t fresh = 0;
+    std::string key;
+    if (!json.beginObject()) return 0;
+    while (json.nextKey(key)) {
+        if (key != "channel_messages") {
+            json.skipValue();
+            continue;
         }
-        // get objects array
-        JSON_Array* messages_array = json_object_get_array(channel_messages, "objects");
-        if (!messages_array) {
-            json_value_free(root_value);
-            return;
-        }
-
-        size_t message_count = json_array_get_count(messages_array);
-        for (size_t i = 0; i < message_count; i++) {
-            JSON_Object* message_object = json_array_get_object(messages_array, i);
-            if (!message_object) continue;
-            const char* message = json_object_get_string(message_object, "message");
-            if (!message) continue;
-            const char* node_name = json_object_get_string(message_object, "name");
-            if (!node_name) node_name = "unknown";
-            int channel_id = static_cast<int>(json_object_get_number(message_object, "channel_id"));
-            if (channel_id == 3) {
-                std::string discord_msg = std::string(node_name) + ": " + std::string(message);
-                if (discord_msg != lastmsg) {
-                    lastmsg = discord_msg;
-                    discordBot.queueMessage(discord_msg);
-                    discordBot.loop();
-                }
+        if (!json.beginObject()) return fresh;
+        while (json.nextKey(key)) {
+            if (key != "objects") {
+                json.skipValue();
+                continue;
             }
-            if (channel_id == 1) {
-                std::string discord_msg = std::string(node_name) + ": " + std::string(message);
-                if (discord_msg != lastmsg) {
-                    lastmsg = discord_msg;
-                    discordBotPub.queueMessage(discord_msg);
-                    discordBotPub.loop();
+            if (!json.beginArray()) return fresh;
+            std::unordered_map<std::string, int> content;  // the messages without an id in this response
+            while (json.nextElement()) {
+                Message message;
+                if (!readMessage(json, message)) return fresh;
+                if (message.text.empty() || (message.channel != 1 && message.channel != 3)) continue;
+                std::string discord_msg = message.name + ": " + message.text;
+                if (message.id.empty()) {
+                    // the copies the previous response had already are the overlap, the others are new
+                    std::string contentKey = std::to_string(message.channel) + ":" + discord_msg;
+                    int copies = ++content[contentKey];
+                    auto last = lastContent.find(contentKey);
+                    if (last != lastContent.end() && copies <= last->second) continue;
+                } else if (!markSeen(message.id)) {
+                    continue;
                 }
+                fresh++;
+                if (message.channel == 3) discordBot.queueMessage(discord_msg);
+                if (message.channel == 1) discordBotPub.queueMessage(discord_msg);
             }
+            lastContent.swap(content);
         }
-        json_value_free(root_value);
-    } catch (const std::exception& e) {
-        // parsing failed
     }
-}
\ No newline at end of file
+    return fresh;
+}
+
+bool MeshCoreDown::readMessage(JsonReader& json, Message& out) {
+    if (json.peek() != JsonReader::OBJECT) return json.skipValue();
+    json.beginObject();
+    out.name = "unknown";
+    std::string key;
+    double number;
+    while (json.nextKey(key)) {
+        JsonReader::Type type = json.peek();
+        if (key == "message" && type == JsonReader::STRING) {
+            json.readString(out.text);
+        } else if (key == "name" && type == JsonReader::STRING) {
+            json.readString(out.name);
+        } else if (key == "channel_id" && type == JsonReader::NUMBER) {
+            json.readNumber(number);
+            out.channel = (int)number;
+        } else if (key == "id" && type == JsonReader::STRING) {
+            json.readString(out.id);
+        } else if (key == "id" && type == JsonReader::NUMBER) {
+            json.readNumber(number);
+            out.id = std::to_string((int64_t)number);
+        } else {
+            json.skipValue();
+        }
+    }
+    return !json.failed();
+}
+
+bool MeshCoreDown::markSeen(const std::string& id) {
+    if (!seen.insert(id).second) return false;
+    seenOrder.push_back(id);
+    if (seenOrder.size() > MESHCORE_SEEN_MAX) {
+        seen.erase(seenOrder.front());
+        seenOrder.pop_front();
+    }
+    return true;
+}
@@ -1,21 +1,69 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <unordered_map>
 #include "config.hpp"
 #include "discord.hpp"
+#include "httpdispatcher.hpp"
+#include "jsonreader.hpp"
 
+#define MESHCORE_OVERLAP_MS 60000           // polls ask again for this much before the cursor, the seen set drops repeats
+#define MESHCORE_CURSOR_MAX_AGE_MS 600000   // the cursor moves on at least this often, even without new messages
+#define MESHCORE_SEEN_MAX 1024              // message ids remembered for dedup
+
+/**
+ * @brief Polls the MeshCore map for channel messages and forwards them to Discord.
+ *
+ * The cursor (after_ms) is the server's Date of the last response that brought something new,
+ * minus an overlap, so late indexed messages and clock skew don't lose messages; the repeats are
+ * dropped by a bounded set of seen message ids. A message without an id is a repeat only while the
+ * previous response had it too, so someone saying the same thing again later is still forwarded.
+ * While nothing is new the URL stays the same and the poll is conditional (If-None-Match /
+ * If-Modified-Since), a 304 costs no parsing at all.
+ * Only channel_messages.objects is read from the response, the rest is skipped unparsed.
+ */
 class MeshCoreDown {
    public:
-    MeshCoreDown();
+    // The URLs are the real map and channels unless a load test points them at a stand-in.
+    MeshCoreDown(HttpDispatcher& http, const std::string& mapUrl = MCMAPURL, const std::string& webhook = DISCORD_MESHCORE, const std::string& webhookPub = DISCORD_MESHCORE_PUB);
     ~MeshCoreDown() {};
 
     void loop();
     void checkNew();
+    std::vector<Notifier*> getNotifiers() { return {&discordBot, &discordBotPub}; }
 
    private:
+    struct Message {
+        std::string id;  // server id when the API sends one
+        std::string name;
+        std::string text;
+        int channel = 0;
+    };
+
+    // on the dispatcher thread
+    void handleResponse(const HttpResult& result);
+    size_t readMessages(JsonReader& json);  // returns the new messages forwarded
+    bool readMessage(JsonReader& json, Message& out);
+    bool markSeen(const std::string& id);  // false when the id was seen already
+
+    HttpDispatcher& http;
+    std::string mapUrl;
     uint8_t cnt = 0;
-    uint64_t last_check_time = 0;
-    DiscordBot discordBot{DISCORD_MESHCORE};
-    DiscordBot discordBotPub{DISCORD_MESHCORE_PUB};
-    std::string lastmsg = "";
-};
\ No newline at end of file
+    DiscordBot discordBot;
+    DiscordBot discordBotPub;
+    std::atomic<bool> polling{false};  // a poll is in flight
+
+    // poll state, used by checkNew() and the response callback, never at the same time (polling)
+    uint64_t cursorMs = 0;     // after_ms, server time
+    uint64_t cursorMoved = 0;  // local epoch ms of the last cursor move
+    std::string etag;          // validators of the response to the current URL
+    std::string lastModified;
+    std::unordered_set<std::string> seen;
+    std::deque<std::string> seenOrder;  // oldest first, for the bound
+    std::unordered_map<std::string, int> lastContent;  // "<channel>:<name>: <text>" of the id-less messages of the last response, copies
+};
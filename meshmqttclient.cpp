@@ -1,9 +1,79 @@
 #include "meshmqttclient.hpp"
 #include "CommandInterpreter.hpp"
+#include "timeutil.hpp"
+#include "latency.hpp"
+#include "logger.hpp"
+#include "ingeststats.hpp"
+
+#define METRICS_MAX_PORT 511  // highest meshtastic portnum
+
+static const Counter decryptAttemptsL1 = metrics().counter("meshmap_decrypt_attempts_total", "key=\"default_l1\"", "Payload decryptions tried, by key");
+static const Counter decryptAttemptsChan = metrics().counter("meshmap_decrypt_attempts_total", "key=\"default_channel\"", "Payload decryptions tried, by key");
+static const Counter decryptMissesL1 = metrics().counter("meshmap_decrypt_misses_total", "key=\"default_l1\"", "Payload decryptions that did not give a valid Data message, by key");
+static const Counter decryptMissesChan = metrics().counter("meshmap_decrypt_misses_total", "key=\"default_channel\"", "Payload decryptions that did not give a valid Data message, by key");
+static const Counter envelopeFailures = metrics().counter("meshmap_decode_failures_total", "stage=\"envelope\"", "Packets dropped undecoded, by stage");
+static const Counter decryptFailures = metrics().counter("meshmap_decode_failures_total", "stage=\"decrypt\"", "Packets dropped undecoded, by stage");
+static const Counter unencryptedPackets = metrics().counter("meshmap_decode_failures_total", "stage=\"unencrypted\"", "Packets dropped undecoded, by stage");
+
 MeshMqttClient::MeshMqttClient() {
     mbedtls_aes_init(&aes_ctx);
 }
 
+void MeshMqttClient::setName(const std::string& name) {
+    this->name = name;
+    connects = metrics().counter("meshmap_mqtt_connects_total", "client=\"" + name + "\"", "Successful MQTT (re)connections");
+    connectionsLost = metrics().counter("meshmap_mqtt_connections_lost_total", "client=\"" + name + "\"", "MQTT connections lost");
+}
+
+// The modem region of msh/<modem region>/<country>/2/e/<channel>/<gateway>, "none" when missing.
+static std::string topicRegion(const char* topic) {
+    const char* start = topic ? strchr(topic, '/') : nullptr;
+    if (!start) return "none";
+    start++;
+    const char* end = strchr(start, '/');
+    std::string value = end ? std::string(start, end) : std::string(start);
+    return value.empty() || value == "2" ? "none" : value;
+}
+
+// The LoRa band of a Meshtastic modem region in MHz, 0 when unknown.
+static uint16_t regionFreq(const std::string& region) {
+    static const std::unordered_map<std::string, uint16_t> bands = {
+        {"EU_868", 868}, {"EU_433", 433}, {"UA_868", 868}, {"UA_433", 433}, {"RU", 868}, {"KZ_433", 433}, {"KZ_863", 863},
+        {"US", 915}, {"ANZ", 915}, {"ANZ_433", 433}, {"NZ_865", 865}, {"BR_902", 902}, {"CN", 470}, {"IN", 865},
+        {"JP", 920}, {"KR", 920}, {"TW", 920}, {"TH", 920}, {"NP_865", 865}, {"MY_433", 433}, {"MY_919", 919},
+        {"SG_923", 923}, {"PH_433", 433}, {"PH_868", 868}, {"PH_915", 915}, {"LORA_24", 2400},
+    };
+    auto it = bands.find(region);
+    return it == bands.end() ? 0 : it->second;
+}
+
+MeshMqttClient::RegionCounters& MeshMqttClient::regionCounters(const char* topic) {
+    std::string region = topicRegion(topic);
+    auto it = packetCounters.find(region);
+    if (it != packetCounters.end()) return it->second;
+    RegionCounters& counters = packetCounters[region];
+    counters.region = region;
+    counters.freq = regionFreq(region);
+    counters.received = ingestStats().received(name, region);
+    return counters;
+}
+
+Counter& MeshMqttClient::decodedCounter(RegionCounters& counters, uint32_t port) {
+    if (port > METRICS_MAX_PORT) port = METRICS_MAX_PORT;
+    if (counters.decoded.size() <= port) counters.decoded.resize(port + 1);
+    Counter& counter = counters.decoded[port];
+    if (!counter.valid()) counter = ingestStats().decoded(name, counters.region, port);
+    return counter;
+}
+
+Counter& MeshMqttClient::handledCounter(RegionCounters& counters, uint32_t port) {
+    if (port > METRICS_MAX_PORT) port = METRICS_MAX_PORT;
+    if (counters.handled.size() <= port) counters.handled.resize(port + 1);
+    Counter& counter = counters.handled[port];
+    if (!counter.valid()) counter = ingestStats().handled(name, counters.region, port);
+    return counter;
+}
+
 MeshMqttClient::~MeshMqttClient() {
     mbedtls_aes_free(&aes_ctx);
     MQTTClient_disconnect(client, TIMEOUT);
@@ -15,12 +85,12 @@ bool MeshMqttClient::init() {
 
     if ((rc = MQTTClient_create(&client, address.c_str(), CLIENTID,
                                 MQTTCLIENT_PERSISTENCE_NONE, NULL)) != MQTTCLIENT_SUCCESS) {
-        safe_printf("Failed to connect. Reason: %d\n", rc);
+        LOG_ERROR("Failed to connect. Reason: %d\n", rc);
         return false;
     }
 
     if ((rc = MQTTClient_setCallbacks(client, (void*)this, connectionLost, messageArrived, NULL) != MQTTCLIENT_SUCCESS)) {
-        safe_printf("Failed to set callbacks. Reason: %d\n", rc);
+        LOG_ERROR("Failed to set callbacks. Reason: %d\n", rc);
         return false;
     }
 
@@ -40,34 +110,35 @@ void MeshMqttClient::loop() {
             MQTTClient_destroy(&client);
             client = nullptr;  // Avoid dangling pointer
         }
-        safe_printf("Try to connect...\n");
+        LOG_INFO("Try to connect...\n");
         if ((rc = MQTTClient_create(&client, address.c_str(), CLIENTID, MQTTCLIENT_PERSISTENCE_NONE, NULL)) != MQTTCLIENT_SUCCESS) {
-            safe_printf("Failed to connect. Reason: %d\n", rc);
+            LOG_WARN("Failed to connect. Reason: %d\n", rc);
             return;
         }
 
         if ((rc = MQTTClient_setCallbacks(client, (void*)this, connectionLost, messageArrived, NULL) != MQTTCLIENT_SUCCESS)) {
-            safe_printf("Failed to set callbacks. Reason: %d\n", rc);
+            LOG_WARN("Failed to set callbacks. Reason: %d\n", rc);
             return;
         }
         // Ha a csatlakozás nem sikerül, várunk és újrapróbáljuk
         if (MQTTClient_connect(client, &conn_opts) != MQTTCLIENT_SUCCESS) {
-            fprintf(stderr, "Connection failed. Retry in %d seconds.\n", RECONNECT_DELAY);
+            LOG_WARN("Connection failed. Retry in %d seconds.\n", RECONNECT_DELAY);
             sleep(RECONNECT_DELAY);
             return;  // Vissza a ciklus elejére
         }
 
-        safe_printf("MQTT connect ok! %s\n", address.c_str());
+        LOG_INFO("MQTT connect ok! %s\n", address.c_str());
+        connects.inc();
 
         // Sikeres csatlakozás után újra fel kell iratkozni a témakörökre!
-        printf("Subscribe to topics...\n");
+        LOG_INFO("Subscribe to topics...\n");
         for (int i = 0; i < topicList.size(); i++) {
             if ((rc = MQTTClient_subscribe(client, topicList[i].c_str(), 1)) != MQTTCLIENT_SUCCESS) {
-                fprintf(stderr, "Failed to resubscribe, error code: %d\n", rc);
+                LOG_WARN("Failed to resubscribe, error code: %d\n", rc);
                 // Nem lépünk ki, a ciklus újrapróbálja a kapcsolatot bontani és újrakötni
                 MQTTClient_disconnect(client, TIMEOUT);
             } else {
-                safe_printf("Successful resubscription.\n\n");
+                LOG_INFO("Successful resubscription.\n\n");
             }
         }
     }
@@ -76,7 +147,7 @@ void MeshMqttClient::loop() {
 bool MeshMqttClient::aes_decrypt_meshtastic_payload(const uint8_t* key, uint16_t keySize, uint32_t packet_id, uint32_t from_node, const uint8_t* encrypted_in, uint8_t* decrypted_out, size_t len) {
     int ret = mbedtls_aes_setkey_enc(&aes_ctx, key, keySize);
     if (ret != 0) {
-        safe_printf("mbedtls_aes_setkey_enc failed with error: -0x%04x", -ret);
+        LOG_ERROR("mbedtls_aes_setkey_enc failed with error: -0x%04x", -ret);
         // mbedtls_aes_free(&aes_ctx);
         return false;
     }
@@ -88,7 +159,7 @@ bool MeshMqttClient::aes_decrypt_meshtastic_payload(const uint8_t* key, uint16_t
     memcpy(nonce + 8, &from_node, sizeof(uint32_t));
     ret = mbedtls_aes_crypt_ctr(&aes_ctx, len, &nc_off, nonce, stream_block, encrypted_in, decrypted_out);
     if (ret != 0) {
-        safe_printf("mbedtls_aes_crypt_ctr failed with error: -0x%04x", -ret);
+        LOG_ERROR("mbedtls_aes_crypt_ctr failed with error: -0x%04x", -ret);
         // mbedtls_aes_free(&aes_ctx);
         return false;
     }
@@ -96,13 +167,14 @@ bool MeshMqttClient::aes_decrypt_meshtastic_payload(const uint8_t* key, uint16_t
 }
 
 void MeshMqttClient::connectionLost(void* context, char* cause) {
-    safe_printf("\n### Disconnected ###\nReason: %s\n", cause ? cause : "UNK");
+    static_cast<MeshMqttClient*>(context)->connectionsLost.inc();
+    LOG_WARN("\n### Disconnected ###\nReason: %s\n", cause ? cause : "UNK");
 }
 
 bool MeshMqttClient::pb_decode_from_bytes(const uint8_t* srcbuf, size_t srcbufsize, const pb_msgdesc_t* fields, void* dest_struct) {
     pb_istream_t stream = pb_istream_from_buffer(srcbuf, srcbufsize);
     if (!pb_decode(&stream, fields, dest_struct)) {
-        safe_printf("Can't decode protobuf reason='%s', pb_msgdesc %p", PB_GET_ERROR(&stream), fields);
+        LOG_DEBUG("Can't decode protobuf reason='%s', pb_msgdesc %p", PB_GET_ERROR(&stream), fields);
         pb_release(fields, dest_struct);
         return false;
     } else {
@@ -110,79 +182,98 @@ bool MeshMqttClient::pb_decode_from_bytes(const uint8_t* srcbuf, size_t srcbufsi
     }
 }
 
+bool MeshMqttClient::decodePayload(const meshtastic_Data& data, const pb_msgdesc_t* fields, void* dest_struct) {
+    LATENCY_SCOPE(LatencyStage::Payload);
+    return pb_decode_from_bytes(data.payload.bytes, data.payload.size, fields, dest_struct);
+}
+
 int16_t MeshMqttClient::try_decode_root_packet(const uint8_t* srcbuf, size_t srcbufsize, const pb_msgdesc_t* fields, void* dest_struct, size_t dest_struct_size, MC_Header& header) {
     uint8_t decrypted_data[srcbufsize] = {0};
     memset(dest_struct, 0, dest_struct_size);
     // 1st.
-    if (aes_decrypt_meshtastic_payload(default_l1_key, sizeof(default_l1_key) * 8, header.packet_id, header.srcnode, srcbuf, decrypted_data, srcbufsize)) {
-        if (pb_decode_from_bytes(decrypted_data, srcbufsize, fields, dest_struct)) return 254;
+    {
+        LATENCY_SCOPE(LatencyStage::DecryptDefaultL1);
+        decryptAttemptsL1.inc();
+        if (aes_decrypt_meshtastic_payload(default_l1_key, sizeof(default_l1_key) * 8, header.packet_id, header.srcnode, srcbuf, decrypted_data, srcbufsize)) {
+            if (pb_decode_from_bytes(decrypted_data, srcbufsize, fields, dest_struct)) return 254;
+        }
+        decryptMissesL1.inc();
     }
     memset(dest_struct, 0, dest_struct_size);
-    if (aes_decrypt_meshtastic_payload(default_chan_key, sizeof(default_chan_key) * 8, header.packet_id, header.srcnode, srcbuf, decrypted_data, srcbufsize)) {
-        if (pb_decode_from_bytes(decrypted_data, srcbufsize, fields, dest_struct)) return 0;
+    {
+        LATENCY_SCOPE(LatencyStage::DecryptDefaultChannel);
+        decryptAttemptsChan.inc();
+        if (aes_decrypt_meshtastic_payload(default_chan_key, sizeof(default_chan_key) * 8, header.packet_id, header.srcnode, srcbuf, decrypted_data, srcbufsize)) {
+            if (pb_decode_from_bytes(decrypted_data, srcbufsize, fields, dest_struct)) return 0;
+        }
+        decryptMissesChan.inc();
     }
 
     if (header.chan_hash == 0 && header.dstnode != 0xffffffff) {
         // todo pki decrypt
-        safe_printf("can't decode priv packet");
+        LOG_DEBUG("can't decode priv packet");
         return -1;
     }
     // todo iterate chan keys
 
-    safe_printf("can't decode packet");
+    LOG_DEBUG("can't decode packet");
     return -1;
 }
 
 void MeshMqttClient::intOnMessage(MC_Header& header, MC_TextMessage& message) {
+    LATENCY_SCOPE(LatencyStage::OnMessage);
     if (onMessage) {
         onMessage(header, message);
     };
 }
 
 void MeshMqttClient::intOnNodeInfo(MC_Header& header, MC_NodeInfo& nodeinfo, bool want_reply) {
+    LATENCY_SCOPE(LatencyStage::OnNodeInfo);
     if (onNodeInfo) {
         onNodeInfo(header, nodeinfo, false);
     };
 }
 
 void MeshMqttClient::intOnWaypointMessage(MC_Header& header, MC_Waypoint& waypoint) {
+    LATENCY_SCOPE(LatencyStage::OnWaypoint);
     if (onWaypointMessage) {
         onWaypointMessage(header, waypoint);
     };
 }
 
 void MeshMqttClient::intOnTelemetryDevice(MC_Header& header, MC_Telemetry_Device& telemetry) {
+    LATENCY_SCOPE(LatencyStage::OnTelemetryDevice);
     if (onTelemetryDevice) {
         onTelemetryDevice(header, telemetry);
     };
 }
 
 void MeshMqttClient::intOnTelemetryEnvironment(MC_Header& header, MC_Telemetry_Environment& telemetry) {
+    LATENCY_SCOPE(LatencyStage::OnTelemetryEnvironment);
     if (onTelemetryEnvironment) {
         onTelemetryEnvironment(header, telemetry);
     };
 }
 
 void MeshMqttClient::intOnTraceroute(MC_Header& header, MC_RouteDiscovery& route_discovery) {
+    LATENCY_SCOPE(LatencyStage::OnTraceroute);
     if (onTraceroute) {
         onTraceroute(header, route_discovery, false, header.request_id == 0, false);
     }
 }
 
 void MeshMqttClient::intOnPositionMessage(MC_Header& header, MC_Position& position, bool want_reply) {
+    LATENCY_SCOPE(LatencyStage::OnPosition);
     if (onPositionMessage) {
         onPositionMessage(header, position, false);
     };
 }
 
 int MeshMqttClient::messageArrived(void* context, char* topicName, int topicLen, MQTTClient_message* message) {
-    uint16_t freq = 868;
-    if (topicName && strstr(topicName, "EU_433")) {
-        freq = 433;
-    }
     MeshMqttClient* client = static_cast<MeshMqttClient*>(context);
     // safe_printf("topic: %s\n", topicName);
-    client->ProcessPacket(static_cast<uint8_t*>(message->payload), message->payloadlen, freq);
+    RegionCounters& counters = client->regionCounters(topicName);
+    client->ProcessPacket(static_cast<uint8_t*>(message->payload), message->payloadlen, counters.freq, counters);
     // safe_printf("\n");
     MQTTClient_freeMessage(&message);
     MQTTClient_free(topicName);
@@ -191,7 +282,7 @@ int MeshMqttClient::messageArrived(void* context, char* topicName, int topicLen,
 
 void MeshMqttClient::sendMeshtasticMsg(uint32_t src_node, std::string& text, std::string& rootTopic, uint8_t hoplimit) {
     if (text.length() > 230) {
-        safe_printf("Text message too long, max 230 characters.\n");
+        LOG_WARN("Text message too long, max 230 characters.\n");
         return;
     }
     uint32_t packetId = static_cast<uint32_t>(rand()) | 0xB0000000;
@@ -213,7 +304,7 @@ void MeshMqttClient::sendMeshtasticMsg(uint32_t src_node, std::string& text, std
     uint8_t encoded_data[meshtastic_Data_size] = {0};
     pb_ostream_t stream = pb_ostream_from_buffer(encoded_data, sizeof(encoded_data));
     if (!pb_encode(&stream, &meshtastic_Data_msg, &data)) {
-        safe_printf("Failed to encode meshtastic_Data: %s\n", PB_GET_ERROR(&stream));
+        LOG_WARN("Failed to encode meshtastic_Data: %s\n", PB_GET_ERROR(&stream));
         return;
     }
     size_t encoded_size = stream.bytes_written;
@@ -222,7 +313,7 @@ void MeshMqttClient::sendMeshtasticMsg(uint32_t src_node, std::string& text, std
     uint8_t encrypted_data[encoded_size] = {0};
     // aes_decrypt_meshtastic_payload(const uint8_t* key, uint16_t keySize, uint32_t packet_id, uint32_t from_node, const uint8_t* encrypted_in, uint8_t* decrypted_out, size_t len)
     if (!aes_decrypt_meshtastic_payload(default_l1_key, sizeof(default_l1_key) * 8, packetId, src_node, encoded_data, encrypted_data, encoded_size)) {
-        safe_printf("Failed to encrypt meshtastic_Data\n");
+        LOG_WARN("Failed to encrypt meshtastic_Data\n");
         return;
     }
 
@@ -247,7 +338,7 @@ void MeshMqttClient::sendMeshtasticMsg(uint32_t src_node, std::string& text, std
     uint8_t encoded_packet[meshtastic_MeshPacket_size] = {0};
     pb_ostream_t stream2 = pb_ostream_from_buffer(encoded_packet, sizeof(encoded_packet));
     if (!pb_encode(&stream2, &meshtastic_MeshPacket_msg, &packet)) {
-        safe_printf("Failed to encode meshtastic_MeshPacket: %s\n", PB_GET_ERROR(&stream2));
+        LOG_WARN("Failed to encode meshtastic_MeshPacket: %s\n", PB_GET_ERROR(&stream2));
         return;
     }
     size_t packet_size = stream2.bytes_written;
@@ -262,16 +353,16 @@ void MeshMqttClient::sendMeshtasticMsg(uint32_t src_node, std::string& text, std
     uint8_t encoded_envelope[300] = {0};
     pb_ostream_t stream3 = pb_ostream_from_buffer(encoded_envelope, sizeof(encoded_envelope));
     if (!pb_encode(&stream3, &meshtastic_ServiceEnvelope_msg, &serviceEnv)) {
-        safe_printf("Failed to encode meshtastic_ServiceEnvelope: %s\n", PB_GET_ERROR(&stream3));
+        LOG_WARN("Failed to encode meshtastic_ServiceEnvelope: %s\n", PB_GET_ERROR(&stream3));
         return;
     }
     size_t envelope_size = stream3.bytes_written;
     // publish the message
     std::string topic = rootTopic + "/2/e/LongFast/" + gateway_id_str;
     if (MQTTClient_publish(client, topic.c_str(), envelope_size, encoded_envelope, 0, false, NULL) != MQTTCLIENT_SUCCESS) {
-        safe_printf("Failed to publish message\n");
+        LOG_WARN("Failed to publish message\n");
     } else {
-        safe_printf("Message published successfully\n");
+        LOG_INFO("Message published successfully\n");
     }
 }
 
@@ -285,7 +376,7 @@ void MeshMqttClient::sendMeshtasticNodeinfo(uint32_t src_node, std::string& shor
     uint8_t pbnodeinfo[meshtastic_User_size] = {0};
     pb_ostream_t steam_nodeinfo = pb_ostream_from_buffer(pbnodeinfo, sizeof(pbnodeinfo));
     if (!pb_encode(&steam_nodeinfo, &meshtastic_User_msg, &nodeinfo)) {
-        safe_printf("Failed to encode meshtastic_NodeInfo: %s\n", PB_GET_ERROR(&steam_nodeinfo));
+        LOG_WARN("Failed to encode meshtastic_NodeInfo: %s\n", PB_GET_ERROR(&steam_nodeinfo));
         return;
     }
 
@@ -306,7 +397,7 @@ void MeshMqttClient::sendMeshtasticNodeinfo(uint32_t src_node, std::string& shor
     uint8_t encoded_data[meshtastic_Data_size] = {0};
     pb_ostream_t stream = pb_ostream_from_buffer(encoded_data, sizeof(encoded_data));
     if (!pb_encode(&stream, &meshtastic_Data_msg, &data)) {
-        safe_printf("Failed to encode meshtastic_Data: %s\n", PB_GET_ERROR(&stream));
+        LOG_WARN("Failed to encode meshtastic_Data: %s\n", PB_GET_ERROR(&stream));
         return;
     }
     size_t encoded_size = stream.bytes_written;
@@ -315,7 +406,7 @@ void MeshMqttClient::sendMeshtasticNodeinfo(uint32_t src_node, std::string& shor
     uint8_t encrypted_data[encoded_size] = {0};
     // aes_decrypt_meshtastic_payload(const uint8_t* key, uint16_t keySize, uint32_t packet_id, uint32_t from_node, const uint8_t* encrypted_in, uint8_t* decrypted_out, size_t len)
     if (!aes_decrypt_meshtastic_payload(default_l1_key, sizeof(default_l1_key) * 8, packetId, src_node, encoded_data, encrypted_data, encoded_size)) {
-        safe_printf("Failed to encrypt meshtastic_Data\n");
+        LOG_WARN("Failed to encrypt meshtastic_Data\n");
         return;
     }
 
@@ -337,7 +428,7 @@ void MeshMqttClient::sendMeshtasticNodeinfo(uint32_t src_node, std::string& shor
     uint8_t encoded_packet[meshtastic_MeshPacket_size] = {0};
     pb_ostream_t stream2 = pb_ostream_from_buffer(encoded_packet, sizeof(encoded_packet));
     if (!pb_encode(&stream2, &meshtastic_MeshPacket_msg, &packet)) {
-        safe_printf("Failed to encode meshtastic_MeshPacket: %s\n", PB_GET_ERROR(&stream2));
+        LOG_WARN("Failed to encode meshtastic_MeshPacket: %s\n", PB_GET_ERROR(&stream2));
         return;
     }
     size_t packet_size = stream2.bytes_written;
@@ -352,31 +443,34 @@ void MeshMqttClient::sendMeshtasticNodeinfo(uint32_t src_node, std::string& shor
     uint8_t encoded_envelope[MESHTASTIC_MESHTASTIC_MQTT_PB_H_MAX_SIZE] = {0};
     pb_ostream_t stream3 = pb_ostream_from_buffer(encoded_envelope, sizeof(encoded_envelope));
     if (!pb_encode(&stream3, &meshtastic_ServiceEnvelope_msg, &serviceEnv)) {
-        safe_printf("Failed to encode meshtastic_ServiceEnvelope: %s\n", PB_GET_ERROR(&stream3));
+        LOG_WARN("Failed to encode meshtastic_ServiceEnvelope: %s\n", PB_GET_ERROR(&stream3));
         return;
     }
     size_t envelope_size = stream3.bytes_written;
     // publish the message
     std::string topic = rootTopic + "/2/e/LongFast/" + gateway_id_str;
     if (MQTTClient_publish(client, topic.c_str(), envelope_size, encoded_envelope, 0, false, NULL) != MQTTCLIENT_SUCCESS) {
-        safe_printf("Failed to publish message\n");
+        LOG_WARN("Failed to publish message\n");
     } else {
-        safe_printf("Message published successfully\n");
+        LOG_INFO("Message published successfully\n");
     }
 }
 
-int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
+int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq, RegionCounters& counters) {
     if (len > 0) {
-        if (freq == 868)
-            msgnum_all_868++;
-        else
-            msgnum_all_433++;
+        counters.received.inc();
         MC_Header header;  // for compatibility reason
         meshtastic_ServiceEnvelope serviceEnv;
         meshtastic_MeshPacket packet;
         meshtastic_Data decodedtmp;
-        if (!pb_decode_from_bytes(data, len, &meshtastic_ServiceEnvelope_msg, &serviceEnv)) {
-            safe_printf("Service env decode failed\r\n");
+        bool envelopeDecoded;
+        {
+            LATENCY_SCOPE(LatencyStage::Envelope);
+            envelopeDecoded = pb_decode_from_bytes(data, len, &meshtastic_ServiceEnvelope_msg, &serviceEnv);
+        }
+        if (!envelopeDecoded) {
+            LOG_WARN("Service env decode failed\r\n");
+            envelopeFailures.inc();
             pb_release(&meshtastic_ServiceEnvelope_msg, &serviceEnv);
             return -1;  // decoding failed
         }
@@ -401,6 +495,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
         header.want_ack = serviceEnv.packet->want_ack;
         header.via_mqtt = serviceEnv.packet->via_mqtt;
         header.freq = freq;
+        header.rx_time_ms = nowMs();
 
         decodedtmp = serviceEnv.packet->decoded;  // copy the decoded data
         int16_t ret = 0;
@@ -410,20 +505,19 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
             if (try_decode_root_packet(serviceEnv.packet->encrypted.bytes, serviceEnv.packet->encrypted.size, &meshtastic_Data_msg, &decodedtmp, sizeof(decodedtmp), header)) {
                 // safe_printf("Decrypted packet ok, size: %d", serviceEnv.packet->encrypted.size);
             } else {
-                safe_printf("Decryption failed, size: %d\r\n", serviceEnv.packet->encrypted.size);
+                LOG_DEBUG("Decryption failed, size: %d\r\n", serviceEnv.packet->encrypted.size);
+                decryptFailures.inc();
                 ret = -1;  // decryption failed
             }
         } else {
-            printf("Unencrypted packet received, size: %d\r\n", serviceEnv.packet->encrypted.size);
+            LOG_DEBUG("Unencrypted packet received, size: %d\r\n", serviceEnv.packet->encrypted.size);
+            unencryptedPackets.inc();
             ret = -2;  // niy
         }
 
         if (ret >= 0) {
             header.emoji = decodedtmp.emoji != 0;
-            if (freq == 868)
-                msgnum_decoded_868++;
-            else
-                msgnum_decoded_433++;
+            decodedCounter(counters, decodedtmp.portnum).inc();
             // extract the want_response from bitfield
             decodedtmp.want_response = false;  // packet.want_response;
             /*safe_printf("PortNum: %d  PacketId: %lu  Src: %lu\r\n", decodedtmp.portnum, header.packet_id, header.srcnode);
@@ -447,31 +541,25 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                 */
                 MC_TextMessage msg = {std::string(reinterpret_cast<const char*>(decodedtmp.payload.bytes), decodedtmp.payload.size), (uint8_t)ret, MC_MESSAGE_TYPE_TEXT};
                 intOnMessage(header, msg);
-                if (freq == 868)
-                    msgnum_handled_868++;
-                else
-                    msgnum_handled_433++;
+                handledCounter(counters, decodedtmp.portnum).inc();
             } else if (decodedtmp.portnum == 2) {
                 // safe_printf("Received a remote hardware packet\r\n");
                 //  payload: protobuf HardwareMessage - NOT INTERESTED IN YET
                 /*meshtastic_HardwareMessage hardware_msg = {};
                 if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_HardwareMessage_msg, &hardware_msg)) {
-                    safe_printf("Hardware Message Type: %d", hardware_msg.type);
-                    safe_printf("GPIO Mask: 0x%016llX", hardware_msg.gpio_mask);
-                    safe_printf("GPIO Value: 0x%016llX", hardware_msg.gpio_value);
+                    LOG_DEBUG("Hardware Message Type: %d\n", hardware_msg.type);
+                    LOG_DEBUG("GPIO Mask: 0x%016" PRIX64 "\n", hardware_msg.gpio_mask);
+                    LOG_DEBUG("GPIO Value: 0x%016" PRIX64 "\n", hardware_msg.gpio_value);
                 } else {
-                    safe_printf("Failed to decode HardwareMessage");
+                    LOG_DEBUG("Failed to decode HardwareMessage\n");
                 }*/
             } else if (decodedtmp.portnum == 3) {
                 // payload: protobuf Position
                 meshtastic_Position position_msg = {};
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_Position_msg, &position_msg)) {
+                if (decodePayload(decodedtmp, &meshtastic_Position_msg, &position_msg)) {
                     MC_Position position = {.latitude_i = position_msg.latitude_i, .longitude_i = position_msg.longitude_i, .altitude = position_msg.altitude, .ground_speed = position_msg.ground_speed, .sats_in_view = position_msg.sats_in_view, .location_source = (uint8_t)position_msg.location_source, .has_latitude_i = position_msg.has_latitude_i, .has_longitude_i = position_msg.has_longitude_i, .has_altitude = position_msg.has_altitude, .has_ground_speed = position_msg.has_ground_speed};
                     intOnPositionMessage(header, position, decodedtmp.want_response);
-                    if (freq == 868)
-                        msgnum_handled_868++;
-                    else
-                        msgnum_handled_433++;
+                    handledCounter(counters, decodedtmp.portnum).inc();
                 } else {
                     // safe_printf("Failed to decode Position\r\n");
                 }
@@ -479,7 +567,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
             } else if (decodedtmp.portnum == 4) {
                 // payload: protobuf User
                 meshtastic_User user_msg = {};
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_User_msg, &user_msg)) {
+                if (decodePayload(decodedtmp, &meshtastic_User_msg, &user_msg)) {
                     MC_NodeInfo node_info;
                     node_info.node_id = header.srcnode;  // srcnode is the node ID
                     memcpy(node_info.id, user_msg.id, sizeof(node_info.id));
@@ -491,20 +579,17 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                     node_info.role = user_msg.role;
                     node_info.hw_model = user_msg.hw_model;
                     intOnNodeInfo(header, node_info, decodedtmp.want_response);
-                    if (freq == 868)
-                        msgnum_handled_868++;
-                    else
-                        msgnum_handled_433++;
+                    handledCounter(counters, decodedtmp.portnum).inc();
 
                 } else {
                     // safe_printf("Failed to decode User\r\n");
                 }
                 pb_release(&meshtastic_User_msg, &user_msg);
             } else if (decodedtmp.portnum == 5) {
-                printf("Received a routing packet\r\n");
+                LOG_DEBUG("Received a routing packet\r\n");
                 // payload: protobuf Routing
                 meshtastic_Routing routing_msg = {};  // todo process it. this is just a debug. or simply drop it.
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_Routing_msg, &routing_msg)) {
+                if (decodePayload(decodedtmp, &meshtastic_Routing_msg, &routing_msg)) {
                     // safe_printf("Routing reply count: %d\r\n", routing_msg.route_reply.route_count);
 
                 } else {
@@ -522,15 +607,12 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                 size_t uncompressed_size = unishox2_decompress((const char*)&decodedtmp.payload.bytes, decodedtmp.payload.size, uncompressed_data, sizeof(uncompressed_data), USX_PSET_DFLT);
                 MC_TextMessage msg = {std::string(reinterpret_cast<const char*>(uncompressed_data), uncompressed_size), (uint8_t)ret, MC_MESSAGE_TYPE_TEXT};
                 intOnMessage(header, msg);
-                if (freq == 868)
-                    msgnum_handled_868++;
-                else
-                    msgnum_handled_433++;
+                handledCounter(counters, decodedtmp.portnum).inc();
             } else if (decodedtmp.portnum == 8) {
                 // safe_printf("Received a waypoint packet\r\n");
                 //  payload: protobuf Waypoint
                 meshtastic_Waypoint waypoint_msg = {};  // todo store and callbacke
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_Waypoint_msg, &waypoint_msg)) {
+                if (decodePayload(decodedtmp, &meshtastic_Waypoint_msg, &waypoint_msg)) {
                     MC_Waypoint waypoint;
                     waypoint.latitude_i = waypoint_msg.latitude_i;
                     waypoint.longitude_i = waypoint_msg.longitude_i;
@@ -542,10 +624,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                     waypoint.has_latitude_i = waypoint_msg.has_latitude_i;
                     waypoint.has_longitude_i = waypoint_msg.has_longitude_i;
                     intOnWaypointMessage(header, waypoint);
-                    if (freq == 868)
-                        msgnum_handled_868++;
-                    else
-                        msgnum_handled_433++;
+                    handledCounter(counters, decodedtmp.portnum).inc();
                 } else {
                     // safe_printf("Failed to decode Waypoint\r\n");
                 }
@@ -555,24 +634,18 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                 //  payload: utf8 text
                 MC_TextMessage msg = {std::string(reinterpret_cast<const char*>(decodedtmp.payload.bytes), decodedtmp.payload.size), (uint8_t)ret, MC_MESSAGE_TYPE_DETECTOR_SENSOR};
                 intOnMessage(header, msg);
-                if (freq == 868)
-                    msgnum_handled_868++;
-                else
-                    msgnum_handled_433++;
+                handledCounter(counters, decodedtmp.portnum).inc();
             } else if (decodedtmp.portnum == 11) {
                 // safe_printf("Received an alert packet\r\n");
                 //  payload: utf8 text
                 MC_TextMessage msg = {std::string(reinterpret_cast<const char*>(decodedtmp.payload.bytes), decodedtmp.payload.size), (uint8_t)ret, MC_MESSAGE_TYPE_ALERT};
                 intOnMessage(header, msg);
-                if (freq == 868)
-                    msgnum_handled_868++;
-                else
-                    msgnum_handled_433++;
+                handledCounter(counters, decodedtmp.portnum).inc();
             } else if (decodedtmp.portnum == 12) {
                 // safe_printf("Received a key verification packet\r\n");
                 //  payload: protobuf KeyVerification
                 meshtastic_KeyVerification key_verification_msg = {};  // todo drop?
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_KeyVerification_msg, &key_verification_msg)) {
+                if (decodePayload(decodedtmp, &meshtastic_KeyVerification_msg, &key_verification_msg)) {
                     ;
 
                 } else {
@@ -584,10 +657,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                 //  payload: ASCII Plaintext //TODO determine the in/out part and send reply if needed
                 MC_TextMessage msg = {std::string(reinterpret_cast<const char*>(decodedtmp.payload.bytes), decodedtmp.payload.size), (uint8_t)ret, MC_MESSAGE_TYPE_PING};
                 intOnMessage(header, msg);
-                if (freq == 868)
-                    msgnum_handled_868++;
-                else
-                    msgnum_handled_433++;
+                handledCounter(counters, decodedtmp.portnum).inc();
             } else if (decodedtmp.portnum == 34) {
                 // safe_printf("Received a paxcounter packet\r\n");
                 // payload: protobuf DROP
@@ -596,10 +666,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                 // payload: uart rx/tx data
                 MC_TextMessage msg = {std::string(reinterpret_cast<const char*>(decodedtmp.payload.bytes), decodedtmp.payload.size), (uint8_t)ret, MC_MESSAGE_TYPE_UART};
                 intOnMessage(header, msg);
-                if (freq == 868)
-                    msgnum_handled_868++;
-                else
-                    msgnum_handled_433++;
+                handledCounter(counters, decodedtmp.portnum).inc();
             } else if (decodedtmp.portnum == 65) {
                 // safe_printf("Received a STORE_FORWARD_APP  packet\r\n");
                 //  payload: ?
@@ -608,15 +675,12 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                 //  payload: ascii text
                 MC_TextMessage msg = {std::string(reinterpret_cast<const char*>(decodedtmp.payload.bytes), decodedtmp.payload.size), (uint8_t)ret, MC_MESSAGE_TYPE_RANGE_TEST};
                 intOnMessage(header, msg);
-                if (freq == 868)
-                    msgnum_handled_868++;
-                else
-                    msgnum_handled_433++;
+                handledCounter(counters, decodedtmp.portnum).inc();
             } else if (decodedtmp.portnum == 67) {
                 // safe_printf("Received a TELEMETRY_APP   packet\r\n");
                 //  payload: Protobuf
                 meshtastic_Telemetry telemetry_msg = {};  // todo store and callback
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_Telemetry_msg, &telemetry_msg)) {
+                if (decodePayload(decodedtmp, &meshtastic_Telemetry_msg, &telemetry_msg)) {
                     // safe_printf("Telemetry Time: %lu", telemetry_msg.time);
                     switch (telemetry_msg.which_variant) {
                         case meshtastic_Telemetry_device_metrics_tag:
@@ -630,10 +694,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                             device_metrics.has_voltage = telemetry_msg.variant.device_metrics.has_voltage;
                             device_metrics.has_channel_utilization = telemetry_msg.variant.device_metrics.has_channel_utilization;
                             intOnTelemetryDevice(header, device_metrics);
-                            if (freq == 868)
-                                msgnum_handled_868++;
-                            else
-                                msgnum_handled_433++;
+                            handledCounter(counters, decodedtmp.portnum).inc();
                             break;
                         case meshtastic_Telemetry_environment_metrics_tag:
                             MC_Telemetry_Environment environment_metrics;
@@ -646,10 +707,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                             environment_metrics.has_pressure = telemetry_msg.variant.environment_metrics.has_barometric_pressure;
                             environment_metrics.has_lux = telemetry_msg.variant.environment_metrics.has_lux;
                             intOnTelemetryEnvironment(header, environment_metrics);
-                            if (freq == 868)
-                                msgnum_handled_868++;
-                            else
-                                msgnum_handled_433++;
+                            handledCounter(counters, decodedtmp.portnum).inc();
                             break;
                         case meshtastic_Telemetry_air_quality_metrics_tag:
                             // safe_printf("Air Quality Metrics: PM2.5: %lu ", telemetry_msg.variant.air_quality_metrics.pm25_standard);
@@ -678,7 +736,7 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                 // safe_printf("Received a TRACEROUTE_APP    packet");
                 //  payload: Protobuf RouteDiscovery
                 meshtastic_RouteDiscovery route_discovery_msg = {};  // drop
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_RouteDiscovery_msg, &route_discovery_msg)) {
+                if (decodePayload(decodedtmp, &meshtastic_RouteDiscovery_msg, &route_discovery_msg)) {
                     // safe_printf("Route Discovery: Hop Count: %d", route_discovery_msg.route_count);
                     //  header.request_id ==0 --route back
                     MC_RouteDiscovery route_discovery;
@@ -691,25 +749,25 @@ int16_t MeshMqttClient::ProcessPacket(uint8_t* data, int len, uint16_t freq) {
                     memcpy(route_discovery.route_back, route_discovery_msg.route_back, sizeof(route_discovery.route_back));
                     memcpy(route_discovery.snr_back, route_discovery_msg.snr_back, sizeof(route_discovery.snr_back));
                     intOnTraceroute(header, route_discovery);
-                    if (freq == 868)
-                        msgnum_handled_868++;
-                    else
-                        msgnum_handled_433++;
+                    handledCounter(counters, decodedtmp.portnum).inc();
                 } else {
                     // safe_printf("Failed to decode RouteDiscovery");
                 }
                 pb_release(&meshtastic_RouteDiscovery_msg, &route_discovery_msg);
             } else if (decodedtmp.portnum == 71) {
-                safe_printf("Received a NEIGHBORINFO_APP   packet\n");
+                LOG_DEBUG("Received a NEIGHBORINFO_APP   packet\n");
                 meshtastic_NeighborInfo neighbor_info_msg = {};
-                if (pb_decode_from_bytes(decodedtmp.payload.bytes, decodedtmp.payload.size, &meshtastic_NeighborInfo_msg, &neighbor_info_msg)) {
-                    if (onNeighborInfo) onNeighborInfo(header, neighbor_info_msg);
+                if (decodePayload(decodedtmp, &meshtastic_NeighborInfo_msg, &neighbor_info_msg)) {
+                    if (onNeighborInfo) {
+                        LATENCY_SCOPE(LatencyStage::OnNeighborInfo);
+                        onNeighborInfo(header, neighbor_info_msg);
+                    }
                 } else {
                     // safe_printf("Failed to decode NeighborInfo");
                 }
                 pb_release(&meshtastic_NeighborInfo_msg, &neighbor_info_msg);
             } else {
-                safe_printf("Received an unhandled portnum: %d\n", decodedtmp.portnum);
+                LOG_DEBUG("Received an unhandled portnum: %d\n", decodedtmp.portnum);
             }
         }
         pb_release(&meshtastic_Data_msg, &decodedtmp);
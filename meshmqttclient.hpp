@@ -10,7 +10,9 @@
 #include <unistd.h>  // sleep()
 #include <atomic>    // std::atomic
 #include <vector>
+#include <unordered_map>
 #include "MQTTClient.h"
+#include "metrics.hpp"
 #include "MeshasticCompactStructs.hpp"
 
 #include "pb.h"
@@ -39,6 +41,8 @@ class MeshMqttClient {
         this->user = user;
         this->pass = pass;
     }
+    // Labels the metrics of this client, set it before init().
+    void setName(const std::string& name);
     using OnMessageCallback = void (*)(MC_Header& header, MC_TextMessage& message);
     using OnPositionMessageCallback = void (*)(MC_Header& header, MC_Position& position, bool needReply);
     using OnNodeInfoCallback = void (*)(MC_Header& header, MC_NodeInfo& nodeinfo, bool needReply);
@@ -83,21 +87,6 @@ class MeshMqttClient {
 
     void addTopic(std::string topic) { topicList.push_back(topic); }
 
-    void resetStats() {
-        msgnum_all_868 = 0;
-        msgnum_decoded_868 = 0;
-        msgnum_handled_868 = 0;
-        msgnum_all_433 = 0;
-        msgnum_decoded_433 = 0;
-        msgnum_handled_433 = 0;
-    }
-    uint32_t msgnum_all_868 = 0;
-    uint32_t msgnum_decoded_868 = 0;
-    uint32_t msgnum_handled_868 = 0;
-    uint32_t msgnum_all_433 = 0;
-    uint32_t msgnum_decoded_433 = 0;
-    uint32_t msgnum_handled_433 = 0;
-
    private:
     MQTTClient client;
     mbedtls_aes_context aes_ctx;
@@ -106,6 +95,7 @@ class MeshMqttClient {
     static void connectionLost(void* context, char* cause);
     bool aes_decrypt_meshtastic_payload(const uint8_t* key, uint16_t keySize, uint32_t packet_id, uint32_t from_node, const uint8_t* encrypted_in, uint8_t* decrypted_out, size_t len);
     bool pb_decode_from_bytes(const uint8_t* srcbuf, size_t srcbufsize, const pb_msgdesc_t* fields, void* dest_struct);
+    bool decodePayload(const meshtastic_Data& data, const pb_msgdesc_t* fields, void* dest_struct);  // the port's protobuf
     int16_t try_decode_root_packet(const uint8_t* srcbuf, size_t srcbufsize, const pb_msgdesc_t* fields, void* dest_struct, size_t dest_struct_size, MC_Header& header);
     void intOnNodeInfo(MC_Header& header, MC_NodeInfo& nodeinfo, bool want_reply);
     void intOnMessage(MC_Header& header, MC_TextMessage& message);
@@ -115,7 +105,23 @@ class MeshMqttClient {
     void intOnTraceroute(MC_Header& header, MC_RouteDiscovery& route_discovery);
     void intOnPositionMessage(MC_Header& header, MC_Position& position, bool want_reply);
 
-    int16_t ProcessPacket(uint8_t* data, int len, uint16_t freq);
+    // Handles of the ingestStats() counters of one topic region, used by the MQTT callback thread only.
+    struct RegionCounters {
+        std::string region;
+        uint16_t freq = 0;  // MHz of the region's band, 0 when unknown
+        Counter received;
+        std::vector<Counter> decoded;  // by portnum, registered on first use
+        std::vector<Counter> handled;  // by portnum, registered on first use
+    };
+    int16_t ProcessPacket(uint8_t* data, int len, uint16_t freq, RegionCounters& counters);
+    RegionCounters& regionCounters(const char* topic);
+    Counter& decodedCounter(RegionCounters& counters, uint32_t port);
+    Counter& handledCounter(RegionCounters& counters, uint32_t port);
+
+    std::string name = "mqtt";
+    std::unordered_map<std::string, RegionCounters> packetCounters;  // by region
+    Counter connects;
+    Counter connectionsLost;
     // Callback function pointers
     OnMessageCallback onMessage = nullptr;  // Function pointer for onMessage callback
     OnPositionMessageCallback onPositionMessage = nullptr;
@@ -0,0 +1,56 @@
+#ifndef MESSAGEBATCH_HPP
+#define MESSAGEBATCH_HPP
+
+#include <string>
+#include <queue>
+
+#define MESSAGE_QUEUE_MAX 1000  // lines a notifier holds while it is behind, newer ones are dropped beyond
+
+// Length in characters (code points) of UTF-8 text, the unit the chat platforms limit.
+inline size_t utf8Length(const std::string& text) {
+    size_t length = 0;
+    for (unsigned char c : text) {
+        if ((c & 0xC0) != 0x80) length++;
+    }
+    return length;
+}
+
+// Cuts UTF-8 text to at most maxChars characters, never inside a character.
+inline std::string utf8Truncate(const std::string& text, size_t maxChars) {
+    size_t chars = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (((unsigned char)text[i] & 0xC0) != 0x80 && chars++ == maxChars) return text.substr(0, i);
+    }
+    return text;
+}
+
+/**
+ * @brief Adds a line to a post of at most maxChars characters, lines are joined by newlines.
+ * A line too long for a post on its own is cut to fit into an empty one.
+ * @param chars Characters in batch, kept up to date.
+ * @return false when the line does not fit anymore.
+ */
+inline bool appendToBatch(std::string& batch, size_t& chars, const std::string& line, size_t maxChars) {
+    size_t length = utf8Length(line);
+    if (batch.empty() && length > maxChars) {
+        batch = utf8Truncate(line, maxChars);
+        chars = maxChars;
+        return true;
+    }
+    size_t needed = batch.empty() ? length : length + 1;
+    if (chars + needed > maxChars) return false;
+    if (!batch.empty()) batch += '\n';
+    batch += line;
+    chars += needed;
+    return true;
+}
+
+// Takes as many queued lines as fit into one post, empty when the queue is empty.
+inline std::string takeBatch(std::queue<std::string>& queue, size_t maxChars) {
+    std::string batch;
+    size_t chars = 0;
+    while (!queue.empty() && appendToBatch(batch, chars, queue.front(), maxChars)) queue.pop();
+    return batch;
+}
+
+#endif  // MESSAGEBATCH_HPP
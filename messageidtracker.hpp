@@ -1,13 +1,25 @@
 #ifndef MESSAGEIDTRACKER_HPP
 #define MESSAGEIDTRACKER_HPP
 
+#include <unordered_set>
+#include <deque>
+#include <mutex>
+#include "metrics.hpp"
+
 #define IDTRACK_LIMIT 300
 
 class MessageIdTracker {
    public:
+    // name labels the dedup metrics of this tracker
+    explicit MessageIdTracker(const std::string& name = "")
+        : checks(metrics().counter("meshmap_dedup_checks_total", "tracker=\"" + name + "\"", "Packet ids looked up by a duplicate filter")),
+          hits(metrics().counter("meshmap_dedup_hits_total", "tracker=\"" + name + "\"", "Packets dropped as duplicates")) {}
+
     bool check(uint32_t msgid) {
+        checks.inc();
         std::lock_guard<std::mutex> lock(mutex_);
         if (msgids_.find(msgid) != msgids_.end()) {
+            hits.inc();
             return true;
         }
         if (msgids_.size() >= IDTRACK_LIMIT) {
@@ -24,6 +36,8 @@ class MessageIdTracker {
     std::unordered_set<uint32_t> msgids_;
     std::deque<uint32_t> msgids_order_;
     std::mutex mutex_;
+    Counter checks;
+    Counter hits;
 };
 
 #endif  // MESSAGEIDTRACKER_HPP
\ No newline at end of file
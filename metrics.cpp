@@ -0,0 +1,292 @@
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+struct Metrics::ThreadCells {
+    std::atomic<std::atomic<uint64_t>*> chunks[METRICS_MAX_SLOTS / METRICS_CHUNK] = {};
+
+    ThreadCells() { metrics().attach(this); }
+    ~ThreadCells() {
+        metrics().detach(this);
+        for (auto& chunk : chunks) delete[] chunk.load();
+    }
+};
+
+Metrics& metrics() {
+    // never destroyed, threads outliving main() may still count
+    static Metrics* instance = new Metrics();
+    return *instance;
+}
+
+void Counter::inc(uint64_t n) const {
+    if (slot == UINT32_MAX) return;
+    std::atomic<uint64_t>& c = Metrics::cell(slot);
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);  // this thread is the only writer
+}
+
+void Histogram::observe(uint64_t value) const {
+    if (!bounds) return;
+    uint32_t bucket = std::lower_bound(bounds->begin(), bounds->end(), value) - bounds->begin();
+    std::atomic<uint64_t>& c = Metrics::cell(slot + bucket);
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic<uint64_t>& sum = Metrics::cell(slot + bounds->size() + 1);
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void LogHistogram::observe(uint64_t value) const {
+    if (slot == UINT32_MAX) return;
+    std::atomic<uint64_t>& c = Metrics::cell(slot + bucketOf(value));
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic<uint64_t>& sum = Metrics::cell(slot + BUCKETS);
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+uint64_t LogHistogram::bucketLow(uint32_t bucket) {
+    if (bucket < (2u << METRICS_LOG_SUB_BITS)) return bucket;
+    uint32_t msb = (bucket >> METRICS_LOG_SUB_BITS) + METRICS_LOG_SUB_BITS - 1;
+    uint64_t mantissa = (1u << METRICS_LOG_SUB_BITS) + (bucket & ((1u << METRICS_LOG_SUB_BITS) - 1));
+    return mantissa << (msb - METRICS_LOG_SUB_BITS);
+}
+
+uint64_t LogHistogram::bucketWidth(uint32_t bucket) {
+    if (bucket < (2u << METRICS_LOG_SUB_BITS)) return 1;
+    return 1ull << ((bucket >> METRICS_LOG_SUB_BITS) - 1);
+}
+
+double LogHistogram::quantile(const std::vector<uint64_t>& counts, double q) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < BUCKETS && i < counts.size(); i++) total += counts[i];
+    if (total == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(q * total));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKETS && i < counts.size(); i++) {
+        seen += counts[i];
+        if (seen >= rank) return bucketLow(i) + (bucketWidth(i) - 1) / 2.0;
+    }
+    return 0;
+}
+
+std::atomic<uint64_t>& Metrics::cell(uint32_t slot) {
+    ThreadCells& cells = threadCells();
+    std::atomic<std::atomic<uint64_t>*>& chunkPtr = cells.chunks[slot / METRICS_CHUNK];
+    std::atomic<uint64_t>* chunk = chunkPtr.load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new std::atomic<uint64_t>[METRICS_CHUNK]();
+        chunkPtr.store(chunk, std::memory_order_release);  // the scraper sees the zeroed cells
+    }
+    return chunk[slot % METRICS_CHUNK];
+}
+
+Metrics::ThreadCells& Metrics::threadCells() {
+    thread_local ThreadCells cells;
+    return cells;
+}
+
+void Metrics::attach(ThreadCells* cells) {
+    std::lock_guard<std::mutex> lock(mtx);
+    threads.push_back(cells);
+}
+
+void Metrics::detach(ThreadCells* cells) {
+    std::lock_guard<std::mutex> lock(mtx);
+    threads.erase(std::remove(threads.begin(), threads.end(), cells), threads.end());
+    retired.resize(METRICS_MAX_SLOTS, 0);
+    for (uint32_t c = 0; c < METRICS_MAX_SLOTS / METRICS_CHUNK; c++) {
+        std::atomic<uint64_t>* chunk = cells->chunks[c].load(std::memory_order_acquire);
+        if (!chunk) continue;
+        for (uint32_t i = 0; i < METRICS_CHUNK; i++) retired[c * METRICS_CHUNK + i] += chunk[i].load(std::memory_order_relaxed);
+    }
+}
+
+Metrics::Family& Metrics::family(const std::string& name, const std::string& help, Type type) {
+    auto it = familyIndex.find(name);
+    if (it != familyIndex.end()) return families[it->second];
+    familyIndex[name] = families.size();
+    families.push_back({name, help, type, {}});
+    return families.back();
+}
+
+uint32_t Metrics::allocate(uint32_t count) {
+    if (nextSlot + count > METRICS_MAX_SLOTS) {
+        LOG_ERROR("Metrics: out of cells, raise METRICS_MAX_SLOTS\n");
+        return UINT32_MAX;
+    }
+    uint32_t slot = nextSlot;
+    nextSlot += count;
+    return slot;
+}
+
+Counter Metrics::counter(const std::string& name, const std::string& labels, const std::string& help) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string key = name + "{" + labels + "}";
+    auto it = slotIndex.find(key);
+    if (it != slotIndex.end()) return Counter(it->second);
+    uint32_t slot = allocate(1);
+    if (slot == UINT32_MAX) return Counter();
+    slotIndex[key] = slot;
+    Series series;
+    series.labels = labels;
+    series.slot = slot;
+    family(name, help, COUNTER).series.push_back(series);
+    return Counter(slot);
+}
+
+Histogram Metrics::histogram(const std::string& name, const std::string& labels, const std::string& help, const std::vector<uint64_t>& bounds, double scale) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string key = name + "{" + labels + "}";
+    Family& f = family(name, help, HISTOGRAM);
+    auto it = slotIndex.find(key);
+    if (it != slotIndex.end()) {
+        for (const Series& series : f.series) {
+            if (series.slot == it->second) return Histogram(series.slot, series.bounds);
+        }
+    }
+    uint32_t slot = allocate(bounds.size() + 2);  // buckets, +Inf, sum
+    if (slot == UINT32_MAX) return Histogram();
+    slotIndex[key] = slot;
+    boundsStore.push_back(bounds);
+    Series series;
+    series.labels = labels;
+    series.slot = slot;
+    series.bounds = &boundsStore.back();
+    series.scale = scale;
+    f.series.push_back(series);
+    return Histogram(slot, series.bounds);
+}
+
+LogHistogram Metrics::logHistogram(const std::string& name, const std::string& labels, const std::string& help, double scale) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string key = name + "{" + labels + "}";
+    auto it = slotIndex.find(key);
+    if (it != slotIndex.end()) return LogHistogram(it->second);
+    uint32_t slot = allocate(LogHistogram::BUCKETS + 1);  // buckets, sum
+    if (slot == UINT32_MAX) return LogHistogram();
+    slotIndex[key] = slot;
+    Series series;
+    series.labels = labels;
+    series.slot = slot;
+    series.scale = scale;
+    series.log = true;
+    family(name, help, SUMMARY).series.push_back(series);
+    return LogHistogram(slot);
+}
+
+void Metrics::callback(const std::string& name, const std::string& labels, const std::string& help, Type type, std::function<double()> fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Family& f = family(name, help, type);
+    for (Series& series : f.series) {
+        if (series.labels == labels) {
+            series.fn = fn;
+            return;
+        }
+    }
+    Series series;
+    series.labels = labels;
+    series.fn = fn;
+    f.series.push_back(series);
+}
+
+void Metrics::callbackSeries(const std::string& name, const std::string& help, Type type, SeriesFn fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Series series;
+    series.seriesFn = fn;
+    family(name, help, type).series.push_back(series);
+}
+
+void Metrics::sum(std::vector<uint64_t>& totals) {
+    totals = retired;
+    totals.resize(nextSlot, 0);
+    for (ThreadCells* cells : threads) {
+        for (uint32_t c = 0; c * METRICS_CHUNK < nextSlot; c++) {
+            std::atomic<uint64_t>* chunk = cells->chunks[c].load(std::memory_order_acquire);
+            if (!chunk) continue;
+            for (uint32_t i = 0; i < METRICS_CHUNK && c * METRICS_CHUNK + i < nextSlot; i++) totals[c * METRICS_CHUNK + i] += chunk[i].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+uint64_t Metrics::value(const Counter& counter) {
+    if (!counter.valid()) return 0;
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<uint64_t> totals;
+    sum(totals);
+    return counter.slot < totals.size() ? totals[counter.slot] : 0;
+}
+
+std::vector<uint64_t> Metrics::values(const std::vector<Counter>& counters) {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<uint64_t> totals;
+    sum(totals);
+    std::vector<uint64_t> out(counters.size(), 0);
+    for (size_t i = 0; i < counters.size(); i++) {
+        if (counters[i].slot < totals.size()) out[i] = totals[counters[i].slot];
+    }
+    return out;
+}
+
+std::vector<uint64_t> Metrics::buckets(const LogHistogram& histogram) {
+    if (!histogram.valid()) return std::vector<uint64_t>(LogHistogram::BUCKETS + 1, 0);
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<uint64_t> totals;
+    sum(totals);
+    return std::vector<uint64_t>(totals.begin() + histogram.slot, totals.begin() + histogram.slot + LogHistogram::BUCKETS + 1);
+}
+
+static std::string formatValue(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.10g", v);
+    return buf;
+}
+
+static std::string withLabel(const std::string& labels, const std::string& extra) {
+    if (labels.empty()) return "{" + extra + "}";
+    return "{" + labels + "," + extra + "}";
+}
+
+std::string Metrics::scrape() {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<uint64_t> totals;
+    sum(totals);
+
+    std::string out;
+    static const char* typeNames[] = {"counter", "gauge", "histogram", "summary"};
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::vector<std::pair<std::string, double>> values;
+    for (const Family& f : families) {
+        out += "# HELP " + f.name + " " + f.help + "\n";
+        out += "# TYPE " + f.name + " " + typeNames[f.type] + "\n";
+        for (const Series& series : f.series) {
+            std::string labels = series.labels.empty() ? "" : "{" + series.labels + "}";
+            if (series.seriesFn) {
+                values.clear();
+                series.seriesFn(values);
+                for (const auto& value : values) out += f.name + (value.first.empty() ? "" : "{" + value.first + "}") + " " + formatValue(value.second) + "\n";
+            } else if (series.fn) {
+                out += f.name + labels + " " + formatValue(series.fn()) + "\n";
+            } else if (series.log) {
+                std::vector<uint64_t> counts(totals.begin() + series.slot, totals.begin() + series.slot + LogHistogram::BUCKETS + 1);
+                uint64_t count = 0;
+                for (uint32_t i = 0; i < LogHistogram::BUCKETS; i++) count += counts[i];
+                for (double q : quantiles) {
+                    out += f.name + withLabel(series.labels, "quantile=\"" + formatValue(q) + "\"") + " " + (count ? formatValue(LogHistogram::quantile(counts, q) * series.scale) : "NaN") + "\n";
+                }
+                out += f.name + "_sum" + labels + " " + formatValue(counts[LogHistogram::BUCKETS] * series.scale) + "\n";
+                out += f.name + "_count" + labels + " " + std::to_string(count) + "\n";
+            } else if (series.bounds) {
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i <= series.bounds->size(); i++) {
+                    cumulative += totals[series.slot + i];
+                    std::string le = i < series.bounds->size() ? formatValue((*series.bounds)[i] * series.scale) : "+Inf";
+                    out += f.name + "_bucket" + withLabel(series.labels, "le=\"" + le + "\"") + " " + std::to_string(cumulative) + "\n";
+                }
+                out += f.name + "_sum" + labels + " " + formatValue(totals[series.slot + series.bounds->size() + 1] * series.scale) + "\n";
+                out += f.name + "_count" + labels + " " + std::to_string(cumulative) + "\n";
+            } else if (series.slot != UINT32_MAX) {
+                out += f.name + labels + " " + std::to_string(totals[series.slot]) + "\n";
+            }
+        }
+    }
+    return out;
+}
@@ -0,0 +1,169 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+#define METRICS_MAX_SLOTS 16384  // counter cells of all metrics, a histogram takes one per bucket and one for the sum
+#define METRICS_CHUNK 256        // cells a thread allocates at a time, on its first write into them
+#define METRICS_LOG_SUB_BITS 3   // log histograms: 2^3 buckets per power of two, so a bucket is within 12.5% of its values
+#define METRICS_LOG_MAX_BITS 40  // and values below 2^40 (18 minutes of nanoseconds), larger ones land in the last bucket
+
+class Counter {
+   public:
+    Counter() = default;
+    // Adds n on the calling thread's cell: no lock, no shared cache line.
+    void inc(uint64_t n = 1) const;
+    bool valid() const { return slot != UINT32_MAX; }
+
+   private:
+    friend class Metrics;
+    explicit Counter(uint32_t slot) : slot(slot) {}
+    uint32_t slot = UINT32_MAX;
+};
+
+class Histogram {
+   public:
+    Histogram() = default;
+    // Counts value (in the unit of the bounds) into its bucket, on the calling thread's cells.
+    void observe(uint64_t value) const;
+    bool valid() const { return bounds != nullptr; }
+
+   private:
+    friend class Metrics;
+    Histogram(uint32_t slot, const std::vector<uint64_t>* bounds) : slot(slot), bounds(bounds) {}
+    uint32_t slot = UINT32_MAX;  // bucket cells, then the sum
+    const std::vector<uint64_t>* bounds = nullptr;
+};
+
+/**
+ * @brief Log-linear ("HDR style") histogram: exact below 16, then 8 buckets per power of two, so every
+ * value is kept to within 12.5% over the whole range without picking bounds. Percentiles are read
+ * from the bucket counts; exported as a summary with quantiles.
+ */
+class LogHistogram {
+   public:
+    static const uint32_t BUCKETS = (METRICS_LOG_MAX_BITS - METRICS_LOG_SUB_BITS + 1) << METRICS_LOG_SUB_BITS;
+
+    LogHistogram() = default;
+    // Counts value into its bucket, on the calling thread's cells.
+    void observe(uint64_t value) const;
+    bool valid() const { return slot != UINT32_MAX; }
+
+    static uint32_t bucketOf(uint64_t value) {
+        if (value < (2u << METRICS_LOG_SUB_BITS)) return (uint32_t)value;
+        uint32_t msb = 63 - __builtin_clzll(value);
+        if (msb >= METRICS_LOG_MAX_BITS) return BUCKETS - 1;
+        return ((msb - METRICS_LOG_SUB_BITS) << METRICS_LOG_SUB_BITS) + (uint32_t)(value >> (msb - METRICS_LOG_SUB_BITS));
+    }
+    // Smallest value of a bucket, and the number of values it holds.
+    static uint64_t bucketLow(uint32_t bucket);
+    static uint64_t bucketWidth(uint32_t bucket);
+    // Estimate of quantile q (0..1) from bucket counts as returned by Metrics::buckets(), the middle of
+    // the bucket holding it. 0 when empty.
+    static double quantile(const std::vector<uint64_t>& counts, double q);
+
+   private:
+    friend class Metrics;
+    explicit LogHistogram(uint32_t slot) : slot(slot) {}
+    uint32_t slot = UINT32_MAX;  // BUCKETS cells, then the sum
+};
+
+/**
+ * @brief Process wide metrics registry with Prometheus text exposition.
+ *
+ * Counters and histograms are registered once (name plus a label string such as
+ * client="main",port="1") and get cells; every thread writing them has its own copy of the cells,
+ * so the hot path is a relaxed add on memory only that thread writes. The copies are summed only
+ * when scraped, and a thread's totals are folded into a shared base when it exits.
+ * Gauges and externally kept counters are callbacks read at scrape time.
+ *
+ * Registration and scraping are thread safe; callers on hot paths keep the returned handles.
+ */
+class Metrics {
+   public:
+    enum Type { COUNTER, GAUGE, HISTOGRAM, SUMMARY };
+
+    // Returns the existing counter when name and labels were registered already.
+    Counter counter(const std::string& name, const std::string& labels, const std::string& help);
+    /**
+     * @param bounds Upper bucket bounds in the unit observed, ascending; +Inf is added.
+     * @param scale Factor from that unit to the exported one, e.g. 1e-6 for microseconds exported as seconds.
+     */
+    Histogram histogram(const std::string& name, const std::string& labels, const std::string& help, const std::vector<uint64_t>& bounds, double scale = 1);
+    // Exported as a summary of the quantiles since start; scale as for histogram().
+    LogHistogram logHistogram(const std::string& name, const std::string& labels, const std::string& help, double scale = 1);
+    // A value read at scrape time, type COUNTER for monotonic totals kept elsewhere. fn runs on the
+    // scraping thread under the registry lock, it must not register metrics.
+    void callback(const std::string& name, const std::string& labels, const std::string& help, Type type, std::function<double()> fn);
+    // Several series of a family from one call per scrape, for values that cost the same to get together
+    // as one by one: fn appends (labels, value) pairs. The same rules as for callback().
+    using SeriesFn = std::function<void(std::vector<std::pair<std::string, double>>& out)>;
+    void callbackSeries(const std::string& name, const std::string& help, Type type, SeriesFn fn);
+
+    // Text exposition format, version 0.0.4.
+    std::string scrape();
+
+    // Sum of the cells of a counter over every thread, for the console.
+    uint64_t value(const Counter& counter);
+    // The same for several counters, summed in one pass.
+    std::vector<uint64_t> values(const std::vector<Counter>& counters);
+    // Bucket counts of a log histogram summed over every thread (BUCKETS of them, then the sum), for the console.
+    std::vector<uint64_t> buckets(const LogHistogram& histogram);
+
+   private:
+    friend class Counter;
+    friend class Histogram;
+    friend class LogHistogram;
+    struct ThreadCells;
+    struct Series {
+        std::string labels;
+        uint32_t slot = UINT32_MAX;
+        const std::vector<uint64_t>* bounds = nullptr;  // histograms
+        double scale = 1;
+        bool log = false;            // log histograms
+        std::function<double()> fn;  // callbacks
+        SeriesFn seriesFn;           // callbackSeries, labels empty
+    };
+    struct Family {
+        std::string name;
+        std::string help;
+        Type type;
+        std::vector<Series> series;
+    };
+
+    Family& family(const std::string& name, const std::string& help, Type type);  // mtx must be held
+    uint32_t allocate(uint32_t count);                                            // mtx must be held
+    void sum(std::vector<uint64_t>& totals);                                      // mtx must be held
+
+    static std::atomic<uint64_t>& cell(uint32_t slot);
+    static ThreadCells& threadCells();
+    void attach(ThreadCells* cells);
+    void detach(ThreadCells* cells);
+
+    std::mutex mtx;
+    std::vector<Family> families;  // in registration order
+    std::unordered_map<std::string, size_t> familyIndex;
+    std::unordered_map<std::string, uint32_t> slotIndex;  // name{labels} -> first cell
+    std::deque<std::vector<uint64_t>> boundsStore;        // stable addresses for the Histogram handles
+    uint32_t nextSlot = 0;
+    std::vector<ThreadCells*> threads;
+    std::vector<uint64_t> retired;  // totals of the threads that exited
+};
+
+// The registry of the process.
+Metrics& metrics();
+
+// Buckets for durations observed in microseconds and exported in seconds (scale 1e-6), 50 us to 10 s.
+inline const std::vector<uint64_t>& latencyBucketsUs() {
+    static const std::vector<uint64_t> bounds = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 10000000};
+    return bounds;
+}
+
+#endif  // METRICS_HPP
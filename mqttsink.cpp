@@ -0,0 +1,9 @@
+#include "mqttsink.hpp"
+#include "meshmqttclient.hpp"
+
+void MqttSink::deliver(const MeshEvent& event) {
+    if (event.node == srcNode) return;
+    std::string text = format.format(event);
+    std::string topic = rootTopic;
+    client.sendMeshtasticMsg(srcNode, text, topic, hopLimit);
+}
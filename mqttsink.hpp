@@ -0,0 +1,26 @@
+#ifndef MQTTSINK_HPP
+#define MQTTSINK_HPP
+
+#include <string>
+#include <cstdint>
+#include "eventrouter.hpp"
+
+class MeshMqttClient;
+
+// Sends the formatted event as a text message to a mesh topic. Events sent by srcNode itself are
+// skipped, so a route can't feed its own output back.
+class MqttSink : public EventSink {
+   public:
+    MqttSink(MeshMqttClient& client, uint32_t srcNode, const std::string& rootTopic, uint8_t hopLimit, const std::string& pattern)
+        : client(client), srcNode(srcNode), rootTopic(rootTopic), hopLimit(hopLimit), format(pattern) {}
+    void deliver(const MeshEvent& event) override;
+
+   private:
+    MeshMqttClient& client;
+    uint32_t srcNode;
+    std::string rootTopic;
+    uint8_t hopLimit;
+    EventFormat format;
+};
+
+#endif  // MQTTSINK_HPP
@@ -1,25 +1,72 @@
 #ifndef NODEDB_HPP
 #define NODEDB_HPP
 
-#include <iostream>
 #include <sqlite3.h>
 #include "nodenamemap.hpp"
+#include "nodestore.hpp"
+#include "timeutil.hpp"
+#include "metrics.hpp"
+#include "latency.hpp"
+#include "logger.hpp"
+#include <chrono>
 #include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define NODEDB_OPTIMIZE_MS (6ULL * 3600 * 1000)  // PRAGMA optimize period, refreshes the planner statistics as the tables grow
+
+// Filters for NodeDb::searchChat. Zero / negative values mean "don't filter".
+struct ChatSearchQuery {
+    std::string text;      // keywords, all must match; a trailing '*' makes a word a prefix match
+    uint32_t nodeId = 0;   // sender
+    uint16_t freq = 0;     // 433 / 868
+    int chanId = -1;       // channel hash
+    int64_t since = 0;     // epoch ms, inclusive
+    int64_t until = 0;     // epoch ms, inclusive
+    int limit = 50;
+};
+
+struct ChatSearchResult {
+    int64_t id;
+    uint32_t nodeId;
+    uint16_t chanId;
+    uint16_t freq;
+    std::string message;
+    uint64_t timestamp;  // epoch ms
+    double rank;  // bm25, lower is better
+};
 
 class NodeDb {
    public:
     NodeDb(const std::string& dbFile) {
         std::lock_guard<std::mutex> lock(mtx);
         if (sqlite3_open(dbFile.c_str(), &db) != SQLITE_OK) {
-            std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Can't open database: %s\n", sqlite3_errmsg(db));
             db = nullptr;
         }
         createTables();
+        if (!db) return;
+        // WAL lets the read connection below see the last commit while a write transaction is open
+        sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+        std::lock_guard<std::mutex> readLock(readMtx);
+        if (sqlite3_open_v2(dbFile.c_str(), &readDb, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            LOG_ERROR("Can't open database for reading: %s\n", sqlite3_errmsg(readDb));
+            sqlite3_close(readDb);
+            readDb = nullptr;
+        }
     }
 
     ~NodeDb() {
+        flushNodeUpdates();
+        {
+            std::lock_guard<std::mutex> readLock(readMtx);
+            if (readDb) sqlite3_close(readDb);
+            readDb = nullptr;
+        }
         std::lock_guard<std::mutex> lock(mtx);
         if (db) {
+            sqlite3_exec(db, "PRAGMA optimize;", nullptr, nullptr, nullptr);
             sqlite3_close(db);
         }
     }
@@ -39,157 +86,334 @@ class NodeDb {
                 names.setNodeName(nodeId, name, 0);  // don't load, since new start, and new hourly stat started
             }
         } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
     }
 
-    void saveChatMessage(uint32_t nodeId, uint16_t chan_id, const std::string& message, uint16_t freq) {
+    // Fills the in-memory store the HTTP API serves from: all nodes, a week of links, recent chat and stats.
+    void loadNodeStore(NodeStore& store) {
         std::lock_guard<std::mutex> lock(mtx);
         if (!db) return;
+        uint64_t now = nowMs();
 
         sqlite3_stmt* stmt;
-        const char* sql = "INSERT INTO chat (node_id, chan_id, message, freq) VALUES (?, ?, ?, ?)";
+        const char* sql =
+            "SELECT node_id, short_name, long_name, latitude, longitude, altitude, temperature, battery_level, battery_voltage, chutil, freq, role, uptime, "
+            "msgcntph, tracecntph, telemetrycntph, nodeinfocntph, poscntph, sumcntph, lastchn, last_updated FROM nodes";
         if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, nodeId);
-            sqlite3_bind_int(stmt, 2, chan_id);
-            sqlite3_bind_text(stmt, 3, message.c_str(), -1, SQLITE_STATIC);
-            sqlite3_bind_int(stmt, 4, freq);
-
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error inserting chat message: " << sqlite3_errmsg(db) << std::endl;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                NodeRecord node;
+                const char* shortName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+                const char* longName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+                node.nodeId = sqlite3_column_int(stmt, 0);
+                node.shortName = shortName ? shortName : "";
+                node.longName = longName ? longName : "";
+                node.latitude = sqlite3_column_int(stmt, 3);
+                node.longitude = sqlite3_column_int(stmt, 4);
+                node.altitude = sqlite3_column_int(stmt, 5);
+                node.temperature = sqlite3_column_double(stmt, 6);
+                node.batteryLevel = sqlite3_column_int(stmt, 7);
+                node.batteryVoltage = sqlite3_column_double(stmt, 8);
+                node.chutil = sqlite3_column_double(stmt, 9);
+                node.freq = sqlite3_column_int(stmt, 10);
+                node.role = sqlite3_column_int(stmt, 11);
+                node.uptime = sqlite3_column_int(stmt, 12);
+                node.msgcntph = sqlite3_column_int(stmt, 13);
+                node.tracecntph = sqlite3_column_int(stmt, 14);
+                node.telemetrycntph = sqlite3_column_int(stmt, 15);
+                node.nodeinfocntph = sqlite3_column_int(stmt, 16);
+                node.poscntph = sqlite3_column_int(stmt, 17);
+                node.sumcntph = sqlite3_column_int(stmt, 18);
+                node.lastchn = sqlite3_column_int(stmt, 19);
+                node.lastUpdated = sqlite3_column_int64(stmt, 20);
+                store.loadNode(node);
             }
         } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
 
-        const char* sql2 = "UPDATE nodes SET  last_updated = CURRENT_TIMESTAMP WHERE node_id = ?";
+        const char* sql2 = "SELECT node1, node2, snr, last_updated, snr_last, snr_min, snr_max, samples, first_seen FROM snr WHERE last_updated >= ? AND node1 != node2 AND snr != 0 AND node1 != -1 AND node2 != -1";
         if (sqlite3_prepare_v2(db, sql2, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, nodeId);
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error updating node last_updated: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_bind_int64(stmt, 1, now - NODESTORE_LINK_MS);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                LinkRecord link;
+                link.node1 = sqlite3_column_int(stmt, 0);
+                link.node2 = sqlite3_column_int(stmt, 1);
+                link.snr = sqlite3_column_double(stmt, 2);
+                link.lastUpdated = sqlite3_column_int64(stmt, 3);
+                link.lastSnr = sqlite3_column_double(stmt, 4);
+                link.minSnr = sqlite3_column_double(stmt, 5);
+                link.maxSnr = sqlite3_column_double(stmt, 6);
+                link.samples = sqlite3_column_int(stmt, 7);
+                link.firstSeen = sqlite3_column_int64(stmt, 8);
+                store.loadLink(link);
             }
         } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
+        }
+        sqlite3_finalize(stmt);
+
+        // the newest messages fill the chat ring, oldest first
+        const char* sql3 = "SELECT id, node_id, chan_id, freq, message, timestamp FROM chat ORDER BY id DESC LIMIT ?";
+        if (sqlite3_prepare_v2(db, sql3, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, store.chatCapacity());
+            std::vector<ChatRecord> rows;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                ChatRecord chat;
+                const char* message = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+                chat.id = sqlite3_column_int64(stmt, 0);
+                chat.nodeId = sqlite3_column_int(stmt, 1);
+                chat.chanId = sqlite3_column_int(stmt, 2);
+                chat.freq = sqlite3_column_int(stmt, 3);
+                chat.message = message ? message : "";
+                chat.timestamp = sqlite3_column_int64(stmt, 5);
+                rows.push_back(chat);
+            }
+            for (auto it = rows.rbegin(); it != rows.rend(); ++it) store.addChatMessage(*it);
+        } else {
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
+        }
+        sqlite3_finalize(stmt);
+
+        const char* sql4 = "SELECT allcnt_868, allcnt_433, decoded_868, decoded_433, handled_868, handled_433, time FROM mainstats ORDER BY time DESC LIMIT ?";
+        if (sqlite3_prepare_v2(db, sql4, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int(stmt, 1, NODESTORE_MAINSTATS);
+            std::vector<MainStatsRecord> rows;
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                MainStatsRecord stats;
+                stats.allcnt_868 = sqlite3_column_int(stmt, 0);
+                stats.allcnt_433 = sqlite3_column_int(stmt, 1);
+                stats.decoded_868 = sqlite3_column_int(stmt, 2);
+                stats.decoded_433 = sqlite3_column_int(stmt, 3);
+                stats.handled_868 = sqlite3_column_int(stmt, 4);
+                stats.handled_433 = sqlite3_column_int(stmt, 5);
+                stats.time = sqlite3_column_int64(stmt, 6);
+                rows.push_back(stats);
+            }
+            for (auto it = rows.rbegin(); it != rows.rend(); ++it) store.addMainStats(*it);
+        } else {
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
     }
 
-    void setNodeInfo(uint32_t nodeId, const std::string& shortName, const std::string& longName, uint16_t freq, uint8_t role, uint8_t chanhash) {
+    // Returns the id of the new chat row, 0 on error.
+    int64_t saveChatMessage(uint32_t nodeId, uint16_t chan_id, const std::string& message, uint16_t freq, uint64_t timeMs) {
+        LATENCY_SCOPE(LatencyStage::DbWrite);
         std::lock_guard<std::mutex> lock(mtx);
-        if (!db) return;
+        if (!db) return 0;
+        int64_t id = 0;
 
         sqlite3_stmt* stmt;
-        const char* sql =
-            "INSERT INTO nodes (node_id, short_name, long_name, freq, role, lastchn, last_updated) VALUES (?, ?, ?, ?, ?, ?, CURRENT_TIMESTAMP) "
-            "ON CONFLICT(node_id) DO UPDATE SET short_name=excluded.short_name, long_name=excluded.long_name, freq=excluded.freq, role=excluded.role, uptime=excluded.uptime, lastchn=excluded.lastchn, last_updated=CURRENT_TIMESTAMP";
+        const char* sql = "INSERT INTO chat (node_id, chan_id, message, freq, timestamp) VALUES (?, ?, ?, ?, ?)";
         if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
             sqlite3_bind_int(stmt, 1, nodeId);
-            sqlite3_bind_text(stmt, 2, shortName.c_str(), -1, SQLITE_STATIC);
-            sqlite3_bind_text(stmt, 3, longName.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, chan_id);
+            sqlite3_bind_text(stmt, 3, message.c_str(), -1, SQLITE_STATIC);
             sqlite3_bind_int(stmt, 4, freq);
-            sqlite3_bind_int(stmt, 5, role);
-            sqlite3_bind_int(stmt, 6, chanhash);
+            sqlite3_bind_int64(stmt, 5, timeMs);
 
             if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error inserting node info: " << sqlite3_errmsg(db) << std::endl;
+                LOG_ERROR("Error inserting chat message: %s\n", sqlite3_errmsg(db));
+            } else {
+                id = sqlite3_last_insert_rowid(db);
             }
         } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
+
+        std::lock_guard<std::mutex> pendingLock(pendingMtx);
+        touchPending(nodeId, timeMs);
+        return id;
     }
 
-    void setNodeTemperature(uint32_t nodeId, float temperature, uint8_t chanhash) {
+    void setNodeInfo(uint32_t nodeId, const std::string& shortName, const std::string& longName, uint16_t freq, uint8_t role, uint8_t chanhash, uint64_t timeMs) {
+        LATENCY_SCOPE(LatencyStage::DbWrite);
         std::lock_guard<std::mutex> lock(mtx);
         if (!db) return;
-        if (temperature < -100 || temperature > 300) {
-            return;  // Skip invalid temperature values
-        }
 
         sqlite3_stmt* stmt;
-        const char* sql = "UPDATE nodes SET temperature = ?, lastchn = ?, last_updated = CURRENT_TIMESTAMP WHERE node_id = ?";
+        const char* sql =
+            "INSERT INTO nodes (node_id, short_name, long_name, freq, role, lastchn, last_updated) VALUES (?, ?, ?, ?, ?, ?, ?) "
+            "ON CONFLICT(node_id) DO UPDATE SET short_name=excluded.short_name, long_name=excluded.long_name, freq=excluded.freq, role=excluded.role, uptime=excluded.uptime, lastchn=excluded.lastchn, last_updated=excluded.last_updated";
         if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_double(stmt, 1, temperature);
-            sqlite3_bind_int(stmt, 2, chanhash);
-            sqlite3_bind_int(stmt, 3, nodeId);
+            sqlite3_bind_int(stmt, 1, nodeId);
+            sqlite3_bind_text(stmt, 2, shortName.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, longName.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 4, freq);
+            sqlite3_bind_int(stmt, 5, role);
+            sqlite3_bind_int(stmt, 6, chanhash);
+            sqlite3_bind_int64(stmt, 7, timeMs);
 
             if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error updating node temperature: " << sqlite3_errmsg(db) << std::endl;
+                LOG_ERROR("Error inserting node info: %s\n", sqlite3_errmsg(db));
             }
         } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
     }
 
-    void setNodeTelemetryDevice(uint32_t nodeId, int batteryLevel, float voltage, uint32_t uptime, float chutil, uint8_t chanhash) {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (!db) return;
+    // The per packet node updates below are only recorded in memory and merged per node; flushNodeUpdates()
+    // writes one UPDATE per dirty node. A chatty node costs at most one write per flush interval.
+    void setNodeTemperature(uint32_t nodeId, float temperature, uint8_t chanhash, uint64_t timeMs) {
+        LATENCY_SCOPE(LatencyStage::DbEnqueue);
+        if (temperature < -100 || temperature > 300) {
+            return;  // Skip invalid temperature values
+        }
+        std::lock_guard<std::mutex> lock(pendingMtx);
+        PendingNodeUpdate& p = touchPending(nodeId, timeMs);
+        p.fields |= FIELD_TEMPERATURE | FIELD_LASTCHN;
+        p.temperature = temperature;
+        p.lastchn = chanhash;
+    }
+
+    void setNodeTelemetryDevice(uint32_t nodeId, int batteryLevel, float voltage, uint32_t uptime, float chutil, uint8_t chanhash, uint64_t timeMs) {
+        LATENCY_SCOPE(LatencyStage::DbEnqueue);
         if (batteryLevel < 0 || batteryLevel > 101) {
             return;  // Skip invalid battery levels
         }
+        std::lock_guard<std::mutex> lock(pendingMtx);
+        PendingNodeUpdate& p = touchPending(nodeId, timeMs);
+        p.fields |= FIELD_DEVICE | FIELD_LASTCHN;
+        p.batteryLevel = batteryLevel;
+        p.voltage = voltage;
+        p.uptime = uptime;
+        p.chutil = chutil;
+        p.lastchn = chanhash;
+    }
 
-        sqlite3_stmt* stmt;
-        const char* sql = "UPDATE nodes SET battery_level = ?, battery_voltage = ?, uptime = ?, chutil = ?,lastchn = ?, last_updated = CURRENT_TIMESTAMP WHERE node_id = ?";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, batteryLevel);
-            sqlite3_bind_double(stmt, 2, voltage);
-            sqlite3_bind_int(stmt, 3, uptime);
-            sqlite3_bind_double(stmt, 4, chutil);
-            sqlite3_bind_int(stmt, 5, chanhash);
-            sqlite3_bind_int(stmt, 6, nodeId);
+    void setNodePosition(uint32_t nodeId, int64_t latitude, int64_t longitude, int altitude, uint64_t timeMs) {
+        LATENCY_SCOPE(LatencyStage::DbEnqueue);
+        std::lock_guard<std::mutex> lock(pendingMtx);
+        PendingNodeUpdate& p = touchPending(nodeId, timeMs);
+        p.fields |= FIELD_POSITION;
+        p.latitude = latitude;
+        p.longitude = longitude;
+        p.altitude = altitude;
+    }
 
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error updating node battery level: " << sqlite3_errmsg(db) << std::endl;
-            }
-        } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+    void setFlushInterval(uint32_t ms) { flushIntervalMs = ms; }
+
+    size_t pendingNodeUpdates() {
+        std::lock_guard<std::mutex> lock(pendingMtx);
+        return pendingUpdates.size();
+    }
+
+    // Call it from the main loop, flushes the pending node updates once per flush interval and lets SQLite
+    // refresh its statistics now and then.
+    void loop() {
+        uint64_t now = nowMs();
+        if (now - lastOptimizeMs >= NODEDB_OPTIMIZE_MS) {
+            lastOptimizeMs = now;
+            std::lock_guard<std::mutex> lock(mtx);
+            if (db) sqlite3_exec(db, "PRAGMA optimize;", nullptr, nullptr, nullptr);
         }
-        sqlite3_finalize(stmt);
+        if (now - lastFlushMs < flushIntervalMs) return;
+        lastFlushMs = now;
+        flushNodeUpdates();
     }
 
-    void setNodePosition(uint32_t nodeId, int64_t latitude, int64_t longitude, int altitude) {
+    // Writes the merged node updates collected since the last flush, one UPDATE per node, in one transaction.
+    void flushNodeUpdates() {
+        std::unordered_map<uint32_t, PendingNodeUpdate> updates;
+        {
+            std::lock_guard<std::mutex> lock(pendingMtx);
+            updates.swap(pendingUpdates);
+        }
+        if (updates.empty()) return;
+        auto start = std::chrono::steady_clock::now();
         std::lock_guard<std::mutex> lock(mtx);
         if (!db) return;
 
-        sqlite3_stmt* stmt;
-        const char* sql = "UPDATE nodes SET latitude = ?, longitude = ?, altitude = ?, last_updated = CURRENT_TIMESTAMP WHERE node_id = ?";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int64(stmt, 1, latitude);
-            sqlite3_bind_int64(stmt, 2, longitude);
-            sqlite3_bind_int(stmt, 3, altitude);
-            sqlite3_bind_int(stmt, 4, nodeId);
-
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error updating node position: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+        for (const auto& pair : updates) {
+            const PendingNodeUpdate& p = pair.second;
+            std::string sql = "UPDATE nodes SET last_updated = MAX(last_updated, ?)";
+            if (p.fields & FIELD_TEMPERATURE) sql += ", temperature = ?";
+            if (p.fields & FIELD_DEVICE) sql += ", battery_level = ?, battery_voltage = ?, uptime = ?, chutil = ?";
+            if (p.fields & FIELD_POSITION) sql += ", latitude = ?, longitude = ?, altitude = ?";
+            if (p.fields & FIELD_LASTCHN) sql += ", lastchn = ?";
+            sql += " WHERE node_id = ?";
+
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+                int idx = 1;
+                sqlite3_bind_int64(stmt, idx++, p.lastUpdated);
+                if (p.fields & FIELD_TEMPERATURE) {
+                    sqlite3_bind_double(stmt, idx++, p.temperature);
+                }
+                if (p.fields & FIELD_DEVICE) {
+                    sqlite3_bind_int(stmt, idx++, p.batteryLevel);
+                    sqlite3_bind_double(stmt, idx++, p.voltage);
+                    sqlite3_bind_int(stmt, idx++, p.uptime);
+                    sqlite3_bind_double(stmt, idx++, p.chutil);
+                }
+                if (p.fields & FIELD_POSITION) {
+                    sqlite3_bind_int64(stmt, idx++, p.latitude);
+                    sqlite3_bind_int64(stmt, idx++, p.longitude);
+                    sqlite3_bind_int(stmt, idx++, p.altitude);
+                }
+                if (p.fields & FIELD_LASTCHN) {
+                    sqlite3_bind_int(stmt, idx++, p.lastchn);
+                }
+                sqlite3_bind_int(stmt, idx++, pair.first);
+
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    LOG_ERROR("Error updating node: %s\n", sqlite3_errmsg(db));
+                }
+            } else {
+                LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
             }
-        } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_finalize(stmt);
         }
-        sqlite3_finalize(stmt);
+        if (sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            LOG_ERROR("Error committing node updates: %s\n", sqlite3_errmsg(db));
+        }
+        flushedRows.inc(updates.size());
+        flushLatency.observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
     }
 
-    void saveNodeSNR(uint32_t nodeId1, uint32_t nodeId2, float snr) {
-        if (nodeId1 == nodeId2) return;                              // Skip exotic case
-        if (nodeId1 == 0xffffffff || nodeId2 == 0xffffffff) return;  // Skip broadcast case
+    // The link graph lives in NodeStore, this writes the links sampled since the last call in one transaction.
+    // Call it periodically and at exit.
+    void saveLinks(NodeStore& store) {
+        std::vector<LinkRecord> links;
+        store.takeDirtyLinks(links);
+        if (links.empty()) return;
         std::lock_guard<std::mutex> lock(mtx);
         if (!db) return;
         sqlite3_stmt* stmt;
-        const char* sql = "INSERT INTO snr (node1, node2, snr, last_updated) VALUES (?, ?, ?, CURRENT_TIMESTAMP) ON CONFLICT(node1, node2) DO UPDATE SET snr = excluded.snr, last_updated = CURRENT_TIMESTAMP";
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, nodeId1);
-            sqlite3_bind_int(stmt, 2, nodeId2);
-            sqlite3_bind_double(stmt, 3, snr);
-
+        const char* sql =
+            "INSERT INTO snr (node1, node2, snr, last_updated, snr_last, snr_min, snr_max, samples, first_seen) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?) "
+            "ON CONFLICT(node1, node2) DO UPDATE SET snr = excluded.snr, last_updated = excluded.last_updated, snr_last = excluded.snr_last, "
+            "snr_min = excluded.snr_min, snr_max = excluded.snr_max, samples = excluded.samples, first_seen = excluded.first_seen";
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
+            return;
+        }
+        sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+        for (const LinkRecord& link : links) {
+            sqlite3_bind_int(stmt, 1, link.node1);
+            sqlite3_bind_int(stmt, 2, link.node2);
+            sqlite3_bind_double(stmt, 3, link.snr);
+            sqlite3_bind_int64(stmt, 4, link.lastUpdated);
+            sqlite3_bind_double(stmt, 5, link.lastSnr);
+            sqlite3_bind_double(stmt, 6, link.minSnr);
+            sqlite3_bind_double(stmt, 7, link.maxSnr);
+            sqlite3_bind_int(stmt, 8, link.samples);
+            sqlite3_bind_int64(stmt, 9, link.firstSeen);
             if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error saving node SNR: " << sqlite3_errmsg(db) << std::endl;
+                LOG_ERROR("Error saving node SNR: %s\n", sqlite3_errmsg(db));
             }
-        } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_reset(stmt);
         }
         sqlite3_finalize(stmt);
+        if (sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            LOG_ERROR("Error committing links: %s\n", sqlite3_errmsg(db));
+        }
     }
 
     void saveNodeMsgCnt(uint32_t nodeId, uint32_t msgCnt, uint32_t traceCnt, uint32_t telemetryCnt, uint32_t nodeInfoCnt, uint32_t posCnt) {
@@ -209,105 +433,442 @@ class NodeDb {
             sqlite3_bind_int(stmt, 7, nodeId);
 
             if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error updating node message count: " << sqlite3_errmsg(db) << std::endl;
+                LOG_ERROR("Error updating node message count: %s\n", sqlite3_errmsg(db));
             }
         } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
     }
 
-    void saveGlobalStats(uint32_t allCnt_868, uint32_t allCnt_433, uint32_t decodedCnt_868, uint32_t decodedCnt_433, uint32_t handledCnt_868, uint32_t handledCnt_433) {
+    // The hourly counts: the EU_868 / EU_433 summary the web pages read into mainstats, and a regionstats row
+    // per client and region.
+    void saveGlobalStats(const MainStatsRecord& stats, const std::vector<RegionStatsRecord>& regions) {
         std::lock_guard<std::mutex> lock(mtx);
         if (!db) return;
 
+        sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
         sqlite3_stmt* stmt;
-        const char* sql = "INSERT INTO mainstats (allcnt_868, allcnt_433, decoded_868, decoded_433, handled_868, handled_433) VALUES (?, ?, ?, ?, ?, ?)";
+        const char* sql = "INSERT INTO mainstats (allcnt_868, allcnt_433, decoded_868, decoded_433, handled_868, handled_433, time) VALUES (?, ?, ?, ?, ?, ?, ?)";
         if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int(stmt, 1, allCnt_868);
-            sqlite3_bind_int(stmt, 2, allCnt_433);
-            sqlite3_bind_int(stmt, 3, decodedCnt_868);
-            sqlite3_bind_int(stmt, 4, decodedCnt_433);
-            sqlite3_bind_int(stmt, 5, handledCnt_868);
-            sqlite3_bind_int(stmt, 6, handledCnt_433);
+            sqlite3_bind_int(stmt, 1, stats.allcnt_868);
+            sqlite3_bind_int(stmt, 2, stats.allcnt_433);
+            sqlite3_bind_int(stmt, 3, stats.decoded_868);
+            sqlite3_bind_int(stmt, 4, stats.decoded_433);
+            sqlite3_bind_int(stmt, 5, stats.handled_868);
+            sqlite3_bind_int(stmt, 6, stats.handled_433);
+            sqlite3_bind_int64(stmt, 7, stats.time);
 
             if (sqlite3_step(stmt) != SQLITE_DONE) {
-                std::cerr << "Error inserting global stats: " << sqlite3_errmsg(db) << std::endl;
+                LOG_ERROR("Error inserting global stats: %s\n", sqlite3_errmsg(db));
+            }
+        } else {
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
+        }
+        sqlite3_finalize(stmt);
+
+        const char* sql2 = "INSERT INTO regionstats (client, region, received, decoded, handled, time) VALUES (?, ?, ?, ?, ?, ?)";
+        if (sqlite3_prepare_v2(db, sql2, -1, &stmt, nullptr) == SQLITE_OK) {
+            for (const RegionStatsRecord& region : regions) {
+                sqlite3_bind_text(stmt, 1, region.client.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 2, region.region.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_int64(stmt, 3, region.received);
+                sqlite3_bind_int64(stmt, 4, region.decoded);
+                sqlite3_bind_int64(stmt, 5, region.handled);
+                sqlite3_bind_int64(stmt, 6, region.time);
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    LOG_ERROR("Error inserting region stats: %s\n", sqlite3_errmsg(db));
+                }
+                sqlite3_reset(stmt);
             }
         } else {
-            std::cerr << "Error preparing statement: " << sqlite3_errmsg(db) << std::endl;
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
         }
         sqlite3_finalize(stmt);
+        if (sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            LOG_ERROR("Error committing global stats: %s\n", sqlite3_errmsg(db));
+        }
     }
 
-   private:
-    void createTables() {
+    // Chat older than the message id beforeId (0: the newest), newest first, appended to out: the pages beyond the NodeStore chat ring.
+    void getChatPage(int64_t beforeId, size_t limit, std::vector<ChatRecord>& out) {
+        std::lock_guard<std::mutex> lock(readMtx);
+        if (!readDb) return;
+        sqlite3_stmt* stmt;
         const char* sql =
-            "CREATE TABLE IF NOT EXISTS nodes ("
-            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-            "node_id INTEGER UNIQUE, "
-            "short_name TEXT, "
-            "long_name TEXT, "
-            "latitude INTEGER, "
-            "longitude INTEGER, "
-            "altitude INTEGER, "
-            "temperature REAL, "
-            "battery_level INTEGER, "
-            "battery_voltage REAL, "
-            "chutil REAL, "
-            "freq INTEGER, "
-            "role INTEGER, "
-            "uptime INTEGER, sumcntph INTEGER DEFAULT 0, msgcntph INTEGER DEFAULT 0, tracecntph INTEGER DEFAULT 0, telemetrycntph INTEGER DEFAULT 0, nodeinfocntph INTEGER DEFAULT 0, poscntph INTEGER DEFAULT 0,"
-            "lastchn INTEGER DEFAULT 0,"
-            "last_updated TIMESTAMP DEFAULT CURRENT_TIMESTAMP);";
-        const char* sql2 =
-            "CREATE TABLE IF NOT EXISTS chat ("
-            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-            "node_id INTEGER, "
-            "chan_id INTEGER, "
-            "message TEXT, "
-            "freq INTEGER, "
-            "timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP);";
-        const char* sql3 =
-            "CREATE TABLE IF NOT EXISTS snr ("
-            "node1        INTEGER,"
-            "node2        INTEGER,"
-            "snr          INTEGER,"
-            "last_updated TIMESTAMP DEFAULT (CURRENT_TIMESTAMP) );";
-        const char* sql4 = "CREATE UNIQUE INDEX IF NOT EXISTS n1n2 ON snr ( node1, node2);";
-
-        const char* sql5 = "CREATE TABLE mainstats (    allcnt_868  INTEGER   DEFAULT (0),    allcnt_433  INTEGER   DEFAULT (0),    decoded_868 INTEGER   DEFAULT (0),    decoded_433 INTEGER   DEFAULT (0),    handled_868 INTEGER   DEFAULT (0),    handled_433 INTEGER   DEFAULT (0),    time    TIMESTAMP DEFAULT (CURRENT_TIMESTAMP) );";
-        if (db) {
-            char* errMsg = nullptr;
-            if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-                std::cerr << "SQL error: " << errMsg << std::endl;
-                sqlite3_free(errMsg);
-                errMsg = nullptr;
+            "SELECT T1.id, T1.node_id, T1.chan_id, T1.freq, T1.message, T1.timestamp, T2.short_name, T2.latitude, T2.longitude "
+            "FROM chat AS T1 LEFT JOIN nodes AS T2 ON T1.node_id = T2.node_id WHERE T1.id < ? ORDER BY T1.id DESC LIMIT ?";
+        if (sqlite3_prepare_v2(readDb, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, beforeId > 0 ? beforeId : INT64_MAX);
+            sqlite3_bind_int64(stmt, 2, limit);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                ChatRecord chat;
+                const char* message = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+                const char* shortName = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 6));
+                chat.id = sqlite3_column_int64(stmt, 0);
+                chat.nodeId = sqlite3_column_int(stmt, 1);
+                chat.chanId = sqlite3_column_int(stmt, 2);
+                chat.freq = sqlite3_column_int(stmt, 3);
+                chat.message = message ? message : "";
+                chat.timestamp = sqlite3_column_int64(stmt, 5);
+                if (shortName && shortName[0]) {
+                    chat.sender = shortName;
+                } else {
+                    char buf[16];
+                    snprintf(buf, sizeof(buf), "!%x", chat.nodeId);
+                    chat.sender = buf;
+                }
+                chat.hasCoords = sqlite3_column_int64(stmt, 7) != 0 || sqlite3_column_int64(stmt, 8) != 0;
+                out.push_back(chat);
             }
-            if (sqlite3_exec(db, sql2, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-                std::cerr << "SQL error: " << errMsg << std::endl;
-                sqlite3_free(errMsg);
-                errMsg = nullptr;
+        } else {
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(readDb));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    // Ranked full text search over the chat history (chat_fts, kept in sync by triggers on chat).
+    std::vector<ChatSearchResult> searchChat(const ChatSearchQuery& query) {
+        std::vector<ChatSearchResult> results;
+        std::string match = buildFtsMatch(query.text);
+        if (match.empty()) return results;
+        std::lock_guard<std::mutex> lock(readMtx);
+        if (!readDb) return results;
+
+        sqlite3_stmt* stmt;
+        const char* sql =
+            "SELECT c.id, c.node_id, c.chan_id, c.freq, c.message, c.timestamp, bm25(chat_fts) AS rank "
+            "FROM chat_fts JOIN chat AS c ON c.id = chat_fts.rowid "
+            "WHERE chat_fts MATCH ?1 "
+            "AND (?2 = 0 OR c.node_id = ?2) "
+            "AND (?3 = 0 OR c.freq = ?3) "
+            "AND (?4 < 0 OR c.chan_id = ?4) "
+            "AND (?5 = 0 OR c.timestamp >= ?5) "
+            "AND (?6 = 0 OR c.timestamp <= ?6) "
+            "ORDER BY rank LIMIT ?7";
+        if (sqlite3_prepare_v2(readDb, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int(stmt, 2, query.nodeId);
+            sqlite3_bind_int(stmt, 3, query.freq);
+            sqlite3_bind_int(stmt, 4, query.chanId);
+            sqlite3_bind_int64(stmt, 5, query.since);
+            sqlite3_bind_int64(stmt, 6, query.until);
+            sqlite3_bind_int(stmt, 7, query.limit > 0 ? query.limit : 50);
+            int rc;
+            while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+                const char* message = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 4));
+                results.push_back({sqlite3_column_int64(stmt, 0), (uint32_t)sqlite3_column_int(stmt, 1), (uint16_t)sqlite3_column_int(stmt, 2), (uint16_t)sqlite3_column_int(stmt, 3),
+                                   message ? message : "", (uint64_t)sqlite3_column_int64(stmt, 5), sqlite3_column_double(stmt, 6)});
             }
-            if (sqlite3_exec(db, sql3, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-                std::cerr << "SQL error: " << errMsg << std::endl;
-                sqlite3_free(errMsg);
-                errMsg = nullptr;
+            if (rc != SQLITE_DONE) {
+                LOG_ERROR("Error searching chat: %s\n", sqlite3_errmsg(readDb));
             }
-            if (sqlite3_exec(db, sql4, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-                std::cerr << "SQL error: " << errMsg << std::endl;
-                sqlite3_free(errMsg);
-                errMsg = nullptr;
+        } else {
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(readDb));
+        }
+        sqlite3_finalize(stmt);
+        return results;
+    }
+
+    // Runs EXPLAIN QUERY PLAN over the queries the web frontend issues and reports every plan step
+    // that walks a whole table (or sorts through a temp b-tree) instead of using an index.
+    // Returns true when all web queries are index-backed. The plans follow the statistics of the data,
+    // so the answer only means something on a database without them (tests/webqueryplans_test.cpp).
+    bool checkWebQueryPlans() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!db) return false;
+        bool ok = true;
+        for (const char* query : WEB_QUERIES) {
+            std::string explain = std::string("EXPLAIN QUERY PLAN ") + query;
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, explain.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+                LOG_ERROR("Error preparing query plan: %s\n", sqlite3_errmsg(db));
+                ok = false;
+                continue;
+            }
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                const char* detail = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+                if (!detail) continue;
+                std::string d(detail);
+                bool fullScan = d.rfind("SCAN ", 0) == 0 && d.find(" USING ") == std::string::npos;
+                if (fullScan || d.find("TEMP B-TREE") != std::string::npos) {
+                    LOG_WARN("Query plan without index: %s in: %s\n", d.c_str(), query);
+                    ok = false;
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+        return ok;
+    }
+
+    int getSchemaVersion() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return readSchemaVersion();
+    }
+
+   private:
+    enum : uint32_t {
+        FIELD_TEMPERATURE = 1 << 0,
+        FIELD_DEVICE = 1 << 1,  // battery level, voltage, uptime, chutil
+        FIELD_POSITION = 1 << 2,
+        FIELD_LASTCHN = 1 << 3,
+    };
+
+    // Latest value of every field touched since the last flush. last_updated is always written.
+    struct PendingNodeUpdate {
+        uint32_t fields = 0;
+        uint64_t lastUpdated = 0;
+        float temperature = 0;
+        int batteryLevel = 0;
+        float voltage = 0;
+        uint32_t uptime = 0;
+        float chutil = 0;
+        int64_t latitude = 0;
+        int64_t longitude = 0;
+        int altitude = 0;
+        uint8_t lastchn = 0;
+    };
+
+    // pendingMtx must be held
+    PendingNodeUpdate& touchPending(uint32_t nodeId, uint64_t timeMs) {
+        PendingNodeUpdate& p = pendingUpdates[nodeId];
+        if (timeMs > p.lastUpdated) p.lastUpdated = timeMs;
+        return p;
+    }
+
+    struct Migration {
+        int version;
+        const char* description;
+        const char* sql;
+    };
+
+    // Ordered schema migrations. The applied version is kept in PRAGMA user_version, each step runs in its own
+    // transaction. Never edit an already released step, append a new one instead.
+    static constexpr Migration MIGRATIONS[] = {
+        {1, "base schema",
+         "CREATE TABLE IF NOT EXISTS nodes ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+         "node_id INTEGER UNIQUE, "
+         "short_name TEXT, "
+         "long_name TEXT, "
+         "latitude INTEGER, "
+         "longitude INTEGER, "
+         "altitude INTEGER, "
+         "temperature REAL, "
+         "battery_level INTEGER, "
+         "battery_voltage REAL, "
+         "chutil REAL, "
+         "freq INTEGER, "
+         "role INTEGER, "
+         "uptime INTEGER, sumcntph INTEGER DEFAULT 0, msgcntph INTEGER DEFAULT 0, tracecntph INTEGER DEFAULT 0, telemetrycntph INTEGER DEFAULT 0, nodeinfocntph INTEGER DEFAULT 0, poscntph INTEGER DEFAULT 0,"
+         "lastchn INTEGER DEFAULT 0,"
+         "last_updated TIMESTAMP DEFAULT CURRENT_TIMESTAMP);"
+         "CREATE TABLE IF NOT EXISTS chat ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+         "node_id INTEGER, "
+         "chan_id INTEGER, "
+         "message TEXT, "
+         "freq INTEGER, "
+         "timestamp TIMESTAMP DEFAULT CURRENT_TIMESTAMP);"
+         "CREATE TABLE IF NOT EXISTS snr ("
+         "node1        INTEGER,"
+         "node2        INTEGER,"
+         "snr          INTEGER,"
+         "last_updated TIMESTAMP DEFAULT (CURRENT_TIMESTAMP) );"
+         "CREATE UNIQUE INDEX IF NOT EXISTS n1n2 ON snr ( node1, node2);"
+         "CREATE TABLE IF NOT EXISTS mainstats (    allcnt_868  INTEGER   DEFAULT (0),    allcnt_433  INTEGER   DEFAULT (0),    decoded_868 INTEGER   DEFAULT (0),    decoded_433 INTEGER   DEFAULT (0),    handled_868 INTEGER   DEFAULT (0),    handled_433 INTEGER   DEFAULT (0),    time    TIMESTAMP DEFAULT (CURRENT_TIMESTAMP) );"},
+        {2, "indexes for the web queries",
+         // map.php / api.php: chat of the last days, newest first
+         "CREATE INDEX IF NOT EXISTS idx_chat_timestamp ON chat (timestamp, node_id, freq, chan_id);"
+         // link layer: covers the whole 7 day snr query, and the incoming side of snrinfo (outgoing uses n1n2)
+         "CREATE INDEX IF NOT EXISTS idx_snr_last_updated ON snr (last_updated, node1, node2, snr);"
+         "CREATE INDEX IF NOT EXISTS idx_snr_node2 ON snr (node2, last_updated, node1, snr);"
+         // node list sorted by last seen, per freq stats, and the nodeinfo lookup by short name
+         "CREATE INDEX IF NOT EXISTS idx_nodes_last_updated ON nodes (last_updated);"
+         "CREATE INDEX IF NOT EXISTS idx_nodes_freq ON nodes (freq, last_updated);"
+         "CREATE INDEX IF NOT EXISTS idx_nodes_short_name ON nodes (short_name COLLATE NOCASE);"
+         "CREATE INDEX IF NOT EXISTS idx_mainstats_time ON mainstats (time);"},
+        {3, "chat full text index",
+         "CREATE VIRTUAL TABLE IF NOT EXISTS chat_fts USING fts5(message, content='chat', content_rowid='id', tokenize='unicode61 remove_diacritics 2');"
+         "CREATE TRIGGER IF NOT EXISTS chat_fts_ai AFTER INSERT ON chat BEGIN "
+         "INSERT INTO chat_fts (rowid, message) VALUES (new.id, new.message); END;"
+         "CREATE TRIGGER IF NOT EXISTS chat_fts_ad AFTER DELETE ON chat BEGIN "
+         "INSERT INTO chat_fts (chat_fts, rowid, message) VALUES ('delete', old.id, old.message); END;"
+         "CREATE TRIGGER IF NOT EXISTS chat_fts_au AFTER UPDATE OF message ON chat BEGIN "
+         "INSERT INTO chat_fts (chat_fts, rowid, message) VALUES ('delete', old.id, old.message); "
+         "INSERT INTO chat_fts (rowid, message) VALUES (new.id, new.message); END;"
+         "INSERT INTO chat_fts (chat_fts) VALUES ('rebuild');"},
+        // Timestamps become integer epoch milliseconds: range filters and staleness checks are plain integer
+        // compares, and the rows get smaller. The tables are rebuilt so the columns lose the text defaults.
+        {4, "integer epoch ms timestamps",
+         "CREATE TABLE nodes_new ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+         "node_id INTEGER UNIQUE, "
+         "short_name TEXT, "
+         "long_name TEXT, "
+         "latitude INTEGER, "
+         "longitude INTEGER, "
+         "altitude INTEGER, "
+         "temperature REAL, "
+         "battery_level INTEGER, "
+         "battery_voltage REAL, "
+         "chutil REAL, "
+         "freq INTEGER, "
+         "role INTEGER, "
+         "uptime INTEGER, sumcntph INTEGER DEFAULT 0, msgcntph INTEGER DEFAULT 0, tracecntph INTEGER DEFAULT 0, telemetrycntph INTEGER DEFAULT 0, nodeinfocntph INTEGER DEFAULT 0, poscntph INTEGER DEFAULT 0,"
+         "lastchn INTEGER DEFAULT 0,"
+         "last_updated INTEGER NOT NULL DEFAULT 0);"
+         "INSERT INTO nodes_new SELECT id, node_id, short_name, long_name, latitude, longitude, altitude, temperature, battery_level, battery_voltage, chutil, freq, role, "
+         "uptime, sumcntph, msgcntph, tracecntph, telemetrycntph, nodeinfocntph, poscntph, lastchn, "
+         "CASE WHEN typeof(last_updated) = 'integer' THEN last_updated ELSE COALESCE(CAST(strftime('%s', last_updated) AS INTEGER) * 1000, 0) END FROM nodes;"
+         "DROP TABLE nodes;"
+         "ALTER TABLE nodes_new RENAME TO nodes;"
+         "CREATE INDEX idx_nodes_last_updated ON nodes (last_updated);"
+         "CREATE INDEX idx_nodes_freq ON nodes (freq, last_updated);"
+         "CREATE INDEX idx_nodes_short_name ON nodes (short_name COLLATE NOCASE);"
+         "CREATE TABLE chat_new ("
+         "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+         "node_id INTEGER, "
+         "chan_id INTEGER, "
+         "message TEXT, "
+         "freq INTEGER, "
+         "timestamp INTEGER NOT NULL DEFAULT 0);"
+         "INSERT INTO chat_new SELECT id, node_id, chan_id, message, freq, CASE WHEN typeof(timestamp) = 'integer' THEN timestamp ELSE COALESCE(CAST(strftime('%s', timestamp) AS INTEGER) * 1000, 0) END FROM chat;"
+         "DROP TABLE chat;"  // drops the chat_fts triggers too, the ids (fts rowids) are kept
+         "ALTER TABLE chat_new RENAME TO chat;"
+         "CREATE INDEX idx_chat_timestamp ON chat (timestamp, node_id, freq, chan_id);"
+         "CREATE TRIGGER chat_fts_ai AFTER INSERT ON chat BEGIN "
+         "INSERT INTO chat_fts (rowid, message) VALUES (new.id, new.message); END;"
+         "CREATE TRIGGER chat_fts_ad AFTER DELETE ON chat BEGIN "
+         "INSERT INTO chat_fts (chat_fts, rowid, message) VALUES ('delete', old.id, old.message); END;"
+         "CREATE TRIGGER chat_fts_au AFTER UPDATE OF message ON chat BEGIN "
+         "INSERT INTO chat_fts (chat_fts, rowid, message) VALUES ('delete', old.id, old.message); "
+         "INSERT INTO chat_fts (rowid, message) VALUES (new.id, new.message); END;"
+         "CREATE TABLE snr_new ("
+         "node1        INTEGER,"
+         "node2        INTEGER,"
+         "snr          INTEGER,"
+         "last_updated INTEGER NOT NULL DEFAULT 0);"
+         "INSERT INTO snr_new SELECT node1, node2, snr, CASE WHEN typeof(last_updated) = 'integer' THEN last_updated ELSE COALESCE(CAST(strftime('%s', last_updated) AS INTEGER) * 1000, 0) END FROM snr;"
+         "DROP TABLE snr;"
+         "ALTER TABLE snr_new RENAME TO snr;"
+         "CREATE UNIQUE INDEX n1n2 ON snr (node1, node2);"
+         "CREATE INDEX idx_snr_last_updated ON snr (last_updated, node1, node2, snr);"
+         "CREATE INDEX idx_snr_node2 ON snr (node2, last_updated, node1, snr);"
+         "CREATE TABLE mainstats_new (allcnt_868 INTEGER DEFAULT (0), allcnt_433 INTEGER DEFAULT (0), decoded_868 INTEGER DEFAULT (0), decoded_433 INTEGER DEFAULT (0), "
+         "handled_868 INTEGER DEFAULT (0), handled_433 INTEGER DEFAULT (0), time INTEGER NOT NULL DEFAULT 0);"
+         "INSERT INTO mainstats_new SELECT allcnt_868, allcnt_433, decoded_868, decoded_433, handled_868, handled_433, CASE WHEN typeof(time) = 'integer' THEN time ELSE COALESCE(CAST(strftime('%s', time) AS INTEGER) * 1000, 0) END FROM mainstats;"
+         "DROP TABLE mainstats;"
+         "ALTER TABLE mainstats_new RENAME TO mainstats;"
+         "CREATE INDEX idx_mainstats_time ON mainstats (time);"},
+        {5, "link statistics",
+         // snr becomes the smoothed value, the map and api.php keep reading it
+         "ALTER TABLE snr ADD COLUMN snr_last REAL;"
+         "ALTER TABLE snr ADD COLUMN snr_min REAL;"
+         "ALTER TABLE snr ADD COLUMN snr_max REAL;"
+         "ALTER TABLE snr ADD COLUMN samples INTEGER NOT NULL DEFAULT 0;"
+         "ALTER TABLE snr ADD COLUMN first_seen INTEGER NOT NULL DEFAULT 0;"
+         "UPDATE snr SET snr_last = snr, snr_min = snr, snr_max = snr, samples = 1, first_seen = last_updated;"},
+        {6, "ingest counts of every region",
+         // mainstats keeps the EU_868 / EU_433 summary the web pages read
+         "CREATE TABLE regionstats ("
+         "client   TEXT,"
+         "region   TEXT,"
+         "received INTEGER NOT NULL DEFAULT 0,"
+         "decoded  INTEGER NOT NULL DEFAULT 0,"
+         "handled  INTEGER NOT NULL DEFAULT 0,"
+         "time     INTEGER NOT NULL DEFAULT 0);"
+         "CREATE INDEX idx_regionstats_time ON regionstats (time, region);"},
+    };
+
+    // The queries WebPage/map.php and WebPage/api.php run, used by checkWebQueryPlans(). Left out on
+    // purpose: map.php's other node list sorts (ORDER BY long_name ASC, ORDER BY sumcntph DESC) and
+    // api.php's unordered node list read the whole table anyway; the sorts are expected to go through
+    // a temp B-tree over the few thousand rows, an index on long_name or on the hourly counters would
+    // cost more on every node flush than it saves there.
+    static constexpr const char* WEB_QUERIES[] = {
+        "SELECT node_id, short_name, long_name, latitude, longitude, last_updated, battery_level, temperature, freq, role, battery_voltage, uptime, msgcntph, tracecntph, telemetrycntph, nodeinfocntph, poscntph, sumcntph, chutil, lastchn FROM nodes ORDER BY last_updated DESC",
+        "SELECT node_id, last_updated FROM nodes WHERE freq = 868 ORDER BY last_updated DESC",
+        "SELECT * FROM nodes WHERE node_id = 1 OR short_name = 'abcd' COLLATE NOCASE",
+        "SELECT node1, node2, snr FROM snr WHERE last_updated >= 1700000000000 AND node1 != node2 AND snr != 0 AND node1 != -1 AND node2 != -1",
+        "SELECT T1.snr, T1.node1, T2.short_name, T2.long_name FROM snr AS T1 LEFT JOIN nodes AS T2 ON T1.node1 = T2.node_id WHERE T1.node2 = 1 AND T1.last_updated >= 1700000000000 AND T1.snr != 0 AND T1.node1 != -1",
+        "SELECT T1.snr, T1.node2, T2.short_name, T2.long_name FROM snr AS T1 LEFT JOIN nodes AS T2 ON T1.node2 = T2.node_id WHERE T1.node1 = 1 AND T1.last_updated >= 1700000000000 AND T1.snr != 0 AND T1.node2 != -1",
+        "SELECT node_id, message, timestamp, freq, chan_id FROM chat WHERE timestamp >= 1700000000000 ORDER BY timestamp DESC",
+        "SELECT allcnt_868, allcnt_433, decoded_868, decoded_433, handled_868, handled_433, time FROM mainstats ORDER BY time DESC LIMIT 5",
+    };
+
+    int readSchemaVersion() {
+        if (!db) return -1;
+        int version = 0;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, nullptr) == SQLITE_OK) {
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                version = sqlite3_column_int(stmt, 0);
             }
-            if (sqlite3_exec(db, sql5, nullptr, nullptr, &errMsg) != SQLITE_OK) {
-                std::cerr << "SQL error: " << errMsg << std::endl;
+        } else {
+            LOG_ERROR("Error preparing statement: %s\n", sqlite3_errmsg(db));
+        }
+        sqlite3_finalize(stmt);
+        return version;
+    }
+
+    // Turns free text into an FTS5 query: every word becomes a quoted term (so user input can't inject
+    // FTS operators), a trailing '*' is kept as prefix match. Terms are ANDed.
+    static std::string buildFtsMatch(const std::string& text) {
+        std::string match;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t start = text.find_first_not_of(" \t\r\n", pos);
+            if (start == std::string::npos) break;
+            size_t end = text.find_first_of(" \t\r\n", start);
+            if (end == std::string::npos) end = text.size();
+            std::string word = text.substr(start, end - start);
+            pos = end;
+            bool prefix = word.size() > 1 && word.back() == '*';
+            if (prefix) word.pop_back();
+            std::string quoted = "\"";
+            for (char c : word) {
+                if (c == '"') quoted += '"';
+                quoted += c;
+            }
+            quoted += "\"";
+            if (!match.empty()) match += " ";
+            match += quoted + (prefix ? "*" : "");
+        }
+        return match;
+    }
+
+    void createTables() {
+        if (!db) return;
+        int version = readSchemaVersion();
+        for (const Migration& m : MIGRATIONS) {
+            if (m.version <= version) continue;
+            std::string sql = std::string("BEGIN;") + m.sql + "PRAGMA user_version = " + std::to_string(m.version) + ";COMMIT;";
+            char* errMsg = nullptr;
+            if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+                LOG_ERROR("Schema migration %d (%s) failed: %s\n", m.version, m.description, errMsg);
                 sqlite3_free(errMsg);
-                errMsg = nullptr;
+                sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+                return;  // later steps depend on this one
             }
+            LOG_INFO("Schema migrated to version %d (%s)\n", m.version, m.description);
+            version = m.version;
         }
     }
     sqlite3* db = nullptr;
     std::mutex mtx;
+    // Read only connection of the web handlers: they run on the HTTP server thread and must not wait for
+    // the writer's transactions behind mtx.
+    sqlite3* readDb = nullptr;
+    std::mutex readMtx;
+
+    std::unordered_map<uint32_t, PendingNodeUpdate> pendingUpdates;
+    std::mutex pendingMtx;  // separate from mtx, so the MQTT threads never wait for a flush
+    uint32_t flushIntervalMs = 30000;
+    uint64_t lastFlushMs = 0;
+    uint64_t lastOptimizeMs = nowMs();  // not at start: a fresh database has nothing worth analyzing yet
+    Histogram flushLatency = metrics().histogram("meshmap_db_flush_seconds", "", "Time of a node update flush, waiting for the database lock included", latencyBucketsUs(), 1e-6);
+    Counter flushedRows = metrics().counter("meshmap_db_flushed_rows_total", "", "Node rows written by the update flushes");
 };
 
 #endif  // NODEDB_HPP
\ No newline at end of file
@@ -82,6 +82,15 @@ class NodeNameMap {
         }
     }
 
+    // Approximate heap use in bytes, for the metrics.
+    size_t memoryUsage() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t bytes = nodeNames_.size() * (sizeof(std::pair<const uint32_t, std::string>) + 16);
+        for (const auto& pair : nodeNames_) bytes += pair.second.capacity() > 15 ? pair.second.capacity() + 1 : 0;
+        bytes += (nodeMsgCnt_.size() + nodeTraceCnt_.size() + nodeTelemetryCnt_.size() + nodeInfoCnt_.size() + posCnt_.size()) * (sizeof(std::pair<const uint32_t, uint32_t>) + 16);
+        return bytes;
+    }
+
    private:
     std::unordered_map<uint32_t, std::string> nodeNames_;
     std::unordered_map<uint32_t, uint32_t> nodeMsgCnt_;
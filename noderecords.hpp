@@ -0,0 +1,101 @@
+#ifndef NODERECORDS_HPP
+#define NODERECORDS_HPP
+
+#include <cstdint>
+#include <string>
+
+#define NODESTORE_STALE_MS (24ULL * 3600 * 1000)   // node is stale after a day without packets
+#define NODESTORE_LINK_MS (7ULL * 24 * 3600 * 1000)  // links are shown for a week
+#define NODESTORE_CHAT_RING 2000                     // default number of chat messages kept in memory
+#define NODESTORE_MAINSTATS 5                        // hourly stat rows kept in memory
+#define NODESTORE_NODE_MS (14ULL * 24 * 3600 * 1000)  // nodes are dropped after two weeks without packets, like adminn.php does
+#define NODESTORE_TOMBSTONE_MS (24ULL * 3600 * 1000)  // removed nodes are reported to delta clients for a day
+#define NODESTORE_SNR_ALPHA 0.25f                     // weight of a new SNR sample in the smoothed link SNR
+#define NODESTORE_TELEMETRY_RING 24                   // recent telemetry samples kept per node
+
+// One row of the nodes table, as the web side sees it.
+struct NodeRecord {
+    uint32_t nodeId = 0;
+    std::string shortName;
+    std::string longName;
+    int32_t latitude = 0;  // 1e-7 degrees
+    int32_t longitude = 0;
+    int32_t altitude = 0;
+    float temperature = 0;
+    int batteryLevel = 0;
+    float batteryVoltage = 0;
+    float chutil = 0;
+    uint16_t freq = 0;
+    uint8_t role = 0;
+    uint32_t uptime = 0;
+    uint32_t msgcntph = 0;
+    uint32_t tracecntph = 0;
+    uint32_t telemetrycntph = 0;
+    uint32_t nodeinfocntph = 0;
+    uint32_t poscntph = 0;
+    uint32_t sumcntph = 0;
+    uint8_t lastchn = 0;
+    uint64_t lastUpdated = 0;  // epoch ms
+    uint64_t seq = 0;          // NodeStore change sequence of the last update
+
+    bool hasPosition() const { return latitude != 0 || longitude != 0; }
+    bool isStale(uint64_t now) const { return lastUpdated != 0 && now > lastUpdated + NODESTORE_STALE_MS; }  // same rule as the web pages
+    // short name if set, long name otherwise (like the web pages do)
+    std::string displayName() const { return !shortName.empty() ? shortName : longName; }
+};
+
+// One directed link, node1 heard by node2.
+struct LinkRecord {
+    uint32_t node1 = 0;
+    uint32_t node2 = 0;
+    float snr = 0;  // exponentially weighted moving average of the samples
+    float lastSnr = 0;
+    float minSnr = 0;
+    float maxSnr = 0;
+    uint32_t samples = 0;
+    uint64_t firstSeen = 0;  // epoch ms
+    uint64_t lastUpdated = 0;
+};
+
+// The telemetry fields of a node right after one of its telemetry packets.
+struct TelemetrySample {
+    uint64_t time = 0;  // epoch ms
+    int batteryLevel = 0;
+    float batteryVoltage = 0;
+    float chutil = 0;
+    uint32_t uptime = 0;
+    float temperature = 0;
+};
+
+struct ChatRecord {
+    int64_t id = 0;
+    uint32_t nodeId = 0;
+    uint16_t chanId = 0;
+    uint16_t freq = 0;
+    std::string message;
+    uint64_t timestamp = 0;
+    std::string sender;      // short name (hex id if unknown) when the message arrived, set by the store
+    bool hasCoords = false;  // the sender's position is known, filled in by the readers
+};
+
+struct MainStatsRecord {
+    uint32_t allcnt_868 = 0;
+    uint32_t allcnt_433 = 0;
+    uint32_t decoded_868 = 0;
+    uint32_t decoded_433 = 0;
+    uint32_t handled_868 = 0;
+    uint32_t handled_433 = 0;
+    uint64_t time = 0;
+};
+
+// Ingest counts of one MQTT client and modem region over an hour, a row of the regionstats table.
+struct RegionStatsRecord {
+    std::string client;
+    std::string region;  // msh/<region>/... of the topic, e.g. EU_868
+    uint64_t received = 0;
+    uint64_t decoded = 0;
+    uint64_t handled = 0;  // passed on to a callback
+    uint64_t time = 0;
+};
+
+#endif  // NODERECORDS_HPP
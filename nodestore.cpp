@@ -0,0 +1,553 @@
+#include "nodestore.hpp"
+#include "timeutil.hpp"
+#include <cstdlib>
+#include <cctype>
+#include <cstdio>
+#include <algorithm>
+#include <strings.h>
+
+template <typename Fn>
+NodeRecord* NodeStore::updateNode(uint32_t nodeId, uint64_t timeMs, Fn fn) {
+    auto it = nodes.find(nodeId);
+    if (it == nodes.end()) return nullptr;
+    NodeRecord& node = it->second;
+    countNode(node, -1);
+    if (timeMs > node.lastUpdated) node.lastUpdated = timeMs;
+    fn(node);
+    countNode(node, 1);
+    stamp(node);
+    return &node;
+}
+
+void NodeStore::setListener(StoreListener fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    listener = fn;
+}
+
+void NodeStore::notify(StoreChange change, const NodeRecord* node, const LinkRecord* link, const ChatRecord* chat) {
+    if (listener) listener(change, node, link, chat);
+}
+
+void NodeStore::setNodeInfo(uint32_t nodeId, const std::string& shortName, const std::string& longName, uint16_t freq, uint8_t role, uint8_t chanhash, uint64_t timeMs) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = nodes.find(nodeId);
+    // links are counted on the frequency of their nodes, a new node or a new frequency moves them
+    bool relink = it == nodes.end() || it->second.freq != freq;
+    if (relink) countLinksOf(nodeId, -1);
+    if (it != nodes.end()) countNode(it->second, -1);
+    NodeRecord& node = nodes[nodeId];
+    node.nodeId = nodeId;
+    node.shortName = shortName;
+    node.longName = longName;
+    node.freq = freq;
+    node.role = role;
+    node.lastchn = chanhash;
+    if (timeMs > node.lastUpdated) node.lastUpdated = timeMs;
+    countNode(node, 1);
+    if (relink) countLinksOf(nodeId, 1);
+    stamp(node);
+    notify(StoreChange::NodeInfo, &node);
+}
+
+void NodeStore::setNodeTemperature(uint32_t nodeId, float temperature, uint8_t chanhash, uint64_t timeMs) {
+    if (temperature < -100 || temperature > 300) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    NodeRecord* node = updateNode(nodeId, timeMs, [&](NodeRecord& node) {
+        node.temperature = temperature;
+        node.lastchn = chanhash;
+    });
+    if (!node) return;
+    addTelemetry(*node, timeMs);
+    notify(StoreChange::Telemetry, node);
+}
+
+void NodeStore::setNodeTelemetryDevice(uint32_t nodeId, int batteryLevel, float voltage, uint32_t uptime, float chutil, uint8_t chanhash, uint64_t timeMs) {
+    if (batteryLevel < 0 || batteryLevel > 101) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    NodeRecord* node = updateNode(nodeId, timeMs, [&](NodeRecord& node) {
+        node.batteryLevel = batteryLevel;
+        node.batteryVoltage = voltage;
+        node.uptime = uptime;
+        node.chutil = chutil;
+        node.lastchn = chanhash;
+    });
+    if (!node) return;
+    addTelemetry(*node, timeMs);
+    notify(StoreChange::Telemetry, node);
+}
+
+void NodeStore::setNodePosition(uint32_t nodeId, int32_t latitude, int32_t longitude, int32_t altitude, uint64_t timeMs) {
+    std::lock_guard<std::mutex> lock(mtx);
+    NodeRecord* node = updateNode(nodeId, timeMs, [&](NodeRecord& node) {
+        node.latitude = latitude;
+        node.longitude = longitude;
+        node.altitude = altitude;
+    });
+    if (node) notify(StoreChange::Position, node);
+}
+
+void NodeStore::setNodeMsgCnt(uint32_t nodeId, uint32_t msgCnt, uint32_t traceCnt, uint32_t telemetryCnt, uint32_t nodeInfoCnt, uint32_t posCnt) {
+    std::lock_guard<std::mutex> lock(mtx);
+    updateNode(nodeId, 0, [&](NodeRecord& node) {
+        node.msgcntph = msgCnt;
+        node.tracecntph = traceCnt;
+        node.telemetrycntph = telemetryCnt;
+        node.nodeinfocntph = nodeInfoCnt;
+        node.poscntph = posCnt;
+        node.sumcntph = msgCnt + traceCnt + telemetryCnt + nodeInfoCnt + posCnt;
+    });
+}
+
+void NodeStore::saveNodeSNR(uint32_t nodeId1, uint32_t nodeId2, float snr, uint64_t timeMs) {
+    if (nodeId1 == nodeId2) return;
+    if (nodeId1 == 0xffffffff || nodeId2 == 0xffffffff) return;
+    std::lock_guard<std::mutex> lock(mtx);
+    LinkRecord link;
+    auto it = links.find({nodeId1, nodeId2});
+    if (it != links.end()) {
+        // smooth the noisy per hop samples, so the link colour doesn't flicker between traceroutes
+        link = it->second;
+        link.snr += NODESTORE_SNR_ALPHA * (snr - link.snr);
+        link.minSnr = std::min(link.minSnr, snr);
+        link.maxSnr = std::max(link.maxSnr, snr);
+        link.samples++;
+        if (timeMs > link.lastUpdated) link.lastUpdated = timeMs;
+    } else {
+        link.node1 = nodeId1;
+        link.node2 = nodeId2;
+        link.snr = link.minSnr = link.maxSnr = snr;
+        link.samples = 1;
+        link.firstSeen = link.lastUpdated = timeMs;
+    }
+    link.lastSnr = snr;
+    storeLink(link);
+    dirtyLinks.insert({nodeId1, nodeId2});
+    notify(StoreChange::Link, nullptr, &links[{nodeId1, nodeId2}]);
+}
+
+void NodeStore::storeLink(const LinkRecord& record) {
+    LinkKey key{record.node1, record.node2};
+    auto it = links.find(key);
+    if (it != links.end()) {
+        countLink(it->second, -1);
+        linksByTime.erase({it->second.lastUpdated, key});
+    } else {
+        outLinks[record.node1].insert(record.node2);
+        inLinks[record.node2].insert(record.node1);
+    }
+    LinkRecord& link = links[key];
+    link = record;
+    linksByTime.insert({link.lastUpdated, key});
+    countLink(link, 1);
+    generations[1]++;
+}
+
+void NodeStore::addChatMessage(const ChatRecord& record) {
+    std::lock_guard<std::mutex> lock(mtx);
+    NodeRecord* sender = updateNode(record.nodeId, record.timestamp, [](NodeRecord&) {});
+    chat.push_back(record);
+    ChatRecord& stored = chat.back();
+    if (sender && !sender->shortName.empty()) {
+        stored.sender = sender->shortName;
+    } else {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "!%x", record.nodeId);
+        stored.sender = buf;
+    }
+    while (chat.size() > chatLimit) chat.pop_front();
+    generations[2]++;
+    notify(StoreChange::Chat, sender, nullptr, &stored);
+}
+
+void NodeStore::setChatCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mtx);
+    chatLimit = capacity > 0 ? capacity : 1;
+    while (chat.size() > chatLimit) chat.pop_front();
+    generations[2]++;
+}
+
+size_t NodeStore::chatCapacity() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return chatLimit;
+}
+
+void NodeStore::addMainStats(const MainStatsRecord& stats) {
+    std::lock_guard<std::mutex> lock(mtx);
+    mainStats.push_back(stats);
+    while (mainStats.size() > NODESTORE_MAINSTATS) mainStats.pop_front();
+    generations[3]++;
+}
+
+void NodeStore::loadNode(const NodeRecord& record) {
+    std::lock_guard<std::mutex> lock(mtx);
+    countLinksOf(record.nodeId, -1);
+    auto it = nodes.find(record.nodeId);
+    if (it != nodes.end()) countNode(it->second, -1);
+    NodeRecord& node = nodes[record.nodeId];
+    uint64_t seq = node.seq;
+    node = record;
+    node.seq = seq;
+    countNode(node, 1);
+    countLinksOf(record.nodeId, 1);
+    stamp(node);
+}
+
+void NodeStore::loadLink(const LinkRecord& link) {
+    std::lock_guard<std::mutex> lock(mtx);
+    storeLink(link);
+}
+
+void NodeStore::expire(uint64_t now) {
+    std::lock_guard<std::mutex> lock(mtx);
+    advance(now);
+}
+
+void NodeStore::takeDirtyLinks(std::vector<LinkRecord>& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const LinkKey& key : dirtyLinks) {
+        auto it = links.find(key);
+        if (it != links.end()) out.push_back(it->second);
+    }
+    dirtyLinks.clear();
+}
+
+uint64_t NodeStore::generation(unsigned states) {
+    std::lock_guard<std::mutex> lock(mtx);
+    advance(nowMs());
+    uint64_t sum = 0;  // every counter only grows, so the sum moves exactly when one of them does
+    for (int i = 0; i < 4; i++) {
+        if (states & (1u << i)) sum += generations[i];
+    }
+    return sum;
+}
+
+void NodeStore::stamp(NodeRecord& node) {
+    if (node.seq) bySeq.erase(node.seq);
+    node.seq = ++changeSeq;
+    bySeq[node.seq] = node.nodeId;
+    generations[0]++;
+}
+
+void NodeStore::removeNode(uint32_t nodeId, uint64_t now) {
+    auto it = nodes.find(nodeId);
+    if (it == nodes.end()) return;
+    countLinksOf(nodeId, -1);
+    countNode(it->second, -1);
+    bySeq.erase(it->second.seq);
+    nodes.erase(it);
+    telemetry.erase(nodeId);
+    tombstones.push_back({++changeSeq, nodeId, now});
+    generations[0]++;
+}
+
+void NodeStore::countNode(const NodeRecord& node, int sign) {
+    FreqStats& stats = freqStats[node.freq];
+    bool online;
+    if (node.lastUpdated != 0) {
+        if (sign > 0) {
+            nodesByTime.insert({node.lastUpdated, node.nodeId});
+        } else {
+            nodesByTime.erase({node.lastUpdated, node.nodeId});
+        }
+    }
+    if (sign > 0) {
+        spatial.add(node);
+        stats.addNode(node);
+        // a node without any timestamp never goes stale, same as on the web pages
+        online = !node.isStale(nowMs());
+        if (online && node.lastUpdated != 0) onlineByTime.insert({node.lastUpdated, node.nodeId});
+        if (online) stats.addOnline(node);
+    } else {
+        spatial.remove(node);
+        stats.removeNode(node);
+        online = node.lastUpdated == 0 || onlineByTime.erase({node.lastUpdated, node.nodeId}) > 0;
+        if (online) stats.removeOnline(node);
+    }
+}
+
+void NodeStore::countLink(const LinkRecord& link, int sign) {
+    if (link.snr == 0 || link.node1 == link.node2) return;
+    auto it1 = nodes.find(link.node1);
+    auto it2 = nodes.find(link.node2);
+    if (it1 == nodes.end() || it2 == nodes.end() || it1->second.freq != it2->second.freq) return;
+    FreqStats& stats = freqStats[it1->second.freq];
+    if (sign > 0) {
+        stats.addLink(link);
+    } else {
+        stats.removeLink(link);
+    }
+}
+
+void NodeStore::countLinksOf(uint32_t nodeId, int sign) {
+    auto out = outLinks.find(nodeId);
+    if (out != outLinks.end()) {
+        for (uint32_t other : out->second) countLink(links[{nodeId, other}], sign);
+    }
+    auto in = inLinks.find(nodeId);
+    if (in != inLinks.end()) {
+        for (uint32_t other : in->second) countLink(links[{other, nodeId}], sign);
+    }
+}
+
+void NodeStore::addTelemetry(const NodeRecord& node, uint64_t timeMs) {
+    std::deque<TelemetrySample>& ring = telemetry[node.nodeId];
+    TelemetrySample sample;
+    sample.time = timeMs;
+    sample.batteryLevel = node.batteryLevel;
+    sample.batteryVoltage = node.batteryVoltage;
+    sample.chutil = node.chutil;
+    sample.uptime = node.uptime;
+    sample.temperature = node.temperature;
+    ring.push_back(sample);
+    if (ring.size() > NODESTORE_TELEMETRY_RING) ring.pop_front();
+}
+
+void NodeStore::advance(uint64_t now) {
+    while (!nodesByTime.empty() && nodesByTime.begin()->first + NODESTORE_NODE_MS < now) {
+        removeNode(nodesByTime.begin()->second, now);
+    }
+    while (!tombstones.empty() && tombstones.front().time + NODESTORE_TOMBSTONE_MS < now) {
+        tombstoneFloor = tombstones.front().seq;
+        tombstones.pop_front();
+    }
+    while (!onlineByTime.empty() && onlineByTime.begin()->first + NODESTORE_STALE_MS < now) {
+        auto it = nodes.find(onlineByTime.begin()->second);
+        onlineByTime.erase(onlineByTime.begin());
+        if (it != nodes.end()) freqStats[it->second.freq].removeOnline(it->second);
+        generations[0]++;  // is_stale flips
+    }
+    while (!linksByTime.empty() && linksByTime.begin()->first + NODESTORE_LINK_MS < now) {
+        LinkKey key = linksByTime.begin()->second;
+        linksByTime.erase(linksByTime.begin());
+        auto it = links.find(key);
+        if (it == links.end()) continue;
+        countLink(it->second, -1);
+        links.erase(it);
+        generations[1]++;
+        auto out = outLinks.find(key.first);
+        out->second.erase(key.second);
+        if (out->second.empty()) outLinks.erase(out);
+        auto in = inLinks.find(key.second);
+        in->second.erase(key.first);
+        if (in->second.empty()) inLinks.erase(in);
+    }
+}
+
+bool NodeStore::getNode(uint32_t nodeId, NodeRecord& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = nodes.find(nodeId);
+    if (it == nodes.end()) return false;
+    out = it->second;
+    return true;
+}
+
+bool NodeStore::findNode(const std::string& query, NodeRecord& out) {
+    if (query.empty()) return false;
+    std::string hex = query[0] == '!' ? query.substr(1) : query;
+    bool isHex = !hex.empty() && hex.size() <= 8;
+    for (char c : hex) {
+        if (!isxdigit((unsigned char)c)) isHex = false;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    if (isHex) {
+        auto it = nodes.find((uint32_t)strtoul(hex.c_str(), nullptr, 16));
+        if (it != nodes.end()) {
+            out = it->second;
+            return true;
+        }
+    }
+    for (const auto& pair : nodes) {
+        if (strcasecmp(pair.second.shortName.c_str(), query.c_str()) == 0) {
+            out = pair.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool NodeStore::getNodeDetail(uint32_t nodeId, NodeDetail& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    advance(nowMs());
+    auto it = nodes.find(nodeId);
+    if (it == nodes.end()) return false;
+    out.node = it->second;
+    auto name = [this](uint32_t id) {
+        auto found = nodes.find(id);
+        if (found != nodes.end() && !found->second.shortName.empty()) return found->second.shortName;
+        char buf[16];
+        snprintf(buf, sizeof(buf), "!%x", id);
+        return std::string(buf);
+    };
+    auto in = inLinks.find(nodeId);
+    if (in != inLinks.end()) {
+        for (uint32_t other : in->second) out.incoming.push_back({links[{other, nodeId}], name(other)});
+    }
+    auto outs = outLinks.find(nodeId);
+    if (outs != outLinks.end()) {
+        for (uint32_t other : outs->second) out.outgoing.push_back({links[{nodeId, other}], name(other)});
+    }
+    auto ring = telemetry.find(nodeId);
+    if (ring != telemetry.end()) out.telemetry.assign(ring->second.begin(), ring->second.end());
+    return true;
+}
+
+void NodeStore::forEachNode(const std::function<void(const NodeRecord&)>& fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto& pair : nodes) fn(pair.second);
+}
+
+void NodeStore::forEachNodeIn(const GeoBox& box, const std::function<void(const NodeRecord&)>& fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    spatial.query(box, [&](uint32_t nodeId) {
+        const NodeRecord& node = nodes[nodeId];
+        if (box.contains(node.latitude, node.longitude)) fn(node);
+    });
+}
+
+void NodeStore::forEachCluster(int zoom, const GeoBox& box, const std::function<void(const ClusterCell&)>& fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    spatial.clusters(zoom, box, fn);
+}
+
+void NodeStore::forEachLink(uint64_t since, const std::function<void(const LinkRecord&)>& fn) {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto& pair : links) {
+        if (pair.second.lastUpdated >= since) fn(pair.second);
+    }
+}
+
+bool NodeStore::getChatPage(int64_t beforeId, size_t limit, std::vector<ChatRecord>& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // ids grow with arrival, so the ring is sorted by id too
+    auto end = chat.end();
+    if (beforeId > 0) {
+        end = std::lower_bound(chat.begin(), chat.end(), beforeId, [](const ChatRecord& c, int64_t id) { return c.id < id; });
+    }
+    size_t taken = 0;
+    for (auto it = std::make_reverse_iterator(end); it != chat.rend() && taken < limit; ++it, ++taken) {
+        out.push_back(*it);
+        auto sender = nodes.find(it->nodeId);
+        out.back().hasCoords = sender != nodes.end() && sender->second.hasPosition();
+    }
+    // a ring that never filled up holds the whole history
+    return taken == limit || chat.size() < chatLimit;
+}
+
+std::vector<MainStatsRecord> NodeStore::getMainStats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return std::vector<MainStatsRecord>(mainStats.rbegin(), mainStats.rend());
+}
+
+size_t NodeStore::nodeCount() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return nodes.size();
+}
+
+// Container bookkeeping estimate per element: hash node (next, hash) or tree node (3 pointers and color).
+#define HASH_NODE_OVERHEAD 16
+#define TREE_NODE_OVERHEAD 32
+
+static size_t stringHeap(const std::string& s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;  // within the small string buffer otherwise
+}
+
+StoreMemory NodeStore::memoryUsage() {
+    std::lock_guard<std::mutex> lock(mtx);
+    StoreMemory m;
+    m.nodes = nodes.bucket_count() * sizeof(void*);
+    for (const auto& pair : nodes) m.nodes += sizeof(pair) + HASH_NODE_OVERHEAD + stringHeap(pair.second.shortName) + stringHeap(pair.second.longName);
+    m.links = links.size() * (sizeof(std::pair<const LinkKey, LinkRecord>) + TREE_NODE_OVERHEAD);
+    for (const auto* adjacency : {&outLinks, &inLinks}) {
+        for (const auto& pair : *adjacency) m.links += sizeof(pair) + HASH_NODE_OVERHEAD + pair.second.size() * (sizeof(uint32_t) + TREE_NODE_OVERHEAD);
+    }
+    for (const ChatRecord& record : chat) m.chat += sizeof(record) + stringHeap(record.message) + stringHeap(record.sender);
+    for (const auto& pair : telemetry) m.telemetry += sizeof(pair) + HASH_NODE_OVERHEAD + pair.second.size() * sizeof(TelemetrySample);
+    m.indexes = (onlineByTime.size() + nodesByTime.size() + bySeq.size()) * (16 + TREE_NODE_OVERHEAD) + linksByTime.size() * (sizeof(std::pair<uint64_t, LinkKey>) + TREE_NODE_OVERHEAD) +
+                tombstones.size() * sizeof(Tombstone) + dirtyLinks.size() * (sizeof(LinkKey) + TREE_NODE_OVERHEAD);
+    return m;
+}
+
+static std::string linkEndName(const std::unordered_map<uint32_t, NodeRecord>& nodes, uint32_t nodeId) {
+    auto it = nodes.find(nodeId);
+    std::string name = it != nodes.end() ? it->second.displayName() : "";
+    if (name.empty()) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "!%x", nodeId);
+        name = buf;
+    }
+    return name;
+}
+
+GlobalStats NodeStore::getGlobalStats(uint16_t freq) {
+    GlobalStats out;
+    out.freq = freq;
+    std::lock_guard<std::mutex> lock(mtx);
+    advance(nowMs());
+    auto found = freqStats.find(freq);
+    if (found == freqStats.end()) return out;
+    const FreqStats& stats = found->second;
+
+    out.totalNodes = stats.totalNodes;
+    out.onlineNodes = stats.onlineNodes;
+    out.staleNodes = stats.totalNodes - stats.onlineNodes;
+    out.nodesWithGps = stats.nodesWithGps;
+    out.sumCnt = stats.sumCnt;
+    out.msgCnt = stats.msgCnt;
+    out.traceCnt = stats.traceCnt;
+    out.telemetryCnt = stats.telemetryCnt;
+    out.nodeInfoCnt = stats.nodeInfoCnt;
+    out.posCnt = stats.posCnt;
+    out.sumBattery = stats.sumBattery;
+    out.batteryNodes = stats.batteryNodes;
+    out.sumUptime = stats.sumUptime;
+    out.uptimeNodes = stats.uptimeNodes;
+    out.sumChutil = stats.sumChutil;
+    out.chutilNodes = stats.chutilNodes;
+
+    auto top = [this](const auto& set, GlobalStats::Top& dst) {
+        if (set.empty()) return;
+        dst.count = set.rbegin()->first;
+        dst.node = nodes[set.rbegin()->second].displayName();
+    };
+    top(stats.topMsg, out.topMsg);
+    top(stats.topTrace, out.topTrace);
+    top(stats.topTelemetry, out.topTelemetry);
+    top(stats.topNodeInfo, out.topNodeInfo);
+    top(stats.topPos, out.topPos);
+    top(stats.topChutil, out.topChutil);
+
+    out.linkCount = stats.linkCount;
+    out.sumSnr = stats.sumSnr;
+    out.snrGood = stats.snrGood;
+    out.snrOkay = stats.snrOkay;
+    out.snrWeak = stats.snrWeak;
+    out.snrBad = stats.snrBad;
+    if (!stats.linksBySnr.empty()) {
+        const auto& worst = *stats.linksBySnr.begin();
+        const auto& best = *stats.linksBySnr.rbegin();
+        out.minSnr = worst.first;
+        out.maxSnr = best.first;
+        out.worstLink = linkEndName(nodes, worst.second.first) + " → " + linkEndName(nodes, worst.second.second);
+        out.bestLink = linkEndName(nodes, best.second.first) + " → " + linkEndName(nodes, best.second.second);
+    }
+
+    out.roles.assign(stats.roles.begin(), stats.roles.end());
+    return out;
+}
+
+uint64_t NodeStore::getChanges(uint64_t since, std::vector<NodeRecord>& changed, std::vector<uint32_t>& removed, bool& full) {
+    std::lock_guard<std::mutex> lock(mtx);
+    advance(nowMs());
+    full = since == 0 || since < tombstoneFloor || since > changeSeq;  // ahead of us: we restarted
+    if (full) since = 0;
+    for (auto it = bySeq.upper_bound(since); it != bySeq.end(); ++it) {
+        changed.push_back(nodes[it->second]);
+    }
+    if (!full) {
+        auto first = std::upper_bound(tombstones.begin(), tombstones.end(), since, [](uint64_t seq, const Tombstone& t) { return seq < t.seq; });
+        for (auto it = first; it != tombstones.end(); ++it) {
+            if (!nodes.count(it->nodeId)) removed.push_back(it->nodeId);  // a node that came back is in changed
+        }
+    }
+    return changeSeq;
+}
@@ -0,0 +1,171 @@
+#ifndef NODESTORE_HPP
+#define NODESTORE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+#include <set>
+#include "noderecords.hpp"
+#include "globalstats.hpp"
+#include "spatialindex.hpp"
+
+// What a NodeStore change was about, for the live feed.
+enum class StoreChange { NodeInfo, Position, Telemetry, Link, Chat };
+
+// Parts of the store a document is built from, combined as a mask for NodeStore::generation().
+enum StoreState : unsigned { STATE_NODES = 1, STATE_LINKS = 2, STATE_CHAT = 4, STATE_MAINSTATS = 8 };
+
+/**
+ * @brief Called after every packet driven change with the updated records (null when not involved,
+ * the chat sender may be unknown). Runs under the store lock, it must not call back into the store.
+ */
+using StoreListener = std::function<void(StoreChange change, const NodeRecord* node, const LinkRecord* link, const ChatRecord* chat)>;
+
+// Approximate heap use of the store's parts in bytes, for the metrics.
+struct StoreMemory {
+    size_t nodes = 0;
+    size_t links = 0;      // link records and adjacency lists
+    size_t chat = 0;
+    size_t telemetry = 0;
+    size_t indexes = 0;    // time ordered sets, change log, tombstones
+};
+
+// What the node popup shows, see NodeStore::getNodeDetail().
+struct NodeDetail {
+    struct Neighbour {
+        LinkRecord link;
+        std::string name;  // short name, hex id when unknown
+    };
+    NodeRecord node;
+    std::vector<Neighbour> incoming;         // links towards the node
+    std::vector<Neighbour> outgoing;         // links from the node
+    std::vector<TelemetrySample> telemetry;  // oldest first
+};
+
+/**
+ * @brief In-memory copy of the node state the web frontend reads.
+ *
+ * It is fed next to NodeDb from the packet callbacks and loaded from NodeDb at startup,
+ * so the HTTP API never has to touch SQLite. All methods are thread safe.
+ */
+class NodeStore {
+   public:
+    // --- writers, same semantics as the NodeDb counterparts ---
+    void setNodeInfo(uint32_t nodeId, const std::string& shortName, const std::string& longName, uint16_t freq, uint8_t role, uint8_t chanhash, uint64_t timeMs);
+    void setNodeTemperature(uint32_t nodeId, float temperature, uint8_t chanhash, uint64_t timeMs);
+    void setNodeTelemetryDevice(uint32_t nodeId, int batteryLevel, float voltage, uint32_t uptime, float chutil, uint8_t chanhash, uint64_t timeMs);
+    void setNodePosition(uint32_t nodeId, int32_t latitude, int32_t longitude, int32_t altitude, uint64_t timeMs);
+    void setNodeMsgCnt(uint32_t nodeId, uint32_t msgCnt, uint32_t traceCnt, uint32_t telemetryCnt, uint32_t nodeInfoCnt, uint32_t posCnt);
+    void saveNodeSNR(uint32_t nodeId1, uint32_t nodeId2, float snr, uint64_t timeMs);  // adds a sample to the link
+    void addChatMessage(const ChatRecord& chat);
+    void addMainStats(const MainStatsRecord& stats);
+
+    void setListener(StoreListener listener);
+
+    // Size of the chat ring, the newest messages kept in memory.
+    void setChatCapacity(size_t capacity);
+    size_t chatCapacity();
+
+    // --- loaders, used once at startup, they don't notify the listener ---
+    void loadNode(const NodeRecord& node);
+    void loadLink(const LinkRecord& link);
+
+    // Drops links that fell out of their time window.
+    void expire(uint64_t now);
+
+    // Links changed since the last call, for NodeDb::saveLinks().
+    void takeDirtyLinks(std::vector<LinkRecord>& out);
+
+    /**
+     * @brief Generation of the masked parts of the state: it moves whenever a document built from
+     * them could change, including nodes going stale and records leaving their time window.
+     */
+    uint64_t generation(unsigned states);
+
+    // --- readers, the callbacks run under the store lock, they must not call back into the store ---
+    bool getNode(uint32_t nodeId, NodeRecord& out);
+    bool findNode(const std::string& query, NodeRecord& out);  // short name or hex id ("!aabbccdd" / "aabbccdd")
+    // The node with its links and recent telemetry, from the adjacency lists: cost depends on the node's degree only.
+    bool getNodeDetail(uint32_t nodeId, NodeDetail& out);
+    void forEachNode(const std::function<void(const NodeRecord&)>& fn);
+    void forEachLink(uint64_t since, const std::function<void(const LinkRecord&)>& fn);
+    /**
+     * @brief Chat messages older than a cursor from the ring, newest first.
+     * @param beforeId Message id cursor, 0 for the newest messages.
+     * @return false when the ring ran out before limit and older messages may exist in NodeDb.
+     */
+    bool getChatPage(int64_t beforeId, size_t limit, std::vector<ChatRecord>& out);
+    void forEachNodeIn(const GeoBox& box, const std::function<void(const NodeRecord&)>& fn);  // positioned nodes inside box
+    void forEachCluster(int zoom, const GeoBox& box, const std::function<void(const ClusterCell&)>& fn);
+    std::vector<MainStatsRecord> getMainStats();  // newest first
+    size_t nodeCount();
+    StoreMemory memoryUsage();  // walks the nodes and the chat ring, call it at scrape rate only
+
+    // Globalstats of one frequency from the running aggregates, cost does not depend on the node count.
+    GlobalStats getGlobalStats(uint16_t freq);
+
+    /**
+     * @brief Nodes changed after the given change sequence and the ids removed since, for delta clients.
+     * @param since Last sequence the client has seen, 0 for everything.
+     * @param full Set when the client must drop its copy first: since was 0, or older than the kept tombstones.
+     * @return The current sequence, the client's next since.
+     */
+    uint64_t getChanges(uint64_t since, std::vector<NodeRecord>& changed, std::vector<uint32_t>& removed, bool& full);
+
+   private:
+    using LinkKey = std::pair<uint32_t, uint32_t>;
+
+    // Runs fn on a known node between taking its old state out of the aggregates and putting the new one in.
+    // Like the UPDATEs in NodeDb, data for nodes that never sent a nodeinfo is ignored. mtx must be held.
+    template <typename Fn>
+    NodeRecord* updateNode(uint32_t nodeId, uint64_t timeMs, Fn fn);
+    void notify(StoreChange change, const NodeRecord* node, const LinkRecord* link = nullptr, const ChatRecord* chat = nullptr);
+    void storeLink(const LinkRecord& link);
+
+    // --- index and aggregate bookkeeping, sign is +1 after a change and -1 before it. mtx must be held ---
+    void countNode(const NodeRecord& node, int sign);
+    void stamp(NodeRecord& node);  // gives the node the next change sequence
+    void removeNode(uint32_t nodeId, uint64_t now);
+    void addTelemetry(const NodeRecord& node, uint64_t timeMs);
+    void countLink(const LinkRecord& link, int sign);
+    void countLinksOf(uint32_t nodeId, int sign);
+    // Takes nodes that went stale out of the online aggregates, drops links that left their window and
+    // nodes not heard for NODESTORE_NODE_MS.
+    void advance(uint64_t now);
+
+    std::unordered_map<uint32_t, NodeRecord> nodes;
+    std::map<LinkKey, LinkRecord> links;
+    std::deque<ChatRecord> chat;            // oldest first, at most chatLimit
+    size_t chatLimit = NODESTORE_CHAT_RING;
+    std::deque<MainStatsRecord> mainStats;  // oldest first
+
+    std::unordered_map<uint16_t, FreqStats> freqStats;
+    SpatialIndex spatial;
+    std::set<std::pair<uint64_t, uint32_t>> onlineByTime;  // (last_updated, node id) of online nodes, the next to go stale first
+    std::set<std::pair<uint64_t, LinkKey>> linksByTime;    // (last_updated, link) of every link, the next to expire first
+    std::set<std::pair<uint64_t, uint32_t>> nodesByTime;   // (last_updated, node id) of nodes with a timestamp, the next to expire first
+
+    struct Tombstone {
+        uint64_t seq;
+        uint32_t nodeId;
+        uint64_t time;
+    };
+    uint64_t changeSeq = 0;
+    std::map<uint64_t, uint32_t> bySeq;  // change sequence -> node id, one entry per node
+    std::deque<Tombstone> tombstones;    // by seq
+    uint64_t tombstoneFloor = 0;         // highest seq of a tombstone already forgotten
+    std::unordered_map<uint32_t, std::set<uint32_t>> outLinks;    // node1 -> node2 of its links
+    std::unordered_map<uint32_t, std::set<uint32_t>> inLinks;     // node2 -> node1 of its links
+    std::unordered_map<uint32_t, std::deque<TelemetrySample>> telemetry;  // per node, oldest first
+    std::set<LinkKey> dirtyLinks;                                 // sampled since the last takeDirtyLinks()
+    uint64_t generations[4] = {};                                 // change counters by StoreState bit
+    StoreListener listener;
+    std::mutex mtx;
+};
+
+#endif  // NODESTORE_HPP
@@ -0,0 +1,195 @@
+#include "notifier.hpp"
+#include "messagebatch.hpp"
+#include "timeutil.hpp"
+#include "latency.hpp"
+#include "logger.hpp"
+#include "parson.h"
+#include <cinttypes>
+#include <cstdlib>
+#include <sys/stat.h>
+
+Notifier::Notifier(HttpDispatcher& http, const std::string& name, size_t maxChars, double ratePerSecond, double burst)
+    : http(http), name(name), maxChars(maxChars), ratePerMs(ratePerSecond / 1000.0), burst(burst), tokens(burst) {}
+
+bool Notifier::persist(const std::string& baseDir) {
+    mkdir(baseDir.c_str(), 0755);
+    std::unique_ptr<DiskQueue> queue(new DiskQueue());
+    if (!queue->open(baseDir + "/" + name)) {
+        LOG_WARN("%s: keeping the queue in memory\n", name.c_str());
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    if (queue->size()) LOG_INFO("%s: %zu queued lines from the last run\n", name.c_str(), queue->size());
+    // lines queued before are not in a post yet (loop() was not running), they follow the old ones
+    while (!messageQueue.empty()) {
+        if (!queue->push(messageQueue.front())) counters.dropped++;
+        messageQueue.pop();
+    }
+    queue->sync();
+    disk = std::move(queue);
+    return true;
+}
+
+void Notifier::queueMessage(const std::string& message) {
+    LATENCY_SCOPE(LatencyStage::NotifierEnqueue);
+    std::lock_guard<std::mutex> lock(mtx);
+    if (disk) {
+        if (!disk->push(message)) counters.dropped++;
+        return;
+    }
+    if (messageQueue.size() >= MESSAGE_QUEUE_MAX) {
+        counters.dropped++;
+        return;
+    }
+    messageQueue.push(message);
+}
+
+void Notifier::takePost() {
+    post.clear();
+    postLines = 0;
+    attempts = 0;
+    if (!disk) {
+        size_t before = messageQueue.size();
+        post = takeBatch(messageQueue, maxChars);
+        postLines = before - messageQueue.size();
+        return;
+    }
+    size_t chars = 0;
+    disk->peek([&](const std::string& line) {
+        if (!appendToBatch(post, chars, line, maxChars)) return false;
+        postLines++;
+        return true;
+    });
+}
+
+void Notifier::finishPost() {
+    if (disk) disk->pop(postLines);
+    post.clear();
+    postLines = 0;
+}
+
+void Notifier::loop() {
+    HttpCall call;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        uint64_t now = nowMs();
+        uint64_t elapsed = lastLoop ? now - lastLoop : 0;
+        lastLoop = now;
+        if (disk) disk->sync();  // one write and fsync for everything queued since the last tick
+        if (sending || (post.empty() && (disk ? disk->size() == 0 : messageQueue.empty()))) return;
+
+        tokens += (now - refilled) * ratePerMs;
+        if (tokens > burst) tokens = burst;
+        refilled = now;
+        if (now < blockedUntil || tokens < 1) {
+            counters.throttledMs += elapsed;
+            return;
+        }
+
+        if (post.empty()) {
+            // everything waiting goes out in as few posts as the length limit allows
+            takePost();
+            if (post.empty()) return;  // the front of the disk queue could not be read
+        } else {
+            counters.retries++;
+        }
+        if (!configured()) {
+            finishPost();
+            return;
+        }
+        if (!buildCall(post, call)) {
+            uint64_t delay;
+            if (retryLater(now, delay)) LOG_WARN("%s could not build a request, retrying in %" PRIu64 " ms\n", name.c_str(), delay);
+            return;
+        }
+        tokens -= 1;
+        sending = true;
+    }
+    http.submit(std::move(call), [this](const HttpResult& result) { onResult(result); });
+}
+
+void Notifier::onResult(const HttpResult& result) {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint64_t now = nowMs();
+    sending = false;
+    if (result.ok()) {
+        counters.sent++;
+        finishPost();
+        // Discord announces an exhausted bucket on the last request it accepts
+        if (result.header("x-ratelimit-remaining") == "0") {
+            blockedUntil = now + parseSeconds(result.header("x-ratelimit-reset-after"));
+        }
+        return;
+    }
+    if (result.status == 429) {
+        counters.rateLimited++;
+        uint64_t delay = retryAfterMs(result, now);
+        blockedUntil = now + (delay ? delay : NOTIFIER_RATE_LIMIT_MS);
+        tokens = 0;
+        LOG_WARN("%s rate limited, retrying in %" PRIu64 " ms\n", name.c_str(), blockedUntil - now);
+        return;
+    }
+    if (result.code == CURLE_OK && result.status < 500) {
+        // the request itself is wrong, sending it again won't help
+        LOG_ERROR("%s rejected a post with HTTP %ld: %s\n", name.c_str(), result.status, result.body.c_str());
+        counters.failed++;
+        finishPost();
+        return;
+    }
+    uint64_t delay;
+    if (!retryLater(now, delay)) return;
+    if (result.code != CURLE_OK) {
+        LOG_WARN("%s request failed: %s, retrying in %" PRIu64 " ms\n", name.c_str(), curl_easy_strerror(result.code), delay);
+    } else {
+        LOG_WARN("%s returned HTTP %ld, retrying in %" PRIu64 " ms\n", name.c_str(), result.status, delay);
+    }
+}
+
+bool Notifier::retryLater(uint64_t now, uint64_t& delay) {
+    // a disk queue waits out outages of any length, a memory queue would only fill up meanwhile
+    if (++attempts >= NOTIFIER_MAX_ATTEMPTS && !disk) {
+        LOG_ERROR("%s post failed %d times, giving up\n", name.c_str(), attempts);
+        counters.failed++;
+        finishPost();
+        return false;
+    }
+    delay = attempts > 16 ? NOTIFIER_BACKOFF_MAX_MS : (uint64_t)NOTIFIER_BACKOFF_MS << (attempts - 1);
+    if (delay > NOTIFIER_BACKOFF_MAX_MS) delay = NOTIFIER_BACKOFF_MAX_MS;
+    blockedUntil = now + delay;
+    return true;
+}
+
+NotifierStats Notifier::stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    NotifierStats out = counters;
+    out.queued = disk ? disk->size() : messageQueue.size() + postLines;
+    return out;
+}
+
+uint64_t Notifier::parseSeconds(const std::string& text) {
+    char* end = nullptr;
+    double seconds = strtod(text.c_str(), &end);
+    if (end == text.c_str() || seconds <= 0) return 0;
+    return (uint64_t)(seconds * 1000.0 + 0.5);
+}
+
+uint64_t Notifier::retryAfterMs(const HttpResult& result, uint64_t now) {
+    // Retry-After header (Discord, most servers) in seconds or as an HTTP date, else "retry_after"
+    // in the body: top level seconds on Discord, under "parameters" on Telegram
+    std::string header = result.header("retry-after");
+    uint64_t delay = parseSeconds(header);
+    if (delay) return delay;
+    time_t date = header.empty() ? -1 : curl_getdate(header.c_str(), nullptr);
+    if (date > 0) return (uint64_t)date * 1000 > now ? (uint64_t)date * 1000 - now : 0;
+    JSON_Value* root = json_parse_string(result.body.c_str());
+    JSON_Object* object = json_value_get_object(root);
+    if (object) {
+        if (json_object_has_value_of_type(object, "retry_after", JSONNumber)) {
+            delay = (uint64_t)(json_object_get_number(object, "retry_after") * 1000.0 + 0.5);
+        } else if (json_object_dothas_value_of_type(object, "parameters.retry_after", JSONNumber)) {
+            delay = (uint64_t)(json_object_dotget_number(object, "parameters.retry_after") * 1000.0 + 0.5);
+        }
+    }
+    json_value_free(root);
+    return delay;
+}
@@ -0,0 +1,93 @@
+#ifndef NOTIFIER_HPP
+#define NOTIFIER_HPP
+
+#include <string>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "httpdispatcher.hpp"
+#include "diskqueue.hpp"
+
+#define NOTIFIER_MAX_ATTEMPTS 8         // tries of a post failing with a network or server error, without a disk queue
+#define NOTIFIER_BACKOFF_MS 1000        // delay after the first failure, doubled after each further one
+#define NOTIFIER_BACKOFF_MAX_MS 60000
+#define NOTIFIER_RATE_LIMIT_MS 1000     // wait after a 429 that does not say how long
+
+struct NotifierStats {
+    size_t queued = 0;          // lines waiting, including the ones of the post in flight or waiting for its retry
+    uint64_t sent = 0;          // posts delivered
+    uint64_t retries = 0;       // posts sent again after a failure or rate limit
+    uint64_t rateLimited = 0;   // 429 answers
+    uint64_t failed = 0;        // posts given up
+    uint64_t dropped = 0;       // lines lost to a full queue
+    uint64_t throttledMs = 0;   // time messages waited for the rate limit
+};
+
+/**
+ * @brief Queue of chat lines posted to one destination (a webhook or chat) through the HttpDispatcher.
+ *
+ * Queued lines are packed into posts of at most maxChars characters. Posts leave at the rate of a
+ * token bucket sized to the destination's published limit; when the destination answers 429 or
+ * announces that its limit is used up, sending pauses exactly as long as it asks for and the same
+ * post is sent again. Network and server errors are retried with a growing delay, without a limit
+ * when the queue is on disk.
+ * Subclasses only turn the text of a post into a request.
+ *
+ * Lines are kept in memory (at most MESSAGE_QUEUE_MAX) unless persist() moved the queue to disk,
+ * where it survives restarts and outages of any length up to DISKQUEUE_MAX_BYTES. Lines leave the
+ * disk queue only once their post was delivered or given up.
+ */
+class Notifier {
+   public:
+    /**
+     * @param name Identifies the destination in logs and metrics.
+     * @param ratePerSecond Posts per second allowed on average.
+     * @param burst Posts that may leave back to back after a quiet period.
+     */
+    Notifier(HttpDispatcher& http, const std::string& name, size_t maxChars, double ratePerSecond, double burst);
+    virtual ~Notifier() = default;
+
+    // Keeps the queue in baseDir/<name> from now on, lines left there by the last run are sent first.
+    bool persist(const std::string& baseDir);
+    void queueMessage(const std::string& message);
+    void loop();  // sends the next post when the destination allows it, never blocks
+    NotifierStats stats();
+    const std::string& getName() const { return name; }
+
+   protected:
+    // false when the destination is not configured, its lines are dropped then.
+    virtual bool configured() const = 0;
+    // Builds the request posting text, false when it can't right now; the post is tried again later.
+    virtual bool buildCall(const std::string& text, HttpCall& call) = 0;
+
+   private:
+    void onResult(const HttpResult& result);
+    void takePost();    // fills post from the front of the queue
+    void finishPost();  // drops post and its lines from the queue
+    bool retryLater(uint64_t now, uint64_t& delay);  // after a failed try of post, false when it was given up
+    static uint64_t parseSeconds(const std::string& text);  // "1.5" -> 1500, 0 when not a number
+    static uint64_t retryAfterMs(const HttpResult& result, uint64_t now);  // 0 when the answer does not say
+
+    HttpDispatcher& http;
+    std::string name;
+    size_t maxChars;
+    double ratePerMs;
+    double burst;
+
+    std::mutex mtx;
+    std::queue<std::string> messageQueue;  // used without a disk queue
+    std::unique_ptr<DiskQueue> disk;
+    std::string post;                  // in flight or waiting for its retry, empty when none
+    size_t postLines = 0;              // queued lines in post
+    int attempts = 0;                  // failed tries of post
+    std::atomic<bool> sending{false};  // one request in flight keeps the messages in order
+    double tokens;
+    uint64_t refilled = 0;      // epoch ms of the last token refill
+    uint64_t blockedUntil = 0;  // epoch ms, no request before it
+    uint64_t lastLoop = 0;
+    NotifierStats counters;
+};
+
+#endif  // NOTIFIER_HPP
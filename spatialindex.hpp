@@ -0,0 +1,159 @@
+#ifndef SPATIALINDEX_HPP
+#define SPATIALINDEX_HPP
+
+#include <cstdint>
+#include <cmath>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include "noderecords.hpp"
+
+#define SPATIAL_GRID_ZOOM 10         // bbox grid cells are web map tiles of this zoom (~40 km)
+#define SPATIAL_CLUSTER_MAXZOOM 16   // cluster summaries are kept for map zoom 0 .. this
+#define SPATIAL_CLUSTER_SHIFT 2      // a cluster cell is a quarter tile (64 px) at its map zoom
+#define SPATIAL_PIXEL_ZOOM 24        // resolution of the tile coordinates kept per node
+
+// Longitude / latitude box in 1e-7 degrees, west > east crosses the antimeridian.
+struct GeoBox {
+    int32_t west = -1800000000;
+    int32_t south = -900000000;
+    int32_t east = 1800000000;
+    int32_t north = 900000000;
+
+    bool contains(int32_t latitude, int32_t longitude) const {
+        if (latitude < south || latitude > north) return false;
+        if (west <= east) return longitude >= west && longitude <= east;
+        return longitude >= west || longitude <= east;
+    }
+};
+
+// Summary of the positioned nodes in one cluster cell.
+struct ClusterCell {
+    size_t count = 0;
+    int64_t sumLatitude = 0;  // 1e-7 degrees
+    int64_t sumLongitude = 0;
+    std::map<uint8_t, size_t> roles;  // role -> node count
+    uint32_t idXor = 0;               // xor of the node ids, which is the node itself when count is 1
+
+    uint32_t nodeId() const { return count == 1 ? idXor : 0; }
+    int32_t latitude() const { return count ? (int32_t)(sumLatitude / (int64_t)count) : 0; }
+    int32_t longitude() const { return count ? (int32_t)(sumLongitude / (int64_t)count) : 0; }
+};
+
+/**
+ * @brief Grid index over node positions with per zoom cluster summaries.
+ *
+ * Cells are web mercator tiles, so a cluster cell lines up with what leaflet draws at that zoom.
+ * NodeStore calls remove() with the old state and add() with the new state around every change,
+ * like the FreqStats aggregates. Nodes without a position are not indexed.
+ */
+class SpatialIndex {
+   public:
+    void add(const NodeRecord& node) { apply(node, 1); }
+    void remove(const NodeRecord& node) { apply(node, -1); }
+
+    // Node ids of the grid cells touching box, the caller tests the exact position.
+    // Scans the grid cells of the box, or all cells when that is fewer.
+    template <typename Fn>
+    void query(const GeoBox& box, Fn fn) const {
+        forEachCell(grid, SPATIAL_GRID_ZOOM, box, [&](const std::unordered_set<uint32_t>& cell) {
+            for (uint32_t nodeId : cell) fn(nodeId);
+        });
+    }
+
+    // Cluster cells of one map zoom that lie inside box (the cell, not its centroid, is tested).
+    template <typename Fn>
+    void clusters(int zoom, const GeoBox& box, Fn fn) const {
+        if (zoom < 0) zoom = 0;
+        if (zoom > SPATIAL_CLUSTER_MAXZOOM) zoom = SPATIAL_CLUSTER_MAXZOOM;
+        forEachCell(cells[zoom], zoom + SPATIAL_CLUSTER_SHIFT, box, fn);
+    }
+
+   private:
+    using CellKey = uint64_t;  // tile x << 32 | tile y
+
+    static uint32_t tileX(int32_t longitude, int zoom) {
+        double x = (longitude / 1e7 + 180.0) / 360.0 * (double)(1u << zoom);
+        return clampTile(x, zoom);
+    }
+    static uint32_t tileY(int32_t latitude, int zoom) {
+        double lat = latitude / 1e7;
+        if (lat > 85.0511) lat = 85.0511;  // mercator limit
+        if (lat < -85.0511) lat = -85.0511;
+        double rad = lat * M_PI / 180.0;
+        double y = (1.0 - std::log(std::tan(rad) + 1.0 / std::cos(rad)) / M_PI) / 2.0 * (double)(1u << zoom);
+        return clampTile(y, zoom);
+    }
+    static uint32_t clampTile(double v, int zoom) {
+        if (v < 0) return 0;
+        uint32_t max = (1u << zoom) - 1;
+        return v > max ? max : (uint32_t)v;
+    }
+    static CellKey key(uint32_t x, uint32_t y) { return ((uint64_t)x << 32) | y; }
+
+    void apply(const NodeRecord& node, int sign) {
+        if (!node.hasPosition()) return;
+        uint32_t x = tileX(node.longitude, SPATIAL_PIXEL_ZOOM);
+        uint32_t y = tileY(node.latitude, SPATIAL_PIXEL_ZOOM);
+
+        int shift = SPATIAL_PIXEL_ZOOM - SPATIAL_GRID_ZOOM;
+        CellKey gridKey = key(x >> shift, y >> shift);
+        if (sign > 0) {
+            grid[gridKey].insert(node.nodeId);
+        } else {
+            auto it = grid.find(gridKey);
+            if (it != grid.end()) {
+                it->second.erase(node.nodeId);
+                if (it->second.empty()) grid.erase(it);
+            }
+        }
+
+        for (int zoom = 0; zoom <= SPATIAL_CLUSTER_MAXZOOM; zoom++) {
+            shift = SPATIAL_PIXEL_ZOOM - zoom - SPATIAL_CLUSTER_SHIFT;
+            CellKey cellKey = key(x >> shift, y >> shift);
+            ClusterCell& cell = cells[zoom][cellKey];
+            cell.count += sign;
+            if (cell.count == 0) {
+                cells[zoom].erase(cellKey);
+                continue;
+            }
+            cell.sumLatitude += sign * (int64_t)node.latitude;
+            cell.sumLongitude += sign * (int64_t)node.longitude;
+            if (sign > 0) {
+                cell.roles[node.role]++;
+            } else if (--cell.roles[node.role] == 0) {
+                cell.roles.erase(node.role);
+            }
+            cell.idXor ^= node.nodeId;
+        }
+    }
+
+    template <typename Cell, typename Fn>
+    static void forEachCell(const std::unordered_map<CellKey, Cell>& map, int zoom, const GeoBox& box, Fn fn) {
+        uint32_t x0 = tileX(box.west, zoom), x1 = tileX(box.east, zoom);
+        uint32_t y0 = tileY(box.north, zoom), y1 = tileY(box.south, zoom);  // tile y grows southwards
+        uint64_t width = x0 <= x1 ? x1 - x0 + 1 : (1ull << zoom) - x0 + x1 + 1;
+        uint64_t area = width * (y1 - y0 + 1);
+        if (area > map.size()) {
+            for (const auto& pair : map) {
+                uint32_t x = (uint32_t)(pair.first >> 32), y = (uint32_t)pair.first;
+                bool inX = x0 <= x1 ? (x >= x0 && x <= x1) : (x >= x0 || x <= x1);
+                if (inX && y >= y0 && y <= y1) fn(pair.second);
+            }
+            return;
+        }
+        uint32_t size = 1u << zoom;
+        for (uint64_t i = 0; i < width; i++) {
+            uint32_t x = (uint32_t)((x0 + i) % size);
+            for (uint32_t y = y0; y <= y1; y++) {
+                auto it = map.find(key(x, y));
+                if (it != map.end()) fn(it->second);
+            }
+        }
+    }
+
+    std::unordered_map<CellKey, std::unordered_set<uint32_t>> grid;
+    std::unordered_map<CellKey, ClusterCell> cells[SPATIAL_CLUSTER_MAXZOOM + 1];
+};
+
+#endif  // SPATIALINDEX_HPP
@@ -2,22 +2,22 @@
 #define TELEGRAM_HPP
 
 #include <string>
-#include <curl/curl.h>
-#include <mutex>
-#include <queue>
+#include "notifier.hpp"
 
-class TelegramPoster {
+class TelegramPoster : public Notifier {
    public:
-    void queueMessage(const std::string& message);
+    TelegramPoster(HttpDispatcher& http);
     void setApiToken(const std::string& token) { apiToken = token; }
     void setChatId(const std::string& id) { chatId = id; }
-    void loop();
+    void setApiBase(const std::string& url) { apiBase = url; }  // a stand-in server for load tests
+
+   protected:
+    bool configured() const override { return !apiToken.empty(); }
+    bool buildCall(const std::string& text, HttpCall& call) override;
 
    private:
-    void sendQueuedMessage();
     std::string apiToken;
     std::string chatId;
-    std::mutex mtx;
-    std::queue<std::string> messageQueue;
+    std::string apiBase = "https://api.telegram.org";
 };
 #endif  // TELEGRAM_HPP
\ No newline at end of file
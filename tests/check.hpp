@@ -0,0 +1,26 @@
+#ifndef TESTS_CHECK_HPP
+#define TESTS_CHECK_HPP
+
+// Checks of the ctest programs: a failed one is reported and counted, the program goes on.
+#include <iostream>
+#include <string>
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        checkFailures()++;
+    }
+}
+
+// The exit code of the test program.
+inline int checkResult(const char* test) {
+    if (checkFailures() == 0) std::cout << test << " passed" << std::endl;
+    return checkFailures() == 0 ? 0 : 1;
+}
+
+#endif  // TESTS_CHECK_HPP
@@ -0,0 +1,140 @@
+// DiskQueue recovery: the consumer position survives a reopen, a torn or corrupted record ends the
+// queue and is cut off, and segments are deleted once consumed.
+#include "diskqueue.hpp"
+#include "check.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> readAll(DiskQueue& queue) {
+    std::vector<std::string> out;
+    queue.peek([&](const std::string& record) {
+        out.push_back(record);
+        return true;
+    });
+    return out;
+}
+
+std::vector<std::string> segmentFiles(const std::string& dir) {
+    std::vector<std::string> out;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return out;
+    while (struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0) out.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    return out;
+}
+
+off_t fileSize(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+void removeDir(const std::string& dir) {
+    for (const std::string& path : segmentFiles(dir)) unlink(path.c_str());
+    unlink((dir + "/offset").c_str());
+    unlink((dir + "/offset.tmp").c_str());
+    rmdir(dir.c_str());
+}
+
+void testTornTail(const std::string& dir) {
+    {
+        DiskQueue queue;
+        check(queue.open(dir), "torn tail: open a new queue");
+        for (int i = 0; i < 5; i++) queue.push("record " + std::to_string(i));
+        queue.sync();
+        queue.pop(2);
+        queue.sync();  // writes the offset
+    }
+    std::vector<std::string> segments = segmentFiles(dir);
+    check(segments.size() == 1, "torn tail: one segment");
+    if (segments.size() != 1) return;
+    // a crash in the middle of writing the last record, 8 bytes of header and 8 of payload
+    off_t intact = fileSize(segments[0]) - (8 + 8);
+    check(truncate(segments[0].c_str(), intact + 5) == 0, "torn tail: cut the last record");
+
+    {
+        DiskQueue queue;
+        check(queue.open(dir), "torn tail: reopen");
+        std::vector<std::string> records = readAll(queue);
+        check(queue.size() == 2, "torn tail: the consumed and the torn records are not counted");
+        check(records == std::vector<std::string>({"record 2", "record 3"}), "torn tail: replay starts at the saved offset and ends before the torn record");
+        check(fileSize(segments[0]) == intact, "torn tail: the torn bytes are truncated");
+        queue.push("record 5");
+        queue.sync();
+    }
+    // appending went on right after the last intact record
+    DiskQueue queue;
+    check(queue.open(dir), "torn tail: open a second time");
+    check(readAll(queue) == std::vector<std::string>({"record 2", "record 3", "record 5"}), "torn tail: records appended after the recovery are read back");
+}
+
+void testCorruptRecord(const std::string& dir) {
+    {
+        DiskQueue queue;
+        check(queue.open(dir), "corrupt record: open a new queue");
+        for (int i = 0; i < 3; i++) queue.push("payload " + std::to_string(i));
+        queue.sync();
+    }
+    std::vector<std::string> segments = segmentFiles(dir);
+    if (segments.size() != 1) {
+        check(false, "corrupt record: one segment");
+        return;
+    }
+    // flip a payload byte of the second record, its CRC no longer matches
+    off_t second = 8 + 9;
+    int fd = open(segments[0].c_str(), O_WRONLY);
+    check(fd >= 0 && pwrite(fd, "X", 1, second + 8 + 2) == 1, "corrupt record: damage a record");
+    if (fd >= 0) close(fd);
+
+    DiskQueue queue;
+    check(queue.open(dir), "corrupt record: reopen");
+    check(readAll(queue) == std::vector<std::string>({"payload 0"}), "corrupt record: the queue ends before the damaged record");
+    check(fileSize(segments[0]) == second, "corrupt record: the damaged record and everything after it are cut off");
+}
+
+void testSegments(const std::string& dir) {
+    std::string big(700 * 1024, 'x');
+    {
+        DiskQueue queue;
+        check(queue.open(dir), "segments: open a new queue");
+        for (int i = 0; i < 4; i++) {
+            queue.push(std::to_string(i) + big);
+            queue.sync();  // past DISKQUEUE_SEGMENT_BYTES the next sync starts a new segment
+        }
+        check(segmentFiles(dir).size() == 2, "segments: a second segment is started");
+        queue.pop(3);
+        check(segmentFiles(dir).size() == 1, "segments: a consumed segment is deleted");
+    }
+    DiskQueue queue;
+    check(queue.open(dir), "segments: reopen");
+    std::vector<std::string> records = readAll(queue);
+    check(records.size() == 1 && records[0][0] == '3', "segments: the offset into the second segment is honoured");
+}
+
+}  // namespace
+
+int main() {
+    char base[] = "/tmp/diskqueue_testXXXXXX";
+    if (!mkdtemp(base)) {
+        std::cerr << "Can't create a temp directory" << std::endl;
+        return 1;
+    }
+    std::string root = base;
+    testTornTail(root + "/torn");
+    testCorruptRecord(root + "/corrupt");
+    testSegments(root + "/segments");
+    removeDir(root + "/torn");
+    removeDir(root + "/corrupt");
+    removeDir(root + "/segments");
+    rmdir(base);
+    return checkResult("diskqueue_test");
+}
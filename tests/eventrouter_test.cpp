@@ -0,0 +1,165 @@
+// RouteRule parsing, the dispatch table compile() builds and publish() fanning events out to
+// recording sinks: each sink gets a matching event once, whatever the number of rules matching it.
+#include "eventrouter.hpp"
+#include "check.hpp"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+// Appends "<sink>:<formatted event>" to a shared log.
+class RecordingSink : public EventSink {
+   public:
+    RecordingSink(std::vector<std::string>& log, const std::string& name) : log(log), name(name), format("{type} {freq} {text}") {}
+    void deliver(const MeshEvent& event) override { log.push_back(name + ":" + format.format(event)); }
+
+   private:
+    std::vector<std::string>& log;
+    std::string name;
+    EventFormat format;
+};
+
+class ThrowingSink : public EventSink {
+   public:
+    void deliver(const MeshEvent&) override { throw std::runtime_error("sink down"); }
+};
+
+MeshEvent makeEvent(EventType type, uint16_t freq, uint8_t chanHash, uint16_t port, uint32_t node, const std::string& text) {
+    MeshEvent event;
+    event.type = type;
+    event.freq = freq;
+    event.chanHash = chanHash;
+    event.port = port;
+    event.node = node;
+    event.text = text;
+    return event;
+}
+
+std::string joined(const std::vector<std::string>& log) {
+    std::string out;
+    for (const auto& line : log) out += (out.empty() ? "" : "|") + line;
+    return out;
+}
+
+void testParse() {
+    RouteRule rule;
+    std::string error;
+    check(RouteRule::parse("discord868 type=chat,position freq=868 chan=8,31 port=1 node=!aabbccdd,0x11223344,42", rule, error), "parse: a full rule");
+    check(rule.sink == "discord868", "parse: sink name");
+    check(rule.types.size() == 2 && rule.types[0] == EventType::Chat && rule.types[1] == EventType::Position, "parse: types");
+    check(rule.freqs == std::vector<uint16_t>{868}, "parse: freq");
+    check(rule.chanHashes == std::vector<uint8_t>{8, 31}, "parse: chan");
+    check(rule.ports == std::vector<uint16_t>{1}, "parse: port");
+    check(rule.nodes == std::vector<uint32_t>({0xaabbccdd, 0x11223344, 42}), "parse: nodes in hex and decimal");
+    check(RouteRule::parse("log", rule, error) && rule.sink == "log" && rule.types.empty() && rule.nodes.empty(), "parse: a rule without conditions");
+
+    const char* bad[] = {
+        "",                           // no sink
+        "log type=chat,bogus",        // unknown event kind
+        "log type=",                  // empty list
+        "log freq=abc",               // not a number
+        "log freq=868,",              // empty last item
+        "log type=chat,",             // empty last kind
+        "log chan=300",               // over 8 bits
+        "log node=!zz",               // not hex
+        "log colour=red",             // unknown field
+        "log type",                   // no value
+    };
+    for (const char* text : bad) {
+        error.clear();
+        check(!RouteRule::parse(text, rule, error) && !error.empty(), std::string("parse: rejects '") + text + "'");
+    }
+    RouteRule::parse("", rule, error);
+    check(error == "missing sink name", "parse: says the sink name is missing");
+    RouteRule::parse("log type=chat,bogus", rule, error);
+    check(error == "bad condition 'type=chat,bogus'", "parse: names the bad condition");
+}
+
+void testAddRoute() {
+    std::vector<std::string> log;
+    EventRouter router;
+    check(router.addSink("log", std::unique_ptr<EventSink>(new RecordingSink(log, "log"))), "routes: sink added");
+    check(router.addRoute("log type=chat"), "routes: rule to a known sink");
+    check(!router.addRoute("nosuchsink type=chat"), "routes: rule to an unknown sink is skipped");
+    check(!router.addRoute("log type=bogus"), "routes: malformed rule is skipped");
+    check(router.routeCount() == 1, "routes: only the good rule counts");
+
+    char path[] = "/tmp/eventrouter_testXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        check(false, "routes: temp file");
+        return;
+    }
+    close(fd);
+    std::ofstream(path) << "# routes\n\nlog freq=433   # trailing comment\nlog type=bogus\nother\n   \nlog port=67\n";
+    check(router.loadRoutes(path) == 2, "routes: loadRoutes skips comments, blank lines and bad rules");
+    check(router.routeCount() == 3, "routes: loaded rules are added");
+    unlink(path);
+
+    EventRouter full;
+    full.addSink("log", std::unique_ptr<EventSink>(new RecordingSink(log, "log")));
+    for (int i = 0; i < ROUTER_MAX; i++) full.addRoute("log");
+    check(!full.addRoute("log") && full.routeCount() == ROUTER_MAX, "routes: at most ROUTER_MAX rules");
+}
+
+void testPublish() {
+    std::vector<std::string> log;
+    EventRouter router;
+    router.addSink("a", std::unique_ptr<EventSink>(new RecordingSink(log, "a")));
+    router.addSink("b", std::unique_ptr<EventSink>(new RecordingSink(log, "b")));
+    router.addSink("broken", std::unique_ptr<EventSink>(new ThrowingSink()));
+    router.addSink("c", std::unique_ptr<EventSink>(new RecordingSink(log, "c")));
+    router.addRoute("a type=chat freq=868");
+    router.addRoute("a type=telemetry port=67 freq=433");
+    router.addRoute("b chan=8,31");
+    router.addRoute("b type=position node=!11223344");
+    router.addRoute("broken type=waypoint");
+    router.addRoute("c");
+    router.compile();
+
+    struct Case {
+        MeshEvent event;
+        const char* expected;
+        const char* what;
+    } cases[] = {
+        {makeEvent(EventType::Chat, 868, 8, 1, 1, "hi"), "a:chat 868 hi|b:chat 868 hi|c:chat 868 hi", "chat on 868 channel 8 reaches every sink once"},
+        {makeEvent(EventType::Chat, 433, 0, 1, 1, "hi"), "c:chat 433 hi", "chat on 433 only reaches the catch-all"},
+        {makeEvent(EventType::Position, 433, 31, 3, 0x11223344, "pos"), "b:position 433 pos|c:position 433 pos", "two rules of b match, b gets the event once"},
+        {makeEvent(EventType::Position, 433, 0, 3, 0x11223344, "pos"), "b:position 433 pos|c:position 433 pos", "node condition"},
+        {makeEvent(EventType::Position, 433, 0, 3, 0x55667788, "pos"), "c:position 433 pos", "other node"},
+        {makeEvent(EventType::Telemetry, 433, 0, 67, 1, "tel"), "a:telemetry 433 tel|c:telemetry 433 tel", "port and freq condition"},
+        {makeEvent(EventType::Telemetry, 868, 0, 67, 1, "tel"), "c:telemetry 868 tel", "port matches, freq does not"},
+        {makeEvent(EventType::Telemetry, 433, 0, 1, 1, "tel"), "c:telemetry 433 tel", "freq matches, port does not"},
+        {makeEvent(EventType::Waypoint, 868, 0, 8, 1, "wp"), "c:waypoint 868 wp", "a throwing sink does not stop the others"},
+        {makeEvent(EventType::Count, 868, 8, 1, 1, "x"), "", "an invalid type reaches nobody"},
+    };
+    for (const Case& c : cases) {
+        log.clear();
+        router.publish(c.event);
+        check(joined(log) == c.expected, std::string("publish: ") + c.what + ", got '" + joined(log) + "'");
+    }
+}
+
+void testFormat() {
+    MeshEvent event = makeEvent(EventType::Chat, 868, 31, 1, 0xaabbccdd, "hello");
+    event.nodeName = "Node";
+    event.channel = "LongFast";
+    event.emoji = true;
+    EventFormat format("[{freq}/{chan}/{chanhash}] {emoji}{name} ({node}) {type}: {text} {unknown}");
+    check(format.format(event) == "[868/LongFast/31] (EMOJI) Node (!aabbccdd) chat: hello {unknown}", "format: every placeholder, unknown ones copied");
+    event.emoji = false;
+    check(EventFormat("{emoji}{text}").format(event) == "hello", "format: no emoji mark");
+}
+
+}  // namespace
+
+int main() {
+    testParse();
+    testAddRoute();
+    testPublish();
+    testFormat();
+    return checkResult("eventrouter_test");
+}
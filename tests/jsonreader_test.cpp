@@ -0,0 +1,113 @@
+// JsonReader: walking documents, string escapes, skipped values, and the syntax errors it rejects.
+#include "jsonreader.hpp"
+#include "check.hpp"
+#include <vector>
+
+namespace {
+
+// Reads an array of numbers, false when the reader failed.
+bool readNumbers(const std::string& text, std::vector<double>& out) {
+    JsonReader json(text);
+    out.clear();
+    if (!json.beginArray()) return false;
+    while (json.nextElement()) {
+        double number;
+        if (!json.readNumber(number)) return false;
+        out.push_back(number);
+    }
+    return !json.failed();
+}
+
+// Reads the keys of an object, skipping their values, false when the reader failed.
+bool readKeys(const std::string& text, std::vector<std::string>& out) {
+    JsonReader json(text);
+    out.clear();
+    if (!json.beginObject()) return false;
+    std::string key;
+    while (json.nextKey(key)) {
+        out.push_back(key);
+        if (!json.skipValue()) return false;
+    }
+    return !json.failed();
+}
+
+void testWalk() {
+    std::string doc = R"( {"a": 1, "skip": {"x": [1, {"y": "]}"}], "z": null}, "list": [true, "two", -3.5e1], "empty": {}, "none": []} )";
+    JsonReader json(doc);  // reads the buffer in place, it must outlive the reader
+    std::string key, text;
+    double number = 0;
+    check(json.beginObject(), "walk: object");
+    check(json.nextKey(key) && key == "a", "walk: first key");
+    check(json.readNumber(number) && number == 1, "walk: number");
+    check(json.nextKey(key) && key == "skip", "walk: second key");
+    check(json.skipValue(), "walk: nested value skipped, brackets inside strings ignored");
+    check(json.nextKey(key) && key == "list", "walk: key after a skipped value");
+    check(json.beginArray(), "walk: array");
+    check(json.nextElement() && json.peek() == JsonReader::BOOL && json.skipValue(), "walk: bool element");
+    check(json.nextElement() && json.readString(text) && text == "two", "walk: string element");
+    check(json.nextElement() && json.readNumber(number) && number == -35, "walk: exponent");
+    check(!json.nextElement(), "walk: end of array");
+    check(json.nextKey(key) && key == "empty" && json.beginObject() && !json.nextKey(key), "walk: empty object");
+    check(json.nextKey(key) && key == "none" && json.beginArray() && !json.nextElement(), "walk: empty array");
+    check(!json.nextKey(key), "walk: end of object");
+    check(!json.failed(), "walk: no error");
+}
+
+void testStrings() {
+    std::string text;
+    std::string escaped = R"("a\"b\\c\/d\n\t\u00e9\u20AC\ud83d\ude00")", lone = R"("\ud83dx")", open = R"("abc)", hex = R"("\u12g4")";
+    JsonReader escapes(escaped);
+    check(escapes.readString(text) && text == "a\"b\\c/d\n\t\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80", "strings: escapes and surrogate pairs");
+    JsonReader unpaired(lone);
+    check(unpaired.readString(text) && text == "\xEF\xBF\xBDx", "strings: an unpaired surrogate becomes U+FFFD");
+    JsonReader unterminated(open);
+    check(!unterminated.readString(text) && unterminated.failed(), "strings: unterminated");
+    JsonReader badHex(hex);
+    check(!badHex.readString(text) && badHex.failed(), "strings: bad \\u escape");
+}
+
+void testCommas() {
+    std::vector<double> numbers;
+    std::vector<std::string> keys;
+    check(readNumbers("[1, 2,3 ]", numbers) && numbers.size() == 3, "commas: array");
+    check(readKeys(R"({"a":1,"b":[1,2],"c":{"d":2}})", keys) && keys.size() == 3, "commas: object");
+    check(!readNumbers("[1 2]", numbers), "commas: missing between elements");
+    check(!readNumbers("[1,]", numbers), "commas: trailing in an array");
+    check(!readNumbers("[,1]", numbers), "commas: leading in an array");
+    check(!readNumbers("[1,,2]", numbers), "commas: doubled");
+    check(!readKeys(R"({"a":1 "b":2})", keys), "commas: missing between members");
+    check(!readKeys(R"({"a":1,})", keys), "commas: trailing in an object");
+    check(!readKeys(R"({"a":[1] "b":2})", keys), "commas: missing after a skipped array");
+}
+
+void testMalformed() {
+    std::vector<double> numbers;
+    std::vector<std::string> keys;
+    check(!readKeys(R"({"a" 1})", keys), "malformed: missing colon");
+    check(!readKeys(R"({a:1})", keys), "malformed: unquoted key");
+    check(!readKeys(R"({"a":{"b":1})", keys), "malformed: unclosed object");
+    check(!readNumbers("[1, 2", numbers), "malformed: unclosed array");
+    check(!readNumbers("[1.2.3]", numbers), "malformed: bad number");
+    check(!readNumbers("", numbers), "malformed: empty input");
+    check(!readNumbers("{}", numbers), "malformed: object where an array is expected");
+
+    // after an error every call fails
+    std::string missing = "[1 2, 3]";
+    JsonReader json(missing);
+    double number;
+    json.beginArray();
+    json.nextElement();
+    json.readNumber(number);
+    check(!json.nextElement() && json.failed(), "malformed: the error is reported");
+    check(!json.nextElement() && !json.readNumber(number) && json.peek() == JsonReader::NONE, "malformed: later calls fail");
+}
+
+}  // namespace
+
+int main() {
+    testWalk();
+    testStrings();
+    testCommas();
+    testMalformed();
+    return checkResult("jsonreader_test");
+}
@@ -0,0 +1,167 @@
+#include "loadtest.hpp"
+#include "discord.hpp"
+#include "telegram.hpp"
+#include "meshcoredown.hpp"
+#include "httpdispatcher.hpp"
+#include "timeutil.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define LOADTEST_TICK_MS 10  // main loop period of the notifiers under test
+
+namespace {
+
+// Delivery bookkeeping of one target. Lines carry an "@<target><seq>" tag the stand-in's listener looks for.
+struct Target {
+    const char* name;
+    char tag;
+    std::vector<uint64_t> sentMs;      // by seq
+    std::vector<uint64_t> receivedMs;  // by seq, 0 until received
+    uint64_t duplicates = 0;
+    uint64_t posts = 0;
+};
+
+std::string percentiles(std::vector<uint64_t> latencies) {
+    if (latencies.empty()) return "no deliveries";
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double q) { return latencies[std::min(latencies.size() - 1, (size_t)(q * latencies.size()))]; };
+    char out[128];
+    snprintf(out, sizeof(out), "p50 %" PRIu64 " ms, p90 %" PRIu64 " ms, p99 %" PRIu64 " ms, max %" PRIu64 " ms", at(0.5), at(0.9), at(0.99), latencies.back());
+    return out;
+}
+
+}  // namespace
+
+bool runNotifierLoadTest(const LoadTestOptions& options, LoadTestResult& result, std::string& report) {
+    std::mutex mtx;
+    Target targets[] = {{"discord", 'D', {}, {}, 0, 0}, {"telegram", 'T', {}, {}, 0, 0}, {"meshcore", 'M', {}, {}, 0, 0}};
+    Target& discordTarget = targets[0];
+    Target& telegramTarget = targets[1];
+    Target& meshcoreTarget = targets[2];
+    size_t expected = options.lines * 2 + options.meshcoreMessages;
+    size_t received = 0;
+
+    WebhookStub stub;
+    stub.setConfig(options.stub);
+    stub.setListener([&](const std::string& endpoint, const std::string& text) {
+        uint64_t now = nowMs();
+        std::lock_guard<std::mutex> lock(mtx);
+        Target& target = endpoint == "telegram" ? telegramTarget : endpoint.find("meshcore") != std::string::npos ? meshcoreTarget : discordTarget;
+        target.posts++;
+        size_t at = 0;
+        while ((at = text.find('@', at)) != std::string::npos) {
+            at++;
+            if (at >= text.size() || text[at] != target.tag) continue;
+            size_t seq = strtoul(text.c_str() + at + 1, nullptr, 10);
+            if (seq >= target.receivedMs.size()) continue;
+            if (target.receivedMs[seq]) {
+                target.duplicates++;
+                continue;
+            }
+            target.receivedMs[seq] = now;
+            received++;
+        }
+    });
+    if (!stub.start(options.port)) return false;
+    std::string base = stub.baseUrl();
+
+    HttpDispatcher http;
+    DiscordBot discord(http, base + "/api/webhooks/1/load", "load_discord");
+    TelegramPoster telegram(http);
+    telegram.setApiBase(base);
+    telegram.setApiToken("1:load");
+    telegram.setChatId("1");
+    MeshCoreDown meshcore(http, base, base + "/api/webhooks/2/meshcore", base + "/api/webhooks/3/meshcore_pub");
+    for (Target& target : targets) {
+        size_t count = target.tag == 'M' ? options.meshcoreMessages : options.lines;
+        target.sentMs.assign(count, 0);
+        target.receivedMs.assign(count, 0);
+    }
+    http.start();
+
+    // a realistic chat line, the tag first
+    auto chatLine = [](char tag, size_t seq) { return "@" + std::string(1, tag) + std::to_string(seq) + " the quick brown fox jumps over the lazy dog"; };
+    uint64_t start = nowMs();
+    uint64_t nextBurst = start;
+    size_t queued = 0, meshcoreAdded = 0;
+    while (true) {
+        uint64_t now = nowMs();
+        if (now >= nextBurst && (queued < options.lines || meshcoreAdded < options.meshcoreMessages)) {
+            size_t end = std::min(options.lines, queued + options.burst);
+            for (; queued < end; queued++) {
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    discordTarget.sentMs[queued] = telegramTarget.sentMs[queued] = nowMs();
+                }
+                discord.queueMessage("868# load:  " + chatLine('D', queued));
+                telegram.queueMessage("868# load:  " + chatLine('T', queued));
+            }
+            // MeshCore messages are a tenth of the chat, split over both channels
+            size_t meshcoreEnd = std::min(options.meshcoreMessages, meshcoreAdded + std::max<size_t>(1, options.burst / 10));
+            for (; meshcoreAdded < meshcoreEnd; meshcoreAdded++) {
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    meshcoreTarget.sentMs[meshcoreAdded] = nowMs();
+                }
+                stub.addMeshCoreMessage(meshcoreAdded % 2 ? 1 : 3, "load", chatLine('M', meshcoreAdded));
+            }
+            nextBurst += options.burstIntervalMs;
+        }
+        discord.loop();
+        telegram.loop();
+        meshcore.loop();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (received >= expected) break;
+        }
+        if (now - start > options.timeoutMs) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOADTEST_TICK_MS));
+    }
+    uint64_t elapsed = std::max<uint64_t>(1, nowMs() - start);
+
+    NotifierStats discordStats = discord.stats(), telegramStats = telegram.stats();
+    NotifierStats meshcoreStats;
+    for (Notifier* notifier : meshcore.getNotifiers()) {
+        NotifierStats s = notifier->stats();
+        meshcoreStats.sent += s.sent;
+        meshcoreStats.retries += s.retries;
+        meshcoreStats.rateLimited += s.rateLimited;
+        meshcoreStats.failed += s.failed;
+        meshcoreStats.dropped += s.dropped;
+    }
+    http.stop();  // completes the requests in flight while the notifiers are still there
+    stub.stop();
+    WebhookStubStats stubStats = stub.stats();
+
+    char row[512];
+    report.clear();
+    result = LoadTestResult();
+    snprintf(row, sizeof(row), "Load test: %zu lines per notifier in bursts of %zu every %u ms, %zu MeshCore messages; stand-in latency %u+%u ms, 429 %u%%, failures %u%%\n",
+             options.lines, options.burst, options.burstIntervalMs, options.meshcoreMessages, options.stub.latencyMs, options.stub.jitterMs, options.stub.rateLimitPercent, options.stub.failPercent);
+    report += row;
+    std::lock_guard<std::mutex> lock(mtx);
+    const NotifierStats* stats[] = {&discordStats, &telegramStats, &meshcoreStats};
+    for (size_t i = 0; i < 3; i++) {
+        const Target& target = targets[i];
+        std::vector<uint64_t> latencies;
+        for (size_t seq = 0; seq < target.receivedMs.size(); seq++) {
+            if (target.receivedMs[seq]) latencies.push_back(target.receivedMs[seq] - target.sentMs[seq]);
+        }
+        snprintf(row, sizeof(row), "  %-8s delivered %zu/%zu (lost %zu, dropped %" PRIu64 ", duplicates %" PRIu64 ") in %" PRIu64 " posts, retries %" PRIu64 ", 429s %" PRIu64 ", gave up %" PRIu64 "\n",
+                 target.name, latencies.size(), target.receivedMs.size(), target.receivedMs.size() - latencies.size(), stats[i]->dropped, target.duplicates, target.posts, stats[i]->retries,
+                 stats[i]->rateLimited, stats[i]->failed);
+        report += row;
+        report += "           latency " + percentiles(latencies) + "\n";
+        result.expected += target.receivedMs.size();
+        result.delivered += latencies.size();
+        result.duplicates += target.duplicates;
+    }
+    snprintf(row, sizeof(row), "  stand-in: %" PRIu64 " requests in %.1f s (%.1f req/s), %" PRIu64 " posts, %" PRIu64 " polls, %" PRIu64 " not modified, %" PRIu64 " 429s, %" PRIu64 " failures\n",
+             stubStats.requests, elapsed / 1000.0, stubStats.requests * 1000.0 / elapsed, stubStats.posts, stubStats.polls, stubStats.notModified, stubStats.rateLimited, stubStats.failed);
+    report += row;
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef LOADTEST_HPP
+#define LOADTEST_HPP
+
+#include <string>
+#include <cstdint>
+#include "webhookstub.hpp"
+
+struct LoadTestOptions {
+    size_t lines = 600;               // chat lines per notifier (Discord, Telegram)
+    size_t burst = 60;                // lines queued at once
+    uint32_t burstIntervalMs = 1000;  // between bursts
+    size_t meshcoreMessages = 60;     // channel messages served to the MeshCore poller
+    uint32_t timeoutMs = 180000;      // lines not delivered by then count as lost
+    uint16_t port = 18099;            // of the stand-in server, on 127.0.0.1
+    WebhookStubConfig stub;
+};
+
+struct LoadTestResult {
+    size_t expected = 0;     // lines queued and messages served, over all targets
+    size_t delivered = 0;    // of them, received by the stand-in
+    uint64_t duplicates = 0; // lines received more than once
+};
+
+/**
+ * @brief Drives chat bursts through a Discord and a Telegram notifier and MeshCore messages through
+ * a MeshCoreDown, all against a local WebhookStub, and reports the delivery of every line:
+ * latency percentiles from queueing to the stand-in's receipt, lost, dropped and duplicate lines,
+ * and the request rate. Uses its own HttpDispatcher and notifiers, the live ones are not touched.
+ *
+ * Blocks until every line arrived or the timeout. Returns false when the stand-in can't start.
+ */
+bool runNotifierLoadTest(const LoadTestOptions& options, LoadTestResult& result, std::string& report);
+
+#endif  // LOADTEST_HPP
@@ -0,0 +1,141 @@
+// Polls the local stand-in with MeshCoreDown and checks what reaches the Discord webhooks: repeats
+// of the overlap are dropped by message id, id-less messages only against the previous response,
+// and polls without news are answered 304 through If-None-Match or If-Modified-Since.
+#include "meshcoredown.hpp"
+#include "webhookstub.hpp"
+#include "check.hpp"
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#define TEST_TIMEOUT_MS 10000
+
+namespace {
+
+// Lines of the accepted posts by webhook path, a post carries one or more lines.
+class Received {
+   public:
+    void add(const std::string& endpoint, const std::string& text) {
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t start = 0;
+        while (start <= text.size()) {
+            size_t end = text.find('\n', start);
+            if (end == std::string::npos) end = text.size();
+            lines[endpoint + " " + text.substr(start, end - start)]++;
+            start = end + 1;
+        }
+    }
+    int count(const std::string& webhook, const std::string& line) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = lines.find("discord:" + webhook + " " + line);
+        return it == lines.end() ? 0 : it->second;
+    }
+
+   private:
+    std::mutex mtx;
+    std::map<std::string, int> lines;
+};
+
+// A poller and its webhooks against a stand-in of its own.
+struct Setup {
+    WebhookStub stub;
+    Received received;
+    HttpDispatcher http;
+    std::unique_ptr<MeshCoreDown> meshcore;
+
+    bool start(uint16_t port, bool etag) {
+        WebhookStubConfig config;
+        config.latencyMs = 0;
+        config.jitterMs = 0;
+        config.discordBucket = 0;
+        config.meshcoreEtag = etag;
+        stub.setConfig(config);
+        stub.setListener([this](const std::string& endpoint, const std::string& text) { received.add(endpoint, text); });
+        if (!stub.start(port)) return false;
+        std::string base = stub.baseUrl();
+        meshcore.reset(new MeshCoreDown(http, base, base + "/api/webhooks/3/channel", base + "/api/webhooks/1/public"));
+        http.start();
+        return true;
+    }
+    ~Setup() {
+        http.stop();
+        stub.stop();
+    }
+
+    // Runs the poller's main loop until done or the timeout.
+    bool runUntil(const std::function<bool()>& done) {
+        for (int waited = 0; waited < TEST_TIMEOUT_MS; waited += 10) {
+            if (done()) return true;
+            meshcore->loop();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return done();
+    }
+    // Waits until the stand-in answered n more polls with 304.
+    bool waitNotModified(uint64_t n) {
+        uint64_t target = stub.stats().notModified + n;
+        return runUntil([&]() { return stub.stats().notModified >= target; });
+    }
+};
+
+void testIdsAndEtag() {
+    Setup s;
+    if (!s.start(18096, true)) {
+        check(false, "stand-in starts");
+        return;
+    }
+    s.stub.addMeshCoreMessage(3, "alice", "hello");
+    s.stub.addMeshCoreMessage(1, "bob", "hi all");
+    check(s.runUntil([&]() { return s.received.count("/api/webhooks/3/channel", "alice: hello") && s.received.count("/api/webhooks/1/public", "bob: hi all"); }),
+          "channel 3 and channel 1 messages are forwarded to their webhooks");
+    check(s.waitNotModified(2), "polls without news are answered 304 through If-None-Match");
+    check(s.stub.stats().polls >= 2, "the poll after new messages asks again without validators");
+    check(s.received.count("/api/webhooks/3/channel", "alice: hello") == 1, "a message repeated by the overlap is forwarded once");
+    check(s.received.count("/api/webhooks/1/public", "bob: hi all") == 1, "a message repeated by the overlap is forwarded once, public channel");
+
+    s.stub.addMeshCoreMessage(3, "alice", "again");
+    check(s.runUntil([&]() { return s.received.count("/api/webhooks/3/channel", "alice: again") == 1; }), "a new message ends the 304s");
+    check(s.waitNotModified(1), "polls are conditional again once nothing is new");
+    check(s.received.count("/api/webhooks/3/channel", "alice: hello") == 1, "old messages are not forwarded again");
+    check(s.received.count("/api/webhooks/3/channel", "alice: again") == 1, "the new message is forwarded once");
+}
+
+void testIdlessMessages() {
+    Setup s;
+    if (!s.start(18097, true)) {
+        check(false, "stand-in starts");
+        return;
+    }
+    s.stub.addMeshCoreMessage(3, "carol", "ok", false);
+    check(s.runUntil([&]() { return s.received.count("/api/webhooks/3/channel", "carol: ok") == 1; }), "an id-less message is forwarded");
+    check(s.waitNotModified(1), "polls settle to 304");
+    check(s.received.count("/api/webhooks/3/channel", "carol: ok") == 1, "an id-less message the previous response had is a repeat");
+
+    // the same words said again: the response has two copies, the previous one had one
+    s.stub.addMeshCoreMessage(3, "carol", "ok", false);
+    check(s.runUntil([&]() { return s.received.count("/api/webhooks/3/channel", "carol: ok") == 2; }), "the same id-less text said again is forwarded");
+    check(s.waitNotModified(1), "polls settle to 304 again");
+    check(s.received.count("/api/webhooks/3/channel", "carol: ok") == 2, "both copies are forwarded once each");
+}
+
+void testLastModified() {
+    Setup s;
+    if (!s.start(18098, false)) {
+        check(false, "stand-in starts");
+        return;
+    }
+    s.stub.addMeshCoreMessage(3, "dave", "no etag here");
+    check(s.runUntil([&]() { return s.received.count("/api/webhooks/3/channel", "dave: no etag here") == 1; }), "a message is forwarded without an ETag");
+    check(s.waitNotModified(2), "polls without news are answered 304 through If-Modified-Since");
+    check(s.received.count("/api/webhooks/3/channel", "dave: no etag here") == 1, "the message is forwarded once");
+}
+
+}  // namespace
+
+int main() {
+    testIdsAndEtag();
+    testIdlessMessages();
+    testLastModified();
+    return checkResult("meshcoredown_test");
+}
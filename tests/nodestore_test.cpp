@@ -0,0 +1,151 @@
+// NodeStore's incremental structures against what they stand for: the change sequence of the
+// delta /nodes, the spatial grid of the bbox queries and the per frequency globalstats aggregates.
+#include "nodestore.hpp"
+#include "timeutil.hpp"
+#include "check.hpp"
+#include <algorithm>
+
+namespace {
+
+std::vector<uint32_t> ids(const std::vector<NodeRecord>& nodes) {
+    std::vector<uint32_t> out;
+    for (const NodeRecord& node : nodes) out.push_back(node.nodeId);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+std::vector<uint32_t> nodesIn(NodeStore& store, const GeoBox& box) {
+    std::vector<NodeRecord> found;
+    store.forEachNodeIn(box, [&](const NodeRecord& node) { found.push_back(node); });
+    return ids(found);
+}
+
+void testDeltaSync() {
+    NodeStore store;
+    uint64_t now = nowMs();
+    store.setNodeInfo(1, "A", "Node A", 868, 0, 8, now);
+    store.setNodeInfo(2, "B", "Node B", 868, 0, 8, now);
+
+    std::vector<NodeRecord> changed;
+    std::vector<uint32_t> removed;
+    bool full = false;
+    uint64_t seq = store.getChanges(0, changed, removed, full);
+    check(full && ids(changed) == std::vector<uint32_t>({1, 2}) && removed.empty(), "delta: since 0 is the full list");
+
+    changed.clear();
+    uint64_t next = store.getChanges(seq, changed, removed, full);
+    check(!full && changed.empty() && removed.empty(), "delta: nothing changed, empty delta");
+    check(next == seq, "delta: nothing changed, the cursor stays");
+
+    store.setNodePosition(2, 475000000, 190000000, 100, now);
+    next = store.getChanges(seq, changed, removed, full);
+    check(!full && ids(changed) == std::vector<uint32_t>{2} && removed.empty(), "delta: only the moved node");
+    check(next > seq, "delta: the cursor moves on a change");
+
+    // a node last heard longer ago than the store keeps nodes is dropped, and reported as removed
+    seq = next;
+    changed.clear();
+    store.setNodeInfo(3, "C", "Node C", 868, 0, 8, now - NODESTORE_NODE_MS - 60000);
+    next = store.getChanges(seq, changed, removed, full);
+    check(!full && changed.empty() && removed == std::vector<uint32_t>{3}, "delta: an expired node is a removal");
+
+    changed.clear();
+    removed.clear();
+    store.getChanges(next + 100, changed, removed, full);
+    check(full && ids(changed) == std::vector<uint32_t>({1, 2}), "delta: a cursor from before a restart gets the full list");
+}
+
+void testBboxQuery() {
+    NodeStore store;
+    uint64_t now = nowMs();
+    GeoBox box;
+    box.west = 190000000;
+    box.east = 191000000;
+    box.south = 475000000;
+    box.north = 476000000;
+    struct {
+        uint32_t id;
+        int32_t latitude, longitude;
+    } positions[] = {
+        {10, box.south, box.west},      // corners are inside
+        {11, box.north, box.east},
+        {12, 475500000, 190500000},
+        {13, box.north + 1, 190500000},  // just outside
+        {14, 475500000, box.east + 1},
+        {15, 0, 0},                      // no position
+    };
+    for (const auto& p : positions) {
+        store.setNodeInfo(p.id, "n", "node", 868, 0, 8, now);
+        store.setNodePosition(p.id, p.latitude, p.longitude, 0, now);
+    }
+    check(nodesIn(store, box) == std::vector<uint32_t>({10, 11, 12}), "bbox: edges are inside, one unit past them is not");
+    check(nodesIn(store, GeoBox()) == std::vector<uint32_t>({10, 11, 12, 13, 14}), "bbox: the world has every positioned node");
+
+    store.setNodePosition(12, 400000000, 100000000, 0, now);
+    check(nodesIn(store, box) == std::vector<uint32_t>({10, 11}), "bbox: a moved node leaves its old cell");
+
+    // boxes on tile borders: the antimeridian and longitude 0
+    store.setNodeInfo(20, "n", "node", 868, 0, 8, now);
+    store.setNodePosition(20, 500000, 1799000000, 0, now);
+    store.setNodeInfo(21, "n", "node", 868, 0, 8, now);
+    store.setNodePosition(21, 500000, -1799000000, 0, now);
+    store.setNodeInfo(22, "n", "node", 868, 0, 8, now);
+    store.setNodePosition(22, 500000, 1, 0, now);
+    GeoBox date;
+    date.west = 1790000000;
+    date.east = -1790000000;
+    date.south = -1000000;
+    date.north = 1000000;
+    check(nodesIn(store, date) == std::vector<uint32_t>({20, 21}), "bbox: a box across the antimeridian");
+    GeoBox east;
+    east.west = 1;
+    east.east = 10000000;
+    east.south = -1000000;
+    east.north = 1000000;
+    check(nodesIn(store, east) == std::vector<uint32_t>{22}, "bbox: a box starting on a tile border");
+}
+
+void testFreqStats() {
+    NodeStore store;
+    uint64_t now = nowMs();
+    store.setNodeInfo(1, "A", "Node A", 868, 0, 8, now);
+    store.setNodeInfo(2, "B", "Node B", 868, 2, 8, now);
+    store.setNodeInfo(3, "C", "Node C", 868, 2, 8, now - NODESTORE_STALE_MS - 60000);  // stale
+    store.setNodeInfo(4, "D", "Node D", 433, 0, 8, now);
+    store.setNodePosition(1, 475000000, 190000000, 0, now);
+    store.setNodeMsgCnt(1, 5, 0, 0, 0, 0);
+    store.setNodeMsgCnt(2, 7, 1, 0, 0, 0);
+    store.setNodeMsgCnt(3, 100, 0, 0, 0, 0);  // stale nodes are not counted
+    store.saveNodeSNR(1, 2, 4.0f, now);      // good
+    store.saveNodeSNR(2, 1, -5.0f, now);     // okay, the bucket includes -5
+    store.saveNodeSNR(1, 3, -7.5f, now);     // weak
+    store.saveNodeSNR(3, 2, -12.0f, now);    // bad
+    store.saveNodeSNR(1, 4, 3.0f, now);      // across frequencies, not counted
+
+    GlobalStats eu868 = store.getGlobalStats(868);
+    check(eu868.totalNodes == 3 && eu868.onlineNodes == 2 && eu868.staleNodes == 1 && eu868.nodesWithGps == 1, "freqstats: node counts");
+    check(eu868.roles == std::vector<std::pair<uint8_t, size_t>>({{0, 1}, {2, 2}}), "freqstats: roles");
+    check(eu868.msgCnt == 12 && eu868.traceCnt == 1 && eu868.sumCnt == 13, "freqstats: hourly counters of the online nodes");
+    check(eu868.topMsg.node == "B" && eu868.topMsg.count == 7, "freqstats: top sender");
+    check(eu868.linkCount == 4 && eu868.snrGood == 1 && eu868.snrOkay == 1 && eu868.snrWeak == 1 && eu868.snrBad == 1, "freqstats: one link per SNR bucket");
+    check(eu868.minSnr == -12 && eu868.maxSnr == 4 && eu868.bestLink == "A → B" && eu868.worstLink == "C → B", "freqstats: link extremes");
+    GlobalStats eu433 = store.getGlobalStats(433);
+    check(eu433.totalNodes == 1 && eu433.onlineNodes == 1 && eu433.linkCount == 0, "freqstats: the other frequency");
+
+    // moving to 868 takes the node and its link along
+    store.setNodeInfo(4, "D", "Node D", 868, 0, 8, now);
+    eu868 = store.getGlobalStats(868);
+    eu433 = store.getGlobalStats(433);
+    check(eu868.totalNodes == 4 && eu868.linkCount == 5 && eu868.snrGood == 2, "freqstats: a node changing frequency brings its links");
+    check(eu433.totalNodes == 0 && eu433.onlineNodes == 0, "freqstats: and leaves nothing behind");
+    check(store.getGlobalStats(915).totalNodes == 0, "freqstats: an unknown frequency is empty");
+}
+
+}  // namespace
+
+int main() {
+    testDeltaSync();
+    testBboxQuery();
+    testFreqStats();
+    return checkResult("nodestore_test");
+}
@@ -0,0 +1,260 @@
+// Notifier scheduling against the local stand-in: 429s wait exactly as long as Retry-After (seconds
+// or an HTTP date) or Telegram's parameters.retry_after say, posts leave at the token bucket's rate,
+// Discord's x-ratelimit-* headers hold back the post that would overrun its bucket, and a request
+// that can't be built is retried, not dropped, from a memory and from a disk queue.
+#include "notifier.hpp"
+#include "discord.hpp"
+#include "telegram.hpp"
+#include "webhookstub.hpp"
+#include "jsonwriter.hpp"
+#include "timeutil.hpp"
+#include "check.hpp"
+#include <dirent.h>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define TEST_TIMEOUT_MS 10000
+#define LONG_LINE 1500  // characters, one such line fills a Discord post
+
+namespace {
+
+// Posts like a Discord webhook, its first buildFailures requests can't be built.
+class FlakyNotifier : public Notifier {
+   public:
+    FlakyNotifier(HttpDispatcher& http, const std::string& name, const std::string& url, int buildFailures)
+        : Notifier(http, name, 2000, 10, 5), url(url), buildFailures(buildFailures) {}
+
+   protected:
+    bool configured() const override { return true; }
+    bool buildCall(const std::string& text, HttpCall& call) override {
+        if (buildFailures > 0) {
+            buildFailures--;
+            return false;
+        }
+        call.url = url;
+        JsonWriter(call.body).beginObject().field("content", text).endObject();
+        call.headers.push_back("Content-Type: application/json");
+        return true;
+    }
+
+   private:
+    std::string url;
+    int buildFailures;
+};
+
+// A stand-in of its own and the posts it accepted, with the time they arrived.
+struct Setup {
+    WebhookStub stub;
+    HttpDispatcher http;
+    WebhookStubConfig config;
+    uint64_t started = 0;  // the test's first line was queued
+    std::mutex mtx;
+    std::vector<std::pair<uint64_t, std::string>> posts;
+
+    Setup() {
+        config.latencyMs = 0;
+        config.jitterMs = 0;
+        config.discordBucket = 0;
+    }
+    bool start(uint16_t port) {
+        stub.setConfig(config);
+        stub.setListener([this](const std::string&, const std::string& text) {
+            std::lock_guard<std::mutex> lock(mtx);
+            posts.push_back({nowMs(), text});
+        });
+        if (!stub.start(port)) return false;
+        http.start();
+        started = nowMs();
+        return true;
+    }
+    ~Setup() {
+        http.stop();
+        stub.stop();
+    }
+
+    size_t count() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return posts.size();
+    }
+    // ms from the start to post i
+    uint64_t sentAfter(size_t i) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return i < posts.size() ? posts[i].first - started : 0;
+    }
+    std::string text(size_t i) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return i < posts.size() ? posts[i].second : "";
+    }
+
+    // Runs the notifier's loop until done or the timeout.
+    bool runUntil(Notifier& notifier, const std::function<bool()>& done) {
+        for (int waited = 0; waited < TEST_TIMEOUT_MS; waited += 10) {
+            if (done()) return true;
+            notifier.loop();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return done();
+    }
+    // Answers the next post 429 and the ones after it normally.
+    bool rateLimitOnce(Notifier& notifier) {
+        WebhookStubConfig limited = config;
+        limited.rateLimitPercent = 100;
+        stub.setConfig(limited);
+        bool seen = runUntil(notifier, [&]() { return notifier.stats().rateLimited >= 1; });
+        stub.setConfig(config);
+        return seen;
+    }
+    bool waitPosts(Notifier& notifier, size_t n) {
+        return runUntil(notifier, [&]() { return count() >= n; });
+    }
+};
+
+bool within(uint64_t ms, uint64_t from, uint64_t to) {
+    return ms >= from && ms < to;
+}
+
+// Retry-After in seconds wins over the body's retry_after: "2" for a 1.5 s wait.
+void testRetryAfterSeconds() {
+    Setup s;
+    s.config.retryAfterMs = 1500;
+    if (!s.start(18090)) {
+        check(false, "retry-after seconds: stand-in starts");
+        return;
+    }
+    DiscordBot discord(s.http, s.stub.baseUrl() + "/api/webhooks/1/seconds");
+    discord.queueMessage("line");
+    check(s.rateLimitOnce(discord), "retry-after seconds: the post is rate limited");
+    check(s.waitPosts(discord, 1), "retry-after seconds: the post is sent again");
+    check(within(s.sentAfter(0), 2000, 2800), "retry-after seconds: waited 2 s, took " + std::to_string(s.sentAfter(0)) + " ms");
+    NotifierStats stats = discord.stats();
+    check(stats.sent == 1 && stats.rateLimited == 1 && stats.retries == 1 && stats.failed == 0, "retry-after seconds: counted one rate limit and one retry");
+}
+
+// Retry-After as an HTTP date, rounded up to the second after the 1.5 s asked for.
+void testRetryAfterDate() {
+    Setup s;
+    s.config.retryAfterMs = 1500;
+    s.config.retryAfterDate = true;
+    if (!s.start(18091)) {
+        check(false, "retry-after date: stand-in starts");
+        return;
+    }
+    DiscordBot discord(s.http, s.stub.baseUrl() + "/api/webhooks/1/date");
+    discord.queueMessage("line");
+    check(s.rateLimitOnce(discord), "retry-after date: the post is rate limited");
+    check(s.waitPosts(discord, 1), "retry-after date: the post is sent again");
+    check(within(s.sentAfter(0), 1500, 3300), "retry-after date: waited until the date, took " + std::to_string(s.sentAfter(0)) + " ms");
+}
+
+// Telegram only says parameters.retry_after in the body, 4 s outlast its 3 s token refill.
+void testTelegramRetryAfter() {
+    Setup s;
+    s.config.retryAfterMs = 4000;
+    if (!s.start(18092)) {
+        check(false, "telegram retry_after: stand-in starts");
+        return;
+    }
+    TelegramPoster telegram(s.http);
+    telegram.setApiBase(s.stub.baseUrl());
+    telegram.setApiToken("1:test");
+    telegram.setChatId("1");
+    telegram.queueMessage("line");
+    check(s.rateLimitOnce(telegram), "telegram retry_after: the post is rate limited");
+    check(s.waitPosts(telegram, 1), "telegram retry_after: the post is sent again");
+    check(within(s.sentAfter(0), 4000, 4800), "telegram retry_after: waited 4 s, took " + std::to_string(s.sentAfter(0)) + " ms");
+}
+
+// Discord's bucket of 5 leaves at once, then one post per 2 s as the tokens refill.
+void testBucketRefill() {
+    Setup s;
+    if (!s.start(18093)) {
+        check(false, "bucket: stand-in starts");
+        return;
+    }
+    DiscordBot discord(s.http, s.stub.baseUrl() + "/api/webhooks/1/bucket");
+    for (int i = 0; i < 7; i++) discord.queueMessage(std::string(LONG_LINE, 'a' + i));
+    check(s.waitPosts(discord, 7), "bucket: all posts are sent");
+    check(s.sentAfter(4) < 500, "bucket: the first 5 posts leave at once, the 5th took " + std::to_string(s.sentAfter(4)) + " ms");
+    check(within(s.sentAfter(5), 1900, 2700), "bucket: the 6th post waits for a token, took " + std::to_string(s.sentAfter(5)) + " ms");
+    check(within(s.sentAfter(6), 3900, 4700), "bucket: the 7th post waits for the next one, took " + std::to_string(s.sentAfter(6)) + " ms");
+    check(s.text(6) == std::string(LONG_LINE, 'g'), "bucket: the posts keep their order");
+    check(discord.stats().throttledMs > 0, "bucket: the waits are counted as throttled");
+}
+
+// A webhook allowing 2 posts per 3 s: x-ratelimit-remaining 0 on the 2nd holds the 3rd back
+// for x-ratelimit-reset-after, so the stand-in never has to answer 429.
+void testRatelimitHeaders() {
+    Setup s;
+    s.config.discordBucket = 2;
+    s.config.discordWindowMs = 3000;
+    if (!s.start(18094)) {
+        check(false, "ratelimit headers: stand-in starts");
+        return;
+    }
+    DiscordBot discord(s.http, s.stub.baseUrl() + "/api/webhooks/1/headers");
+    for (int i = 0; i < 3; i++) discord.queueMessage(std::string(LONG_LINE, 'a' + i));
+    check(s.waitPosts(discord, 3), "ratelimit headers: all posts are sent");
+    check(s.sentAfter(1) < 500, "ratelimit headers: the first 2 posts leave at once");
+    check(s.sentAfter(2) - s.sentAfter(0) >= 2900, "ratelimit headers: the 3rd post waits for the reset, took " + std::to_string(s.sentAfter(2)) + " ms");
+    check(s.stub.stats().rateLimited == 0 && discord.stats().rateLimited == 0, "ratelimit headers: no 429s");
+}
+
+void testBuildFailure(const std::string& queueDir) {
+    Setup s;
+    if (!s.start(18095)) {
+        check(false, "build failure: stand-in starts");
+        return;
+    }
+    FlakyNotifier memory(s.http, "memory", s.stub.baseUrl() + "/api/webhooks/1/memory", 1);
+    memory.queueMessage("kept in memory");
+    memory.loop();
+    check(memory.stats().queued == 1, "build failure: the post stays in the memory queue");
+    check(s.waitPosts(memory, 1), "build failure: the post from memory is sent later");
+    NotifierStats stats = memory.stats();
+    check(stats.sent == 1 && stats.retries == 1 && stats.failed == 0 && stats.queued == 0, "build failure: memory queue counted one retry");
+
+    FlakyNotifier disk(s.http, "disk", s.stub.baseUrl() + "/api/webhooks/1/disk", 1);
+    check(disk.persist(queueDir), "build failure: disk queue opens");
+    disk.queueMessage("kept on disk");
+    disk.loop();
+    disk.loop();  // a second tick while it backs off
+    check(disk.stats().queued == 1, "build failure: the line stays in the disk queue");
+    check(s.waitPosts(disk, 2), "build failure: the post from disk is sent later");
+    check(s.runUntil(disk, [&]() { return disk.stats().queued == 0; }), "build failure: the line leaves the disk queue once delivered");
+    check(s.count() == 2 && s.text(0) == "kept in memory" && s.text(1) == "kept on disk", "build failure: each post is delivered once");
+}
+
+void removeQueueDir(const std::string& dir) {
+    DIR* d = opendir(dir.c_str());
+    if (d) {
+        while (struct dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") unlink((dir + "/" + name).c_str());
+        }
+        closedir(d);
+    }
+    rmdir(dir.c_str());
+}
+
+}  // namespace
+
+int main() {
+    testRetryAfterSeconds();
+    testRetryAfterDate();
+    testTelegramRetryAfter();
+    testBucketRefill();
+    testRatelimitHeaders();
+
+    char base[] = "/tmp/notifier_testXXXXXX";
+    if (!mkdtemp(base)) {
+        std::cerr << "Can't create a temp directory" << std::endl;
+        return 1;
+    }
+    testBuildFailure(base);
+    removeQueueDir(std::string(base) + "/disk");
+    rmdir(base);
+    return checkResult("notifier_test");
+}
@@ -0,0 +1,38 @@
+// Runs chat bursts through the Discord, Telegram and MeshCore paths against the local stand-in, with
+// some 429s and server errors, and checks that every line arrives exactly once.
+// "notifierload_test [lines] [latency_ms] [429_pct] [fail_pct]" runs a bigger load by hand.
+#include "loadtest.hpp"
+#include "check.hpp"
+#include <cstdlib>
+
+int main(int argc, char* argv[]) {
+    LoadTestOptions options;
+    options.lines = 120;
+    options.burst = 40;
+    options.meshcoreMessages = 12;
+    options.timeoutMs = 60000;
+    options.stub.latencyMs = 5;
+    options.stub.jitterMs = 5;
+    options.stub.rateLimitPercent = 5;
+    options.stub.failPercent = 5;
+    options.stub.retryAfterMs = 200;
+    if (argc > 1) {
+        options.lines = strtoul(argv[1], nullptr, 10);
+        options.meshcoreMessages = options.lines / 10;
+        options.timeoutMs = 180000;
+    }
+    if (argc > 2) options.stub.latencyMs = strtoul(argv[2], nullptr, 10);
+    if (argc > 3) options.stub.rateLimitPercent = strtoul(argv[3], nullptr, 10);
+    if (argc > 4) options.stub.failPercent = strtoul(argv[4], nullptr, 10);
+
+    LoadTestResult result;
+    std::string report;
+    if (!runNotifierLoadTest(options, result, report)) {
+        std::cerr << "FAIL: the stand-in server could not start on port " << options.port << std::endl;
+        return 1;
+    }
+    std::cout << report;
+    check(result.delivered == result.expected, std::to_string(result.delivered) + " of " + std::to_string(result.expected) + " lines delivered");
+    check(result.duplicates == 0, std::to_string(result.duplicates) + " duplicate lines");
+    return checkResult("notifierload_test");
+}
@@ -0,0 +1,347 @@
+#include "webhookstub.hpp"
+#include "httpserver.hpp"
+#include "jsonreader.hpp"
+#include "jsonwriter.hpp"
+#include "timeutil.hpp"
+#include "logger.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+
+#define STUB_POLL_MS 100          // how often blocked threads look at running
+#define STUB_MAX_REQUEST (1024 * 1024)
+
+void WebhookStub::setConfig(const WebhookStubConfig& config) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->config = config;
+}
+
+bool WebhookStub::start(uint16_t port, const std::string& bindAddress) {
+    if (running) return true;
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        LOG_ERROR("Stub: socket() failed: %s\n", strerror(errno));
+        return false;
+    }
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, bindAddress.c_str(), &addr.sin_addr) != 1 || bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 64) < 0) {
+        LOG_ERROR("Stub: can't listen on %s:%u: %s\n", bindAddress.c_str(), port, strerror(errno));
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    this->port = port;
+    running = true;
+    acceptThread = std::thread(&WebhookStub::acceptLoop, this);
+    return true;
+}
+
+void WebhookStub::stop() {
+    if (!running) return;
+    running = false;
+    if (acceptThread.joinable()) acceptThread.join();
+    for (std::thread& thread : connectionThreads) thread.join();
+    connectionThreads.clear();
+    close(listenFd);
+    listenFd = -1;
+}
+
+void WebhookStub::addMeshCoreMessage(int channel, const std::string& name, const std::string& text, bool withId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    meshcoreMessages.push_back({nextMeshCoreId++, withId, nowMs(), channel, name, text});
+}
+
+WebhookStubStats WebhookStub::stats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return counters;
+}
+
+void WebhookStub::acceptLoop() {
+    while (running) {
+        pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, STUB_POLL_MS) <= 0) continue;
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) continue;
+        connectionThreads.emplace_back(&WebhookStub::serve, this, fd);
+    }
+}
+
+void WebhookStub::serve(int fd) {
+    std::string buffer;
+    Request request;
+    while (running && readRequest(fd, buffer, request, running)) {
+        Response response;
+        uint32_t delay = drawDelay();
+        if (delay) std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        handle(request, response);
+
+        std::string out = "HTTP/1.1 " + std::to_string(response.status) + (response.status < 300 ? " OK" : " Error") + "\r\n";
+        out += "Date: " + httpDate(nowMs()) + "\r\n";
+        if (response.status != 204 && response.status != 304) {
+            out += "Content-Type: " + response.contentType + "\r\n";
+            out += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+        }
+        for (const auto& header : response.headers) out += header.first + ": " + header.second + "\r\n";
+        out += "\r\n";
+        if (response.status != 204 && response.status != 304) out += response.body;
+        size_t sent = 0;
+        while (sent < out.size()) {
+            ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        if (sent < out.size()) break;
+        auto connection = request.headers.find("connection");
+        if (connection != request.headers.end() && connection->second == "close") break;
+    }
+    close(fd);
+}
+
+bool WebhookStub::readRequest(int fd, std::string& buffer, Request& request, const std::atomic<bool>& running) {
+    request = Request();
+    size_t headEnd;
+    while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (buffer.size() > STUB_MAX_REQUEST) return false;
+        pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, STUB_POLL_MS);
+        if (!running) return false;
+        if (ready <= 0) continue;
+        char chunk[16384];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+    std::string head = buffer.substr(0, headEnd);
+    size_t lineEnd = head.find("\r\n");
+    std::string requestLine = head.substr(0, lineEnd);
+    size_t sp1 = requestLine.find(' '), sp2 = requestLine.rfind(' ');
+    if (sp1 == std::string::npos || sp2 <= sp1) return false;
+    request.method = requestLine.substr(0, sp1);
+    std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != std::string::npos) request.query = target.substr(question + 1);
+
+    size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+    while (pos < head.size()) {
+        size_t end = head.find("\r\n", pos);
+        if (end == std::string::npos) end = head.size();
+        std::string line = head.substr(pos, end - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+            request.headers[name] = valueStart == std::string::npos ? "" : line.substr(valueStart);
+        }
+        pos = end + 2;
+    }
+
+    size_t length = strtoul(request.headers["content-length"].c_str(), nullptr, 10);
+    if (length > STUB_MAX_REQUEST) return false;
+    while (buffer.size() < headEnd + 4 + length) {
+        pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, STUB_POLL_MS);
+        if (!running) return false;
+        if (ready <= 0) continue;
+        char chunk[16384];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+    request.body = buffer.substr(headEnd + 4, length);
+    buffer.erase(0, headEnd + 4 + length);
+    return true;
+}
+
+void WebhookStub::handle(const Request& request, Response& response) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        counters.requests++;
+    }
+    if (request.method == "POST" && request.path.compare(0, 14, "/api/webhooks/") == 0) {
+        handleDiscord(request, response);
+    } else if (request.method == "POST" && request.path.compare(0, 4, "/bot") == 0 && request.path.size() > 12 &&
+               request.path.compare(request.path.size() - 12, 12, "/sendMessage") == 0) {
+        handleTelegram(request, response);
+    } else if (request.method == "GET" && (request.path == "/api/v1/all/" || request.path == "/api/v1/all")) {
+        handleMeshCore(request, response);
+    } else {
+        response.status = 404;
+        response.body = "{\"message\":\"404: Not Found\"}";
+    }
+}
+
+void WebhookStub::handleDiscord(const Request& request, Response& response) {
+    uint64_t now = nowMs();
+    Fault fault = drawFault();
+    std::unique_lock<std::mutex> lock(mtx);
+    // the per webhook bucket, counted over a sliding window
+    std::deque<uint64_t>& posts = discordPosts[request.path];
+    while (!posts.empty() && now - posts.front() >= config.discordWindowMs) posts.pop_front();
+    uint64_t resetMs = posts.empty() ? config.discordWindowMs : posts.front() + config.discordWindowMs - now;
+    if (fault == NONE && config.discordBucket > 0 && posts.size() >= config.discordBucket) fault = RATE_LIMITED;
+
+    if (fault == FAILED) {
+        counters.failed++;
+        response.status = 500;
+        response.body = "{\"message\":\"500: Internal Server Error\",\"code\":0}";
+        return;
+    }
+    if (fault == RATE_LIMITED) {
+        counters.rateLimited++;
+        uint64_t waitMs = posts.size() >= config.discordBucket && config.discordBucket > 0 ? resetMs : config.retryAfterMs;
+        response.status = 429;
+        if (config.retryAfterDate) {
+            // whole seconds, rounded up so that the wait is never shorter
+            response.body = "{\"message\":\"You are being rate limited.\",\"global\":false}";
+            response.headers.push_back({"Retry-After", httpDate(now + waitMs + 999)});
+        } else {
+            response.body = "{\"message\":\"You are being rate limited.\",\"retry_after\":" + std::to_string(waitMs / 1000.0) + ",\"global\":false}";
+            response.headers.push_back({"Retry-After", std::to_string((waitMs + 999) / 1000)});
+        }
+        response.headers.push_back({"X-RateLimit-Remaining", "0"});
+        response.headers.push_back({"X-RateLimit-Reset-After", std::to_string(waitMs / 1000.0)});
+        return;
+    }
+
+    std::string content, key;
+    JsonReader json(request.body);
+    if (json.beginObject()) {
+        while (json.nextKey(key)) {
+            if (key == "content" && json.peek() == JsonReader::STRING) json.readString(content);
+            else json.skipValue();
+        }
+    }
+    if (json.failed() || content.empty()) {
+        response.status = 400;
+        response.body = "{\"message\":\"Cannot send an empty message\",\"code\":50006}";
+        return;
+    }
+    posts.push_back(now);
+    counters.posts++;
+    if (config.discordBucket > 0) {
+        response.headers.push_back({"X-RateLimit-Limit", std::to_string(config.discordBucket)});
+        response.headers.push_back({"X-RateLimit-Remaining", std::to_string(config.discordBucket - posts.size())});
+        response.headers.push_back({"X-RateLimit-Reset-After", std::to_string((posts.front() + config.discordWindowMs - now) / 1000.0)});
+    }
+    response.status = 204;
+    lock.unlock();
+    if (listener) listener("discord:" + request.path, content);
+}
+
+void WebhookStub::handleTelegram(const Request& request, Response& response) {
+    Fault fault = drawFault();
+    std::unique_lock<std::mutex> lock(mtx);
+    if (fault == FAILED) {
+        counters.failed++;
+        response.status = 502;
+        response.body = "{\"ok\":false,\"error_code\":502,\"description\":\"Bad Gateway\"}";
+        return;
+    }
+    if (fault == RATE_LIMITED) {
+        counters.rateLimited++;
+        uint32_t seconds = (config.retryAfterMs + 999) / 1000;
+        response.status = 429;
+        response.body = "{\"ok\":false,\"error_code\":429,\"description\":\"Too Many Requests: retry after " + std::to_string(seconds) +
+                        "\",\"parameters\":{\"retry_after\":" + std::to_string(seconds) + "}}";
+        return;
+    }
+    std::string text;
+    size_t pos = 0;
+    while (pos <= request.body.size()) {
+        size_t amp = request.body.find('&', pos);
+        if (amp == std::string::npos) amp = request.body.size();
+        std::string pair = request.body.substr(pos, amp - pos);
+        if (pair.compare(0, 5, "text=") == 0) text = HttpServer::urlDecode(pair.substr(5));
+        pos = amp + 1;
+    }
+    if (text.empty()) {
+        response.status = 400;
+        response.body = "{\"ok\":false,\"error_code\":400,\"description\":\"Bad Request: message text is empty\"}";
+        return;
+    }
+    counters.posts++;
+    response.body = "{\"ok\":true,\"result\":{\"message_id\":" + std::to_string(counters.posts) + "}}";
+    lock.unlock();
+    if (listener) listener("telegram", text);
+}
+
+void WebhookStub::handleMeshCore(const Request& request, Response& response) {
+    uint64_t afterMs = 0;
+    size_t at = request.query.find("after_ms=");
+    if (at != std::string::npos) afterMs = strtoull(request.query.c_str() + at + 9, nullptr, 10);
+    Fault fault = drawFault();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (fault != NONE) {
+        // the map has no rate limit of its own, both faults are server errors there
+        counters.failed++;
+        response.status = 503;
+        response.body = "{\"error\":\"unavailable\"}";
+        return;
+    }
+    std::string body;
+    JsonWriter json(body);
+    json.beginObject().key("channel_messages").beginObject().key("objects").beginArray();
+    uint64_t lastId = 0, lastMs = afterMs;
+    size_t count = 0;
+    for (const MeshCoreMessage& message : meshcoreMessages) {
+        if (message.timeMs <= afterMs) continue;
+        json.beginObject();
+        if (message.withId) json.field("id", message.id);
+        json.field("channel_id", message.channel).field("name", message.name).field("message", message.text).field("created_ms", message.timeMs).endObject();
+        lastId = message.id;
+        lastMs = std::max(lastMs, message.timeMs);
+        count++;
+    }
+    json.endArray().endObject().endObject();
+
+    std::string etag = "\"" + std::to_string(count) + "-" + std::to_string(lastId) + "\"";
+    std::string lastModified = httpDate(lastMs);
+    if (config.meshcoreEtag) response.headers.push_back({"ETag", etag});
+    response.headers.push_back({"Last-Modified", lastModified});
+    // If-None-Match wins over If-Modified-Since, as in RFC 9110
+    auto match = request.headers.find("if-none-match");
+    auto since = request.headers.find("if-modified-since");
+    bool notModified = match != request.headers.end() ? config.meshcoreEtag && match->second == etag : since != request.headers.end() && since->second == lastModified;
+    if (notModified) {
+        counters.notModified++;
+        response.status = 304;
+        return;
+    }
+    counters.polls++;
+    response.body = std::move(body);
+}
+
+WebhookStub::Fault WebhookStub::drawFault() {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint32_t roll = std::uniform_int_distribution<uint32_t>(0, 99)(random);
+    if (roll < config.failPercent) return FAILED;
+    if (roll < config.failPercent + config.rateLimitPercent) return RATE_LIMITED;
+    return NONE;
+}
+
+uint32_t WebhookStub::drawDelay() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return config.latencyMs + (config.jitterMs ? std::uniform_int_distribution<uint32_t>(0, config.jitterMs)(random) : 0);
+}
+
+std::string WebhookStub::httpDate(uint64_t ms) {
+    time_t t = ms / 1000;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char out[64];
+    strftime(out, sizeof(out), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return out;
+}
@@ -0,0 +1,119 @@
+#ifndef WEBHOOKSTUB_HPP
+#define WEBHOOKSTUB_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+struct WebhookStubConfig {
+    uint32_t latencyMs = 50;       // added to every answer
+    uint32_t jitterMs = 50;        // plus a uniform random part up to this
+    uint32_t rateLimitPercent = 0; // requests answered 429 at random, on top of the Discord bucket
+    uint32_t failPercent = 0;      // requests answered 500 at random
+    uint32_t retryAfterMs = 1000;  // asked for by the 429 answers
+    bool retryAfterDate = false;   // Discord's 429s give Retry-After as an HTTP date, without retry_after in the body
+    uint32_t discordBucket = 5;    // posts per discordWindowMs and webhook, like Discord's, 0 turns it off
+    uint32_t discordWindowMs = 2000;
+    bool meshcoreEtag = true;       // false leaves Last-Modified as the only validator of the polls
+};
+
+struct WebhookStubStats {
+    uint64_t requests = 0;
+    uint64_t posts = 0;        // Discord and Telegram posts accepted
+    uint64_t polls = 0;        // MeshCore polls answered 200
+    uint64_t notModified = 0;  // MeshCore polls answered 304
+    uint64_t rateLimited = 0;
+    uint64_t failed = 0;
+};
+
+/**
+ * @brief Local stand-in for the HTTP services the notifiers talk to, for load tests.
+ *
+ *   POST /api/webhooks/...           Discord webhook: JSON "content", 204, x-ratelimit-* headers
+ *   POST /bot<token>/sendMessage     Telegram: form "text", {"ok":true}
+ *   GET  /api/v1/all/?after_ms=N     MeshCore: the messages added with addMeshCoreMessage() after N,
+ *                                    with Date, ETag and Last-Modified, 304 on a matching
+ *                                    If-None-Match, or If-Modified-Since without it
+ *
+ * Answers are delayed and failed as configured, 429s carry the wait the way each service does
+ * (Retry-After in seconds or as a date, and retry_after / parameters.retry_after). Every accepted
+ * post is handed to the listener with the endpoint ("discord:<path>" or "telegram"). One thread per
+ * connection, so slow answers don't hold up each other; not meant to face the network.
+ */
+class WebhookStub {
+   public:
+    using Listener = std::function<void(const std::string& endpoint, const std::string& text)>;
+
+    ~WebhookStub() { stop(); }
+
+    void setConfig(const WebhookStubConfig& config);
+    void setListener(Listener listener) { this->listener = listener; }  // before start()
+
+    bool start(uint16_t port, const std::string& bindAddress = "127.0.0.1");
+    void stop();
+    std::string baseUrl() const { return "http://127.0.0.1:" + std::to_string(port); }
+
+    // Serves a channel message to the MeshCore polls from now on, without an "id" field when withId is false.
+    void addMeshCoreMessage(int channel, const std::string& name, const std::string& text, bool withId = true);
+    WebhookStubStats stats();
+
+   private:
+    struct Request {
+        std::string method;
+        std::string path;
+        std::string query;
+        std::unordered_map<std::string, std::string> headers;  // names in lower case
+        std::string body;
+    };
+    struct Response {
+        int status = 200;
+        std::string contentType = "application/json";
+        std::string body;
+        std::vector<std::pair<std::string, std::string>> headers;
+    };
+    struct MeshCoreMessage {
+        uint64_t id;
+        bool withId;
+        uint64_t timeMs;
+        int channel;
+        std::string name;
+        std::string text;
+    };
+    enum Fault { NONE, RATE_LIMITED, FAILED };
+
+    void acceptLoop();
+    void serve(int fd);
+    void handle(const Request& request, Response& response);
+    void handleDiscord(const Request& request, Response& response);
+    void handleTelegram(const Request& request, Response& response);
+    void handleMeshCore(const Request& request, Response& response);
+    Fault drawFault();
+    uint32_t drawDelay();
+    static bool readRequest(int fd, std::string& buffer, Request& request, const std::atomic<bool>& running);
+    static std::string httpDate(uint64_t ms);
+
+    WebhookStubConfig config;
+    Listener listener;
+    uint16_t port = 0;
+    int listenFd = -1;
+    std::atomic<bool> running{false};
+    std::thread acceptThread;
+    std::list<std::thread> connectionThreads;  // joined by stop()
+
+    std::mutex mtx;  // everything below
+    std::mt19937 random{12345};
+    std::unordered_map<std::string, std::deque<uint64_t>> discordPosts;  // times of the recent posts per webhook
+    std::vector<MeshCoreMessage> meshcoreMessages;
+    uint64_t nextMeshCoreId = 1;
+    WebhookStubStats counters;
+};
+
+#endif  // WEBHOOKSTUB_HPP
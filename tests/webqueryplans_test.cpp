@@ -0,0 +1,35 @@
+// Checks that every query of the web frontend is served by an index, on a freshly created database and
+// on one with some rows in it. Without ANALYZE statistics the plans depend on the schema only.
+#include "nodedb.hpp"
+#include "check.hpp"
+#include <cstdio>
+#include <unistd.h>
+
+static void seed(NodeDb& db) {
+    for (uint32_t node = 1; node <= 50; node++) {
+        uint16_t freq = node % 2 ? 868 : 433;
+        db.setNodeInfo(node, "n" + std::to_string(node), "node " + std::to_string(node), freq, 0, 8, 1700000000000ULL + node);
+        db.saveChatMessage(node, 8, "hello " + std::to_string(node), freq, 1700000000000ULL + node);
+    }
+    db.flushNodeUpdates();
+}
+
+int main() {
+    char path[] = "/tmp/webqueryplans_testXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cerr << "Can't create a temp file" << std::endl;
+        return 1;
+    }
+    close(fd);
+    unlink(path);
+    {
+        NodeDb db(path);
+        check(db.getSchemaVersion() > 0, "schema created");
+        check(db.checkWebQueryPlans(), "web queries on a fresh database use indexes");
+        seed(db);
+        check(db.checkWebQueryPlans(), "web queries on a seeded database use indexes");
+    }
+    unlink(path);
+    return checkResult("webqueryplans_test");
+}
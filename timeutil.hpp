@@ -0,0 +1,12 @@
+#ifndef TIMEUTIL_HPP
+#define TIMEUTIL_HPP
+
+#include <chrono>
+#include <cstdint>
+
+// Wall clock time in unix epoch milliseconds. This is what NodeDb stores in its timestamp columns.
+inline uint64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+#endif  // TIMEUTIL_HPP
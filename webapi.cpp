@@ -0,0 +1,821 @@
+#include "webapi.hpp"
+#include "timeutil.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <unordered_map>
+#include <map>
+#include <zlib.h>
+
+#define WEBAPI_LINK_MS (7ULL * 24 * 3600 * 1000)
+
+static const char* ROLE_MAP_LONG[] = {"Client", "Client Mute", "Router", "Router Client", "Repeater", "Tracker", "Sensor", "TAK", "Client Hidden", "Lost and Found", "TAK Tracker", "Router Late", "Client base"};
+
+static std::string roleName(uint8_t role) {
+    if (role < sizeof(ROLE_MAP_LONG) / sizeof(ROLE_MAP_LONG[0])) return ROLE_MAP_LONG[role];
+    return "Unknown (" + std::to_string(role) + ")";
+}
+
+static std::string chanelName(uint8_t chn) {
+    if (chn == 8) return "LongFast";
+    if (chn == 31) return "MediumFast";
+    if (chn == 92) return "Hungary";
+    return std::to_string(chn);
+}
+
+static std::string nodeIdHex(uint32_t nodeId) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "!%x", nodeId);
+    return buf;
+}
+
+// node_id is signed in SQLite, the PHP pages hand it out that way
+static int32_t nodeIdInt(uint32_t nodeId) {
+    return (int32_t)nodeId;
+}
+
+static void writeUtc(JsonWriter& json, uint64_t ms) {
+    if (ms == 0) {
+        json.null();
+        return;
+    }
+    time_t t = ms / 1000;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    json.value(buf);
+}
+
+// (float)number_format($v, decimals)
+static double roundTo(double v, int decimals) {
+    double p = std::pow(10.0, decimals);
+    return std::round(v * p) / p;
+}
+
+// formatUptimePhp() from api.php
+static std::string formatUptime(double totalSeconds) {
+    if (totalSeconds <= 0) return "N/A";
+    uint64_t secs = (uint64_t)totalSeconds;
+    uint64_t days = secs / 86400;
+    uint64_t hours = (secs % 86400) / 3600;
+    uint64_t minutes = (secs % 3600) / 60;
+    if (days > 0) return std::to_string(days) + "d " + std::to_string(hours) + "h";
+    if (hours > 0) return std::to_string(hours) + "h " + std::to_string(minutes) + "m";
+    if (minutes > 0) return std::to_string(minutes) + "m";
+    return std::to_string(secs) + "s";
+}
+
+// "west,south,east,north" in degrees, as leaflet's LatLngBounds.toBBoxString() gives it
+static bool parseBox(const std::string& text, GeoBox& box) {
+    double v[4];
+    if (sscanf(text.c_str(), "%lf,%lf,%lf,%lf", &v[0], &v[1], &v[2], &v[3]) != 4) return false;
+    for (double& d : v) {
+        if (!std::isfinite(d)) return false;
+    }
+    // leaflet runs past +-180 when the map is panned around the globe
+    auto lon = [](double d) { return (int32_t)std::lround((std::remainder(d, 360.0)) * 1e7); };
+    auto lat = [](double d) { return (int32_t)std::lround(std::max(-90.0, std::min(90.0, d)) * 1e7); };
+    if (v[2] - v[0] >= 360) {
+        box.west = -1800000000;
+        box.east = 1800000000;
+    } else {
+        box.west = lon(v[0]);
+        box.east = lon(v[2]);
+    }
+    box.south = lat(v[1]);
+    box.north = lat(v[3]);
+    return box.south <= box.north;
+}
+
+WebApi::WebApi(NodeStore& store, NodeDb& db) : store(store), db(db), bootId(nowMs()) {}
+
+void WebApi::registerRoutes(HttpServer& server) {
+    server.subscribe("/nodes", [this](const HttpRequest& req, HttpResponse& res) {
+        if (req.query.count("since")) {
+            handleNodes(req, res);  // deltas differ per client, nothing to share
+        } else {
+            serveCached(STATE_NODES, req, res, &WebApi::handleNodes);
+        }
+    });
+    server.subscribe("/clusters", [this](const HttpRequest& req, HttpResponse& res) { serveCached(STATE_NODES, req, res, &WebApi::handleClusters); });
+    server.subscribe("/snr", [this](const HttpRequest& req, HttpResponse& res) { serveCached(STATE_LINKS, req, res, &WebApi::handleSnr); });
+    server.subscribe("/map.bin", [this](const HttpRequest& req, HttpResponse& res) { serveCached(STATE_NODES | STATE_LINKS, req, res, &WebApi::handleMapBin); });
+    server.subscribe("/chat", [this](const HttpRequest& req, HttpResponse& res) { serveCached(STATE_CHAT | STATE_NODES, req, res, &WebApi::handleChat); });
+    server.subscribe("/chat/search", [this](const HttpRequest& req, HttpResponse& res) { handleChatSearch(req, res); });
+    server.subscribe("/globalstats", [this](const HttpRequest& req, HttpResponse& res) {
+        serveCached(STATE_NODES | STATE_LINKS | STATE_MAINSTATS, req, res, &WebApi::handleGlobalStats);
+    });
+    server.subscribe("/node/", [this](const HttpRequest& req, HttpResponse& res) { handleNode(req, res); });
+    server.subscribe("/events", [this](const HttpRequest& req, HttpResponse& res) { handleEvents(req, res); });
+    store.setListener([this, &server](StoreChange change, const NodeRecord* node, const LinkRecord* link, const ChatRecord* chat) {
+        publish(server, change, node, link, chat);
+    });
+}
+
+void WebApi::serveCached(unsigned states, const HttpRequest& request, HttpResponse& response, Handler handler) {
+    std::string key = request.path;
+    std::map<std::string, std::string> sorted(request.query.begin(), request.query.end());
+    for (const auto& param : sorted) key += "&" + param.first + "=" + param.second;
+
+    // taken before building, a change during the build makes the next request rebuild
+    uint64_t generation = store.generation(states);
+    uint64_t now = nowMs();
+    auto it = cache.find(key);
+    if (it == cache.end() || (it->second.generation != generation && it->second.built + WEBAPI_CACHE_MIN_AGE_MS <= now)) {
+        (this->*handler)(request, response);
+        if (response.status != 200) return;  // errors are cheap, don't keep them
+        if (cache.size() >= WEBAPI_CACHE_ENTRIES) cache.clear();
+        CachedDocument& doc = cache[key];
+        doc.generation = generation;
+        doc.built = now;
+        doc.contentType = response.contentType;
+        char etag[48];
+        snprintf(etag, sizeof(etag), "%llx-%llx", (unsigned long long)bootId, (unsigned long long)generation);
+        doc.etag = etag;
+        doc.body = std::make_shared<const std::string>(std::move(response.body));
+        response.body.clear();
+        doc.gzip.reset();
+        if (doc.body->size() >= WEBAPI_GZIP_MIN) {
+            std::string packed = gzip(*doc.body);
+            if (!packed.empty()) doc.gzip = std::make_shared<const std::string>(std::move(packed));
+        }
+        it = cache.find(key);
+    }
+    const CachedDocument& doc = it->second;
+
+    // the gzip'd variant gets its own tag, a strong ETag names one exact byte sequence
+    bool useGzip = doc.gzip && request.header("accept-encoding").find("gzip") != std::string::npos;
+    std::string etag = "\"" + doc.etag + (useGzip ? "-gz\"" : "\"");
+    response.headers.push_back({"ETag", etag});
+    response.headers.push_back({"Cache-Control", "no-cache"});
+    if (doc.gzip) response.headers.push_back({"Vary", "Accept-Encoding"});
+    std::string ifNoneMatch = request.header("if-none-match");
+    if (!ifNoneMatch.empty() && (ifNoneMatch.find(etag) != std::string::npos || ifNoneMatch == "*")) {
+        response.status = 304;
+        response.contentType.clear();
+        return;
+    }
+    response.status = 200;
+    response.contentType = doc.contentType;
+    if (useGzip) {
+        response.headers.push_back({"Content-Encoding", "gzip"});
+        response.sharedBody = doc.gzip;
+    } else {
+        response.sharedBody = doc.body;
+    }
+}
+
+std::string WebApi::gzip(const std::string& data) {
+    z_stream zs = {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return "";  // +16: gzip wrapper
+    std::string out;
+    out.resize(deflateBound(&zs, data.size()));
+    zs.next_in = (Bytef*)data.data();
+    zs.avail_in = data.size();
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = out.size();
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END) {
+        LOG_ERROR("WebApi: gzip failed (%d)\n", rc);
+        return "";
+    }
+    return out;
+}
+
+void WebApi::error(HttpResponse& response, int status, const std::string& message) {
+    response.status = status;
+    response.body.clear();
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "error").field("message", message).endObject();
+}
+
+void WebApi::writeNode(JsonWriter& json, const NodeRecord& node, uint64_t now) {
+    json.beginObject();
+    json.field("node_id", nodeIdInt(node.nodeId));
+    json.field("node_id_hex", nodeIdHex(node.nodeId));
+    json.field("short_name", node.shortName);
+    json.field("long_name", node.longName);
+    json.field("latitude", node.latitude / 10000000.0);
+    json.field("longitude", node.longitude / 10000000.0);
+    json.key("last_updated");
+    writeUtc(json, node.lastUpdated);
+    json.field("battery_level", node.batteryLevel);
+    json.field("battery_voltage", node.batteryVoltage);
+    json.field("temperature", node.temperature);
+    json.field("freq", node.freq);
+    json.field("role", node.role);
+    json.field("uptime", node.uptime);
+    json.field("msgcntph", node.msgcntph);
+    json.field("tracecntph", node.tracecntph);
+    json.field("telemetrycntph", node.telemetrycntph);
+    json.field("nodeinfocntph", node.nodeinfocntph);
+    json.field("poscntph", node.poscntph);
+    json.field("sumcntph", node.sumcntph);
+    json.field("chutil", node.chutil);
+    json.field("lastchn", node.lastchn);
+    json.field("is_stale", node.isStale(now));
+    json.endObject();
+}
+
+// link fields next to the smoothed snr, for the node details
+static void writeLinkStats(JsonWriter& json, const LinkRecord& link) {
+    json.field("snr_last", link.lastSnr);
+    json.field("snr_min", link.minSnr);
+    json.field("snr_max", link.maxSnr);
+    json.field("samples", link.samples);
+    json.key("first_seen");
+    writeUtc(json, link.firstSeen);
+    json.key("last_updated");
+    writeUtc(json, link.lastUpdated);
+}
+
+void WebApi::handleNodes(const HttpRequest& request, HttpResponse& response) {
+    std::string since = request.param("since", "");
+    if (!since.empty()) {
+        handleNodeChanges(strtoull(since.c_str(), nullptr, 10), response);
+        return;
+    }
+    std::vector<NodeRecord> nodes;
+    std::vector<uint32_t> removed;
+    bool full;
+    uint64_t seq = 0;
+    std::string bbox = request.param("bbox", "");
+    if (!bbox.empty()) {
+        GeoBox box;
+        if (!parseBox(bbox, box)) {
+            error(response, 400, "bbox must be west,south,east,north");
+            return;
+        }
+        store.forEachNodeIn(box, [&nodes](const NodeRecord& node) { nodes.push_back(node); });
+    } else {
+        nodes.reserve(store.nodeCount());
+        seq = store.getChanges(0, nodes, removed, full);
+    }
+
+    // same orders as map.php
+    std::string sort = request.param("sort", "last_updated");
+    if (sort == "name") {
+        std::sort(nodes.begin(), nodes.end(), [](const NodeRecord& a, const NodeRecord& b) { return a.longName < b.longName; });
+    } else if (sort == "msgcntph") {
+        std::sort(nodes.begin(), nodes.end(), [](const NodeRecord& a, const NodeRecord& b) { return a.sumcntph > b.sumcntph; });
+    } else {
+        std::sort(nodes.begin(), nodes.end(), [](const NodeRecord& a, const NodeRecord& b) { return a.lastUpdated > b.lastUpdated; });
+    }
+
+    uint64_t now = nowMs();
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success");
+    if (bbox.empty()) json.field("seq", seq);  // a box is no base for delta sync
+    json.field("count", nodes.size());
+    json.key("data").beginArray();
+    for (const auto& node : nodes) writeNode(json, node, now);
+    json.endArray().endObject();
+}
+
+void WebApi::handleClusters(const HttpRequest& request, HttpResponse& response) {
+    GeoBox box;
+    std::string bbox = request.param("bbox", "");
+    if (!bbox.empty() && !parseBox(bbox, box)) {
+        error(response, 400, "bbox must be west,south,east,north");
+        return;
+    }
+    int zoom = atoi(request.param("zoom", "0").c_str());
+    if (zoom < 0 || zoom > SPATIAL_CLUSTER_MAXZOOM) {
+        error(response, 400, "zoom must be 0.." + std::to_string(SPATIAL_CLUSTER_MAXZOOM) + ", fetch /nodes?bbox= above that");
+        return;
+    }
+
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success").field("zoom", zoom);
+    json.key("data").beginArray();
+    store.forEachCluster(zoom, box, [&json](const ClusterCell& cell) {
+        json.beginObject();
+        json.field("count", cell.count);
+        json.field("latitude", cell.latitude() / 10000000.0);
+        json.field("longitude", cell.longitude() / 10000000.0);
+        if (cell.count == 1) json.field("node_id", nodeIdInt(cell.nodeId()));
+        json.key("roles").beginObject();
+        for (const auto& role : cell.roles) json.field(roleName(role.first).c_str(), role.second);
+        json.endObject();
+        json.endObject();
+    });
+    json.endArray().endObject();
+}
+
+void WebApi::handleNodeChanges(uint64_t since, HttpResponse& response) {
+    std::vector<NodeRecord> changed;
+    std::vector<uint32_t> removed;
+    bool full;
+    uint64_t seq = store.getChanges(since, changed, removed, full);
+
+    uint64_t now = nowMs();
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success").field("seq", seq).field("full", full).field("count", changed.size());
+    json.key("data").beginArray();
+    for (const auto& node : changed) writeNode(json, node, now);
+    json.endArray();
+    json.key("removed").beginArray();
+    for (uint32_t nodeId : removed) json.value(nodeIdInt(nodeId));
+    json.endArray().endObject();
+}
+
+void WebApi::handleSnr(const HttpRequest&, HttpResponse& response) {
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success");
+    json.key("data").beginArray();
+    store.forEachLink(nowMs() - WEBAPI_LINK_MS, [&json](const LinkRecord& link) {
+        if (link.snr == 0) return;
+        json.beginObject().field("node1", nodeIdInt(link.node1)).field("node2", nodeIdInt(link.node2)).field("snr", link.snr).endObject();
+    });
+    json.endArray().endObject();
+}
+
+// Appends the array in host byte order (little endian on every target we run on) and pads the
+// document to 4 bytes, so the decoder can map each array as a typed array without copying.
+template <typename T>
+static void putArray(std::string& out, const std::vector<T>& values) {
+    out.append((const char*)values.data(), values.size() * sizeof(T));
+    out.append((4 - out.size() % 4) % 4, '\0');
+}
+
+void WebApi::handleMapBin(const HttpRequest&, HttpResponse& response) {
+    std::vector<NodeRecord> nodes;
+    nodes.reserve(store.nodeCount());
+    store.forEachNode([&nodes](const NodeRecord& node) { nodes.push_back(node); });
+    std::sort(nodes.begin(), nodes.end(), [](const NodeRecord& a, const NodeRecord& b) { return a.lastUpdated > b.lastUpdated; });
+    std::vector<LinkRecord> links;
+    store.forEachLink(nowMs() - WEBAPI_LINK_MS, [&links](const LinkRecord& link) {
+        if (link.snr != 0) links.push_back(link);
+    });
+
+    // names go to a deduplicated string table, the nodes hold indexes
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> stringIndex;
+    auto intern = [&](const std::string& s) {
+        auto it = stringIndex.find(s);
+        if (it != stringIndex.end()) return it->second;
+        uint32_t index = strings.size();
+        strings.push_back(s.substr(0, s.find('\0')));  // the table is NUL separated
+        stringIndex[s] = index;
+        return index;
+    };
+
+    uint64_t now = nowMs();
+    size_t n = nodes.size();
+    std::vector<uint32_t> id(n), lastUpdated(n), uptime(n), shortName(n), longName(n);
+    std::vector<int32_t> latitude(n), longitude(n);
+    std::vector<int16_t> temperature(n);                 // 0.01 C
+    std::vector<uint16_t> batteryVoltage(n), chutil(n);  // mV, 0.01 %
+    std::vector<uint16_t> msgcnt(n), tracecnt(n), telemetrycnt(n), nodeinfocnt(n), poscnt(n), sumcnt(n);
+    std::vector<uint16_t> freq(n);
+    auto clamp16 = [](double v, double lo, double hi) { return std::lround(std::max(lo, std::min(hi, v))); };
+    std::vector<uint8_t> batteryLevel(n), role(n), lastchn(n), stale(n);
+    for (size_t i = 0; i < n; i++) {
+        const NodeRecord& node = nodes[i];
+        id[i] = node.nodeId;
+        latitude[i] = node.latitude;
+        longitude[i] = node.longitude;
+        lastUpdated[i] = node.lastUpdated / 1000;
+        uptime[i] = node.uptime;
+        shortName[i] = intern(node.shortName);
+        longName[i] = intern(node.longName);
+        temperature[i] = clamp16(node.temperature * 100.0, -32768, 32767);
+        batteryVoltage[i] = clamp16(node.batteryVoltage * 1000.0, 0, 65535);
+        chutil[i] = clamp16(node.chutil * 100.0, 0, 65535);
+        // hourly packet counts, saturated
+        msgcnt[i] = std::min<uint32_t>(node.msgcntph, 65535);
+        tracecnt[i] = std::min<uint32_t>(node.tracecntph, 65535);
+        telemetrycnt[i] = std::min<uint32_t>(node.telemetrycntph, 65535);
+        nodeinfocnt[i] = std::min<uint32_t>(node.nodeinfocntph, 65535);
+        poscnt[i] = std::min<uint32_t>(node.poscntph, 65535);
+        sumcnt[i] = std::min<uint32_t>(node.sumcntph, 65535);
+        freq[i] = node.freq;
+        batteryLevel[i] = node.batteryLevel;
+        role[i] = node.role;
+        lastchn[i] = node.lastchn;
+        stale[i] = node.isStale(now);
+    }
+    size_t l = links.size();
+    std::vector<uint32_t> node1(l), node2(l), linkUpdated(l);
+    std::vector<float> snr(l);
+    for (size_t i = 0; i < l; i++) {
+        node1[i] = links[i].node1;
+        node2[i] = links[i].node2;
+        snr[i] = links[i].snr;
+        linkUpdated[i] = links[i].lastUpdated / 1000;
+    }
+    size_t stringBytes = 0;
+    for (const auto& s : strings) stringBytes += s.size() + 1;
+
+    // layout: WebPage/mapbin.js
+    std::string& out = response.body;
+    out.reserve(20 + n * 56 + l * 16 + stringBytes + 64);
+    out.append("MMB1", 4);
+    putArray(out, std::vector<uint32_t>{(uint32_t)n, (uint32_t)l, (uint32_t)strings.size(), (uint32_t)(now / 1000)});
+    putArray(out, id);
+    putArray(out, latitude);
+    putArray(out, longitude);
+    putArray(out, lastUpdated);
+    putArray(out, uptime);
+    putArray(out, shortName);
+    putArray(out, longName);
+    putArray(out, temperature);
+    putArray(out, batteryVoltage);
+    putArray(out, chutil);
+    putArray(out, msgcnt);
+    putArray(out, tracecnt);
+    putArray(out, telemetrycnt);
+    putArray(out, nodeinfocnt);
+    putArray(out, poscnt);
+    putArray(out, sumcnt);
+    putArray(out, freq);
+    putArray(out, batteryLevel);
+    putArray(out, role);
+    putArray(out, lastchn);
+    putArray(out, stale);
+    putArray(out, node1);
+    putArray(out, node2);
+    putArray(out, snr);
+    putArray(out, linkUpdated);
+    for (const auto& s : strings) {
+        out += s;
+        out += '\0';
+    }
+    response.contentType = "application/octet-stream";
+}
+
+void WebApi::handleChat(const HttpRequest& request, HttpResponse& response) {
+    int64_t before = atoll(request.param("before", "0").c_str());
+    int limit = atoi(request.param("limit", std::to_string(WEBAPI_CHAT_PAGE)).c_str());
+    if (limit <= 0 || limit > WEBAPI_CHAT_PAGE_MAX) {
+        error(response, 400, "limit must be 1.." + std::to_string(WEBAPI_CHAT_PAGE_MAX));
+        return;
+    }
+
+    std::vector<ChatRecord> messages;
+    messages.reserve(limit);
+    if (!store.getChatPage(before, limit, messages)) {
+        // older than the ring, the rest of the page comes from SQLite
+        db.getChatPage(messages.empty() ? before : messages.back().id, limit - messages.size(), messages);
+    }
+
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success");
+    json.key("data").beginArray();
+    for (const auto& chat : messages) {
+        json.beginObject();
+        json.field("id", chat.id);
+        json.field("node_id", nodeIdInt(chat.nodeId));
+        json.field("sender", chat.sender);
+        json.field("message", chat.message);
+        json.key("timestamp");
+        writeUtc(json, chat.timestamp);
+        json.field("freq", chat.freq);
+        json.field("chan_id", chat.chanId);
+        json.field("has_coords", chat.hasCoords);
+        json.endObject();
+    }
+    json.endArray();
+    // cursor of the next (older) page, null at the end of the history
+    json.key("next");
+    if ((int)messages.size() == limit) {
+        json.value(messages.back().id);
+    } else {
+        json.null();
+    }
+    json.endObject();
+}
+
+void WebApi::handleChatSearch(const HttpRequest& request, HttpResponse& response) {
+    ChatSearchQuery query;
+    query.text = request.param("q");
+    if (query.text.empty()) {
+        error(response, 400, "Missing q parameter.");
+        return;
+    }
+    std::string node = request.param("node");
+    if (!node.empty()) {
+        NodeRecord record;
+        if (!store.findNode(node, record)) {
+            error(response, 404, "Node not found with identifier: " + node);
+            return;
+        }
+        query.nodeId = record.nodeId;
+    }
+    query.freq = atoi(request.param("freq", "0").c_str());
+    query.chanId = atoi(request.param("chan", "-1").c_str());
+    query.since = atoll(request.param("since", "0").c_str());
+    query.until = atoll(request.param("until", "0").c_str());
+    query.limit = std::clamp(atoi(request.param("limit", "50").c_str()), 1, 500);
+
+    std::vector<ChatSearchResult> results = db.searchChat(query);
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success");
+    json.key("data").beginArray();
+    for (const auto& result : results) {
+        json.beginObject();
+        json.field("id", result.id);
+        json.field("node_id", nodeIdInt(result.nodeId));
+        json.field("node_id_hex", nodeIdHex(result.nodeId));
+        json.field("message", result.message);
+        json.key("timestamp");
+        writeUtc(json, result.timestamp);
+        json.field("freq", result.freq);
+        json.field("chan_id", result.chanId);
+        json.field("rank", result.rank);
+        json.endObject();
+    }
+    json.endArray().endObject();
+}
+
+void WebApi::handleGlobalStats(const HttpRequest& request, HttpResponse& response) {
+    std::string freqParam = request.param("freq", request.param("query"));
+    if (freqParam != "433" && freqParam != "868") {
+        error(response, 400, "Invalid query parameter. Must be \"433\" or \"868\".");
+        return;
+    }
+    uint16_t queryFreq = atoi(freqParam.c_str());
+    bool is868 = queryFreq == 868;
+
+    std::vector<MainStatsRecord> mainStats = store.getMainStats();
+    GlobalStats stats = store.getGlobalStats(queryFreq);
+
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success").field("frequency", queryFreq);
+    if (stats.totalNodes == 0) {
+        json.field("message", "No node data to analyze for " + freqParam + " MHz.");
+    }
+    json.key("data").beginObject();
+    json.key("recent_activity").beginArray();
+    for (const auto& row : mainStats) {
+        json.beginObject();
+        json.key("time_utc");
+        writeUtc(json, row.time);
+        json.field("all_packets", is868 ? row.allcnt_868 : row.allcnt_433);
+        json.field("decoded", is868 ? row.decoded_868 : row.decoded_433);
+        json.field("handled", is868 ? row.handled_868 : row.handled_433);
+        json.endObject();
+    }
+    json.endArray();
+    if (stats.totalNodes == 0) {
+        json.endObject().endObject();
+        return;
+    }
+
+    double avgRepeatCount = 0;
+    uint32_t lastAllPackets = mainStats.empty() ? 0 : (is868 ? mainStats[0].allcnt_868 : mainStats[0].allcnt_433);
+    if (lastAllPackets > 0 && stats.sumCnt > 0) avgRepeatCount = (double)lastAllPackets / stats.sumCnt;
+
+    json.key("node_status").beginObject();
+    json.field("total_nodes", stats.totalNodes);
+    json.field("online_nodes", stats.onlineNodes);
+    json.field("stale_nodes", stats.staleNodes);
+    json.field("nodes_with_gps", stats.nodesWithGps);
+    json.endObject();
+
+    json.key("message_counts_per_hour").beginObject();
+    json.field("total_all_msgs", roundTo(stats.sumCnt, 2));
+    json.field("total_all_msgs_per_second", roundTo(stats.sumCnt / 3600.0, 4));
+    json.field("avg_repeat_count", roundTo(avgRepeatCount, 2));
+    json.field("text_msgs", stats.msgCnt);
+    json.field("traceroute", stats.traceCnt);
+    json.field("telemetry", stats.telemetryCnt);
+    json.field("nodeinfo", stats.nodeInfoCnt);
+    json.field("position", stats.posCnt);
+    json.endObject();
+
+    auto top = [&json](const char* name, const GlobalStats::Top& top) {
+        json.key(name).beginObject().field("node", top.node).field("count", (uint32_t)top.count).endObject();
+    };
+    json.key("top_contributors_online").beginObject();
+    top("text_msgs", stats.topMsg);
+    top("traceroute", stats.topTrace);
+    top("telemetry", stats.topTelemetry);
+    top("nodeinfo", stats.topNodeInfo);
+    top("position", stats.topPos);
+    json.key("channel_utilization").beginObject().field("node", stats.topChutil.node).field("percent", roundTo(stats.topChutil.count, 1)).endObject();
+    json.endObject();
+
+    size_t countSnr = stats.linkCount;
+    auto bucket = [&json, countSnr](const char* name, size_t n) {
+        json.key(name).beginObject().field("count", n).field("percent", roundTo(countSnr > 0 ? (double)n / countSnr * 100 : 0, 1)).endObject();
+    };
+    json.key("link_stats_snr_7_days").beginObject();
+    json.field("total_links_logged", countSnr);
+    json.field("average_snr_db", roundTo(countSnr > 0 ? stats.sumSnr / countSnr : 0, 2));
+    json.field("best_link_db", roundTo(stats.maxSnr, 2));
+    json.field("best_link_nodes", stats.bestLink);
+    json.field("worst_link_db", roundTo(stats.minSnr, 2));
+    json.field("worst_link_nodes", stats.worstLink);
+    json.key("distribution").beginObject();
+    bucket("good_gt_0db", stats.snrGood);
+    bucket("okay_0_to_-5db", stats.snrOkay);
+    bucket("weak_-5_to_-10db", stats.snrWeak);
+    bucket("bad_lt_-10db", stats.snrBad);
+    json.endObject();
+    json.endObject();
+
+    json.key("averages_online_nodes").beginObject();
+    json.field("battery_percent", roundTo(stats.batteryNodes > 0 ? stats.sumBattery / stats.batteryNodes : 0, 1));
+    json.field("battery_node_count", stats.batteryNodes);
+    json.field("uptime_human", formatUptime(stats.uptimeNodes > 0 ? stats.sumUptime / stats.uptimeNodes : 0));
+    json.field("uptime_node_count", stats.uptimeNodes);
+    json.field("channel_utilization_percent", roundTo(stats.chutilNodes > 0 ? stats.sumChutil / stats.chutilNodes : 0, 1));
+    json.field("channel_utilization_node_count", stats.chutilNodes);
+    json.endObject();
+
+    json.key("distribution_by_role").beginArray();
+    for (const auto& role : stats.roles) {
+        json.beginObject();
+        json.field("role", roleName(role.first));
+        json.field("count", role.second);
+        json.field("percentage", roundTo((double)role.second / stats.totalNodes * 100, 1));
+        json.endObject();
+    }
+    json.endArray();
+
+    json.endObject().endObject();
+}
+
+// the nodeinfo fields, inside the "data" object
+static void writeNodeInfo(JsonWriter& json, const NodeRecord& node) {
+    json.field("node_id_int", nodeIdInt(node.nodeId));
+    json.field("node_id_hex", nodeIdHex(node.nodeId));
+    json.field("long_name", node.longName);
+    json.field("short_name", node.shortName);
+    json.key("position").beginObject().field("latitude", node.latitude / 10000000.0).field("longitude", node.longitude / 10000000.0).endObject();
+    json.key("last_updated");
+    writeUtc(json, node.lastUpdated);
+    json.field("frequency", node.freq);
+    json.field("role", node.role < sizeof(ROLE_MAP_LONG) / sizeof(ROLE_MAP_LONG[0]) ? ROLE_MAP_LONG[node.role] : "Unknown");
+    json.field("lastchn", chanelName(node.lastchn));
+    json.field("uptime_seconds", node.uptime);
+    json.key("telemetry").beginObject();
+    json.field("battery_level", node.batteryLevel);
+    json.field("battery_voltage", node.batteryVoltage);
+    json.field("temperature", node.temperature);
+    json.endObject();
+    json.key("counts_per_hour").beginObject();
+    json.field("total", node.sumcntph);
+    json.field("message", node.msgcntph);
+    json.field("traceroute", node.tracecntph);
+    json.field("telemetry", node.telemetrycntph);
+    json.field("nodeinfo", node.nodeinfocntph);
+    json.field("position", node.poscntph);
+    json.endObject();
+    json.field("channel_utilization_percent", node.chutil);
+}
+
+// snrinfo's incoming / outgoing arrays; neighbours are named by short name or hex id, never by long name
+static void writeNeighbours(JsonWriter& json, const NodeDetail& detail) {
+    uint64_t since = nowMs() - WEBAPI_LINK_MS;
+    json.key("incoming").beginArray();
+    for (const auto& neighbour : detail.incoming) {
+        const LinkRecord& link = neighbour.link;
+        if (link.snr == 0 || link.lastUpdated < since) continue;
+        json.beginObject().field("from_node_id", nodeIdInt(link.node1)).field("from_node_name", neighbour.name).field("snr", link.snr);
+        writeLinkStats(json, link);
+        json.endObject();
+    }
+    json.endArray();
+    json.key("outgoing").beginArray();
+    for (const auto& neighbour : detail.outgoing) {
+        const LinkRecord& link = neighbour.link;
+        if (link.snr == 0 || link.lastUpdated < since) continue;
+        json.beginObject().field("to_node_id", nodeIdInt(link.node2)).field("to_node_name", neighbour.name).field("snr", link.snr);
+        writeLinkStats(json, link);
+        json.endObject();
+    }
+    json.endArray();
+}
+
+void WebApi::handleNode(const HttpRequest& request, HttpResponse& response) {
+    std::string id = request.path.substr(6);  // after "/node/"
+    enum { NODEINFO, SNRINFO, DETAIL } view = NODEINFO;
+    if (id.size() > 4 && id.compare(id.size() - 4, 4, "/snr") == 0) {
+        view = SNRINFO;
+        id.resize(id.size() - 4);
+    } else if (id.size() > 7 && id.compare(id.size() - 7, 7, "/detail") == 0) {
+        view = DETAIL;
+        id.resize(id.size() - 7);
+    }
+    id = HttpServer::urlDecode(id);
+    if (id.empty()) {
+        error(response, 400, "Missing query parameter (node hex ID or shortname).");
+        return;
+    }
+    NodeRecord node;
+    NodeDetail detail;
+    // the node may expire between the two lookups, answer as if it was never found
+    if (!store.findNode(id, node) || (view != NODEINFO && !store.getNodeDetail(node.nodeId, detail))) {
+        error(response, 404, "Node not found with identifier: " + id);
+        return;
+    }
+
+    JsonWriter json(response.body);
+    json.beginObject().field("status", "success");
+    json.key("data").beginObject();
+    switch (view) {
+        case NODEINFO:
+            writeNodeInfo(json, node);
+            break;
+        case SNRINFO:
+            writeNeighbours(json, detail);
+            break;
+        case DETAIL:
+            writeNodeInfo(json, detail.node);
+            writeNeighbours(json, detail);
+            json.key("telemetry_history").beginArray();
+            for (const auto& sample : detail.telemetry) {
+                json.beginObject();
+                json.key("time");
+                writeUtc(json, sample.time);
+                json.field("battery_level", sample.batteryLevel);
+                json.field("battery_voltage", sample.batteryVoltage);
+                json.field("temperature", sample.temperature);
+                json.field("channel_utilization_percent", sample.chutil);
+                json.field("uptime_seconds", sample.uptime);
+                json.endObject();
+            }
+            json.endArray();
+            break;
+    }
+    json.endObject().endObject();
+}
+
+void WebApi::handleEvents(const HttpRequest& request, HttpResponse& response) {
+    response.stream = true;
+    std::string types = request.param("types");
+    size_t pos = 0;
+    while (pos < types.size()) {
+        size_t comma = types.find(',', pos);
+        if (comma == std::string::npos) comma = types.size();
+        if (comma > pos) response.topics.insert(types.substr(pos, comma - pos));
+        pos = comma + 1;
+    }
+    response.body = "retry: 5000\n\n";
+}
+
+void WebApi::publish(HttpServer& server, StoreChange change, const NodeRecord* node, const LinkRecord* link, const ChatRecord* chat) {
+    if (server.streamCount() == 0) return;  // nobody is listening, don't build the event
+    std::string data;
+    JsonWriter json(data);
+    const char* topic = "";
+    json.beginObject();
+    switch (change) {
+        case StoreChange::NodeInfo:
+            topic = "nodeinfo";
+            json.field("node_id", nodeIdInt(node->nodeId));
+            json.field("node_id_hex", nodeIdHex(node->nodeId));
+            json.field("short_name", node->shortName);
+            json.field("long_name", node->longName);
+            json.field("freq", node->freq);
+            json.field("role", node->role);
+            json.field("lastchn", node->lastchn);
+            break;
+        case StoreChange::Position:
+            topic = "position";
+            json.field("node_id", nodeIdInt(node->nodeId));
+            json.field("latitude", node->latitude / 10000000.0);
+            json.field("longitude", node->longitude / 10000000.0);
+            json.field("altitude", node->altitude);
+            break;
+        case StoreChange::Telemetry:
+            topic = "telemetry";
+            json.field("node_id", nodeIdInt(node->nodeId));
+            json.field("battery_level", node->batteryLevel);
+            json.field("battery_voltage", node->batteryVoltage);
+            json.field("temperature", node->temperature);
+            json.field("uptime", node->uptime);
+            json.field("chutil", node->chutil);
+            break;
+        case StoreChange::Link:
+            topic = "link";
+            json.field("node1", nodeIdInt(link->node1));
+            json.field("node2", nodeIdInt(link->node2));
+            json.field("snr", link->snr);
+            break;
+        case StoreChange::Chat:
+            topic = "chat";
+            json.field("id", chat->id);
+            json.field("node_id", nodeIdInt(chat->nodeId));
+            json.field("sender", node && !node->shortName.empty() ? node->shortName : nodeIdHex(chat->nodeId));
+            json.field("message", chat->message);
+            json.key("timestamp");
+            writeUtc(json, chat->timestamp);
+            json.field("freq", chat->freq);
+            json.field("chan_id", chat->chanId);
+            json.field("has_coords", node && node->hasPosition());
+            break;
+    }
+    if (node) {
+        json.key("last_updated");
+        writeUtc(json, node->lastUpdated);
+    }
+    json.endObject();
+    server.broadcast(topic, data);
+}
@@ -0,0 +1,88 @@
+#ifndef WEBAPI_HPP
+#define WEBAPI_HPP
+
+#include "httpserver.hpp"
+#include "nodestore.hpp"
+#include "nodedb.hpp"
+#include "jsonwriter.hpp"
+#include <memory>
+#include <unordered_map>
+
+#define WEBAPI_CACHE_ENTRIES 256       // cached documents (distinct path and query), dropped all at once when full
+#define WEBAPI_CACHE_MIN_AGE_MS 1000   // while packets keep coming, a document is rebuilt at most once a second
+#define WEBAPI_GZIP_MIN 1024           // smaller documents are sent uncompressed
+#define WEBAPI_CHAT_PAGE 100           // default /chat page size
+#define WEBAPI_CHAT_PAGE_MAX 1000
+
+/**
+ * @brief JSON endpoints of the web frontend, served from NodeStore.
+ *
+ * The documents follow WebPage/map.php and WebPage/api.php field for field, so the
+ * frontend can switch over without changes. Only /chat/search goes to SQLite (FTS index).
+ *
+ *   /nodes?sort=name|msgcntph       all nodes (map.php node_data), with the store's change "seq"
+ *   /nodes?bbox=w,s,e,n             positioned nodes inside the box (degrees)
+ *   /clusters?zoom=z&bbox=w,s,e,n   node clusters (count, centroid, role mix) of 64 px cells at map zoom z
+ *   /nodes?since=seq                nodes changed after seq and "removed" node ids; "full" tells the
+ *                                   client to drop its copy first (seq too old or from before a restart)
+ *   /snr                            links of the last 7 days
+ *   /map.bin                        /nodes and /snr in one binary document, decoded by WebPage/mapbin.js
+ *   /chat?before=id&limit=n         chat newest first, a page of n (default 100) older than the
+ *                                   cursor; "next" is the cursor of the following page
+ *   /chat/search?q=                 full text search
+ *   /globalstats?freq=433|868       api.php action=globalstats
+ *   /node/{id}                      api.php action=nodeinfo, id is hex or short name
+ *   /node/{id}/snr                  api.php action=snrinfo, plus last/min/max snr, sample count and first/last seen
+ *   /node/{id}/detail               nodeinfo and snrinfo in one document, plus "telemetry_history", the
+ *                                   node's last telemetry packets oldest first (memory only, empty after restart)
+ *   /events?types=position,chat     live feed (server-sent events) of position, nodeinfo,
+ *                                   telemetry, link and chat changes, fields as in the documents above
+ *
+ * The documents built from store state only are cached serialized and gzip'd next to the store
+ * generation they were built at, with an ETag. Repeated requests cost a copy, or nothing with
+ * If-None-Match, until the generation moves.
+ */
+class WebApi {
+   public:
+    WebApi(NodeStore& store, NodeDb& db);
+
+    // Also hooks the live feed into the store, call it once.
+    void registerRoutes(HttpServer& server);
+
+   private:
+    struct CachedDocument {
+        uint64_t generation = 0;
+        uint64_t built = 0;  // epoch ms
+        std::string etag;    // without quotes
+        std::string contentType;
+        std::shared_ptr<const std::string> body;
+        std::shared_ptr<const std::string> gzip;  // null when not worth it
+    };
+    using Handler = void (WebApi::*)(const HttpRequest&, HttpResponse&);
+
+    // Answers from the cache while the masked store state is unchanged, runs handler and caches its document otherwise.
+    void serveCached(unsigned states, const HttpRequest& request, HttpResponse& response, Handler handler);
+    static std::string gzip(const std::string& data);
+
+    void handleNodes(const HttpRequest& request, HttpResponse& response);
+    void handleNodeChanges(uint64_t since, HttpResponse& response);
+    void handleClusters(const HttpRequest& request, HttpResponse& response);
+    void handleSnr(const HttpRequest& request, HttpResponse& response);
+    void handleMapBin(const HttpRequest& request, HttpResponse& response);
+    void handleChat(const HttpRequest& request, HttpResponse& response);
+    void handleChatSearch(const HttpRequest& request, HttpResponse& response);
+    void handleGlobalStats(const HttpRequest& request, HttpResponse& response);
+    void handleNode(const HttpRequest& request, HttpResponse& response);
+    void handleEvents(const HttpRequest& request, HttpResponse& response);
+    void publish(HttpServer& server, StoreChange change, const NodeRecord* node, const LinkRecord* link, const ChatRecord* chat);
+
+    static void writeNode(JsonWriter& json, const NodeRecord& node, uint64_t now);
+    static void error(HttpResponse& response, int status, const std::string& message);
+
+    NodeStore& store;
+    NodeDb& db;
+    std::unordered_map<std::string, CachedDocument> cache;  // by path and sorted query, only used on the server thread
+    uint64_t bootId;                                        // makes ETags of an earlier run never match
+};
+
+#endif  // WEBAPI_HPP